@@ -0,0 +1,546 @@
+/* Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "mpv_ipc.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// Same limits as mpv uses.
+#define MAX_FRAME (16 * 1024 * 1024)
+#define MAX_DEPTH 100
+
+struct buf {
+    unsigned char *data;
+    size_t len, alloc;
+};
+
+struct mpv_ipc {
+    int fd;
+    struct buf in;              // received, not yet parsed data
+    mpv_ipc_value **queue;      // events received by mpv_ipc_command()
+    int num_queue;
+};
+
+static int buf_reserve(struct buf *b, size_t size)
+{
+    if (b->alloc - b->len >= size)
+        return 0;
+    size_t alloc = b->alloc ? b->alloc : 256;
+    while (alloc - b->len < size)
+        alloc *= 2;
+    unsigned char *data = realloc(b->data, alloc);
+    if (!data)
+        return -1;
+    b->data = data;
+    b->alloc = alloc;
+    return 0;
+}
+
+static int buf_append(struct buf *b, const void *data, size_t size)
+{
+    if (buf_reserve(b, size) < 0)
+        return -1;
+    memcpy(b->data + b->len, data, size);
+    b->len += size;
+    return 0;
+}
+
+static void buf_remove(struct buf *b, size_t size)
+{
+    memmove(b->data, b->data + size, b->len - size);
+    b->len -= size;
+}
+
+// --- MessagePack encoder
+
+static int put_tagged(struct buf *b, unsigned char tag, uint64_t v, int size)
+{
+    unsigned char d[9] = {tag};
+    for (int n = 0; n < size; n++)
+        d[1 + n] = v >> (8 * (size - n - 1));
+    return buf_append(b, d, 1 + size);
+}
+
+static int put_size(struct buf *b, size_t size, unsigned char fix,
+                    size_t fix_max, unsigned char tag8, unsigned char tag16)
+{
+    if (size <= fix_max)
+        return put_tagged(b, fix | size, 0, 0);
+    if (tag8 && size <= 0xff)
+        return put_tagged(b, tag8, size, 1);
+    if (size <= 0xffff)
+        return put_tagged(b, tag16, size, 2);
+    return put_tagged(b, tag16 + 1, size, 4);
+}
+
+static int put_string(struct buf *b, const char *s)
+{
+    size_t len = strlen(s);
+    if (put_size(b, len, 0xa0, 31, 0xd9, 0xda) < 0)
+        return -1;
+    return buf_append(b, s, len);
+}
+
+static int put_value(struct buf *b, const mpv_ipc_value *v)
+{
+    switch (v->type) {
+    case MPV_IPC_NIL:
+        return put_tagged(b, 0xc0, 0, 0);
+    case MPV_IPC_BOOL:
+        return put_tagged(b, v->u.flag ? 0xc3 : 0xc2, 0, 0);
+    case MPV_IPC_INT: {
+        int64_t i = v->u.int64;
+        if (i >= -32 && i < 128)
+            return put_tagged(b, (unsigned char)i, 0, 0);
+        return put_tagged(b, 0xd3, i, 8);
+    }
+    case MPV_IPC_DOUBLE: {
+        uint64_t bits;
+        memcpy(&bits, &v->u.double_, sizeof(bits));
+        return put_tagged(b, 0xcb, bits, 8);
+    }
+    case MPV_IPC_STRING:
+        return put_string(b, v->u.string);
+    case MPV_IPC_ARRAY:
+    case MPV_IPC_MAP: {
+        int is_map = v->type == MPV_IPC_MAP;
+        if (put_size(b, v->u.list.num, is_map ? 0x80 : 0x90, 15, 0,
+                     is_map ? 0xde : 0xdc) < 0)
+            return -1;
+        for (int n = 0; n < v->u.list.num; n++) {
+            if (is_map && put_string(b, v->u.list.keys[n]) < 0)
+                return -1;
+            if (put_value(b, &v->u.list.values[n]) < 0)
+                return -1;
+        }
+        return 0;
+    }
+    }
+    return -1;
+}
+
+// --- MessagePack decoder
+
+struct reader {
+    const unsigned char *data;
+    size_t len;
+};
+
+static int get_uint(struct reader *r, int size, uint64_t *out)
+{
+    if (r->len < size)
+        return -1;
+    uint64_t v = 0;
+    for (int n = 0; n < size; n++)
+        v = (v << 8) | r->data[n];
+    r->data += size;
+    r->len -= size;
+    *out = v;
+    return 0;
+}
+
+static void free_contents(mpv_ipc_value *v)
+{
+    if (v->type == MPV_IPC_STRING) {
+        free(v->u.string);
+    } else if (v->type == MPV_IPC_ARRAY || v->type == MPV_IPC_MAP) {
+        for (int n = 0; n < v->u.list.num; n++) {
+            free_contents(&v->u.list.values[n]);
+            if (v->u.list.keys)
+                free(v->u.list.keys[n]);
+        }
+        free(v->u.list.values);
+        free(v->u.list.keys);
+    }
+    v->type = MPV_IPC_NIL;
+}
+
+static int get_value(struct reader *r, mpv_ipc_value *v, int depth)
+{
+    *v = (mpv_ipc_value){MPV_IPC_NIL};
+    if (depth <= 0)
+        return -1;
+    uint64_t tag, size = 0, x;
+    if (get_uint(r, 1, &tag) < 0)
+        return -1;
+
+    int type = -1;
+    if (tag <= 0x7f) {
+        *v = mpv_ipc_int(tag);
+        return 0;
+    } else if (tag >= 0xe0) {
+        *v = mpv_ipc_int((int8_t)tag);
+        return 0;
+    } else if (tag <= 0x8f) {
+        type = MPV_IPC_MAP;
+        size = tag & 0x0f;
+    } else if (tag <= 0x9f) {
+        type = MPV_IPC_ARRAY;
+        size = tag & 0x0f;
+    } else if (tag <= 0xbf) {
+        type = MPV_IPC_STRING;
+        size = tag & 0x1f;
+    } else if (tag == 0xc0) {
+        return 0;
+    } else if (tag == 0xc2 || tag == 0xc3) {
+        *v = mpv_ipc_bool(tag == 0xc3);
+        return 0;
+    } else if (tag >= 0xc4 && tag <= 0xc6) {
+        type = MPV_IPC_STRING; // bin
+        if (get_uint(r, 1 << (tag - 0xc4), &size) < 0)
+            return -1;
+    } else if (tag == 0xca) {
+        uint32_t bits;
+        float f;
+        if (get_uint(r, 4, &x) < 0)
+            return -1;
+        bits = x;
+        memcpy(&f, &bits, sizeof(f));
+        *v = mpv_ipc_double(f);
+        return 0;
+    } else if (tag == 0xcb) {
+        double d;
+        if (get_uint(r, 8, &x) < 0)
+            return -1;
+        memcpy(&d, &x, sizeof(d));
+        *v = mpv_ipc_double(d);
+        return 0;
+    } else if (tag >= 0xcc && tag <= 0xcf) {
+        if (get_uint(r, 1 << (tag - 0xcc), &x) < 0 || x > INT64_MAX)
+            return -1;
+        *v = mpv_ipc_int(x);
+        return 0;
+    } else if (tag >= 0xd0 && tag <= 0xd3) {
+        int bytes = 1 << (tag - 0xd0);
+        if (get_uint(r, bytes, &x) < 0)
+            return -1;
+        int shift = 64 - 8 * bytes;
+        *v = mpv_ipc_int(shift ? (int64_t)(x << shift) >> shift : (int64_t)x);
+        return 0;
+    } else if (tag >= 0xd9 && tag <= 0xdb) {
+        type = MPV_IPC_STRING;
+        if (get_uint(r, 1 << (tag - 0xd9), &size) < 0)
+            return -1;
+    } else if (tag == 0xdc || tag == 0xdd) {
+        type = MPV_IPC_ARRAY;
+        if (get_uint(r, tag == 0xdc ? 2 : 4, &size) < 0)
+            return -1;
+    } else if (tag == 0xde || tag == 0xdf) {
+        type = MPV_IPC_MAP;
+        if (get_uint(r, tag == 0xde ? 2 : 4, &size) < 0)
+            return -1;
+    }
+
+    if (type == MPV_IPC_STRING) {
+        if (r->len < size)
+            return -1;
+        char *s = malloc(size + 1);
+        if (!s)
+            return -1;
+        memcpy(s, r->data, size);
+        s[size] = '\0';
+        r->data += size;
+        r->len -= size;
+        *v = mpv_ipc_string(s);
+        return 0;
+    }
+    if (type == MPV_IPC_ARRAY || type == MPV_IPC_MAP) {
+        // Each element needs at least 1 byte.
+        if (size > r->len)
+            return -1;
+        v->type = type;
+        v->u.list.values = calloc(size ? size : 1, sizeof(mpv_ipc_value));
+        if (type == MPV_IPC_MAP)
+            v->u.list.keys = calloc(size ? size : 1, sizeof(char *));
+        if (!v->u.list.values || (type == MPV_IPC_MAP && !v->u.list.keys))
+            goto error;
+        for (int n = 0; n < size; n++) {
+            // (num is incremented first, so that errors free the partial key)
+            v->u.list.num++;
+            if (type == MPV_IPC_MAP) {
+                mpv_ipc_value key;
+                if (get_value(r, &key, 1) < 0)
+                    goto error;
+                if (key.type != MPV_IPC_STRING) {
+                    free_contents(&key);
+                    goto error;
+                }
+                v->u.list.keys[n] = key.u.string;
+            }
+            if (get_value(r, &v->u.list.values[n], depth - 1) < 0)
+                goto error;
+        }
+        return 0;
+    error:
+        free_contents(v);
+        return -1;
+    }
+    return -1; // ext types and unused tags
+}
+
+// --- connection
+
+// Wait until the socket is readable, or until the deadline (in ms of
+// CLOCK_MONOTONIC, <0 for none) is reached, and read data. Returns -1 on
+// timeout or error.
+static int fill_buffer(mpv_ipc *ipc, int64_t deadline)
+{
+    while (1) {
+        int timeout = -1;
+        if (deadline >= 0) {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            int64_t now = ts.tv_sec * (int64_t)1000 + ts.tv_nsec / 1000000;
+            timeout = now < deadline ? deadline - now : 0;
+        }
+        struct pollfd pfd = {.fd = ipc->fd, .events = POLLIN};
+        int rc = poll(&pfd, 1, timeout);
+        if (rc < 0 && errno == EINTR)
+            continue;
+        if (rc <= 0)
+            return -1;
+        if (buf_reserve(&ipc->in, 4096) < 0)
+            return -1;
+        ssize_t got = read(ipc->fd, ipc->in.data + ipc->in.len,
+                           ipc->in.alloc - ipc->in.len);
+        if (got < 0 && (errno == EINTR || errno == EAGAIN))
+            continue;
+        if (got <= 0)
+            return -1;
+        ipc->in.len += got;
+        return 0;
+    }
+}
+
+static int64_t get_deadline(int timeout_ms)
+{
+    if (timeout_ms < 0)
+        return -1;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * (int64_t)1000 + ts.tv_nsec / 1000000 + timeout_ms;
+}
+
+static int write_all(int fd, const unsigned char *data, size_t size)
+{
+    while (size) {
+        ssize_t rc = send(fd, data, size, MSG_NOSIGNAL);
+        if (rc < 0 && errno == EINTR)
+            continue;
+        if (rc < 0)
+            return -1;
+        data += rc;
+        size -= rc;
+    }
+    return 0;
+}
+
+mpv_ipc *mpv_ipc_open_fd(int fd)
+{
+    mpv_ipc *ipc = calloc(1, sizeof(*ipc));
+    if (!ipc) {
+        close(fd);
+        return NULL;
+    }
+    ipc->fd = fd;
+
+    static const char request[] = "{\"command\":[\"set_protocol\",\"msgpack\"]}\n";
+    if (write_all(fd, (const unsigned char *)request, strlen(request)) < 0)
+        goto error;
+
+    // Until the reply, the connection uses JSON. Skip events sent before it.
+    while (1) {
+        unsigned char *nl =
+            ipc->in.len ? memchr(ipc->in.data, '\n', ipc->in.len) : NULL;
+        if (!nl) {
+            if (fill_buffer(ipc, -1) < 0)
+                goto error;
+            continue;
+        }
+        size_t len = nl - ipc->in.data + 1;
+        static const char ev[] = "{\"event\":";
+        int is_event = len > strlen(ev) && !memcmp(ipc->in.data, ev, strlen(ev));
+        static const char ok[] = "{\"error\":\"success\"}\n";
+        int success = len == strlen(ok) && !memcmp(ipc->in.data, ok, len);
+        buf_remove(&ipc->in, len);
+        if (!is_event) {
+            if (!success) {
+                errno = EPROTO;
+                goto error;
+            }
+            return ipc;
+        }
+    }
+
+error:
+    mpv_ipc_close(ipc);
+    return NULL;
+}
+
+mpv_ipc *mpv_ipc_connect(const char *socket_path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return NULL;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return NULL;
+    }
+    return mpv_ipc_open_fd(fd);
+}
+
+void mpv_ipc_close(mpv_ipc *ipc)
+{
+    if (!ipc)
+        return;
+    for (int n = 0; n < ipc->num_queue; n++)
+        mpv_ipc_free(ipc->queue[n]);
+    free(ipc->queue);
+    free(ipc->in.data);
+    close(ipc->fd);
+    free(ipc);
+}
+
+int mpv_ipc_get_fd(mpv_ipc *ipc)
+{
+    return ipc->fd;
+}
+
+int mpv_ipc_send(mpv_ipc *ipc, const mpv_ipc_value *msg)
+{
+    struct buf b = {0};
+    int rc = -1;
+    if (buf_append(&b, (unsigned char[4]){0}, 4) < 0 || put_value(&b, msg) < 0)
+        goto done;
+    size_t size = b.len - 4;
+    for (int n = 0; n < 4; n++)
+        b.data[n] = size >> (8 * (3 - n));
+    rc = write_all(ipc->fd, b.data, b.len);
+done:
+    free(b.data);
+    return rc;
+}
+
+// Read the next message from the socket (ignoring the queue).
+static mpv_ipc_value *read_message(mpv_ipc *ipc, int64_t deadline)
+{
+    while (1) {
+        if (ipc->in.len >= 4) {
+            uint64_t size;
+            struct reader r = {ipc->in.data, ipc->in.len};
+            get_uint(&r, 4, &size);
+            if (size > MAX_FRAME) {
+                errno = EPROTO;
+                return NULL;
+            }
+            if (r.len >= size) {
+                r.len = size;
+                mpv_ipc_value *v = malloc(sizeof(*v));
+                if (!v)
+                    return NULL;
+                if (get_value(&r, v, MAX_DEPTH) < 0 || r.len) {
+                    free_contents(v);
+                    free(v);
+                    errno = EPROTO;
+                    return NULL;
+                }
+                buf_remove(&ipc->in, 4 + size);
+                return v;
+            }
+        }
+        if (fill_buffer(ipc, deadline) < 0)
+            return NULL;
+    }
+}
+
+mpv_ipc_value *mpv_ipc_receive(mpv_ipc *ipc, int timeout_ms)
+{
+    if (ipc->num_queue) {
+        mpv_ipc_value *v = ipc->queue[0];
+        ipc->num_queue--;
+        memmove(ipc->queue, ipc->queue + 1, ipc->num_queue * sizeof(v));
+        return v;
+    }
+    return read_message(ipc, get_deadline(timeout_ms));
+}
+
+mpv_ipc_value *mpv_ipc_command(mpv_ipc *ipc, int num_args,
+                               const mpv_ipc_value *args)
+{
+    mpv_ipc_value cmd = {MPV_IPC_ARRAY};
+    cmd.u.list.values = (mpv_ipc_value *)args;
+    cmd.u.list.num = num_args;
+    char *key = "command";
+    mpv_ipc_value msg = {MPV_IPC_MAP};
+    msg.u.list.values = &cmd;
+    msg.u.list.keys = &key;
+    msg.u.list.num = 1;
+    if (mpv_ipc_send(ipc, &msg) < 0)
+        return NULL;
+
+    while (1) {
+        mpv_ipc_value *v = read_message(ipc, -1);
+        if (!v || !mpv_ipc_map_get(v, "event"))
+            return v;
+        mpv_ipc_value **queue = realloc(ipc->queue,
+                                        (ipc->num_queue + 1) * sizeof(v));
+        if (!queue) {
+            mpv_ipc_free(v);
+            return NULL;
+        }
+        ipc->queue = queue;
+        ipc->queue[ipc->num_queue++] = v;
+    }
+}
+
+void mpv_ipc_free(mpv_ipc_value *val)
+{
+    if (!val)
+        return;
+    free_contents(val);
+    free(val);
+}
+
+const mpv_ipc_value *mpv_ipc_map_get(const mpv_ipc_value *map,
+                                     const char *key)
+{
+    if (!map || map->type != MPV_IPC_MAP)
+        return NULL;
+    for (int n = 0; n < map->u.list.num; n++) {
+        if (strcmp(map->u.list.keys[n], key) == 0)
+            return &map->u.list.values[n];
+    }
+    return NULL;
+}
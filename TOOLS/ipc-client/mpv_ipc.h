@@ -0,0 +1,171 @@
+/* Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Minimal client for mpv's IPC (--input-unix-socket), using the binary
+ * MessagePack protocol. It consists of mpv_ipc.h and mpv_ipc.c, which can be
+ * copied into other projects. It has no dependencies other than POSIX, and
+ * doesn't need libmpv.
+ *
+ * Messages have the same contents as with the JSON protocol (see the
+ * "JSON IPC" section in the mpv manpage). Example:
+ *
+ *      mpv_ipc *ipc = mpv_ipc_connect("/tmp/mpvsocket");
+ *      mpv_ipc_value args[] = {
+ *          mpv_ipc_string("observe_property"),
+ *          mpv_ipc_int(1),
+ *          mpv_ipc_string("time-pos"),
+ *      };
+ *      mpv_ipc_value *reply = mpv_ipc_command(ipc, 3, args);
+ *      ... check mpv_ipc_map_get(reply, "error") ...
+ *      mpv_ipc_free(reply);
+ *      while (1) {
+ *          mpv_ipc_value *ev = mpv_ipc_receive(ipc, -1);
+ *          if (!ev)
+ *              break; // disconnected
+ *          ... use mpv_ipc_map_get(ev, "event") etc. ...
+ *          mpv_ipc_free(ev);
+ *      }
+ *      mpv_ipc_close(ipc);
+ *
+ * A mpv_ipc handle must not be used by multiple threads at the same time.
+ */
+
+#ifndef MPV_IPC_H_
+#define MPV_IPC_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum mpv_ipc_type {
+    MPV_IPC_NIL,
+    MPV_IPC_BOOL,       // u.flag (0 or 1)
+    MPV_IPC_INT,        // u.int64
+    MPV_IPC_DOUBLE,     // u.double_
+    MPV_IPC_STRING,     // u.string (0-terminated UTF-8)
+    MPV_IPC_ARRAY,      // u.list.values[0..u.list.num-1]
+    MPV_IPC_MAP,        // same, with u.list.keys[] set
+} mpv_ipc_type;
+
+typedef struct mpv_ipc_value {
+    mpv_ipc_type type;
+    union {
+        int flag;
+        int64_t int64;
+        double double_;
+        char *string;
+        struct {
+            struct mpv_ipc_value *values;
+            char **keys;
+            int num;
+        } list;
+    } u;
+} mpv_ipc_value;
+
+typedef struct mpv_ipc mpv_ipc;
+
+/**
+ * Connect to the given unix socket, and switch the connection to the binary
+ * protocol. Returns NULL on failure (errno is set).
+ */
+mpv_ipc *mpv_ipc_connect(const char *socket_path);
+
+/**
+ * Like mpv_ipc_connect(), but use an already connected socket. The fd is
+ * owned by the returned handle (or closed on failure).
+ */
+mpv_ipc *mpv_ipc_open_fd(int fd);
+
+/**
+ * Close the connection and free the handle.
+ */
+void mpv_ipc_close(mpv_ipc *ipc);
+
+/**
+ * Return the socket, e.g. to wait for new messages with poll(). Note that
+ * mpv_ipc_command() might have queued events; call mpv_ipc_receive() with
+ * timeout_ms=0 until it returns NULL before polling.
+ */
+int mpv_ipc_get_fd(mpv_ipc *ipc);
+
+/**
+ * Send a message (normally a map with a "command" entry), without waiting
+ * for the reply. Returns 0 on success, -1 on error.
+ */
+int mpv_ipc_send(mpv_ipc *ipc, const mpv_ipc_value *msg);
+
+/**
+ * Return the next message (a reply or an event), waiting up to timeout_ms
+ * milliseconds (<0 waits forever). Returns NULL on timeout or error. The
+ * result must be freed with mpv_ipc_free().
+ */
+mpv_ipc_value *mpv_ipc_receive(mpv_ipc *ipc, int timeout_ms);
+
+/**
+ * Send {"command": [args...]} and wait for the reply. Events received in
+ * the meantime are queued, and returned by the next mpv_ipc_receive() calls.
+ * Replies to messages sent with mpv_ipc_send() must have been received
+ * before. Returns the reply map (must be freed with mpv_ipc_free()), or NULL
+ * on error.
+ */
+mpv_ipc_value *mpv_ipc_command(mpv_ipc *ipc, int num_args,
+                               const mpv_ipc_value *args);
+
+/**
+ * Free a value returned by mpv_ipc_receive() or mpv_ipc_command().
+ */
+void mpv_ipc_free(mpv_ipc_value *val);
+
+/**
+ * Return the map entry with the given key, or NULL if there is none (or if
+ * map is not a map).
+ */
+const mpv_ipc_value *mpv_ipc_map_get(const mpv_ipc_value *map,
+                                     const char *key);
+
+static inline mpv_ipc_value mpv_ipc_string(const char *s)
+{
+    mpv_ipc_value v = {MPV_IPC_STRING};
+    v.u.string = (char *)s;
+    return v;
+}
+
+static inline mpv_ipc_value mpv_ipc_int(int64_t i)
+{
+    mpv_ipc_value v = {MPV_IPC_INT};
+    v.u.int64 = i;
+    return v;
+}
+
+static inline mpv_ipc_value mpv_ipc_double(double d)
+{
+    mpv_ipc_value v = {MPV_IPC_DOUBLE};
+    v.u.double_ = d;
+    return v;
+}
+
+static inline mpv_ipc_value mpv_ipc_bool(int flag)
+{
+    mpv_ipc_value v = {MPV_IPC_BOOL};
+    v.u.flag = !!flag;
+    return v;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -25,8 +25,13 @@
 #include "audio.h"
 #include "format.h"
 
+// The readable data is the range [start, buffer->samples) of the buffer.
+// Reading from the front only advances start, so that not every read has to
+// move the rest of the data. The data is moved to the front of the buffer
+// only when there's no room for appending after it.
 struct mp_audio_buffer {
     struct mp_audio *buffer;
+    int start;
 };
 
 struct mp_audio_buffer *mp_audio_buffer_create(void *talloc_ctx)
@@ -45,6 +50,7 @@ void mp_audio_buffer_reinit(struct mp_audio_buffer *ab, struct mp_audio *fmt)
     mp_audio_copy_config(ab->buffer, fmt);
     mp_audio_realloc(ab->buffer, 1);
     ab->buffer->samples = 0;
+    ab->start = 0;
 }
 
 void mp_audio_buffer_reinit_fmt(struct mp_audio_buffer *ab, int format,
@@ -64,6 +70,25 @@ void mp_audio_buffer_get_format(struct mp_audio_buffer *ab,
     mp_audio_copy_config(out_fmt, ab->buffer);
 }
 
+// Move the readable data to the start of the internal buffer.
+static void compact(struct mp_audio_buffer *ab)
+{
+    if (!ab->start)
+        return;
+    int samples = mp_audio_buffer_samples(ab);
+    mp_audio_copy(ab->buffer, 0, ab->buffer, ab->start, samples);
+    ab->buffer->samples = samples;
+    ab->start = 0;
+}
+
+// Make room for appending the given number of samples.
+static void reserve_tail(struct mp_audio_buffer *ab, int samples)
+{
+    if (mp_audio_get_allocated_size(ab->buffer) - ab->buffer->samples < samples)
+        compact(ab);
+    mp_audio_realloc_min(ab->buffer, ab->buffer->samples + samples);
+}
+
 // Make the total size of the internal buffer at least this number of samples.
 void mp_audio_buffer_preallocate_min(struct mp_audio_buffer *ab, int samples)
 {
@@ -74,7 +99,7 @@ void mp_audio_buffer_preallocate_min(struct mp_audio_buffer *ab, int samples)
 // internal buffer.
 int mp_audio_buffer_get_write_available(struct mp_audio_buffer *ab)
 {
-    return mp_audio_get_allocated_size(ab->buffer) - ab->buffer->samples;
+    return mp_audio_get_allocated_size(ab->buffer) - mp_audio_buffer_samples(ab);
 }
 
 // Get a pointer to the end of the buffer (where writing would append). If the
@@ -85,7 +110,7 @@ void mp_audio_buffer_get_write_buffer(struct mp_audio_buffer *ab, int samples,
                                       struct mp_audio *out_buffer)
 {
     assert(samples >= 0);
-    mp_audio_realloc_min(ab->buffer, ab->buffer->samples + samples);
+    reserve_tail(ab, samples);
     *out_buffer = *ab->buffer;
     out_buffer->samples = ab->buffer->samples + samples;
     mp_audio_skip_samples(out_buffer, ab->buffer->samples);
@@ -93,7 +118,8 @@ void mp_audio_buffer_get_write_buffer(struct mp_audio_buffer *ab, int samples,
 
 void mp_audio_buffer_finish_write(struct mp_audio_buffer *ab, int samples)
 {
-    assert(samples >= 0 && samples <= mp_audio_buffer_get_write_available(ab));
+    assert(samples >= 0 && ab->buffer->samples + samples <=
+                          mp_audio_get_allocated_size(ab->buffer));
     ab->buffer->samples += samples;
 }
 
@@ -102,9 +128,9 @@ void mp_audio_buffer_finish_write(struct mp_audio_buffer *ab, int samples)
 // For now always copies the data.
 void mp_audio_buffer_append(struct mp_audio_buffer *ab, struct mp_audio *mpa)
 {
+    reserve_tail(ab, mpa->samples);
     int offset = ab->buffer->samples;
     ab->buffer->samples += mpa->samples;
-    mp_audio_realloc_min(ab->buffer, ab->buffer->samples);
     mp_audio_copy(ab->buffer, offset, mpa, 0, mpa->samples);
 }
 
@@ -112,41 +138,48 @@ void mp_audio_buffer_append(struct mp_audio_buffer *ab, struct mp_audio *mpa)
 void mp_audio_buffer_prepend_silence(struct mp_audio_buffer *ab, int samples)
 {
     assert(samples >= 0);
-    int oldlen = ab->buffer->samples;
-    ab->buffer->samples += samples;
-    mp_audio_realloc_min(ab->buffer, ab->buffer->samples);
-    mp_audio_copy(ab->buffer, samples, ab->buffer, 0, oldlen);
-    mp_audio_fill_silence(ab->buffer, 0, samples);
+    if (ab->start < samples) {
+        int oldlen = mp_audio_buffer_samples(ab);
+        mp_audio_realloc_min(ab->buffer, oldlen + samples);
+        ab->buffer->samples = MPMAX(ab->buffer->samples, oldlen + samples);
+        mp_audio_copy(ab->buffer, samples, ab->buffer, ab->start, oldlen);
+        ab->buffer->samples = oldlen + samples;
+        ab->start = samples;
+    }
+    ab->start -= samples;
+    mp_audio_fill_silence(ab->buffer, ab->start, samples);
 }
 
 // Get the start of the current readable buffer.
 void mp_audio_buffer_peek(struct mp_audio_buffer *ab, struct mp_audio *out_mpa)
 {
     *out_mpa = *ab->buffer;
+    mp_audio_skip_samples(out_mpa, ab->start);
 }
 
 // Skip leading samples. (Used with mp_audio_buffer_peek() to read data.)
 void mp_audio_buffer_skip(struct mp_audio_buffer *ab, int samples)
 {
-    assert(samples >= 0 && samples <= ab->buffer->samples);
-    mp_audio_copy(ab->buffer, 0, ab->buffer, samples,
-                  ab->buffer->samples - samples);
-    ab->buffer->samples -= samples;
+    assert(samples >= 0 && samples <= mp_audio_buffer_samples(ab));
+    ab->start += samples;
+    if (ab->start == ab->buffer->samples)
+        mp_audio_buffer_clear(ab);
 }
 
 void mp_audio_buffer_clear(struct mp_audio_buffer *ab)
 {
     ab->buffer->samples = 0;
+    ab->start = 0;
 }
 
 // Return number of buffered audio samples
 int mp_audio_buffer_samples(struct mp_audio_buffer *ab)
 {
-    return ab->buffer->samples;
+    return ab->buffer->samples - ab->start;
 }
 
 // Return amount of buffered audio in seconds.
 double mp_audio_buffer_seconds(struct mp_audio_buffer *ab)
 {
-    return ab->buffer->samples / (double)ab->buffer->rate;
+    return mp_audio_buffer_samples(ab) / (double)ab->buffer->rate;
 }
@@ -0,0 +1,134 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "talloc.h"
+#include "common/common.h"
+#include "osdep/atomics.h"
+#include "chmap.h"
+#include "audio_ring.h"
+
+struct mp_audio_ring {
+    int num_planes;
+    int size;
+    uint8_t *planes[MP_NUM_CHANNELS];
+
+    /* Read/write positions in the range [0, 2 * size). Using twice the size
+     * distinguishes a full buffer from an empty one, and positions never
+     * overflow. rpos is changed by the reader only, wpos by the writer only,
+     * and each is updated after the data was copied. */
+    atomic_ulong rpos, wpos;
+};
+
+struct mp_audio_ring *mp_audio_ring_new(void *talloc_ctx, int num_planes,
+                                        int size)
+{
+    assert(num_planes > 0 && num_planes <= MP_NUM_CHANNELS && size > 0);
+    struct mp_audio_ring *ring = talloc_zero(talloc_ctx, struct mp_audio_ring);
+    ring->num_planes = num_planes;
+    ring->size = size;
+    for (int n = 0; n < num_planes; n++)
+        ring->planes[n] = talloc_size(ring, size);
+    mp_audio_ring_reset(ring);
+    return ring;
+}
+
+static unsigned long advance(struct mp_audio_ring *ring, unsigned long pos,
+                             int len)
+{
+    pos += len;
+    if (pos >= 2 * (unsigned long)ring->size)
+        pos -= 2 * (unsigned long)ring->size;
+    return pos;
+}
+
+static int buffered(struct mp_audio_ring *ring, unsigned long rpos,
+                    unsigned long wpos)
+{
+    return wpos >= rpos ? wpos - rpos : 2 * ring->size - (rpos - wpos);
+}
+
+int mp_audio_ring_read(struct mp_audio_ring *ring, void **dest, int len)
+{
+    unsigned long rpos = atomic_load(&ring->rpos);
+    unsigned long wpos = atomic_load(&ring->wpos);
+    int read_len = MPMIN(len, buffered(ring, rpos, wpos));
+    int read_ptr = rpos % ring->size;
+
+    int len1 = MPMIN(ring->size - read_ptr, read_len);
+    int len2 = read_len - len1;
+
+    if (dest) {
+        for (int n = 0; n < ring->num_planes; n++) {
+            memcpy(dest[n], ring->planes[n] + read_ptr, len1);
+            memcpy((uint8_t *)dest[n] + len1, ring->planes[n], len2);
+        }
+    }
+
+    atomic_store(&ring->rpos, advance(ring, rpos, read_len));
+
+    return read_len;
+}
+
+int mp_audio_ring_write(struct mp_audio_ring *ring, void **src, int len)
+{
+    unsigned long rpos = atomic_load(&ring->rpos);
+    unsigned long wpos = atomic_load(&ring->wpos);
+    int write_len = MPMIN(len, ring->size - buffered(ring, rpos, wpos));
+    int write_ptr = wpos % ring->size;
+
+    int len1 = MPMIN(ring->size - write_ptr, write_len);
+    int len2 = write_len - len1;
+
+    for (int n = 0; n < ring->num_planes; n++) {
+        memcpy(ring->planes[n] + write_ptr, src[n], len1);
+        memcpy(ring->planes[n], (uint8_t *)src[n] + len1, len2);
+    }
+
+    atomic_store(&ring->wpos, advance(ring, wpos, write_len));
+
+    return write_len;
+}
+
+void mp_audio_ring_reset(struct mp_audio_ring *ring)
+{
+    atomic_store(&ring->wpos, 0);
+    atomic_store(&ring->rpos, 0);
+}
+
+int mp_audio_ring_available(struct mp_audio_ring *ring)
+{
+    return ring->size - mp_audio_ring_buffered(ring);
+}
+
+int mp_audio_ring_buffered(struct mp_audio_ring *ring)
+{
+    // Load rpos first. rpos never passes wpos, so even if both sides advance
+    // in between, the stale rpos is still behind wpos. The result can be
+    // too large in this case, but never more than the size.
+    unsigned long rpos = atomic_load(&ring->rpos);
+    unsigned long wpos = atomic_load(&ring->wpos);
+    return MPMIN(buffered(ring, rpos, wpos), ring->size);
+}
+
+int mp_audio_ring_size(struct mp_audio_ring *ring)
+{
+    return ring->size;
+}
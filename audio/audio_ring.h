@@ -0,0 +1,77 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_AUDIO_RING_H
+#define MP_AUDIO_RING_H
+
+/**
+ * Like mp_ring (misc/ring.h), but with a separate buffer for each plane of
+ * planar audio. All planes share the same read and write positions, so the
+ * reader always sees the same amount of data on every plane.
+ *
+ * This is a wait-free SPSC (single producer, single consumer) ringbuffer:
+ * mp_audio_ring_write() may be called by one thread, and mp_audio_ring_read()
+ * concurrently by another thread. Neither blocks, locks, or allocates memory.
+ * The query functions can be called from any thread. mp_audio_ring_reset()
+ * must not be called concurrently with reading or writing.
+ */
+
+struct mp_audio_ring;
+
+/**
+ * Create a new ringbuffer.
+ *
+ * talloc_ctx: talloc context of the newly created object
+ * num_planes: number of planes (1 for interleaved audio)
+ * size:       size of each plane in bytes
+ */
+struct mp_audio_ring *mp_audio_ring_new(void *talloc_ctx, int num_planes,
+                                        int size);
+
+/**
+ * Read up to len bytes from each plane. If dest is NULL, the data is
+ * discarded. Returns the number of bytes read per plane.
+ */
+int mp_audio_ring_read(struct mp_audio_ring *ring, void **dest, int len);
+
+/**
+ * Write up to len bytes to each plane. Returns the number of bytes written
+ * per plane.
+ */
+int mp_audio_ring_write(struct mp_audio_ring *ring, void **src, int len);
+
+/**
+ * Discard all buffered data.
+ */
+void mp_audio_ring_reset(struct mp_audio_ring *ring);
+
+/**
+ * Number of bytes per plane that can be written.
+ */
+int mp_audio_ring_available(struct mp_audio_ring *ring);
+
+/**
+ * Number of bytes per plane that can be read.
+ */
+int mp_audio_ring_buffered(struct mp_audio_ring *ring);
+
+/**
+ * Total size of each plane in bytes.
+ */
+int mp_audio_ring_size(struct mp_audio_ring *ring);
+
+#endif
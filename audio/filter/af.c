@@ -39,6 +39,7 @@ extern const struct af_info af_info_format;
 extern const struct af_info af_info_force;
 extern const struct af_info af_info_volume;
 extern const struct af_info af_info_equalizer;
+extern const struct af_info af_info_parameq;
 extern const struct af_info af_info_pan;
 extern const struct af_info af_info_surround;
 extern const struct af_info af_info_sub;
@@ -49,6 +50,7 @@ extern const struct af_info af_info_lavcac3enc;
 extern const struct af_info af_info_lavrresample;
 extern const struct af_info af_info_sweep;
 extern const struct af_info af_info_hrtf;
+extern const struct af_info af_info_convolve;
 extern const struct af_info af_info_ladspa;
 extern const struct af_info af_info_center;
 extern const struct af_info af_info_sinesuppress;
@@ -67,6 +69,7 @@ static const struct af_info *const filter_list[] = {
     &af_info_format,
     &af_info_volume,
     &af_info_equalizer,
+    &af_info_parameq,
     &af_info_pan,
     &af_info_surround,
     &af_info_sub,
@@ -77,6 +80,7 @@ static const struct af_info *const filter_list[] = {
     &af_info_lavrresample,
     &af_info_sweep,
     &af_info_hrtf,
+    &af_info_convolve,
 #if HAVE_LADSPA
     &af_info_ladspa,
 #endif
@@ -588,7 +592,10 @@ void af_uninit(struct af_stream *s)
 struct af_stream *af_new(struct mpv_global *global)
 {
     struct af_stream *s = talloc_zero(NULL, struct af_stream);
-    static const struct af_info in = { .name = "in" };
+    static const struct af_info in = {
+        .name = "in",
+        .flags = AF_FLAGS_READONLY,
+    };
     s->first = talloc(s, struct af_instance);
     *s->first = (struct af_instance) {
         .info = &in,
@@ -598,7 +605,10 @@ struct af_stream *af_new(struct mpv_global *global)
         .data = &s->input,
         .mul = 1.0,
     };
-    static const struct af_info out = { .name = "out" };
+    static const struct af_info out = {
+        .name = "out",
+        .flags = AF_FLAGS_READONLY,
+    };
     s->last = talloc(s, struct af_instance);
     *s->last = (struct af_instance) {
         .info = &out,
@@ -713,6 +723,64 @@ int af_remove_by_label(struct af_stream *s, char *label)
     return 1;
 }
 
+/* Send a filter specific command to the filter with the given label. Returns
+ * a negative error code if the filter wasn't found, or didn't accept it.
+ */
+int af_send_command(struct af_stream *s, char *label, char *cmd, char *arg)
+{
+    struct af_instance *af = af_find_by_label(s, label);
+    if (!af)
+        return AF_ERROR;
+    int r = af->control(af, AF_CONTROL_COMMAND, (char *[2]){cmd, arg});
+    return r == AF_OK ? AF_OK : AF_ERROR;
+}
+
+static bool writes_input(struct af_stream *s)
+{
+    for (struct af_instance *af = s->first; af; af = af->next) {
+        if (!(af->info->flags & AF_FLAGS_READONLY))
+            return true;
+    }
+    return false;
+}
+
+// Size of the blocks (over all planes) used by filter_inplace_run()
+#define INPLACE_BLOCK_BYTES (16 * 1024)
+
+static bool is_inplace(struct af_instance *af)
+{
+    return af && (af->info->flags & AF_FLAGS_INPLACE);
+}
+
+// Run the consecutive AF_FLAGS_INPLACE filters starting with af on frame. The
+// frame is processed in blocks small enough to stay in the CPU cache, and
+// each block goes through all filters before the next block is touched, so
+// that the data is read from memory only once, instead of once per filter.
+// Returns the first filter after the run.
+static struct af_instance *filter_inplace_run(struct af_instance *af,
+                                              struct mp_audio *frame, int *r)
+{
+    struct af_instance *end = af;
+    while (is_inplace(end))
+        end = end->next;
+
+    int bytes = MPMAX(frame->sstride * frame->num_planes, 1);
+    int block = MPMAX(INPLACE_BLOCK_BYTES / bytes, 64);
+    for (int pos = 0; pos < frame->samples; pos += block) {
+        struct mp_audio part = *frame;
+        mp_audio_skip_samples(&part, pos);
+        part.samples = MPMIN(part.samples, block);
+        for (struct af_instance *cur = af; cur != end; cur = cur->next) {
+            *r = cur->filter(cur, &part, 0);
+            if (*r < 0)
+                return end;
+            assert(mp_audio_config_equals(cur->data, &part));
+        }
+    }
+    *r = 0;
+    return end;
+}
+
 /* Feed "data" to the chain, and write results to output. "data" needs to be
  * a refcounted frame, although refcounting is not used yet.
  * data==NULL means EOF.
@@ -728,7 +796,9 @@ int af_filter(struct af_stream *s, struct mp_audio *data,
     char dummy[MP_NUM_CHANNELS];
     if (data) {
         assert(mp_audio_config_equals(af->data, data));
-        r = mp_audio_make_writeable(data);
+        // Avoid copying the decoder's frame if nothing writes to it.
+        if (writes_input(s))
+            r = mp_audio_make_writeable(data);
     } else {
         data = &tmp;
         *data = *(af->data);
@@ -744,6 +814,12 @@ int af_filter(struct af_stream *s, struct mp_audio *data,
         frame.allocated[n] = NULL;
     // Iterate through all filters
     while (af) {
+        if (!flags && is_inplace(af) && is_inplace(af->next)) {
+            af = filter_inplace_run(af, &frame, &r);
+            if (r < 0)
+                goto done;
+            continue;
+        }
         r = af->filter(af, &frame, flags);
         if (r < 0)
             goto done;
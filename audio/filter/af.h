@@ -38,6 +38,13 @@ struct mpv_global;
 // Flags used for defining the behavior of an audio filter
 #define AF_FLAGS_REENTRANT      0x00000000
 #define AF_FLAGS_NOT_REENTRANT  0x00000001
+// filter() modifies the data in place, never changes the number of samples,
+// and doesn't depend on how the input is split into frames. af_filter() may
+// then pass a frame in several parts.
+#define AF_FLAGS_INPLACE        0x00000002
+// filter() never writes to the data passed to it. If all filters in the chain
+// have this flag, af_filter() doesn't need to make the input writeable.
+#define AF_FLAGS_READONLY       0x00000004
 
 // Flags for af->filter()
 #define AF_FILTER_FLAG_EOF 1
@@ -121,6 +128,7 @@ enum af_control {
     AF_CONTROL_GET_PAN_BALANCE,
     AF_CONTROL_SET_PLAYBACK_SPEED,
     AF_CONTROL_SET_PLAYBACK_SPEED_RESAMPLE,
+    AF_CONTROL_COMMAND,         // char *[2]: command name and argument
 };
 
 // Argument for AF_CONTROL_SET_PAN_LEVEL
@@ -136,6 +144,7 @@ void af_uninit(struct af_stream *s);
 struct af_instance *af_add(struct af_stream *s, char *name, char **args);
 int af_remove_by_label(struct af_stream *s, char *label);
 struct af_instance *af_find_by_label(struct af_stream *s, char *label);
+int af_send_command(struct af_stream *s, char *label, char *cmd, char *arg);
 struct mp_audio_buffer;
 int af_filter(struct af_stream *s, struct mp_audio *data,
               struct mp_audio_buffer *output);
@@ -241,6 +241,7 @@ static int af_open(struct af_instance* af){
 const struct af_info af_info_channels = {
     .info = "Insert or remove channels",
     .name = "channels",
+    .flags = AF_FLAGS_READONLY,
     .open = af_open,
     .priv_size = sizeof(af_channels_t),
     .options = (const struct m_option[]) {
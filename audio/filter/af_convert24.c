@@ -112,6 +112,7 @@ static int af_open(struct af_instance *af)
 const struct af_info af_info_convert24 = {
     .info = "Convert between 24 and 32 bit sample format",
     .name = "convert24",
+    .flags = AF_FLAGS_READONLY,
     .open = af_open,
     .test_conversion = test_conversion,
 };
@@ -0,0 +1,244 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "talloc.h"
+#include "common/common.h"
+#include "af.h"
+#include "convolve.h"
+
+// Limit memory usage for absurdly large files (~3 minutes at 48 kHz).
+#define MAX_IR_SAMPLES (1 << 23)
+
+struct priv {
+    // options
+    char *filename;
+    int ir_channels;
+    int rate;
+    int block;
+
+    struct mp_convolver *conv;
+    struct mp_conv_ir *irs[MP_NUM_CHANNELS];
+    struct mp_conv_input *inputs[MP_NUM_CHANNELS];
+    struct mp_conv_output *outputs[MP_NUM_CHANNELS];
+    int ir_len;
+    // Input of the current block, and the output of the previous block, which
+    // is played while the current block is collected.
+    float *in_blk[MP_NUM_CHANNELS];
+    float *out_blk[MP_NUM_CHANNELS];
+    int pos;
+    bool pending;       // out_blk[] contains output not played yet
+    int num_channels;
+};
+
+static void reset(struct priv *p)
+{
+    for (int c = 0; c < p->num_channels; c++) {
+        mp_conv_input_reset(p->inputs[c]);
+        memset(p->out_blk[c], 0, p->block * sizeof(float));
+    }
+    p->pos = 0;
+    p->pending = false;
+}
+
+static int control(struct af_instance *af, int cmd, void *arg)
+{
+    struct priv *p = af->priv;
+
+    switch (cmd) {
+    case AF_CONTROL_REINIT: {
+        struct mp_audio *in = arg;
+
+        mp_audio_copy_config(af->data, in);
+        mp_audio_set_format(af->data, AF_FORMAT_FLOATP);
+        if (p->rate)
+            af->data->rate = p->rate;
+        if (p->ir_channels > 1)
+            mp_audio_set_num_channels(af->data, p->ir_channels);
+
+        // Streams are allocated on demand, and kept for later reinits.
+        for (int c = 0; c < af->data->nch; c++) {
+            if (!p->inputs[c]) {
+                p->inputs[c] = mp_conv_input_create(p->conv, p->ir_len);
+                p->outputs[c] = mp_conv_output_create(p->conv);
+                p->in_blk[c] = talloc_array(p, float, p->block);
+                p->out_blk[c] = talloc_array(p, float, p->block);
+            }
+        }
+        p->num_channels = af->data->nch;
+        reset(p);
+
+        af->delay = p->block / (double)af->data->rate;
+
+        return af_test_output(af, in);
+    }
+    case AF_CONTROL_RESET:
+        reset(p);
+        return AF_OK;
+    }
+    return AF_UNKNOWN;
+}
+
+static void process_block(struct priv *p)
+{
+    for (int c = 0; c < p->num_channels; c++) {
+        mp_conv_input_push(p->inputs[c], p->in_blk[c]);
+        mp_conv_output_add(p->outputs[c], p->inputs[c],
+                           p->irs[c % p->ir_channels]);
+        mp_conv_output_finish(p->outputs[c], p->out_blk[c]);
+    }
+}
+
+static int filter(struct af_instance *af, struct mp_audio *data, int flags)
+{
+    struct priv *p = af->priv;
+
+    // The output lags by one block. At EOF, append a block of silence to
+    // play the rest of it, which zero-pads the last, partial block.
+    if ((flags & AF_FILTER_FLAG_EOF) && p->pending) {
+        struct mp_audio *r = af->data;
+        mp_audio_realloc_min(r, data->samples + p->block);
+        r->samples = data->samples + p->block;
+        mp_audio_copy(r, 0, data, 0, data->samples);
+        mp_audio_fill_silence(r, data->samples, p->block);
+        *data = *r;
+    }
+
+    p->pending |= data->samples > 0;
+    int done = 0;
+    while (done < data->samples) {
+        int len = MPMIN(data->samples - done, p->block - p->pos);
+        for (int c = 0; c < p->num_channels; c++) {
+            float *ptr = (float *)data->planes[c] + done;
+            memcpy(p->in_blk[c] + p->pos, ptr, len * sizeof(float));
+            memcpy(ptr, p->out_blk[c] + p->pos, len * sizeof(float));
+        }
+        p->pos += len;
+        done += len;
+        if (p->pos == p->block) {
+            process_block(p);
+            p->pos = 0;
+        }
+    }
+
+    if (flags & AF_FILTER_FLAG_EOF)
+        reset(p);
+
+    return 0;
+}
+
+// Read the interleaved float impulse responses. Returns the number of samples
+// per channel, or -1 on error.
+static int load_irs(struct af_instance *af)
+{
+    struct priv *p = af->priv;
+    int res = -1;
+    float *data = NULL;
+
+    FILE *f = fopen(p->filename, "rb");
+    if (!f) {
+        MP_FATAL(af, "Could not open %s\n", p->filename);
+        return -1;
+    }
+    if (fseek(f, 0, SEEK_END) < 0)
+        goto done;
+    long size = ftell(f);
+    if (size < 0 || fseek(f, 0, SEEK_SET) < 0)
+        goto done;
+    int frame = sizeof(float) * p->ir_channels;
+    if (size < frame || size / frame > MAX_IR_SAMPLES) {
+        MP_FATAL(af, "Impulse response has invalid length.\n");
+        goto done;
+    }
+    int len = size / frame;
+    data = talloc_array(NULL, float, len * p->ir_channels);
+    if (fread(data, frame, len, f) != (size_t)len)
+        goto done;
+
+    float *plane = talloc_array(data, float, len);
+    for (int c = 0; c < p->ir_channels; c++) {
+        for (int n = 0; n < len; n++)
+            plane[n] = data[n * p->ir_channels + c];
+        p->irs[c] = mp_conv_ir_create(p->conv, plane, len);
+    }
+    res = len;
+
+done:
+    if (res < 0)
+        MP_FATAL(af, "Could not read %s\n", p->filename);
+    talloc_free(data);
+    fclose(f);
+    return res;
+}
+
+static int af_open(struct af_instance *af)
+{
+    struct priv *p = af->priv;
+
+    af->control = control;
+    af->filter = filter;
+
+    if (!p->filename) {
+        MP_FATAL(af, "No impulse response file set.\n");
+        return AF_ERROR;
+    }
+
+    // round up to a power of 2
+    int block = MP_CONV_MIN_BLOCK;
+    while (block < p->block)
+        block *= 2;
+    p->block = block;
+
+    p->conv = mp_convolver_create(p, p->block);
+    if (!p->conv) {
+        MP_FATAL(af, "Could not initialize the FFT.\n");
+        return AF_ERROR;
+    }
+
+    p->ir_len = load_irs(af);
+    if (p->ir_len < 0)
+        return AF_ERROR;
+
+    MP_VERBOSE(af, "%d samples, %d partitions of %d samples\n", p->ir_len,
+               (p->ir_len + p->block - 1) / p->block, p->block);
+
+    return AF_OK;
+}
+
+#define OPT_BASE_STRUCT struct priv
+
+const struct af_info af_info_convolve = {
+    .info = "Convolution with impulse responses",
+    .name = "convolve",
+    .flags = AF_FLAGS_INPLACE,
+    .open = af_open,
+    .priv_size = sizeof(struct priv),
+    .priv_defaults = &(const struct priv) {
+        .ir_channels = 1,
+        .block = 256,
+    },
+    .options = (const struct m_option[]) {
+        OPT_STRING("file", filename, 0),
+        OPT_INTRANGE("channels", ir_channels, 0, 1, MP_NUM_CHANNELS),
+        OPT_INTRANGE("rate", rate, 0, 0, 8*48000),
+        OPT_INTRANGE("block", block, 0, MP_CONV_MIN_BLOCK, MP_CONV_MAX_BLOCK),
+        {0}
+    },
+};
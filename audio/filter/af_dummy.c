@@ -57,5 +57,6 @@ static int af_open(struct af_instance* af){
 const struct af_info af_info_dummy = {
     .info = "dummy",
     .name = "dummy",
+    .flags = AF_FLAGS_READONLY,
     .open = af_open,
 };
@@ -64,6 +64,7 @@ static int af_open(struct af_instance *af)
 const struct af_info af_info_forcespeed = {
     .info = "Force audio speed",
     .name = "forcespeed",
+    .flags = AF_FLAGS_READONLY,
     .open = af_open,
     .priv_size = sizeof(struct priv),
 };
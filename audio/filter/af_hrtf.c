@@ -30,22 +30,48 @@
 #include <math.h>
 #include <libavutil/common.h>
 
+#include "talloc.h"
 #include "af.h"
 #include "dsp.h"
+#include "convolve.h"
 
 /* HRTF filter coefficients and adjustable parameters */
 #include "af_hrtf.h"
 
+/* Signals recorded for the block convolution. The order of the
+   convolved signals matches the ring buffers in af_hrtf_t. */
+enum {
+    BLK_LF, BLK_RF, BLK_LR, BLK_RR, BLK_CF, BLK_CR, BLK_BA_L, BLK_BA_R,
+    BLK_NUM_CONV,
+    BLK_LFE = BLK_NUM_CONV,
+    BLK_NUM
+};
+
 typedef struct af_hrtf_s {
     /* Lengths */
     int dlbuflen, hrflen, basslen;
     /* L, C, R, Ls, Rs channels */
     float *lf, *rf, *lr, *rr, *cf, *cr;
-    const float *cf_ir, *af_ir, *of_ir, *ar_ir, *or_ir, *cr_ir;
-    int cf_o, af_o, of_o, ar_o, or_o, cr_o;
     /* Bass */
     float *ba_l, *ba_r;
     float *ba_ir;
+    /* Partitioned convolution of the decoded channels with the HRIRs. The
+       gains applied to the rear and bass channels are folded into the
+       impulse responses. */
+    struct mp_convolver *conv;
+    struct mp_conv_input *conv_in[BLK_NUM_CONV];
+    struct mp_conv_ir *cf_ir, *af_ir, *of_ir, *ar_ir, *or_ir, *cr_ir;
+    struct mp_conv_ir *ba_ir_same, *ba_ir_cross;
+    struct mp_conv_output *conv_l, *conv_r;
+    /* Decoded input of the current block, and the output of the previous
+       block, which is played while the current block is collected. */
+    float blk[BLK_NUM][HRTF_BLOCKLEN];
+    float blk_out[2][HRTF_BLOCKLEN];
+    int blk_pos;
+    /* Whether blk_out contains output not played yet */
+    bool blk_pending;
+    /* Input padded with silence at EOF */
+    short *eof_buf;
     /* Whether to matrix decode the rear center channel */
     int matrix_mode;
     /* How to decode the input:
@@ -74,32 +100,15 @@ typedef struct af_hrtf_s {
     int mode;
 } af_hrtf_t;
 
-/* Convolution on a ring buffer
- *    nx:       length of the ring buffer
- *    nk:       length of the convolution kernel
- *    sx:       ring buffer
- *    sk:       convolution kernel
- *    offset:   offset on the ring buffer, can be
- */
-static float conv(const int nx, const int nk, const float *sx, const float *sk,
-                  const int offset)
-{
-    /* k = reminder of offset / nx */
-    int k = offset >= 0 ? offset % nx : nx + (offset % nx);
-
-    if(nk + k <= nx)
-        return af_filter_fir(nk, sx + k, sk);
-    else
-        return af_filter_fir(nk + k - nx, sx, sk + nx - k) +
-            af_filter_fir(nx - k, sx + k, sk);
-}
+/* Reference impulse response length */
+#define HRIRLEN 128
 
 /* Detect when the impulse response starts (significantly) */
 static int pulse_detect(const float *sx)
 {
-    /* nmax must be the reference impulse response length (128) minus
+    /* nmax must be the reference impulse response length minus
        s->hrflen */
-    const int nmax = 128 - HRTFFILTLEN;
+    const int nmax = HRIRLEN - HRTFFILTLEN;
     const float thresh = IRTHRESH;
     int i;
 
@@ -109,6 +118,29 @@ static int pulse_detect(const float *sx)
     return 0;
 }
 
+static struct mp_conv_ir *create_ir(af_hrtf_t *s, const float *ir, int len,
+                                   float gain)
+{
+    float *tmp = talloc_array(NULL, float, len);
+    for(int i = 0; i < len; i++)
+        tmp[i] = ir[i] * gain;
+    struct mp_conv_ir *res = mp_conv_ir_create(s->conv, tmp, len);
+    talloc_free(tmp);
+    return res;
+}
+
+/* Use s->hrflen samples of the reference impulse response, starting with
+   the detected pulse. The delay before the pulse is kept. */
+static struct mp_conv_ir *create_hrir(af_hrtf_t *s, const float *filt,
+                                      float gain)
+{
+    float ir[HRIRLEN] = {0};
+    int o = pulse_detect(filt);
+
+    memcpy(ir + o, filt + o, s->hrflen * sizeof(float));
+    return create_ir(s, ir, o + s->hrflen, gain);
+}
+
 /* Fuzzy matrix coefficient transfer function to "lock" the matrix on
    a effectively passive mode if the gain is approximately 1 */
 static inline float passive_lock(float x)
@@ -308,6 +340,12 @@ static void reset(af_hrtf_t *s)
     clear_coeff(s, s->fwrbuf_r);
     clear_coeff(s, s->fwrbuf_lr);
     clear_coeff(s, s->fwrbuf_rr);
+    for (int n = 0; n < BLK_NUM_CONV; n++)
+        mp_conv_input_reset(s->conv_in[n]);
+    memset(s->blk, 0, sizeof(s->blk));
+    memset(s->blk_out, 0, sizeof(s->blk_out));
+    s->blk_pos = 0;
+    s->blk_pending = false;
 }
 
 /* Initialization and runtime control */
@@ -334,6 +372,7 @@ static int control(struct af_instance *af, int cmd, void* arg)
         test_output_res = af_test_output(af, (struct mp_audio*)arg);
         // after testing input set the real output format
         mp_audio_set_num_channels(af->data, 2);
+        af->delay = HRTF_BLOCKLEN / (double)af->data->rate;
         s->print_flag = 1;
         return test_output_res;
     case AF_CONTROL_RESET:
@@ -364,6 +403,101 @@ static void uninit(struct af_instance *af)
         free(s->fwrbuf_rr);
 }
 
+static bool conv_input_used(af_hrtf_t *s, int n)
+{
+    switch (n) {
+    case BLK_LR:
+    case BLK_RR:
+    case BLK_CF:
+        return s->decode_mode != HRTF_MIX_STEREO;
+    case BLK_CR:
+        return s->decode_mode != HRTF_MIX_STEREO && s->matrix_mode;
+    }
+    return true;
+}
+
+/* Convolve a complete block of decoded channels, and mix the result into
+   blk_out. */
+static void process_block(af_hrtf_t *s)
+{
+    struct mp_conv_output *l = s->conv_l, *r = s->conv_r;
+    struct mp_conv_input **in = s->conv_in;
+
+    for(int n = 0; n < BLK_NUM_CONV; n++) {
+        if(conv_input_used(s, n))
+            mp_conv_input_push(in[n], s->blk[n]);
+    }
+
+    /* Mixer filter matrix */
+    switch (s->decode_mode) {
+    case HRTF_MIX_51:
+    case HRTF_MIX_MATRIX2CH:
+       /* common */
+       mp_conv_output_add(l, in[BLK_CF], s->cf_ir);
+       mp_conv_output_add(r, in[BLK_CF], s->cf_ir);
+       if(s->matrix_mode) {
+          mp_conv_output_add(l, in[BLK_CR], s->cr_ir);
+          mp_conv_output_add(r, in[BLK_CR], s->cr_ir);
+       }
+       mp_conv_output_add(l, in[BLK_LR], s->ar_ir);
+       mp_conv_output_add(l, in[BLK_RR], s->or_ir);
+       mp_conv_output_add(r, in[BLK_RR], s->ar_ir);
+       mp_conv_output_add(r, in[BLK_LR], s->or_ir);
+       /* fall through */
+    case HRTF_MIX_STEREO:
+       mp_conv_output_add(l, in[BLK_LF], s->af_ir);
+       mp_conv_output_add(l, in[BLK_RF], s->of_ir);
+       mp_conv_output_add(r, in[BLK_RF], s->af_ir);
+       mp_conv_output_add(r, in[BLK_LF], s->of_ir);
+       break;
+    }
+
+    /* Bass compensation for the lower frequency cut of the HRTF.  A
+       cross talk of the left and right channel is introduced to
+       match the directional characteristics of higher frequencies.
+       The bass will not have any real 3D perception, but that is
+       OK (note at 180 Hz, the wavelength is about 2 m, and any
+       spatial perception is impossible). */
+    mp_conv_output_add(l, in[BLK_BA_L], s->ba_ir_same);
+    mp_conv_output_add(l, in[BLK_BA_R], s->ba_ir_cross);
+    mp_conv_output_add(r, in[BLK_BA_R], s->ba_ir_same);
+    mp_conv_output_add(r, in[BLK_BA_L], s->ba_ir_cross);
+
+    mp_conv_output_finish(l, s->blk_out[0]);
+    mp_conv_output_finish(r, s->blk_out[1]);
+
+    for(int i = 0; i < HRTF_BLOCKLEN; i++) {
+        float left = s->blk_out[0][i] + s->blk[BLK_LFE][i] * M3_01DB;
+        float right = s->blk_out[1][i] + s->blk[BLK_LFE][i] * M3_01DB;
+        float diff;
+
+        /* Amplitude renormalization. */
+        left  *= AMPLNORM;
+        right *= AMPLNORM;
+
+        switch (s->decode_mode) {
+        case HRTF_MIX_51:
+        case HRTF_MIX_STEREO:
+           /* "Cheating": linear stereo expansion to amplify the 3D
+              perception.  Note: Too much will destroy the acoustic space
+              and may even result in headaches. */
+           diff = STEXPAND2 * (left - right);
+           left  += diff;
+           right -= diff;
+           break;
+        case HRTF_MIX_MATRIX2CH:
+           /* Do attempt any stereo expansion with matrix encoded
+              sources.  The L, R channels are already stereo expanded
+              by the steering, any further stereo expansion will sound
+              very unnatural. */
+           break;
+        }
+
+        s->blk_out[0][i] = left;
+        s->blk_out[1][i] = right;
+    }
+}
+
 /* Filter data through filter
 
 Two "tricks" are used to compensate the "color" of the KEMAR data:
@@ -378,11 +512,24 @@ damped (without any real 3D acoustical image, however).
 static int filter(struct af_instance *af, struct mp_audio *data, int flags)
 {
     af_hrtf_t *s = af->priv;
+    const int dblen = s->dlbuflen;
+
+    /* The output lags by one block. At EOF, append a block of silence to
+       play the rest of it, which zero-pads the last, partial block. */
+    if((flags & AF_FILTER_FLAG_EOF) && s->blk_pending) {
+        int len = data->samples * data->nch;
+        s->eof_buf = talloc_realloc(af, s->eof_buf, short,
+                                    len + HRTF_BLOCKLEN * data->nch);
+        memcpy(s->eof_buf, data->planes[0], len * sizeof(short));
+        memset(s->eof_buf + len, 0, HRTF_BLOCKLEN * data->nch * sizeof(short));
+        data->planes[0] = s->eof_buf;
+        data->samples += HRTF_BLOCKLEN;
+    }
+    s->blk_pending |= data->samples > 0;
+
     short *in = data->planes[0]; // Input audio data
     short *out = NULL; // Output audio data
     short *end = in + data->samples * data->nch; // Loop end
-    float common, left, right, diff, left_b, right_b;
-    const int dblen = s->dlbuflen, hlen = s->hrflen, blen = s->basslen;
 
     mp_audio_realloc_min(af->data, data->samples);
 
@@ -434,6 +581,7 @@ static int filter(struct af_instance *af, struct mp_audio *data, int flags)
 
     while(in < end) {
         const int k = s->cyc_pos;
+        const int i = s->blk_pos;
 
         update_ch(s, in, k);
 
@@ -444,103 +592,38 @@ static int filter(struct af_instance *af, struct mp_audio *data, int flags)
         s->lf[k] += CFECHOAMPL * s->cf[(k + CFECHODELAY) % s->dlbuflen];
         s->rf[k] += CFECHOAMPL * s->cf[(k + CFECHODELAY) % s->dlbuflen];
 
-        switch (s->decode_mode) {
-        case HRTF_MIX_51:
-        case HRTF_MIX_MATRIX2CH:
-           /* Mixer filter matrix */
-           common = conv(dblen, hlen, s->cf, s->cf_ir, k + s->cf_o);
-           if(s->matrix_mode) {
-              /* In matrix decoding mode, the rear channel gain must be
-                 renormalized, as there is an additional channel. */
-              matrix_decode(in, k, 2, 3, 0, s->dlbuflen,
-                            s->lr_fwr, s->rr_fwr,
-                            s->lrprr_fwr, s->lrmrr_fwr,
-                            &(s->adapt_lr_gain), &(s->adapt_rr_gain),
-                            &(s->adapt_lrprr_gain), &(s->adapt_lrmrr_gain),
-                            s->lr, s->rr, NULL, NULL, s->cr);
-              common +=
-                 conv(dblen, hlen, s->cr, s->cr_ir, k + s->cr_o) *
-                 M1_76DB;
-              left    =
-                 ( conv(dblen, hlen, s->lf, s->af_ir, k + s->af_o) +
-                   conv(dblen, hlen, s->rf, s->of_ir, k + s->of_o) +
-                   (conv(dblen, hlen, s->lr, s->ar_ir, k + s->ar_o) +
-                    conv(dblen, hlen, s->rr, s->or_ir, k + s->or_o)) *
-                   M1_76DB + common);
-              right   =
-                 ( conv(dblen, hlen, s->rf, s->af_ir, k + s->af_o) +
-                   conv(dblen, hlen, s->lf, s->of_ir, k + s->of_o) +
-                   (conv(dblen, hlen, s->rr, s->ar_ir, k + s->ar_o) +
-                    conv(dblen, hlen, s->lr, s->or_ir, k + s->or_o)) *
-                   M1_76DB + common);
-           } else {
-              left    =
-                 ( conv(dblen, hlen, s->lf, s->af_ir, k + s->af_o) +
-                   conv(dblen, hlen, s->rf, s->of_ir, k + s->of_o) +
-                   conv(dblen, hlen, s->lr, s->ar_ir, k + s->ar_o) +
-                   conv(dblen, hlen, s->rr, s->or_ir, k + s->or_o) +
-                   common);
-              right   =
-                 ( conv(dblen, hlen, s->rf, s->af_ir, k + s->af_o) +
-                   conv(dblen, hlen, s->lf, s->of_ir, k + s->of_o) +
-                   conv(dblen, hlen, s->rr, s->ar_ir, k + s->ar_o) +
-                   conv(dblen, hlen, s->lr, s->or_ir, k + s->or_o) +
-                   common);
-           }
-           break;
-        case HRTF_MIX_STEREO:
-           left    =
-              ( conv(dblen, hlen, s->lf, s->af_ir, k + s->af_o) +
-                conv(dblen, hlen, s->rf, s->of_ir, k + s->of_o));
-           right   =
-              ( conv(dblen, hlen, s->rf, s->af_ir, k + s->af_o) +
-                conv(dblen, hlen, s->lf, s->of_ir, k + s->of_o));
-           break;
-        default:
-            /* make gcc happy */
-            left = 0.0;
-            right = 0.0;
-            break;
+        if(s->decode_mode != HRTF_MIX_STEREO && s->matrix_mode) {
+           /* In matrix decoding mode, the rear channel gain must be
+              renormalized, as there is an additional channel. (The gain is
+              part of the rear impulse responses.) */
+           matrix_decode(in, k, 2, 3, 0, s->dlbuflen,
+                         s->lr_fwr, s->rr_fwr,
+                         s->lrprr_fwr, s->lrmrr_fwr,
+                         &(s->adapt_lr_gain), &(s->adapt_rr_gain),
+                         &(s->adapt_lrprr_gain), &(s->adapt_lrmrr_gain),
+                         s->lr, s->rr, NULL, NULL, s->cr);
         }
 
-        /* Bass compensation for the lower frequency cut of the HRTF.  A
-           cross talk of the left and right channel is introduced to
-           match the directional characteristics of higher frequencies.
-           The bass will not have any real 3D perception, but that is
-           OK (note at 180 Hz, the wavelength is about 2 m, and any
-           spatial perception is impossible). */
-        left_b  = conv(dblen, blen, s->ba_l, s->ba_ir, k);
-        right_b = conv(dblen, blen, s->ba_r, s->ba_ir, k);
-        left  += (1 - BASSCROSS) * left_b  + BASSCROSS * right_b;
-        right += (1 - BASSCROSS) * right_b + BASSCROSS * left_b;
+        /* The ring buffer entries at k are final now. (The rear delay of
+           the matrix decoder writes to k + MATREARDELAY, which comes around
+           as k only after dlbuflen - MATREARDELAY samples.) */
+        s->blk[BLK_LF][i] = s->lf[k];
+        s->blk[BLK_RF][i] = s->rf[k];
+        s->blk[BLK_LR][i] = s->lr[k];
+        s->blk[BLK_RR][i] = s->rr[k];
+        s->blk[BLK_CF][i] = s->cf[k];
+        s->blk[BLK_CR][i] = s->cr[k];
+        s->blk[BLK_BA_L][i] = s->ba_l[k];
+        s->blk[BLK_BA_R][i] = s->ba_r[k];
         /* Also mix the LFE channel (if available) */
-        if(data->nch >= 6) {
-            left  += in[5] * M3_01DB;
-            right += in[5] * M3_01DB;
-        }
+        s->blk[BLK_LFE][i] = data->nch >= 6 ? in[5] : 0;
 
-        /* Amplitude renormalization. */
-        left  *= AMPLNORM;
-        right *= AMPLNORM;
+        out[0] = av_clip_int16(s->blk_out[0][i]);
+        out[1] = av_clip_int16(s->blk_out[1][i]);
 
-        switch (s->decode_mode) {
-        case HRTF_MIX_51:
-        case HRTF_MIX_STEREO:
-           /* "Cheating": linear stereo expansion to amplify the 3D
-              perception.  Note: Too much will destroy the acoustic space
-              and may even result in headaches. */
-           diff = STEXPAND2 * (left - right);
-           out[0] = av_clip_int16(left  + diff);
-           out[1] = av_clip_int16(right - diff);
-           break;
-        case HRTF_MIX_MATRIX2CH:
-           /* Do attempt any stereo expansion with matrix encoded
-              sources.  The L, R channels are already stereo expanded
-              by the steering, any further stereo expansion will sound
-              very unnatural. */
-           out[0] = av_clip_int16(left);
-           out[1] = av_clip_int16(right);
-           break;
+        if(++s->blk_pos == HRTF_BLOCKLEN) {
+            process_block(s);
+            s->blk_pos = 0;
         }
 
         /* Next sample... */
@@ -551,6 +634,9 @@ static int filter(struct af_instance *af, struct mp_audio *data, int flags)
             s->cyc_pos += dblen;
     }
 
+    if(flags & AF_FILTER_FLAG_EOF)
+        s->blk_pending = false;
+
     /* Set output data */
     data->planes[0] = af->data->planes[0];
     mp_audio_set_num_channels(data, 2);
@@ -584,7 +670,7 @@ static int af_open(struct af_instance* af)
 {
     int i;
     af_hrtf_t *s;
-    float fc;
+    float fc, rear_gain;
 
     af->control = control;
     af->uninit = uninit;
@@ -629,12 +715,25 @@ static int af_open(struct af_instance* af)
     s->lr_fwr =
         s->rr_fwr = 0;
 
-    s->cf_ir = cf_filt + (s->cf_o = pulse_detect(cf_filt));
-    s->af_ir = af_filt + (s->af_o = pulse_detect(af_filt));
-    s->of_ir = of_filt + (s->of_o = pulse_detect(of_filt));
-    s->ar_ir = ar_filt + (s->ar_o = pulse_detect(ar_filt));
-    s->or_ir = or_filt + (s->or_o = pulse_detect(or_filt));
-    s->cr_ir = cr_filt + (s->cr_o = pulse_detect(cr_filt));
+    s->conv = mp_convolver_create(af, HRTF_BLOCKLEN);
+    if(!s->conv) {
+        MP_ERR(af, "Unable to initialize the FFT.\n");
+        return AF_ERROR;
+    }
+    for(i = 0; i < BLK_NUM_CONV; i++) {
+        int len = i == BLK_BA_L || i == BLK_BA_R ? s->basslen : HRIRLEN;
+        s->conv_in[i] = mp_conv_input_create(s->conv, len);
+    }
+    s->conv_l = mp_conv_output_create(s->conv);
+    s->conv_r = mp_conv_output_create(s->conv);
+
+    rear_gain = s->matrix_mode ? M1_76DB : 1;
+    s->cf_ir = create_hrir(s, cf_filt, 1);
+    s->af_ir = create_hrir(s, af_filt, 1);
+    s->of_ir = create_hrir(s, of_filt, 1);
+    s->ar_ir = create_hrir(s, ar_filt, rear_gain);
+    s->or_ir = create_hrir(s, or_filt, rear_gain);
+    s->cr_ir = create_hrir(s, cr_filt, M1_76DB);
 
     if((s->ba_ir = malloc(s->basslen * sizeof(float))) == NULL) {
         MP_ERR(af, "Memory allocation error.\n");
@@ -649,6 +748,8 @@ static int af_open(struct af_instance* af)
     }
     for(i = 0; i < s->basslen; i++)
         s->ba_ir[i] *= BASSGAIN;
+    s->ba_ir_same = create_ir(s, s->ba_ir, s->basslen, 1 - BASSCROSS);
+    s->ba_ir_cross = create_ir(s, s->ba_ir, s->basslen, BASSCROSS);
 
     return AF_OK;
 }
@@ -316,6 +316,7 @@ static int af_open(struct af_instance* af){
 const struct af_info af_info_lavcac3enc = {
     .info = "runtime encode to ac3 using libavcodec",
     .name = "lavcac3enc",
+    .flags = AF_FLAGS_READONLY,
     .open = af_open,
     .priv_size = sizeof(struct af_ac3enc_s),
     .priv_defaults = &(const struct af_ac3enc_s){
@@ -0,0 +1,261 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "talloc.h"
+#include "common/common.h"
+#include "af.h"
+#include "biquad.h"
+
+#define MAX_BANDS 32
+
+// While a parameter change is smoothed, the coefficients are recomputed every
+// this many frames.
+#define SMOOTH_FRAMES 64
+
+struct band {
+    enum mp_biquad_type type;
+    double freq, gain, q;
+};
+
+static const char *const type_names[] = {
+    [MP_BIQUAD_PEAK] = "peak",
+    [MP_BIQUAD_LOWSHELF] = "lowshelf",
+    [MP_BIQUAD_HIGHSHELF] = "highshelf",
+    [MP_BIQUAD_NOTCH] = "notch",
+};
+
+struct priv {
+    // options
+    char **bands_opt;
+    float smooth;
+
+    const struct mp_biquad_fns *fns;
+    int rate;
+    int num_bands;
+    // cur is what the coefficients in bq were computed from. While smoothing,
+    // it moves from start to target.
+    struct band cur[MAX_BANDS], start[MAX_BANDS], target[MAX_BANDS];
+    struct mp_biquad bq[MAX_BANDS];
+    int smooth_steps, smooth_pos;
+    int step_frames; // frames left until the next smoothing step
+};
+
+// Parse "type/freq[/gain[/q]]".
+static bool parse_band(struct af_instance *af, const char *s, struct band *b)
+{
+    char type[16];
+    double freq = 0, gain = 0, q = M_SQRT1_2;
+    int n = sscanf(s, "%15[a-z]/%lf/%lf/%lf", type, &freq, &gain, &q);
+    if (n < 2 || freq <= 0 || q <= 0) {
+        MP_ERR(af, "Invalid band '%s'.\n", s);
+        return false;
+    }
+    for (int i = 0; i < MP_ARRAY_SIZE(type_names); i++) {
+        if (strcmp(type, type_names[i]) == 0) {
+            *b = (struct band){i, freq, gain, q};
+            return true;
+        }
+    }
+    MP_ERR(af, "Unknown band type '%s'.\n", type);
+    return false;
+}
+
+// Returns the number of bands, or -1 on error.
+static int parse_bands(struct af_instance *af, char **list,
+                       struct band bands[MAX_BANDS])
+{
+    int num = 0;
+    for (; list && list[num]; num++) {
+        if (num >= MAX_BANDS) {
+            MP_ERR(af, "Too many bands (maximum is %d).\n", MAX_BANDS);
+            return -1;
+        }
+        if (!parse_band(af, list[num], &bands[num]))
+            return -1;
+    }
+    return num;
+}
+
+static void update_coeffs(struct priv *p)
+{
+    for (int n = 0; n < p->num_bands; n++) {
+        struct band *b = &p->cur[n];
+        mp_biquad_design(&p->bq[n], b->type, b->freq / p->rate, b->gain, b->q);
+    }
+}
+
+static void reset(struct priv *p)
+{
+    for (int n = 0; n < MAX_BANDS; n++)
+        mp_biquad_reset(&p->bq[n]);
+}
+
+// Set t in [0, 1] of the way from start to target. The frequency and Q are
+// interpolated on a logarithmic scale, which is how they are perceived.
+static void smooth_step(struct priv *p, double t)
+{
+    for (int n = 0; n < p->num_bands; n++) {
+        struct band *a = &p->start[n], *b = &p->target[n];
+        p->cur[n] = (struct band){
+            .type = b->type,
+            .freq = a->freq * pow(b->freq / a->freq, t),
+            .gain = a->gain + (b->gain - a->gain) * t,
+            .q = a->q * pow(b->q / a->q, t),
+        };
+    }
+    update_coeffs(p);
+}
+
+// Change the bands. Bands which keep their type are smoothly moved to the new
+// parameters; the other ones are switched immediately.
+static void set_bands(struct priv *p, struct band *bands, int num)
+{
+    for (int n = 0; n < num; n++) {
+        if (n >= p->num_bands || p->cur[n].type != bands[n].type) {
+            p->cur[n] = bands[n];
+            mp_biquad_reset(&p->bq[n]);
+        }
+        p->start[n] = p->cur[n];
+        p->target[n] = bands[n];
+    }
+    p->num_bands = num;
+    p->smooth_steps = p->rate ? p->smooth * p->rate / SMOOTH_FRAMES : 0;
+    p->smooth_pos = 0;
+    p->step_frames = 0;
+    if (!p->smooth_steps) {
+        for (int n = 0; n < num; n++)
+            p->cur[n] = p->target[n];
+    }
+    if (p->rate)
+        update_coeffs(p);
+}
+
+static int control(struct af_instance *af, int cmd, void *arg)
+{
+    struct priv *p = af->priv;
+
+    switch (cmd) {
+    case AF_CONTROL_REINIT: {
+        struct mp_audio *in = arg;
+
+        mp_audio_copy_config(af->data, in);
+        mp_audio_set_format(af->data, AF_FORMAT_FLOAT);
+        if (af->data->nch > MP_BIQUAD_LANES)
+            mp_audio_set_num_channels(af->data, MP_BIQUAD_LANES);
+
+        p->rate = af->data->rate;
+        // finish smoothing
+        for (int n = 0; n < p->num_bands; n++)
+            p->cur[n] = p->target[n];
+        p->smooth_steps = 0;
+        update_coeffs(p);
+        reset(p);
+
+        return af_test_output(af, in);
+    }
+    case AF_CONTROL_RESET:
+        reset(p);
+        return AF_OK;
+    case AF_CONTROL_COMMAND: {
+        char **c = arg;
+        if (strcmp(c[0], "bands") == 0) {
+            struct band bands[MAX_BANDS];
+            char **list = NULL;
+            int num_list = 0;
+            char *s = talloc_strdup(NULL, c[1]), *tok, *ptr = NULL;
+            for (tok = strtok_r(s, ",", &ptr); tok; tok = strtok_r(NULL, ",", &ptr))
+                MP_TARRAY_APPEND(s, list, num_list, tok);
+            MP_TARRAY_APPEND(s, list, num_list, NULL);
+            int num = parse_bands(af, list, bands);
+            talloc_free(s);
+            if (num < 0)
+                return AF_ERROR;
+            set_bands(p, bands, num);
+            return AF_OK;
+        }
+        return AF_ERROR;
+    }
+    }
+    return AF_UNKNOWN;
+}
+
+static int filter(struct af_instance *af, struct mp_audio *data, int flags)
+{
+    struct priv *p = af->priv;
+    float *ptr = data->planes[0];
+    int left = data->samples;
+
+    while (left > 0) {
+        int n = left;
+        if (p->smooth_pos < p->smooth_steps) {
+            if (!p->step_frames) {
+                p->smooth_pos++;
+                smooth_step(p, p->smooth_pos / (double)p->smooth_steps);
+                p->step_frames = SMOOTH_FRAMES;
+            }
+            n = MPMIN(n, p->step_frames);
+            p->step_frames -= n;
+        }
+        p->fns->process(p->bq, p->num_bands, ptr, data->nch, n);
+        ptr += n * data->nch;
+        left -= n;
+    }
+
+    return 0;
+}
+
+static int af_open(struct af_instance *af)
+{
+    struct priv *p = af->priv;
+
+    af->control = control;
+    af->filter = filter;
+    p->fns = mp_biquad_get_fns();
+
+    struct band bands[MAX_BANDS];
+    int num = parse_bands(af, p->bands_opt, bands);
+    if (num < 0)
+        return AF_ERROR;
+    set_bands(p, bands, num);
+
+    MP_VERBOSE(af, "%d bands, using %s\n", num, p->fns->name);
+
+    return AF_OK;
+}
+
+#define OPT_BASE_STRUCT struct priv
+
+const struct af_info af_info_parameq = {
+    .info = "Parametric equalizer",
+    .name = "parameq",
+    .flags = AF_FLAGS_INPLACE,
+    .open = af_open,
+    .priv_size = sizeof(struct priv),
+    .priv_defaults = &(const struct priv) {
+        .smooth = 0.05,
+    },
+    .options = (const struct m_option[]) {
+        OPT_STRINGLIST("bands", bands_opt, 0),
+        OPT_FLOATRANGE("smooth", smooth, 0, 0, 10),
+        {0}
+    },
+};
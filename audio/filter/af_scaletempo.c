@@ -33,12 +33,13 @@
 
 #include <stdlib.h>
 #include <string.h>
-#include <limits.h>
+#include <math.h>
 #include <assert.h>
 
 #include "common/common.h"
 
 #include "af.h"
+#include "dotprod.h"
 #include "options/m_option.h"
 
 // Data for specific instances of this filter
@@ -71,11 +72,13 @@ typedef struct af_scaletempo_s
     void *buf_pre_corr;
     void *table_window;
     int (*best_overlap_offset)(struct af_scaletempo_s *s);
+    const struct mp_dotprod_fns *dotprod;
     // command line
     float scale_nominal;
     float ms_stride;
     float percent_overlap;
     float ms_search;
+    int search_step;
     int speed_opt;
     short speed_tempo;
     short speed_pitch;
@@ -116,13 +119,51 @@ static int fill_queue(struct af_instance *af, struct mp_audio *data, int offset)
     return offset - offset_unchanged;
 }
 
-#define UNROLL_PADDING (4 * 4)
-
-static int best_overlap_offset_float(af_scaletempo_t *s)
+// Return the offset in frames into the queue at which the queued audio
+// correlates best with the overlap. corr() returns the correlation for one
+// offset. With search_step > 1, only every search_step-th offset is tried
+// first, and then the offsets around the best one.
+static int search_best_offset(af_scaletempo_t *s,
+                              double (*corr)(af_scaletempo_t *s, int off))
 {
-    float best_corr = INT_MIN;
+    int step = MPMIN(s->search_step, s->frames_search);
+    double best_corr = -INFINITY;
     int best_off = 0;
 
+    for (int off = 0; off < s->frames_search; off += step) {
+        double c = corr(s, off);
+        if (c > best_corr) {
+            best_corr = c;
+            best_off  = off;
+        }
+    }
+
+    if (step > 1) {
+        int center = best_off;
+        int end = MPMIN(center + step, s->frames_search);
+        for (int off = MPMAX(center - step + 1, 0); off < end; off++) {
+            if (off == center)
+                continue;
+            double c = corr(s, off);
+            if (c > best_corr) {
+                best_corr = c;
+                best_off  = off;
+            }
+        }
+    }
+
+    return best_off;
+}
+
+static double corr_float(af_scaletempo_t *s, int off)
+{
+    float *ps = (float *)s->buf_queue + (off + 1) * s->num_channels;
+    return s->dotprod->dot_float(s->buf_pre_corr, ps,
+                                 s->samples_overlap - s->num_channels);
+}
+
+static int best_overlap_offset_float(af_scaletempo_t *s)
+{
     float *pw  = s->table_window;
     float *po  = s->buf_overlap;
     po += s->num_channels;
@@ -130,28 +171,18 @@ static int best_overlap_offset_float(af_scaletempo_t *s)
     for (int i = s->num_channels; i < s->samples_overlap; i++)
         *ppc++ = *pw++ **po++;
 
-    float *search_start = (float *)s->buf_queue + s->num_channels;
-    for (int off = 0; off < s->frames_search; off++) {
-        float corr = 0;
-        float *ps = search_start;
-        ppc = s->buf_pre_corr;
-        for (int i = s->num_channels; i < s->samples_overlap; i++)
-            corr += *ppc++ **ps++;
-        if (corr > best_corr) {
-            best_corr = corr;
-            best_off  = off;
-        }
-        search_start += s->num_channels;
-    }
+    return search_best_offset(s, corr_float) * 4 * s->num_channels;
+}
 
-    return best_off * 4 * s->num_channels;
+static double corr_s16(af_scaletempo_t *s, int off)
+{
+    int16_t *ps = (int16_t *)s->buf_queue + (off + 1) * s->num_channels;
+    return s->dotprod->dot_s16(s->buf_pre_corr, ps,
+                               s->samples_overlap - s->num_channels);
 }
 
 static int best_overlap_offset_s16(af_scaletempo_t *s)
 {
-    int64_t best_corr = INT64_MIN;
-    int best_off = 0;
-
     int32_t *pw  = s->table_window;
     int16_t *po  = s->buf_overlap;
     po += s->num_channels;
@@ -159,29 +190,7 @@ static int best_overlap_offset_s16(af_scaletempo_t *s)
     for (long i = s->num_channels; i < s->samples_overlap; i++)
         *ppc++ = (*pw++ **po++) >> 15;
 
-    int16_t *search_start = (int16_t *)s->buf_queue + s->num_channels;
-    for (int off = 0; off < s->frames_search; off++) {
-        int64_t corr = 0;
-        int16_t *ps = search_start;
-        ppc = s->buf_pre_corr;
-        ppc += s->samples_overlap - s->num_channels;
-        ps  += s->samples_overlap - s->num_channels;
-        long i  = -(s->samples_overlap - s->num_channels);
-        do {
-            corr += ppc[i + 0] * ps[i + 0];
-            corr += ppc[i + 1] * ps[i + 1];
-            corr += ppc[i + 2] * ps[i + 2];
-            corr += ppc[i + 3] * ps[i + 3];
-            i += 4;
-        } while (i < 0);
-        if (corr > best_corr) {
-            best_corr = corr;
-            best_off  = off;
-        }
-        search_start += s->num_channels;
-    }
-
-    return best_off * 2 * s->num_channels;
+    return search_best_offset(s, corr_s16) * 2 * s->num_channels;
 }
 
 static void output_overlap_float(af_scaletempo_t *s, void *buf_out,
@@ -349,16 +358,13 @@ static int control(struct af_instance *af, int cmd, void *arg)
             if (use_int) {
                 int64_t t = frames_overlap;
                 int32_t n = 8589934588LL / (t * t); // 4 * (2^31 - 1) / t^2
-                s->buf_pre_corr = realloc(s->buf_pre_corr,
-                                          s->bytes_overlap * 2 + UNROLL_PADDING);
+                s->buf_pre_corr = realloc(s->buf_pre_corr, s->bytes_overlap * 2);
                 s->table_window = realloc(s->table_window,
                                           s->bytes_overlap * 2 - nch * bps * 2);
                 if (!s->buf_pre_corr || !s->table_window) {
                     MP_FATAL(af, "Out of memory\n");
                     return AF_ERROR;
                 }
-                memset((char *)s->buf_pre_corr + s->bytes_overlap * 2, 0,
-                       UNROLL_PADDING);
                 int32_t *pw = s->table_window;
                 for (int i = 1; i < frames_overlap; i++) {
                     int32_t v = (i * (t - i) * n) >> 15;
@@ -389,7 +395,7 @@ static int control(struct af_instance *af, int cmd, void *arg)
 
         s->bytes_queue = (s->frames_search + s->frames_stride + frames_overlap)
                          * bps * nch;
-        s->buf_queue = realloc(s->buf_queue, s->bytes_queue + UNROLL_PADDING);
+        s->buf_queue = realloc(s->buf_queue, s->bytes_queue);
         if (!s->buf_queue) {
             MP_FATAL(af, "Out of memory\n");
             return AF_ERROR;
@@ -458,6 +464,7 @@ static int af_open(struct af_instance *af)
     af->uninit    = uninit;
     af->filter    = filter;
 
+    s->dotprod = mp_dotprod_get_fns();
     s->speed_tempo = !!(s->speed_opt & SCALE_TEMPO);
     s->speed_pitch = !!(s->speed_opt & SCALE_PITCH);
 
@@ -470,12 +477,14 @@ static int af_open(struct af_instance *af)
 const struct af_info af_info_scaletempo = {
     .info = "Scale audio tempo while maintaining pitch",
     .name = "scaletempo",
+    .flags = AF_FLAGS_READONLY,
     .open = af_open,
     .priv_size = sizeof(af_scaletempo_t),
     .priv_defaults = &(const af_scaletempo_t) {
         .ms_stride = 60,
         .percent_overlap = .20,
         .ms_search = 14,
+        .search_step = 1,
         .speed_opt = SCALE_TEMPO,
         .speed = 1.0,
         .scale_nominal = 1.0,
@@ -485,6 +494,7 @@ const struct af_info af_info_scaletempo = {
         OPT_FLOAT("stride", ms_stride, M_OPT_MIN, .min = 0.01),
         OPT_FLOAT("overlap", percent_overlap, M_OPT_RANGE, .min = 0, .max = 1),
         OPT_FLOAT("search", ms_search, M_OPT_MIN, .min = 0),
+        OPT_INTRANGE("search-step", search_step, 0, 1, 64),
         OPT_CHOICE("speed", speed_opt, 0,
                    ({"pitch", SCALE_PITCH},
                     {"tempo", SCALE_TEMPO},
@@ -28,6 +28,7 @@
 
 #include "common/common.h"
 #include "af.h"
+#include "gain.h"
 #include "demux/demux.h"
 
 struct priv {
@@ -41,6 +42,7 @@ struct priv {
     int fast;                   // Use fix-point volume control
     int detach;                 // Detach if gain volume is neutral
     float cfg_volume;
+    const struct mp_gain_fns *fns;
 };
 
 static int control(struct af_instance *af, int cmd, void *arg)
@@ -100,25 +102,21 @@ static int control(struct af_instance *af, int cmd, void *arg)
 static void filter_plane(struct af_instance *af, void *ptr, int num_samples)
 {
     struct priv *s = af->priv;
+    const struct mp_gain_fns *fns = s->fns;
 
     float level = s->level * s->rgain;
 
     if (af_fmt_from_planar(af->data->format) == AF_FORMAT_S16) {
-        int16_t *a = ptr;
         int vol = 256.0 * level;
-        if (vol != 256) {
-            for (int i = 0; i < num_samples; i++) {
-                int x = (a[i] * vol) >> 8;
-                a[i] = MPCLAMP(x, SHRT_MIN, SHRT_MAX);
-            }
-        }
+        if (vol != 256)
+            fns->s16(ptr, num_samples, vol);
     } else if (af_fmt_from_planar(af->data->format) == AF_FORMAT_FLOAT) {
-        float *a = ptr;
         float vol = level;
         if (vol != 1.0) {
-            for (int i = 0; i < num_samples; i++) {
-                float x = a[i] * vol;
-                a[i] = s->soft ? af_softclip(x) : MPCLAMP(x, -1.0, 1.0);
+            if (s->soft) {
+                fns->softclip_float(ptr, num_samples, vol);
+            } else {
+                fns->clip_float(ptr, num_samples, vol);
             }
         }
     }
@@ -137,6 +135,7 @@ static int af_open(struct af_instance *af)
     struct priv *s = af->priv;
     af->control = control;
     af->filter = filter;
+    s->fns = mp_gain_get_fns();
     af_from_dB(1, &s->cfg_volume, &s->level, 20.0, -200.0, 60.0);
     return AF_OK;
 }
@@ -147,7 +146,7 @@ static int af_open(struct af_instance *af)
 const struct af_info af_info_volume = {
     .info = "Volume control audio filter",
     .name = "volume",
-    .flags = AF_FLAGS_NOT_REENTRANT,
+    .flags = AF_FLAGS_NOT_REENTRANT | AF_FLAGS_INPLACE,
     .open = af_open,
     .priv_size = sizeof(struct priv),
     .options = (const struct m_option[]) {
@@ -0,0 +1,253 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "config.h"
+#include "common/common.h"
+#include "biquad.h"
+
+#if HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+void mp_biquad_design(struct mp_biquad *bq, enum mp_biquad_type type,
+                      double freq, double gain, double q)
+{
+    double A = pow(10, gain / 40);
+    double w0 = 2 * M_PI * MPCLAMP(freq, 1e-5, 0.499);
+    double cw = cos(w0);
+    double alpha = sin(w0) / (2 * q);
+    double sa = 2 * sqrt(A) * alpha;
+    double b0, b1, b2, a0, a1, a2;
+
+    switch (type) {
+    case MP_BIQUAD_PEAK:
+        b0 = 1 + alpha * A;
+        b1 = -2 * cw;
+        b2 = 1 - alpha * A;
+        a0 = 1 + alpha / A;
+        a1 = -2 * cw;
+        a2 = 1 - alpha / A;
+        break;
+    case MP_BIQUAD_LOWSHELF:
+        b0 = A * ((A + 1) - (A - 1) * cw + sa);
+        b1 = 2 * A * ((A - 1) - (A + 1) * cw);
+        b2 = A * ((A + 1) - (A - 1) * cw - sa);
+        a0 = (A + 1) + (A - 1) * cw + sa;
+        a1 = -2 * ((A - 1) + (A + 1) * cw);
+        a2 = (A + 1) + (A - 1) * cw - sa;
+        break;
+    case MP_BIQUAD_HIGHSHELF:
+        b0 = A * ((A + 1) + (A - 1) * cw + sa);
+        b1 = -2 * A * ((A - 1) + (A + 1) * cw);
+        b2 = A * ((A + 1) + (A - 1) * cw - sa);
+        a0 = (A + 1) - (A - 1) * cw + sa;
+        a1 = 2 * ((A - 1) - (A + 1) * cw);
+        a2 = (A + 1) - (A - 1) * cw - sa;
+        break;
+    case MP_BIQUAD_NOTCH:
+    default:
+        b0 = 1;
+        b1 = -2 * cw;
+        b2 = 1;
+        a0 = 1 + alpha;
+        a1 = -2 * cw;
+        a2 = 1 - alpha;
+        break;
+    }
+
+    for (int n = 0; n < MP_BIQUAD_LANES; n++) {
+        bq->b0[n] = b0 / a0;
+        bq->b1[n] = b1 / a0;
+        bq->b2[n] = b2 / a0;
+        bq->a1[n] = a1 / a0;
+        bq->a2[n] = a2 / a0;
+    }
+}
+
+void mp_biquad_reset(struct mp_biquad *bq)
+{
+    memset(bq->z1, 0, sizeof(bq->z1));
+    memset(bq->z2, 0, sizeof(bq->z2));
+}
+
+// The sections are applied one after another to the whole buffer, so that
+// the state of a section can stay in registers.
+static void biquad_process(struct mp_biquad *bq, int num_bq, float *data,
+                           int nch, int num_frames)
+{
+    for (int b = 0; b < num_bq; b++) {
+        struct mp_biquad *q = &bq[b];
+        for (int c = 0; c < nch; c++) {
+            float b0 = q->b0[c], b1 = q->b1[c], b2 = q->b2[c];
+            float a1 = q->a1[c], a2 = q->a2[c];
+            float z1 = q->z1[c], z2 = q->z2[c];
+            float *p = data + c;
+            for (int i = 0; i < num_frames; i++, p += nch) {
+                float x = *p;
+                float y = b0 * x + z1;
+                z1 = b1 * x - a1 * y + z2;
+                z2 = b2 * x - a2 * y;
+                *p = y;
+            }
+            q->z1[c] = z1;
+            q->z2[c] = z2;
+        }
+    }
+}
+
+static const struct mp_biquad_fns biquad_fns_c = {
+    .name = "C",
+    .process = biquad_process,
+};
+
+#if HAVE_X86_SIMD
+
+// Process the lanes [lane, lane + vector width) of a buffer with stride
+// floats per frame. All of these lanes must be readable and writable.
+typedef void (*run_lanes_fn)(struct mp_biquad *bq, int num_bq, float *buf,
+                             int stride, int lane, int num_frames);
+
+static SSE2 void run_lanes_sse2(struct mp_biquad *bq, int num_bq, float *buf,
+                                int stride, int lane, int num_frames)
+{
+    for (int b = 0; b < num_bq; b++) {
+        struct mp_biquad *q = &bq[b];
+        __m128 b0 = _mm_loadu_ps(q->b0 + lane), b1 = _mm_loadu_ps(q->b1 + lane);
+        __m128 b2 = _mm_loadu_ps(q->b2 + lane);
+        __m128 a1 = _mm_loadu_ps(q->a1 + lane), a2 = _mm_loadu_ps(q->a2 + lane);
+        __m128 z1 = _mm_loadu_ps(q->z1 + lane), z2 = _mm_loadu_ps(q->z2 + lane);
+        float *p = buf + lane;
+        for (int i = 0; i < num_frames; i++, p += stride) {
+            __m128 x = _mm_loadu_ps(p);
+            __m128 y = _mm_add_ps(_mm_mul_ps(b0, x), z1);
+            z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, x), _mm_mul_ps(a1, y)), z2);
+            z2 = _mm_sub_ps(_mm_mul_ps(b2, x), _mm_mul_ps(a2, y));
+            _mm_storeu_ps(p, y);
+        }
+        _mm_storeu_ps(q->z1 + lane, z1);
+        _mm_storeu_ps(q->z2 + lane, z2);
+    }
+}
+
+static AVX2 void run_lanes_avx2(struct mp_biquad *bq, int num_bq, float *buf,
+                                int stride, int lane, int num_frames)
+{
+    for (int b = 0; b < num_bq; b++) {
+        struct mp_biquad *q = &bq[b];
+        __m256 b0 = _mm256_loadu_ps(q->b0 + lane);
+        __m256 b1 = _mm256_loadu_ps(q->b1 + lane);
+        __m256 b2 = _mm256_loadu_ps(q->b2 + lane);
+        __m256 a1 = _mm256_loadu_ps(q->a1 + lane);
+        __m256 a2 = _mm256_loadu_ps(q->a2 + lane);
+        __m256 z1 = _mm256_loadu_ps(q->z1 + lane);
+        __m256 z2 = _mm256_loadu_ps(q->z2 + lane);
+        float *p = buf + lane;
+        for (int i = 0; i < num_frames; i++, p += stride) {
+            __m256 x = _mm256_loadu_ps(p);
+            // no FMA, so that the result matches the C version
+            __m256 y = _mm256_add_ps(_mm256_mul_ps(b0, x), z1);
+            z1 = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(b1, x),
+                                             _mm256_mul_ps(a1, y)), z2);
+            z2 = _mm256_sub_ps(_mm256_mul_ps(b2, x), _mm256_mul_ps(a2, y));
+            _mm256_storeu_ps(p, y);
+        }
+        _mm256_storeu_ps(q->z1 + lane, z1);
+        _mm256_storeu_ps(q->z2 + lane, z2);
+    }
+}
+
+// When the input becomes silent, the state decays into denormals, which are
+// very slow on x86. Flush them to zero while filtering. (Denormals are far
+// below the precision of any audio output.)
+static SSE2 unsigned int enable_ftz(void)
+{
+    unsigned int csr = _mm_getcsr();
+    _mm_setcsr(csr | _MM_FLUSH_ZERO_ON);
+    return csr;
+}
+
+#define PAD_FRAMES 256
+
+// If nch is not a multiple of the vector width, vectors would straddle
+// frames. Copy the audio into a buffer padded to whole vectors instead. The
+// padding lanes are filtered too, but the results are thrown away.
+static void run_padded(run_lanes_fn run, int width, struct mp_biquad *bq,
+                       int num_bq, float *data, int nch, int num_frames)
+{
+    int stride = (nch + width - 1) / width * width;
+    float tmp[PAD_FRAMES * MP_BIQUAD_LANES];
+    for (int pos = 0; pos < num_frames; pos += PAD_FRAMES) {
+        int n = MPMIN(num_frames - pos, PAD_FRAMES);
+        float *d = data + pos * nch;
+        for (int i = 0; i < n; i++) {
+            memcpy(tmp + i * stride, d + i * nch, nch * sizeof(float));
+            memset(tmp + i * stride + nch, 0, (stride - nch) * sizeof(float));
+        }
+        for (int lane = 0; lane < stride; lane += width)
+            run(bq, num_bq, tmp, stride, lane, n);
+        for (int i = 0; i < n; i++)
+            memcpy(d + i * nch, tmp + i * stride, nch * sizeof(float));
+    }
+}
+
+static SSE2 void biquad_process_sse2(struct mp_biquad *bq, int num_bq,
+                                     float *data, int nch, int num_frames)
+{
+    unsigned int csr = enable_ftz();
+    if (nch % 4) {
+        run_padded(run_lanes_sse2, 4, bq, num_bq, data, nch, num_frames);
+    } else {
+        for (int lane = 0; lane < nch; lane += 4)
+            run_lanes_sse2(bq, num_bq, data, nch, lane, num_frames);
+    }
+    _mm_setcsr(csr);
+}
+
+static AVX2 void biquad_process_avx2(struct mp_biquad *bq, int num_bq,
+                                     float *data, int nch, int num_frames)
+{
+    // half of the lanes would be wasted
+    if (nch <= 4) {
+        biquad_process_sse2(bq, num_bq, data, nch, num_frames);
+        return;
+    }
+    unsigned int csr = enable_ftz();
+    if (nch % 8) {
+        run_padded(run_lanes_avx2, 8, bq, num_bq, data, nch, num_frames);
+    } else {
+        run_lanes_avx2(bq, num_bq, data, nch, 0, num_frames);
+    }
+    _mm_setcsr(csr);
+}
+
+static const struct mp_biquad_fns biquad_fns_sse2 = {
+    .name = "SSE2",
+    .process = biquad_process_sse2,
+};
+
+static const struct mp_biquad_fns biquad_fns_avx2 = {
+    .name = "AVX2",
+    .process = biquad_process_avx2,
+};
+
+#endif /* HAVE_X86_SIMD */
+
+MP_SIMD_DEFINE(biquad)
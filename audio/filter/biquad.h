@@ -0,0 +1,48 @@
+#ifndef MPLAYER_AF_BIQUAD_H
+#define MPLAYER_AF_BIQUAD_H
+
+#include "misc/simd.h"
+
+// Maximum number of channels, each of which is a lane in a SIMD vector.
+#define MP_BIQUAD_LANES 8
+
+// A 2nd order IIR section (transposed direct form II) with separate
+// coefficients and state for each channel. The coefficients are normalized
+// so that a0 is 1.
+struct mp_biquad {
+    float b0[MP_BIQUAD_LANES], b1[MP_BIQUAD_LANES], b2[MP_BIQUAD_LANES];
+    float a1[MP_BIQUAD_LANES], a2[MP_BIQUAD_LANES];
+    float z1[MP_BIQUAD_LANES], z2[MP_BIQUAD_LANES];
+};
+
+enum mp_biquad_type {
+    MP_BIQUAD_PEAK,
+    MP_BIQUAD_LOWSHELF,
+    MP_BIQUAD_HIGHSHELF,
+    MP_BIQUAD_NOTCH,
+};
+
+// Set the coefficients of all lanes (formulas from the "Audio EQ Cookbook" by
+// Robert Bristow-Johnson). freq is relative to the sample rate, gain is in dB
+// (ignored for notch filters). The state is not changed.
+void mp_biquad_design(struct mp_biquad *bq, enum mp_biquad_type type,
+                      double freq, double gain, double q);
+
+// Clear the state of all lanes.
+void mp_biquad_reset(struct mp_biquad *bq);
+
+// Inner loop of af_parameq.c. The plain C version serves as reference; the
+// SIMD versions process the channels in parallel lanes, and compute the same
+// operations in the same order. The results are identical, except that the
+// SIMD versions flush denormals to zero.
+struct mp_biquad_fns {
+    const char *name;
+    // Run interleaved float audio with nch (<= MP_BIQUAD_LANES) channels
+    // through a cascade of num_bq sections, in place.
+    void (*process)(struct mp_biquad *bq, int num_bq, float *data, int nch,
+                    int num_frames);
+};
+
+MP_SIMD_DECLARE(biquad)
+
+#endif /* MPLAYER_AF_BIQUAD_H */
@@ -0,0 +1,188 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+#include <assert.h>
+
+#include <libavutil/common.h>
+#include <libavcodec/avfft.h>
+
+#include "talloc.h"
+#include "common/common.h"
+#include "convolve.h"
+
+// Spectra use the av_rdft layout: fft_size floats, [0] is the DC and [1] the
+// Nyquist coefficient (both real), followed by (re, im) pairs for the other
+// bins.
+
+struct mp_convolver {
+    int block;      // partition size
+    int fft_size;   // 2 * block
+    RDFTContext *rdft, *irdft;
+};
+
+struct mp_conv_ir {
+    struct mp_convolver *c;
+    int num_parts;
+    float **parts;
+};
+
+struct mp_conv_input {
+    struct mp_convolver *c;
+    float *window;  // previous and current input block
+    int num_parts;
+    float **spectra; // spectra of the last num_parts input windows
+    int pos;        // index of the newest entry in spectra
+};
+
+struct mp_conv_output {
+    struct mp_convolver *c;
+    float *acc;
+};
+
+static void destroy_convolver(void *ptr)
+{
+    struct mp_convolver *c = ptr;
+    if (c->rdft)
+        av_rdft_end(c->rdft);
+    if (c->irdft)
+        av_rdft_end(c->irdft);
+}
+
+struct mp_convolver *mp_convolver_create(void *talloc_ctx, int block_size)
+{
+    int bits = av_log2(block_size);
+    if (block_size < MP_CONV_MIN_BLOCK || block_size > MP_CONV_MAX_BLOCK ||
+        (1 << bits) != block_size)
+        return NULL;
+    struct mp_convolver *c = talloc_zero(talloc_ctx, struct mp_convolver);
+    talloc_set_destructor(c, destroy_convolver);
+    c->block = block_size;
+    c->fft_size = block_size * 2;
+    c->rdft = av_rdft_init(bits + 1, DFT_R2C);
+    c->irdft = av_rdft_init(bits + 1, IDFT_C2R);
+    if (!c->rdft || !c->irdft) {
+        talloc_free(c);
+        return NULL;
+    }
+    return c;
+}
+
+int mp_convolver_block_size(struct mp_convolver *c)
+{
+    return c->block;
+}
+
+static float *alloc_spectrum(void *ta, struct mp_convolver *c)
+{
+    return talloc_zero_array(ta, float, c->fft_size);
+}
+
+struct mp_conv_ir *mp_conv_ir_create(struct mp_convolver *c, const float *ir,
+                                     int len)
+{
+    struct mp_conv_ir *h = talloc_zero(c, struct mp_conv_ir);
+    h->c = c;
+    h->num_parts = MPMAX((len + c->block - 1) / c->block, 1);
+    h->parts = talloc_array(h, float *, h->num_parts);
+    // The inverse transform scales by fft_size / 2; compensate here.
+    float scale = 2.0f / c->fft_size;
+    for (int p = 0; p < h->num_parts; p++) {
+        float *s = alloc_spectrum(h, c);
+        int n = MPMIN(len - p * c->block, c->block);
+        for (int i = 0; i < n; i++)
+            s[i] = ir[p * c->block + i] * scale;
+        // the second half stays 0 (overlap-save needs a zero padded kernel)
+        av_rdft_calc(c->rdft, s);
+        h->parts[p] = s;
+    }
+    return h;
+}
+
+struct mp_conv_input *mp_conv_input_create(struct mp_convolver *c,
+                                           int max_ir_len)
+{
+    struct mp_conv_input *in = talloc_zero(c, struct mp_conv_input);
+    in->c = c;
+    in->window = alloc_spectrum(in, c);
+    in->num_parts = MPMAX((max_ir_len + c->block - 1) / c->block, 1);
+    in->spectra = talloc_array(in, float *, in->num_parts);
+    for (int p = 0; p < in->num_parts; p++)
+        in->spectra[p] = alloc_spectrum(in, c);
+    return in;
+}
+
+void mp_conv_input_push(struct mp_conv_input *in, const float *src)
+{
+    struct mp_convolver *c = in->c;
+    memmove(in->window, in->window + c->block, c->block * sizeof(float));
+    memcpy(in->window + c->block, src, c->block * sizeof(float));
+    in->pos = (in->pos + in->num_parts - 1) % in->num_parts;
+    float *s = in->spectra[in->pos];
+    memcpy(s, in->window, c->fft_size * sizeof(float));
+    av_rdft_calc(c->rdft, s);
+}
+
+void mp_conv_input_reset(struct mp_conv_input *in)
+{
+    struct mp_convolver *c = in->c;
+    memset(in->window, 0, c->fft_size * sizeof(float));
+    for (int p = 0; p < in->num_parts; p++)
+        memset(in->spectra[p], 0, c->fft_size * sizeof(float));
+}
+
+struct mp_conv_output *mp_conv_output_create(struct mp_convolver *c)
+{
+    struct mp_conv_output *out = talloc_zero(c, struct mp_conv_output);
+    out->c = c;
+    out->acc = alloc_spectrum(out, c);
+    return out;
+}
+
+// acc += x * h (complex, av_rdft layout)
+static void cmac(float *restrict acc, const float *restrict x,
+                 const float *restrict h, int fft_size)
+{
+    acc[0] += x[0] * h[0];
+    acc[1] += x[1] * h[1];
+    for (int i = 2; i < fft_size; i += 2) {
+        acc[i]     += x[i] * h[i]     - x[i + 1] * h[i + 1];
+        acc[i + 1] += x[i] * h[i + 1] + x[i + 1] * h[i];
+    }
+}
+
+void mp_conv_output_add(struct mp_conv_output *out, struct mp_conv_input *in,
+                        struct mp_conv_ir *ir)
+{
+    struct mp_convolver *c = out->c;
+    assert(in->c == c && ir->c == c);
+    int num_parts = MPMIN(in->num_parts, ir->num_parts);
+    for (int p = 0; p < num_parts; p++) {
+        float *x = in->spectra[(in->pos + p) % in->num_parts];
+        cmac(out->acc, x, ir->parts[p], c->fft_size);
+    }
+}
+
+void mp_conv_output_finish(struct mp_conv_output *out, float *dst)
+{
+    struct mp_convolver *c = out->c;
+    av_rdft_calc(c->irdft, out->acc);
+    // The first half is the circular wraparound of the previous block.
+    memcpy(dst, out->acc + c->block, c->block * sizeof(float));
+    memset(out->acc, 0, c->fft_size * sizeof(float));
+}
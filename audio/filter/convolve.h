@@ -0,0 +1,53 @@
+#ifndef MPLAYER_AF_CONVOLVE_H
+#define MPLAYER_AF_CONVOLVE_H
+
+// Uniformly partitioned convolution (frequency domain overlap-save).
+//
+// The signal is processed in blocks of block_size samples. Impulse responses
+// are split into partitions of block_size samples, and each partition is
+// multiplied with the spectrum of the matching older input block. The cost
+// per sample grows only with the number of partitions, and the latency is
+// one block regardless of the impulse response length.
+//
+// An output can be the sum of several convolutions (e.g. a mixing matrix like
+// in af_hrtf). This costs one FFT per input block, one inverse FFT per output
+// block, and a complex multiply-add per convolution and partition.
+//
+// All objects created from a mp_convolver are talloc children of it.
+
+struct mp_convolver;
+struct mp_conv_ir;      // partitioned impulse response spectra
+struct mp_conv_input;   // frequency domain delay line of an input signal
+struct mp_conv_output;  // frequency domain accumulator of an output signal
+
+// block_size must be a power of 2 between MP_CONV_MIN_BLOCK and
+// MP_CONV_MAX_BLOCK. Returns NULL if the FFT can't be initialized.
+struct mp_convolver *mp_convolver_create(void *talloc_ctx, int block_size);
+int mp_convolver_block_size(struct mp_convolver *c);
+
+#define MP_CONV_MIN_BLOCK 16
+#define MP_CONV_MAX_BLOCK 32768
+
+// Copies and transforms ir[0..len-1].
+struct mp_conv_ir *mp_conv_ir_create(struct mp_convolver *c, const float *ir,
+                                     int len);
+
+// max_ir_len is the length of the longest impulse response this input is
+// convolved with. Longer impulse responses are truncated.
+struct mp_conv_input *mp_conv_input_create(struct mp_convolver *c,
+                                           int max_ir_len);
+// Append the next block_size samples of the input signal.
+void mp_conv_input_push(struct mp_conv_input *in, const float *src);
+// Forget the signal history (as if silence was pushed).
+void mp_conv_input_reset(struct mp_conv_input *in);
+
+struct mp_conv_output *mp_conv_output_create(struct mp_convolver *c);
+// Add the convolution of the input with ir to the current output block. Call
+// after pushing the input block.
+void mp_conv_output_add(struct mp_conv_output *out, struct mp_conv_input *in,
+                        struct mp_conv_ir *ir);
+// Write the current output block (block_size samples) to dst, and start the
+// next block.
+void mp_conv_output_finish(struct mp_conv_output *out, float *dst);
+
+#endif /* MPLAYER_AF_CONVOLVE_H */
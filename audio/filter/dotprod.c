@@ -0,0 +1,120 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+#include "dotprod.h"
+
+#if HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+static float dot_float(const float *a, const float *b, int num)
+{
+    float sum = 0;
+    for (int i = 0; i < num; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+static int64_t dot_s16(const int32_t *a, const int16_t *b, int num)
+{
+    int64_t sum = 0;
+    for (int i = 0; i < num; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+static const struct mp_dotprod_fns dotprod_fns_c = {
+    .name = "C",
+    .dot_float = dot_float,
+    .dot_s16 = dot_s16,
+};
+
+#if HAVE_X86_SIMD
+
+// dot_float keeps two vector accumulators to hide the add latency, and sums
+// the tail with the C function. SSE2 has no signed 32 bit multiply with 64 bit
+// result, so dot_s16 is vectorized with AVX2 only.
+
+static SSE2 float dot_float_sse2(const float *a, const float *b, int num)
+{
+    __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= num; i += 8) {
+        s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i),
+                                       _mm_loadu_ps(b + i)));
+        s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4),
+                                       _mm_loadu_ps(b + i + 4)));
+    }
+    float v[4];
+    _mm_storeu_ps(v, _mm_add_ps(s0, s1));
+    return (v[0] + v[1]) + (v[2] + v[3]) + dot_float(a + i, b + i, num - i);
+}
+
+static AVX2 float dot_float_avx2(const float *a, const float *b, int num)
+{
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= num; i += 16) {
+        s0 = _mm256_add_ps(s0, _mm256_mul_ps(_mm256_loadu_ps(a + i),
+                                             _mm256_loadu_ps(b + i)));
+        s1 = _mm256_add_ps(s1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8),
+                                             _mm256_loadu_ps(b + i + 8)));
+    }
+    __m256 s = _mm256_add_ps(s0, s1);
+    __m128 h = _mm_add_ps(_mm256_castps256_ps128(s),
+                          _mm256_extractf128_ps(s, 1));
+    float v[4];
+    _mm_storeu_ps(v, h);
+    return (v[0] + v[1]) + (v[2] + v[3]) + dot_float(a + i, b + i, num - i);
+}
+
+static AVX2 int64_t dot_s16_avx2(const int32_t *a, const int16_t *b, int num)
+{
+    __m256i sum = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 8 <= num; i += 8) {
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i vb = _mm256_cvtepi16_epi32(
+                        _mm_loadu_si128((const __m128i *)(b + i)));
+        // mul_epi32 multiplies the even 32 bit lanes to 64 bit results
+        __m256i even = _mm256_mul_epi32(va, vb);
+        __m256i odd = _mm256_mul_epi32(_mm256_srli_epi64(va, 32),
+                                       _mm256_srli_epi64(vb, 32));
+        sum = _mm256_add_epi64(sum, _mm256_add_epi64(even, odd));
+    }
+    int64_t v[4];
+    _mm256_storeu_si256((__m256i *)v, sum);
+    return v[0] + v[1] + v[2] + v[3] + dot_s16(a + i, b + i, num - i);
+}
+
+static const struct mp_dotprod_fns dotprod_fns_sse2 = {
+    .name = "SSE2",
+    .dot_float = dot_float_sse2,
+    .dot_s16 = dot_s16,
+};
+
+static const struct mp_dotprod_fns dotprod_fns_avx2 = {
+    .name = "AVX2",
+    .dot_float = dot_float_avx2,
+    .dot_s16 = dot_s16_avx2,
+};
+
+#endif /* HAVE_X86_SIMD */
+
+MP_SIMD_DEFINE(dotprod)
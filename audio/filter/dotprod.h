@@ -0,0 +1,21 @@
+#ifndef MPLAYER_AF_DOTPROD_H
+#define MPLAYER_AF_DOTPROD_H
+
+#include <stdint.h>
+
+#include "misc/simd.h"
+
+// Dot products used by the scaletempo correlation search. The plain C
+// versions serve as reference. dot_s16 is exact in all implementations;
+// the float versions sum in a different order, so the results can differ in
+// the last bits.
+struct mp_dotprod_fns {
+    const char *name;
+    float (*dot_float)(const float *a, const float *b, int num);
+    // Each product must fit into int32_t.
+    int64_t (*dot_s16)(const int32_t *a, const int16_t *b, int num);
+};
+
+MP_SIMD_DECLARE(dotprod)
+
+#endif /* MPLAYER_AF_DOTPROD_H */
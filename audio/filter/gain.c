@@ -0,0 +1,205 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <limits.h>
+#include <math.h>
+
+#include "config.h"
+#include "common/common.h"
+#include "af.h"
+#include "gain.h"
+
+#if HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+static void gain_s16(int16_t *a, int num_samples, int vol)
+{
+    for (int i = 0; i < num_samples; i++) {
+        int x = (a[i] * vol) >> 8;
+        a[i] = MPCLAMP(x, SHRT_MIN, SHRT_MAX);
+    }
+}
+
+static void gain_clip_float(float *a, int num_samples, float vol)
+{
+    for (int i = 0; i < num_samples; i++) {
+        float x = a[i] * vol;
+        a[i] = MPCLAMP(x, -1.0, 1.0);
+    }
+}
+
+static void gain_softclip_float(float *a, int num_samples, float vol)
+{
+    for (int i = 0; i < num_samples; i++)
+        a[i] = af_softclip(a[i] * vol);
+}
+
+static const struct mp_gain_fns gain_fns_c = {
+    .name = "C",
+    .s16 = gain_s16,
+    .clip_float = gain_clip_float,
+    .softclip_float = gain_softclip_float,
+};
+
+#if HAVE_X86_SIMD
+
+// Each step handles 8 (SSE2) or 16 (AVX2) s16 samples, or 4 or 8 floats; the
+// C functions above handle the remaining samples.
+
+// Taylor series of sin(x) up to x^11; on [-pi/2, pi/2] the truncation error
+// is below 6e-8, which is about the float precision around 1.0.
+#define SIN_C3  (-1.0f / 6)
+#define SIN_C5  (1.0f / 120)
+#define SIN_C7  (-1.0f / 5040)
+#define SIN_C9  (1.0f / 362880)
+#define SIN_C11 (-1.0f / 39916800)
+
+// The products fit into 32 bits only if vol fits into 16 bits.
+#define S16_MAX_VOL 0x7FFF
+
+static SSE2 void gain_s16_sse2(int16_t *a, int num_samples, int vol)
+{
+    if (vol > S16_MAX_VOL) {
+        gain_s16(a, num_samples, vol);
+        return;
+    }
+    const __m128i v = _mm_set1_epi16(vol);
+    int i = 0;
+    for (; i + 8 <= num_samples; i += 8) {
+        __m128i x = _mm_loadu_si128((__m128i *)(a + i));
+        __m128i lo = _mm_mullo_epi16(x, v), hi = _mm_mulhi_epi16(x, v);
+        __m128i p0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 8);
+        __m128i p1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 8);
+        // packs saturates, which is the same as clamping
+        _mm_storeu_si128((__m128i *)(a + i), _mm_packs_epi32(p0, p1));
+    }
+    gain_s16(a + i, num_samples - i, vol);
+}
+
+static SSE2 void gain_clip_float_sse2(float *a, int num_samples, float vol)
+{
+    const __m128 v = _mm_set1_ps(vol);
+    const __m128 lo = _mm_set1_ps(-1.0f), hi = _mm_set1_ps(1.0f);
+    int i = 0;
+    for (; i + 4 <= num_samples; i += 4) {
+        __m128 x = _mm_mul_ps(_mm_loadu_ps(a + i), v);
+        _mm_storeu_ps(a + i, _mm_min_ps(_mm_max_ps(x, lo), hi));
+    }
+    gain_clip_float(a + i, num_samples - i, vol);
+}
+
+static inline SSE2 __m128 softclip_sse2(__m128 x)
+{
+    const __m128 lim = _mm_set1_ps(M_PI / 2);
+    x = _mm_min_ps(_mm_max_ps(x, _mm_sub_ps(_mm_setzero_ps(), lim)), lim);
+    __m128 x2 = _mm_mul_ps(x, x);
+    __m128 p = _mm_set1_ps(SIN_C11);
+    p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(SIN_C9));
+    p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(SIN_C7));
+    p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(SIN_C5));
+    p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(SIN_C3));
+    p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(1.0f));
+    p = _mm_mul_ps(p, x);
+    return _mm_min_ps(_mm_max_ps(p, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+}
+
+static SSE2 void gain_softclip_float_sse2(float *a, int num_samples, float vol)
+{
+    const __m128 v = _mm_set1_ps(vol);
+    int i = 0;
+    for (; i + 4 <= num_samples; i += 4) {
+        __m128 x = _mm_mul_ps(_mm_loadu_ps(a + i), v);
+        _mm_storeu_ps(a + i, softclip_sse2(x));
+    }
+    gain_softclip_float(a + i, num_samples - i, vol);
+}
+
+static AVX2 void gain_s16_avx2(int16_t *a, int num_samples, int vol)
+{
+    if (vol > S16_MAX_VOL) {
+        gain_s16(a, num_samples, vol);
+        return;
+    }
+    const __m256i v = _mm256_set1_epi16(vol);
+    int i = 0;
+    for (; i + 16 <= num_samples; i += 16) {
+        __m256i x = _mm256_loadu_si256((__m256i *)(a + i));
+        __m256i lo = _mm256_mullo_epi16(x, v), hi = _mm256_mulhi_epi16(x, v);
+        // unpack and packs work per 128 bit lane, so the order is preserved
+        __m256i p0 = _mm256_srai_epi32(_mm256_unpacklo_epi16(lo, hi), 8);
+        __m256i p1 = _mm256_srai_epi32(_mm256_unpackhi_epi16(lo, hi), 8);
+        _mm256_storeu_si256((__m256i *)(a + i), _mm256_packs_epi32(p0, p1));
+    }
+    gain_s16_sse2(a + i, num_samples - i, vol);
+}
+
+static AVX2 void gain_clip_float_avx2(float *a, int num_samples, float vol)
+{
+    const __m256 v = _mm256_set1_ps(vol);
+    const __m256 lo = _mm256_set1_ps(-1.0f), hi = _mm256_set1_ps(1.0f);
+    int i = 0;
+    for (; i + 8 <= num_samples; i += 8) {
+        __m256 x = _mm256_mul_ps(_mm256_loadu_ps(a + i), v);
+        _mm256_storeu_ps(a + i, _mm256_min_ps(_mm256_max_ps(x, lo), hi));
+    }
+    gain_clip_float(a + i, num_samples - i, vol);
+}
+
+static AVX2 void gain_softclip_float_avx2(float *a, int num_samples, float vol)
+{
+    const __m256 v = _mm256_set1_ps(vol);
+    const __m256 lim = _mm256_set1_ps(M_PI / 2);
+    const __m256 nlim = _mm256_set1_ps(-M_PI / 2);
+    int i = 0;
+    for (; i + 8 <= num_samples; i += 8) {
+        __m256 x = _mm256_mul_ps(_mm256_loadu_ps(a + i), v);
+        x = _mm256_min_ps(_mm256_max_ps(x, nlim), lim);
+        __m256 x2 = _mm256_mul_ps(x, x);
+        __m256 p = _mm256_set1_ps(SIN_C11);
+        // no FMA, so that the result matches the SSE2 version
+        p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(SIN_C9));
+        p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(SIN_C7));
+        p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(SIN_C5));
+        p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(SIN_C3));
+        p = _mm256_add_ps(_mm256_mul_ps(p, x2), _mm256_set1_ps(1.0f));
+        p = _mm256_mul_ps(p, x);
+        p = _mm256_min_ps(_mm256_max_ps(p, _mm256_set1_ps(-1.0f)),
+                          _mm256_set1_ps(1.0f));
+        _mm256_storeu_ps(a + i, p);
+    }
+    gain_softclip_float_sse2(a + i, num_samples - i, vol);
+}
+
+static const struct mp_gain_fns gain_fns_sse2 = {
+    .name = "SSE2",
+    .s16 = gain_s16_sse2,
+    .clip_float = gain_clip_float_sse2,
+    .softclip_float = gain_softclip_float_sse2,
+};
+
+static const struct mp_gain_fns gain_fns_avx2 = {
+    .name = "AVX2",
+    .s16 = gain_s16_avx2,
+    .clip_float = gain_clip_float_avx2,
+    .softclip_float = gain_softclip_float_avx2,
+};
+
+#endif /* HAVE_X86_SIMD */
+
+MP_SIMD_DEFINE(gain)
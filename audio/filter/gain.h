@@ -0,0 +1,24 @@
+#ifndef MPLAYER_AF_GAIN_H
+#define MPLAYER_AF_GAIN_H
+
+#include <stdint.h>
+
+#include "misc/simd.h"
+
+// Inner loops used by af_volume.c. The plain C versions serve as reference.
+// s16 and clip_float are bit-identical across implementations; the SIMD
+// softclip_float uses a polynomial instead of sin(), and differs from the
+// reference by at most a few float ulps.
+struct mp_gain_fns {
+    const char *name;
+    // a[i] = clamp((a[i] * vol) >> 8) for vol >= 0 (vol=256 means 1.0)
+    void (*s16)(int16_t *a, int num_samples, int vol);
+    // a[i] = clamp(a[i] * vol, -1, 1)
+    void (*clip_float)(float *a, int num_samples, float vol);
+    // a[i] = af_softclip(a[i] * vol)
+    void (*softclip_float)(float *a, int num_samples, float vol);
+};
+
+MP_SIMD_DECLARE(gain)
+
+#endif /* MPLAYER_AF_GAIN_H */
@@ -392,6 +392,14 @@ bool ao_eof_reached(struct ao *ao)
     return ao->api->get_eof ? ao->api->get_eof(ao) : true;
 }
 
+// Get the xrun and callback timing statistics. Returns false if the AO
+// doesn't use an audio callback.
+bool ao_get_stats(struct ao *ao, struct ao_stats *stats)
+{
+    *stats = (struct ao_stats){0};
+    return ao->api->get_stats ? ao->api->get_stats(ao, stats) : false;
+}
+
 // Query the AO_EVENT_*s as requested by the events parameter, and return them.
 int ao_query_and_reset_events(struct ao *ao, int events)
 {
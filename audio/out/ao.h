@@ -20,6 +20,7 @@
 #define MPLAYER_AUDIO_OUT_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "misc/bstr.h"
 #include "common/common.h"
@@ -55,6 +56,18 @@ typedef struct ao_control_vol {
     float right;
 } ao_control_vol_t;
 
+#define AO_STATS_HIST_SIZE 16
+
+// Statistics of AOs using an audio callback (see ao_get_stats()).
+struct ao_stats {
+    // Number of times the buffer ran empty while playing.
+    uint64_t xruns;
+    // Number of audio callbacks by the time spent in them: entry 0 counts
+    // calls that took less than 1us, entry n calls that took [2^(n-1), 2^n)
+    // microseconds, and the last entry also all slower calls.
+    uint64_t callback_hist[AO_STATS_HIST_SIZE];
+};
+
 struct ao_device_desc {
     const char *name;   // symbolic name; will be set on ao->device
     const char *desc;   // verbose human readable name
@@ -91,6 +104,7 @@ void ao_drain(struct ao *ao);
 bool ao_eof_reached(struct ao *ao);
 int ao_query_and_reset_events(struct ao *ao, int events);
 void ao_request_reload(struct ao *ao);
+bool ao_get_stats(struct ao *ao, struct ao_stats *stats);
 
 struct ao_device_list *ao_get_device_list(struct mpv_global *global);
 void ao_print_devices(struct mpv_global *global, struct mp_log *log);
@@ -41,13 +41,16 @@
 #include "common/encode_lavc.h"
 
 struct priv {
+    // Accessed by the encoder thread only (once it has been created).
     uint8_t *buffer;
     size_t buffer_size;
+    int64_t savepts;
+
     AVStream *stream;
+    struct encode_lavc_worker *worker;
     int pcmhack;
     int aframesize;
     int aframecount;
-    int64_t savepts;
     int framecount;
     int64_t lastpts;
     int sample_size;
@@ -60,6 +63,15 @@ struct priv {
     bool shutdown;
 };
 
+// A frame of exactly ac->aframesize samples; a NULL job flushes the encoder.
+struct ao_job {
+    int64_t pts;        // in codec time base
+    double apts, realapts;
+    void *data[MP_NUM_CHANNELS];
+};
+
+static void encode_job(void *priv, void *p);
+
 static void select_format(struct ao *ao, AVCodec *codec)
 {
     int best_score = INT_MIN;
@@ -171,6 +183,9 @@ static int init(struct ao *ao)
 
     ao->untimed = true;
 
+    ac->worker = encode_lavc_worker_create(ao->encode_lavc_ctx, encode_job,
+                                           ao, 32);
+
     pthread_mutex_unlock(&ao->encode_lavc_ctx->lock);
     return 0;
 
@@ -181,7 +196,6 @@ fail:
 }
 
 // close audio device
-static int encode(struct ao *ao, double apts, void **data);
 static void uninit(struct ao *ao)
 {
     struct priv *ac = ao->priv;
@@ -195,19 +209,19 @@ static void uninit(struct ao *ao)
     if (!encode_lavc_start(ectx)) {
         MP_WARN(ao, "not even ready to encode audio at end -> dropped\n");
         pthread_mutex_unlock(&ectx->lock);
+        encode_lavc_worker_destroy(ac->worker);
+        ac->worker = NULL;
         return;
     }
 
-    if (ac->buffer) {
-        double outpts = ac->expected_next_pts;
-        if (!ectx->options->rawts && ectx->options->copyts)
-            outpts += ectx->discontinuity_pts_offset;
-        outpts += encode_lavc_getoffset(ectx, ac->stream);
-        while (encode(ao, outpts, NULL) > 0) ;
-    }
+    if (ac->buffer)
+        encode_lavc_worker_queue(ac->worker, NULL);
 
     pthread_mutex_unlock(&ectx->lock);
 
+    encode_lavc_worker_destroy(ac->worker);
+    ac->worker = NULL;
+
     ac->shutdown = true;
 }
 
@@ -219,54 +233,32 @@ static int get_space(struct ao *ao)
     return ac->aframesize * ac->framecount;
 }
 
-// must get exactly ac->aframesize amount of data
-static int encode(struct ao *ao, double apts, void **data)
+// Called on the encoder thread, without the encode_lavc_context lock.
+// Returns the packet size, 0 if no packet was output, or -1 on error.
+static int encode_frame(struct ao *ao, struct ao_job *job)
 {
     AVPacket packet;
     struct priv *ac = ao->priv;
-    struct encode_lavc_context *ectx = ao->encode_lavc_ctx;
-    double realapts = ac->aframecount * (double) ac->aframesize /
-                      ao->samplerate;
     int status, gotpacket;
 
-    ac->aframecount++;
-
-    if (data)
-        ectx->audio_pts_offset = realapts - apts;
-
     av_init_packet(&packet);
     packet.data = ac->buffer;
     packet.size = ac->buffer_size;
-    if(data) {
+    if (job) {
         AVFrame *frame = av_frame_alloc();
+        if (!frame)
+            return -1;
         frame->format = af_to_avformat(ao->format);
         frame->nb_samples = ac->aframesize;
 
         size_t num_planes = af_fmt_is_planar(ao->format) ? ao->channels.num : 1;
         assert(num_planes <= AV_NUM_DATA_POINTERS);
         for (int n = 0; n < num_planes; n++)
-            frame->extended_data[n] = data[n];
+            frame->extended_data[n] = job->data[n];
 
         frame->linesize[0] = frame->nb_samples * ao->sstride;
 
-        if (ectx->options->rawts || ectx->options->copyts) {
-            // real audio pts
-            frame->pts = floor(apts * ac->stream->codec->time_base.den / ac->stream->codec->time_base.num + 0.5);
-        } else {
-            // audio playback time
-            frame->pts = floor(realapts * ac->stream->codec->time_base.den / ac->stream->codec->time_base.num + 0.5);
-        }
-
-        int64_t frame_pts = av_rescale_q(frame->pts, ac->stream->codec->time_base, ac->worst_time_base);
-        if (ac->lastpts != AV_NOPTS_VALUE && frame_pts <= ac->lastpts) {
-            // this indicates broken video
-            // (video pts failing to increase fast enough to match audio)
-            MP_WARN(ao, "audio frame pts went backwards (%d <- %d), autofixed\n",
-                    (int)frame->pts, (int)ac->lastpts);
-            frame_pts = ac->lastpts + 1;
-            frame->pts = av_rescale_q(frame_pts, ac->worst_time_base, ac->stream->codec->time_base);
-        }
-        ac->lastpts = frame_pts;
+        frame->pts = job->pts;
 
         frame->quality = ac->stream->codec->global_quality;
         status = avcodec_encode_audio2(ac->stream->codec, &packet, frame, &gotpacket);
@@ -291,8 +283,10 @@ static int encode(struct ao *ao, double apts, void **data)
     if(!gotpacket)
         return 0;
 
-    MP_DBG(ao, "got pts %f (playback time: %f); out size: %d\n",
-           apts, realapts, packet.size);
+    if (job) {
+        MP_DBG(ao, "got pts %f (playback time: %f); out size: %d\n",
+               job->apts, job->realapts, packet.size);
+    }
 
     encode_lavc_write_stats(ao->encode_lavc_ctx, ac->stream);
 
@@ -320,8 +314,8 @@ static int encode(struct ao *ao, double apts, void **data)
     ac->savepts = AV_NOPTS_VALUE;
 
     if (encode_lavc_write_frame(ao->encode_lavc_ctx, &packet) < 0) {
-        MP_ERR(ao, "error writing at %f %f/%f\n",
-               realapts, (double) ac->stream->time_base.num,
+        MP_ERR(ao, "error writing at %f/%f\n",
+               (double) ac->stream->time_base.num,
                (double) ac->stream->time_base.den);
         return -1;
     }
@@ -329,6 +323,60 @@ static int encode(struct ao *ao, double apts, void **data)
     return packet.size;
 }
 
+static void encode_job(void *priv, void *p)
+{
+    struct ao *ao = priv;
+    if (p) {
+        encode_frame(ao, p);
+    } else {
+        // finish encoding
+        while (encode_frame(ao, NULL) > 0) ;
+    }
+}
+
+// must get exactly ac->aframesize amount of data
+static void encode(struct ao *ao, double apts, void **data)
+{
+    struct priv *ac = ao->priv;
+    struct encode_lavc_context *ectx = ao->encode_lavc_ctx;
+    double realapts = ac->aframecount * (double) ac->aframesize /
+                      ao->samplerate;
+
+    ac->aframecount++;
+
+    ectx->audio_pts_offset = realapts - apts;
+
+    struct ao_job *job = talloc_zero(NULL, struct ao_job);
+    job->apts = apts;
+    job->realapts = realapts;
+
+    // The caller's buffer is only valid during play(), so copy the samples.
+    size_t num_planes = af_fmt_is_planar(ao->format) ? ao->channels.num : 1;
+    for (int n = 0; n < num_planes; n++)
+        job->data[n] = talloc_memdup(job, data[n], ac->aframesize * ao->sstride);
+
+    if (ectx->options->rawts || ectx->options->copyts) {
+        // real audio pts
+        job->pts = floor(apts * ac->stream->codec->time_base.den / ac->stream->codec->time_base.num + 0.5);
+    } else {
+        // audio playback time
+        job->pts = floor(realapts * ac->stream->codec->time_base.den / ac->stream->codec->time_base.num + 0.5);
+    }
+
+    int64_t frame_pts = av_rescale_q(job->pts, ac->stream->codec->time_base, ac->worst_time_base);
+    if (ac->lastpts != AV_NOPTS_VALUE && frame_pts <= ac->lastpts) {
+        // this indicates broken video
+        // (video pts failing to increase fast enough to match audio)
+        MP_WARN(ao, "audio frame pts went backwards (%d <- %d), autofixed\n",
+                (int)job->pts, (int)ac->lastpts);
+        frame_pts = ac->lastpts + 1;
+        job->pts = av_rescale_q(frame_pts, ac->worst_time_base, ac->stream->codec->time_base);
+    }
+    ac->lastpts = frame_pts;
+
+    encode_lavc_worker_queue(ac->worker, job);
+}
+
 // this should round samples down to frame sizes
 // return: number of samples played
 static int play(struct ao *ao, void **data, int samples, int flags)
@@ -140,6 +140,8 @@ struct ao_driver {
     void (*drain)(struct ao *ao);
     // Optional. Return true if audio has stopped in any way.
     bool (*get_eof)(struct ao *ao);
+    // Optional. Set by the pull API only; see ao_get_stats().
+    bool (*get_stats)(struct ao *ao, struct ao_stats *stats);
     // Wait until the audio buffer needs to be refilled. The lock is the
     // internal mutex usually protecting the internal AO state (and used to
     // protect driver calls), and must be temporarily unlocked while waiting.
@@ -31,11 +31,17 @@
 #include "osdep/timer.h"
 #include "osdep/threads.h"
 #include "osdep/atomics.h"
-#include "misc/ring.h"
+#include "audio/audio_ring.h"
 
 /*
  * Note: there is some stupid stuff in this file in order to avoid mutexes.
  * This requirement is dictated by several audio APIs, at least jackaudio.
+ *
+ * ao_read_data() runs in the realtime audio callback. It never takes a mutex,
+ * never allocates memory, and never waits for the other threads: it only
+ * copies from the ringbuffer, uses atomics, reads the clock, and posts a
+ * semaphore to wake up the playloop. The other side uses a spinlock to wait
+ * for a running ao_read_data() call in set_state().
  */
 
 enum {
@@ -49,14 +55,26 @@ enum {
 #define IS_PLAYING(st) ((st) == AO_STATE_PLAY || (st) == AO_STATE_BUSY)
 
 struct ao_pull_state {
-    // Be very careful with the order when accessing planes.
-    struct mp_ring *buffers[MP_NUM_CHANNELS];
+    struct mp_audio_ring *buffer;
 
     // AO_STATE_*
     atomic_int state;
 
     // Device delay of the last written sample, in realtime.
     atomic_llong end_time_us;
+
+    // Set if the data in the buffer ends with AOPLAY_FINAL_CHUNK.
+    atomic_bool final_chunk;
+
+    // Statistics; see struct ao_stats. Written by ao_read_data() only.
+    // Machine word sized, so that the increments are lock-free on 32 bit
+    // targets too (where 64 bit atomics may go through libatomic's locks);
+    // there the counters wrap around after 2^32 events.
+    atomic_ulong xruns;
+    atomic_ulong callback_hist[AO_STATS_HIST_SIZE];
+    // The last ao_read_data() call ran out of data. (Accessed by the audio
+    // callback only, or while it's stopped.)
+    bool underrun;
 };
 
 static void set_state(struct ao *ao, int new_state)
@@ -77,9 +95,7 @@ static void set_state(struct ao *ao, int new_state)
 static int get_space(struct ao *ao)
 {
     struct ao_pull_state *p = ao->api_priv;
-    // Since the reader will read the last plane last, its free space is the
-    // minimum free space across all planes.
-    return mp_ring_available(p->buffers[ao->num_planes - 1]) / ao->sstride;
+    return mp_audio_ring_available(p->buffer) / ao->sstride;
 }
 
 static int play(struct ao *ao, void **data, int samples, int flags)
@@ -89,14 +105,11 @@ static int play(struct ao *ao, void **data, int samples, int flags)
     int write_samples = get_space(ao);
     write_samples = MPMIN(write_samples, samples);
 
-    // Write starting from the last plane - this way, the first plane will
-    // always contain the minimum amount of data readable across all planes
-    // (assumes the reader starts with the first plane).
     int write_bytes = write_samples * ao->sstride;
-    for (int n = ao->num_planes - 1; n >= 0; n--) {
-        int r = mp_ring_write(p->buffers[n], data[n], write_bytes);
-        assert(r == write_bytes);
-    }
+    int r = mp_audio_ring_write(p->buffer, data, write_bytes);
+    assert(r == write_bytes);
+    if (write_samples || (flags & AOPLAY_FINAL_CHUNK))
+        atomic_store(&p->final_chunk, !!(flags & AOPLAY_FINAL_CHUNK));
 
     int state = atomic_load(&p->state);
     if (!IS_PLAYING(state)) {
@@ -115,11 +128,13 @@ static int play(struct ao *ao, void **data, int samples, int flags)
 // If this is called in paused mode, it will always return 0.
 // The caller should set out_time_us to the expected delay the last sample
 // reaches the speakers, in microseconds, using mp_time_us() as reference.
+// This is safe to call from realtime threads (see the note at the top).
 int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_us)
 {
     assert(ao->api == &ao_api_pull);
 
     struct ao_pull_state *p = ao->api_priv;
+    int64_t start_time = mp_time_us();
     int full_bytes = samples * ao->sstride;
     bool need_wakeup = false;
     int bytes = 0;
@@ -129,21 +144,21 @@ int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_us)
                                         AO_STATE_BUSY))
         goto end;
 
-    // Since the writer will write the first plane last, its buffered amount
-    // of data is the minimum amount across all planes.
-    int buffered_bytes = mp_ring_buffered(p->buffers[0]);
-    bytes = MPMIN(buffered_bytes, full_bytes);
+    bytes = mp_audio_ring_read(p->buffer, data, full_bytes);
 
     if (bytes > 0)
         atomic_store(&p->end_time_us, out_time_us);
 
-    for (int n = 0; n < ao->num_planes; n++) {
-        int r = mp_ring_read(p->buffers[n], data[n], bytes);
-        bytes = MPMIN(bytes, r);
-    }
+    // Running out of data at the end of playback is not an xrun. Count each
+    // underrun once, not every callback during it.
+    bool underrun = bytes < full_bytes;
+    if (underrun && !p->underrun && !atomic_load(&p->final_chunk))
+        atomic_fetch_add(&p->xruns, 1);
+    p->underrun = underrun;
 
     // Half of the buffer played -> request more.
-    need_wakeup = buffered_bytes - bytes <= mp_ring_size(p->buffers[0]) / 2;
+    need_wakeup = mp_audio_ring_buffered(p->buffer) <=
+                  mp_audio_ring_size(p->buffer) / 2;
 
     // Should never fail.
     atomic_compare_exchange_strong(&p->state, &(int){AO_STATE_BUSY}, AO_STATE_PLAY);
@@ -155,7 +170,15 @@ end:
 
     // pad with silence (underflow/paused/eof)
     for (int n = 0; n < ao->num_planes; n++)
-        af_fill_silence(data[n], full_bytes - bytes, ao->format);
+        af_fill_silence((char *)data[n] + bytes, full_bytes - bytes, ao->format);
+
+    int64_t duration = mp_time_us() - start_time;
+    int bucket = 0;
+    while (duration > 0 && bucket < AO_STATS_HIST_SIZE - 1) {
+        duration >>= 1;
+        bucket++;
+    }
+    atomic_fetch_add(&p->callback_hist[bucket], 1);
 
     return bytes / ao->sstride;
 }
@@ -179,7 +202,7 @@ static double get_delay(struct ao *ao)
     int64_t end = atomic_load(&p->end_time_us);
     int64_t now = mp_time_us();
     double driver_delay = MPMAX(0, (end - now) / (1000.0 * 1000.0));
-    return mp_ring_buffered(p->buffers[0]) / (double)ao->bps + driver_delay;
+    return mp_audio_ring_buffered(p->buffer) / (double)ao->bps + driver_delay;
 }
 
 static void reset(struct ao *ao)
@@ -188,9 +211,10 @@ static void reset(struct ao *ao)
     if (ao->driver->reset)
         ao->driver->reset(ao); // assumes the audio callback thread is stopped
     set_state(ao, AO_STATE_NONE);
-    for (int n = 0; n < ao->num_planes; n++)
-        mp_ring_reset(p->buffers[n]);
+    mp_audio_ring_reset(p->buffer);
     atomic_store(&p->end_time_us, 0);
+    atomic_store(&p->final_chunk, false);
+    p->underrun = false;
 }
 
 static void pause(struct ao *ao)
@@ -220,19 +244,42 @@ static bool get_eof(struct ao *ao)
     struct ao_pull_state *p = ao->api_priv;
     // For simplicity, ignore the latency. Otherwise, we would have to run an
     // extra thread to time it.
-    return mp_ring_buffered(p->buffers[0]) == 0;
+    return mp_audio_ring_buffered(p->buffer) == 0;
+}
+
+static bool get_stats(struct ao *ao, struct ao_stats *stats)
+{
+    struct ao_pull_state *p = ao->api_priv;
+    stats->xruns = atomic_load(&p->xruns);
+    for (int n = 0; n < AO_STATS_HIST_SIZE; n++)
+        stats->callback_hist[n] = atomic_load(&p->callback_hist[n]);
+    return true;
 }
 
 static void uninit(struct ao *ao)
 {
     ao->driver->uninit(ao);
+
+    struct ao_stats stats;
+    get_stats(ao, &stats);
+    MP_VERBOSE(ao, "%"PRIu64" xruns. Audio callback durations:\n", stats.xruns);
+    for (int n = 0; n < AO_STATS_HIST_SIZE; n++) {
+        if (!stats.callback_hist[n])
+            continue;
+        if (n < AO_STATS_HIST_SIZE - 1) {
+            MP_VERBOSE(ao, "  < %dus: %"PRIu64"\n", 1 << n,
+                       stats.callback_hist[n]);
+        } else {
+            MP_VERBOSE(ao, "  >= %dus: %"PRIu64"\n", 1 << (n - 1),
+                       stats.callback_hist[n]);
+        }
+    }
 }
 
 static int init(struct ao *ao)
 {
     struct ao_pull_state *p = ao->api_priv;
-    for (int n = 0; n < ao->num_planes; n++)
-        p->buffers[n] = mp_ring_new(ao, ao->buffer * ao->sstride);
+    p->buffer = mp_audio_ring_new(ao, ao->num_planes, ao->buffer * ao->sstride);
     atomic_store(&p->state, AO_STATE_NONE);
     assert(ao->driver->resume);
     return 0;
@@ -248,6 +295,7 @@ const struct ao_driver ao_api_pull = {
     .play = play,
     .get_delay = get_delay,
     .get_eof = get_eof,
+    .get_stats = get_stats,
     .pause = pause,
     .resume = resume,
     .priv_size = sizeof(struct ao_pull_state),
@@ -145,6 +145,24 @@ static void mp_msg_av_log_callback(void *ptr, int level, const char *fmt,
     pthread_mutex_unlock(&log_lock);
 }
 
+static pthread_once_t register_once = PTHREAD_ONCE_INIT;
+
+// The registration functions are not thread-safe, so mpv instances created
+// concurrently must not call them at the same time.
+static void register_libav(void)
+{
+    avcodec_register_all();
+    av_register_all();
+    avformat_network_init();
+
+#if HAVE_LIBAVFILTER
+    avfilter_register_all();
+#endif
+#if HAVE_LIBAVDEVICE
+    avdevice_register_all();
+#endif
+}
+
 void init_libav(struct mpv_global *global)
 {
     pthread_mutex_lock(&log_lock);
@@ -158,16 +176,7 @@ void init_libav(struct mpv_global *global)
     }
     pthread_mutex_unlock(&log_lock);
 
-    avcodec_register_all();
-    av_register_all();
-    avformat_network_init();
-
-#if HAVE_LIBAVFILTER
-    avfilter_register_all();
-#endif
-#if HAVE_LIBAVDEVICE
-    avdevice_register_all();
-#endif
+    pthread_once(&register_once, register_libav);
 }
 
 void uninit_libav(struct mpv_global *global)
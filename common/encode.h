@@ -29,6 +29,7 @@ struct encode_opts {
     int video_first;
     int audio_first;
     int metadata;
+    int chunks;
 };
 
 // interface for mplayer.c
@@ -45,5 +46,7 @@ void encode_lavc_set_metadata(struct encode_lavc_context *ctx,
 void encode_lavc_set_video_fps(struct encode_lavc_context *ctx, float fps);
 void encode_lavc_set_audio_pts(struct encode_lavc_context *ctx, double pts);
 bool encode_lavc_didfail(struct encode_lavc_context *ctx); // check if encoding failed
+bool encode_lavc_concat(struct encode_lavc_context *ctx, char **files,
+                        int num_files);
 
 #endif
@@ -20,6 +20,8 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <assert.h>
+
 #include <libavutil/avutil.h>
 
 #include "encode_lavc.h"
@@ -30,6 +32,7 @@
 #include "options/m_option.h"
 #include "options/options.h"
 #include "osdep/timer.h"
+#include "osdep/threads.h"
 #include "video/out/vo.h"
 #include "talloc.h"
 #include "stream/stream.h"
@@ -56,6 +59,7 @@ const struct m_sub_options encode_config = {
         OPT_FLAG("ovfirst", video_first, CONF_GLOBAL),
         OPT_FLAG("oafirst", audio_first, CONF_GLOBAL),
         OPT_FLAG("ometadata", metadata, CONF_GLOBAL),
+        OPT_INTRANGE("ochunks", chunks, CONF_GLOBAL, 0, 1024),
         {0}
     },
     .size = sizeof(struct encode_opts),
@@ -127,18 +131,18 @@ static bool value_has_flag(const char *value, const char *flag)
 }
 
 #define CHECK_FAIL(ctx, val) \
-    if (ctx && (ctx->failed || ctx->finished)) { \
+    if (ctx && (atomic_load(&ctx->failed) || atomic_load(&ctx->finished))) { \
         MP_ERR(ctx, \
                "Called a function on a %s encoding context. Bailing out.\n", \
-               ctx->failed ? "failed" : "finished"); \
+               atomic_load(&ctx->failed) ? "failed" : "finished"); \
         return val; \
     }
 
 #define CHECK_FAIL_UNLOCK(ctx, val) \
-    if (ctx && (ctx->failed || ctx->finished)) { \
+    if (ctx && (atomic_load(&ctx->failed) || atomic_load(&ctx->finished))) { \
         MP_ERR(ctx, \
                "Called a function on a %s encoding context. Bailing out.\n", \
-               ctx->failed ? "failed" : "finished"); \
+               atomic_load(&ctx->failed) ? "failed" : "finished"); \
         pthread_mutex_unlock(&ctx->lock); \
         return val; \
     }
@@ -175,6 +179,9 @@ struct encode_lavc_context *encode_lavc_init(struct encode_opts *options,
 
     ctx = talloc_zero(NULL, struct encode_lavc_context);
     pthread_mutex_init(&ctx->lock, NULL);
+    pthread_mutex_init(&ctx->mux_lock, NULL);
+    pthread_cond_init(&ctx->mux_wakeup, NULL);
+    pthread_mutex_init(&ctx->mux_io_lock, NULL);
     ctx->log = mp_log_new(ctx, global->log, "encode-lavc");
     ctx->global = global;
     encode_lavc_discontinuity(ctx);
@@ -282,6 +289,61 @@ void encode_lavc_set_metadata(struct encode_lavc_context *ctx,
         ctx->metadata = metadata;
 }
 
+// Maximum number of packets waiting for the muxer thread.
+#define MUX_QUEUE_SIZE 256
+
+static int write_packet(struct encode_lavc_context *ctx, AVPacket *packet)
+{
+    pthread_mutex_lock(&ctx->mux_io_lock);
+    int r = av_interleaved_write_frame(ctx->avc, packet);
+    pthread_mutex_unlock(&ctx->mux_io_lock);
+    return r;
+}
+
+static void *mux_thread(void *p)
+{
+    struct encode_lavc_context *ctx = p;
+    mpthread_set_name("encode-mux");
+
+    pthread_mutex_lock(&ctx->mux_lock);
+    while (1) {
+        if (!ctx->num_mux_queue) {
+            if (ctx->mux_terminate)
+                break;
+            pthread_cond_wait(&ctx->mux_wakeup, &ctx->mux_lock);
+            continue;
+        }
+        AVPacket *packet = ctx->mux_queue[0];
+        MP_TARRAY_REMOVE_AT(ctx->mux_queue, ctx->num_mux_queue, 0);
+        pthread_cond_broadcast(&ctx->mux_wakeup);
+        pthread_mutex_unlock(&ctx->mux_lock);
+
+        int r = write_packet(ctx, packet);
+        av_free_packet(packet);
+        av_free(packet);
+
+        pthread_mutex_lock(&ctx->mux_lock);
+        if (r < 0 && !ctx->mux_failed) {
+            MP_ERR(ctx, "error writing packet\n");
+            ctx->mux_failed = true;
+        }
+    }
+    pthread_mutex_unlock(&ctx->mux_lock);
+    return NULL;
+}
+
+static void stop_mux_thread(struct encode_lavc_context *ctx)
+{
+    if (!ctx->mux_thread_running)
+        return;
+    pthread_mutex_lock(&ctx->mux_lock);
+    ctx->mux_terminate = true;
+    pthread_cond_broadcast(&ctx->mux_wakeup);
+    pthread_mutex_unlock(&ctx->mux_lock);
+    pthread_join(ctx->mux_thread, NULL);
+    ctx->mux_thread_running = false;
+}
+
 int encode_lavc_start(struct encode_lavc_context *ctx)
 {
     AVDictionaryEntry *de;
@@ -358,6 +420,10 @@ int encode_lavc_start(struct encode_lavc_context *ctx)
         MP_WARN(ctx, "ofopts: key '%s' not found.\n", de->key);
     av_dict_free(&ctx->foptions);
 
+    // If this fails, packets are written directly by encode_lavc_write_frame.
+    ctx->mux_thread_running =
+        !pthread_create(&ctx->mux_thread, NULL, mux_thread, ctx);
+
     ctx->header_written = 1;
     return 1;
 }
@@ -367,14 +433,113 @@ void encode_lavc_free(struct encode_lavc_context *ctx)
     if (!ctx)
         return;
 
-    if (!ctx->finished)
+    if (!atomic_load(&ctx->finished))
         encode_lavc_fail(ctx,
                          "called encode_lavc_free without encode_lavc_finish\n");
 
+    talloc_free(ctx->mux_queue);
+    pthread_mutex_destroy(&ctx->mux_io_lock);
+    pthread_cond_destroy(&ctx->mux_wakeup);
+    pthread_mutex_destroy(&ctx->mux_lock);
     pthread_mutex_destroy(&ctx->lock);
     talloc_free(ctx);
 }
 
+// Remux the given files (all encoded with the same settings) into the output
+// file, one after another. Each file's timestamps are shifted so that it
+// starts where the previous one ended.
+bool encode_lavc_concat(struct encode_lavc_context *ctx, char **files,
+                        int num_files)
+{
+    bool ok = false;
+    AVFormatContext *in = NULL;
+    int64_t end = AV_NOPTS_VALUE; // end of written data, in AV_TIME_BASE
+
+    pthread_mutex_lock(&ctx->lock);
+
+    if (ctx->header_written || ctx->avc->nb_streams) {
+        MP_ERR(ctx, "can't concatenate into an output that is in use\n");
+        goto done;
+    }
+
+    for (int n = 0; n < num_files; n++) {
+        if (avformat_open_input(&in, files[n], NULL, NULL) < 0 ||
+            avformat_find_stream_info(in, NULL) < 0)
+        {
+            MP_ERR(ctx, "could not open '%s'\n", files[n]);
+            goto done;
+        }
+
+        if (n == 0) {
+            for (unsigned i = 0; i < in->nb_streams; i++) {
+                AVStream *ist = in->streams[i];
+                AVStream *st = avformat_new_stream(ctx->avc, NULL);
+                if (!st || avcodec_copy_context(st->codec, ist->codec) < 0)
+                    goto done;
+                st->codec->codec_tag = 0;
+                st->time_base = ist->time_base;
+                st->sample_aspect_ratio = ist->sample_aspect_ratio;
+                if (ctx->avc->oformat->flags & AVFMT_GLOBALHEADER)
+                    st->codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
+            }
+            if (!encode_lavc_start(ctx))
+                goto done;
+        } else if (in->nb_streams != ctx->avc->nb_streams) {
+            MP_ERR(ctx, "'%s' has a different number of streams\n", files[n]);
+            goto done;
+        }
+
+        int64_t offset = 0;
+        if (end != AV_NOPTS_VALUE && in->start_time != AV_NOPTS_VALUE)
+            offset = end - in->start_time;
+
+        AVPacket packet;
+        while (av_read_frame(in, &packet) >= 0) {
+            AVStream *ist = in->streams[packet.stream_index];
+            AVStream *st = ctx->avc->streams[packet.stream_index];
+            int64_t off = av_rescale_q(offset, AV_TIME_BASE_Q, ist->time_base);
+
+            if (packet.pts != AV_NOPTS_VALUE)
+                packet.pts = av_rescale_q(packet.pts + off, ist->time_base,
+                                          st->time_base);
+            if (packet.dts != AV_NOPTS_VALUE)
+                packet.dts = av_rescale_q(packet.dts + off, ist->time_base,
+                                          st->time_base);
+            if (packet.duration > 0)
+                packet.duration = av_rescale_q(packet.duration, ist->time_base,
+                                               st->time_base);
+
+            int64_t ts = packet.pts != AV_NOPTS_VALUE ? packet.pts : packet.dts;
+            if (ts != AV_NOPTS_VALUE) {
+                ts = av_rescale_q(ts + FFMAX(packet.duration, 0),
+                                  st->time_base, AV_TIME_BASE_Q);
+                if (end == AV_NOPTS_VALUE || ts > end)
+                    end = ts;
+            }
+
+            int r = encode_lavc_write_frame(ctx, &packet);
+            av_free_packet(&packet);
+            if (r < 0) {
+                MP_ERR(ctx, "error writing packet\n");
+                goto done;
+            }
+        }
+
+        avformat_close_input(&in);
+    }
+
+    ok = true;
+done:
+    if (in)
+        avformat_close_input(&in);
+    if (!ok)
+        encode_lavc_fail(ctx, "concatenating chunks failed\n");
+    pthread_mutex_unlock(&ctx->lock);
+    return ok;
+}
+
+static void stop_worker(struct encode_lavc_worker *w);
+
 void encode_lavc_finish(struct encode_lavc_context *ctx)
 {
     unsigned i;
@@ -382,9 +547,14 @@ void encode_lavc_finish(struct encode_lavc_context *ctx)
     if (!ctx)
         return;
 
-    if (ctx->finished)
+    if (atomic_load(&ctx->finished))
         return;
 
+    // Normally, the VO and AO have destroyed their workers already.
+    for (int n = 0; n < ctx->num_workers; n++)
+        stop_worker(ctx->workers[n]);
+    stop_mux_thread(ctx);
+
     if (ctx->avc) {
         if (ctx->header_written > 0)
             av_write_trailer(ctx->avc);  // this is allowed to fail
@@ -441,7 +611,7 @@ void encode_lavc_finish(struct encode_lavc_context *ctx)
         av_free(ctx->avc);
     }
 
-    ctx->finished = true;
+    atomic_store(&ctx->finished, true);
 }
 
 void encode_lavc_set_video_fps(struct encode_lavc_context *ctx, float fps)
@@ -805,6 +975,13 @@ int encode_lavc_write_frame(struct encode_lavc_context *ctx, AVPacket *packet)
         / (double)ctx->avc->streams[packet->stream_index]->time_base.den,
         (int)packet->size);
 
+    pthread_mutex_lock(&ctx->mux_lock);
+
+    if (ctx->mux_failed) {
+        pthread_mutex_unlock(&ctx->mux_lock);
+        return -1;
+    }
+
     switch (ctx->avc->streams[packet->stream_index]->codec->codec_type) {
     case AVMEDIA_TYPE_VIDEO:
         ctx->vbytes += packet->size;
@@ -820,8 +997,31 @@ int encode_lavc_write_frame(struct encode_lavc_context *ctx, AVPacket *packet)
         break;
     }
 
-    r = av_interleaved_write_frame(ctx->avc, packet);
+    // With AVFMT_RAWPICTURE, the packet points to the caller's picture, which
+    // is only valid during this call.
+    if (!ctx->mux_thread_running ||
+        (ctx->avc->oformat->flags & AVFMT_RAWPICTURE))
+    {
+        pthread_mutex_unlock(&ctx->mux_lock);
+        return write_packet(ctx, packet);
+    }
+
+    r = -1;
+    AVPacket *copy = av_malloc(sizeof(AVPacket));
+    if (copy) {
+        av_init_packet(copy);
+        if (av_packet_ref(copy, packet) >= 0) {
+            while (ctx->num_mux_queue >= MUX_QUEUE_SIZE)
+                pthread_cond_wait(&ctx->mux_wakeup, &ctx->mux_lock);
+            MP_TARRAY_APPEND(NULL, ctx->mux_queue, ctx->num_mux_queue, copy);
+            pthread_cond_broadcast(&ctx->mux_wakeup);
+            r = 0;
+        } else {
+            av_free(copy);
+        }
+    }
 
+    pthread_mutex_unlock(&ctx->mux_lock);
     return r;
 }
 
@@ -1093,10 +1293,14 @@ int encode_lavc_getstatus(struct encode_lavc_context *ctx,
 
     CHECK_FAIL_UNLOCK(ctx, -1);
 
+    // Querying the output file size would race with the muxer thread, so
+    // this excludes the (small) muxing overhead.
+    pthread_mutex_lock(&ctx->mux_lock);
     minutes = (now - ctx->t0) / 60.0 * (1 - f) / f;
-    megabytes = ctx->avc->pb ? (avio_size(ctx->avc->pb) / 1048576.0 / f) : 0;
+    megabytes = (ctx->vbytes + ctx->abytes) / 1048576.0 / f;
     fps = ctx->frames / (now - ctx->t0);
     x = ctx->audioseconds / (now - ctx->t0);
+    pthread_mutex_unlock(&ctx->mux_lock);
     if (ctx->frames)
         snprintf(buf, bufsize, "{%.1fmin %.1ffps %.1fMB}",
                  minutes, fps, megabytes);
@@ -1134,10 +1338,7 @@ bool encode_lavc_didfail(struct encode_lavc_context *ctx)
 {
     if (!ctx)
         return false;
-    pthread_mutex_lock(&ctx->lock);
-    bool fail = ctx && ctx->failed;
-    pthread_mutex_unlock(&ctx->lock);
-    return fail;
+    return atomic_load(&ctx->failed);
 }
 
 void encode_lavc_fail(struct encode_lavc_context *ctx, const char *format, ...)
@@ -1146,9 +1347,9 @@ void encode_lavc_fail(struct encode_lavc_context *ctx, const char *format, ...)
     va_start(va, format);
     mp_msg_va(ctx->log, MSGL_ERR, format, va);
     va_end(va);
-    if (ctx->failed)
+    bool failed = false;
+    if (!atomic_compare_exchange_strong(&ctx->failed, &failed, true))
         return;
-    ctx->failed = true;
     encode_lavc_finish(ctx);
 }
 
@@ -1198,4 +1399,122 @@ enum mp_csp_levels encode_lavc_get_csp_levels(struct encode_lavc_context *ctx,
     return avcol_range_to_mp_csp_levels(stream->codec->color_range);
 }
 
+struct encode_lavc_worker {
+    struct encode_lavc_context *ctx;
+    void (*encode)(void *priv, void *job);
+    void *priv;
+    int max_jobs;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    pthread_t thread;
+    bool running;       // thread was created and not joined yet
+    bool stopped;       // no more jobs are accepted
+    bool terminate;
+    void **jobs;
+    int num_jobs;
+};
+
+static void *worker_thread(void *p)
+{
+    struct encode_lavc_worker *w = p;
+    mpthread_set_name("encode");
+
+    pthread_mutex_lock(&w->lock);
+    while (1) {
+        if (!w->num_jobs) {
+            if (w->terminate)
+                break;
+            pthread_cond_wait(&w->wakeup, &w->lock);
+            continue;
+        }
+        void *job = w->jobs[0];
+        MP_TARRAY_REMOVE_AT(w->jobs, w->num_jobs, 0);
+        pthread_cond_broadcast(&w->wakeup);
+        pthread_mutex_unlock(&w->lock);
+
+        w->encode(w->priv, job);
+        talloc_free(job);
+
+        pthread_mutex_lock(&w->lock);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+struct encode_lavc_worker *encode_lavc_worker_create(
+    struct encode_lavc_context *ctx, void (*encode)(void *priv, void *job),
+    void *priv, int max_jobs)
+{
+    struct encode_lavc_worker *w = talloc_ptrtype(NULL, w);
+    *w = (struct encode_lavc_worker){
+        .ctx = ctx,
+        .encode = encode,
+        .priv = priv,
+        .max_jobs = max_jobs,
+    };
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->wakeup, NULL);
+    // If this fails, jobs are encoded directly by encode_lavc_worker_queue().
+    w->running = !pthread_create(&w->thread, NULL, worker_thread, w);
+    MP_TARRAY_APPEND(ctx, ctx->workers, ctx->num_workers, w);
+    return w;
+}
+
+void encode_lavc_worker_queue(struct encode_lavc_worker *w, void *job)
+{
+    pthread_mutex_lock(&w->lock);
+    // stop_worker() can run on another thread while we wait for queue space,
+    // so check the state only after waiting.
+    while (w->running && !w->stopped && w->num_jobs >= w->max_jobs)
+        pthread_cond_wait(&w->wakeup, &w->lock);
+    if (w->stopped) {
+        pthread_mutex_unlock(&w->lock);
+        talloc_free(job);
+        return;
+    }
+    if (!w->running) {
+        pthread_mutex_unlock(&w->lock);
+        w->encode(w->priv, job);
+        talloc_free(job);
+        return;
+    }
+    MP_TARRAY_APPEND(w, w->jobs, w->num_jobs, job);
+    pthread_cond_broadcast(&w->wakeup);
+    pthread_mutex_unlock(&w->lock);
+}
+
+// Encode all pending jobs, then stop the thread.
+static void stop_worker(struct encode_lavc_worker *w)
+{
+    pthread_mutex_lock(&w->lock);
+    w->stopped = true;
+    w->terminate = true;
+    pthread_cond_broadcast(&w->wakeup);
+    bool join = w->running;
+    w->running = false;
+    pthread_mutex_unlock(&w->lock);
+    if (join)
+        pthread_join(w->thread, NULL);
+}
+
+void encode_lavc_worker_destroy(struct encode_lavc_worker *w)
+{
+    if (!w)
+        return;
+    struct encode_lavc_context *ctx = w->ctx;
+    stop_worker(w);
+    pthread_mutex_lock(&ctx->lock);
+    for (int n = 0; n < ctx->num_workers; n++) {
+        if (ctx->workers[n] == w) {
+            MP_TARRAY_REMOVE_AT(ctx->workers, ctx->num_workers, n);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    pthread_cond_destroy(&w->wakeup);
+    pthread_mutex_destroy(&w->lock);
+    talloc_free(w);
+}
+
 // vim: ts=4 sw=4 et
@@ -31,6 +31,7 @@
 #include <libavutil/opt.h>
 #include <libavutil/mathematics.h>
 
+#include "osdep/atomics.h"
 #include "encode.h"
 #include "video/csputils.h"
 
@@ -83,13 +84,31 @@ struct encode_lavc_context {
     bool video_first;
     bool audio_first;
 
-    // has encoding failed?
-    bool failed;
-    bool finished;
+    // has encoding failed? Atomic, since the encoder workers and the muxer
+    // thread check them without holding the lock.
+    atomic_bool failed;
+    atomic_bool finished;
+
+    // Packets are written by a separate muxer thread, which doesn't need the
+    // main lock. mux_lock protects the queue and the byte/frame counters.
+    pthread_mutex_t mux_lock;
+    pthread_cond_t mux_wakeup;
+    pthread_mutex_t mux_io_lock; // held while writing packets to avc
+    pthread_t mux_thread;
+    bool mux_thread_running;
+    bool mux_terminate;
+    bool mux_failed;
+    AVPacket **mux_queue;
+    int num_mux_queue;
+
+    // Per-stream encoder threads (see encode_lavc_worker_create()).
+    struct encode_lavc_worker **workers;
+    int num_workers;
 };
 
 // interface for vo/ao drivers
 AVStream *encode_lavc_alloc_stream(struct encode_lavc_context *ctx, enum AVMediaType mt);
+// These two can be called without holding the lock (from encoder threads).
 void encode_lavc_write_stats(struct encode_lavc_context *ctx, AVStream *stream);
 int encode_lavc_write_frame(struct encode_lavc_context *ctx, AVPacket *packet);
 int encode_lavc_supports_pixfmt(struct encode_lavc_context *ctx, enum AVPixelFormat format);
@@ -111,4 +130,19 @@ enum mp_csp encode_lavc_get_csp(struct encode_lavc_context *ctx,
 enum mp_csp_levels encode_lavc_get_csp_levels(struct encode_lavc_context *ctx,
                                               AVStream *stream);
 
+// Runs the encoder of a single stream on its own thread. encode() is called
+// on that thread for each queued job, in queue order. Jobs are talloc
+// allocations, and are freed after encode() returns. A NULL job means the
+// encoder should be flushed. encode() must not take the context lock.
+// Create with the context lock held.
+struct encode_lavc_worker;
+struct encode_lavc_worker *encode_lavc_worker_create(
+    struct encode_lavc_context *ctx, void (*encode)(void *priv, void *job),
+    void *priv, int max_jobs);
+// Takes ownership of job. Blocks while max_jobs jobs are pending.
+void encode_lavc_worker_queue(struct encode_lavc_worker *w, void *job);
+// Wait until all jobs are processed, and free w. Call without the context
+// lock held.
+void encode_lavc_worker_destroy(struct encode_lavc_worker *w);
+
 #endif
@@ -267,6 +267,13 @@ void demux_stop_thread(struct demuxer *demuxer)
     }
 }
 
+// Whether the demuxer runs its own thread. Only then packets can be read from
+// several threads at once (each thread reading different streams).
+bool demux_is_threaded(struct demuxer *demuxer)
+{
+    return demuxer->in->threading;
+}
+
 // The demuxer thread will call cb(ctx) if there's a new packet, or EOF is reached.
 void demux_set_wakeup_cb(struct demuxer *demuxer, void (*cb)(void *ctx), void *ctx)
 {
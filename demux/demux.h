@@ -253,6 +253,7 @@ struct demuxer *demux_open(struct stream *stream, char *force_format,
 
 void demux_start_thread(struct demuxer *demuxer);
 void demux_stop_thread(struct demuxer *demuxer);
+bool demux_is_threaded(struct demuxer *demuxer);
 void demux_set_wakeup_cb(struct demuxer *demuxer, void (*cb)(void *ctx), void *ctx);
 
 void demux_flush(struct demuxer *demuxer);
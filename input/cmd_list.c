@@ -163,6 +163,7 @@ const struct mp_cmd_def mp_cmds[] = {
   { MP_CMD_DROP_BUFFERS, "drop_buffers", },
 
   { MP_CMD_AF, "af", { ARG_STRING, ARG_STRING } },
+  { MP_CMD_AF_COMMAND, "af_command", { ARG_STRING, ARG_STRING, ARG_STRING } },
   { MP_CMD_AO_RELOAD, "ao_reload", },
 
   { MP_CMD_VF, "vf", { ARG_STRING, ARG_STRING } },
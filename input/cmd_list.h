@@ -85,6 +85,7 @@ enum mp_command_type {
 
     /// Audio Filter commands
     MP_CMD_AF,
+    MP_CMD_AF_COMMAND,
     MP_CMD_AO_RELOAD,
 
     /// Video filter commands
@@ -264,6 +264,7 @@ struct mp_ipc_ctx;
 struct mp_client_api;
 struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
                                struct mpv_global *global);
+void mp_shutdown_ipc(struct mp_ipc_ctx *ctx);
 void mp_uninit_ipc(struct mp_ipc_ctx *ctx);
 
 #endif /* MPLAYER_INPUT_H */
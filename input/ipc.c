@@ -28,6 +28,10 @@
 
 #include "config.h"
 
+#if HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #include "osdep/io.h"
 #include "osdep/threads.h"
 
@@ -38,29 +42,105 @@
 #include "libmpv/client.h"
 #include "misc/bstr.h"
 #include "misc/json.h"
+#include "misc/msgpack.h"
+#include "misc/thread_pool.h"
 #include "options/m_option.h"
 #include "options/options.h"
 #include "options/path.h"
 #include "player/client.h"
 
+// If this much output is buffered for a client, stop reading commands and
+// events for it until the client has read some of it.
+#define MAX_OUTPUT_BUFFER (1 * 1024 * 1024)
+
+// Larger messages of the binary protocol are rejected (the size is known in
+// advance, so this avoids buffering garbage).
+#define MAX_INPUT_FRAME (16 * 1024 * 1024)
+
+// Maximum number of commands run at the same time (by different clients).
+#define MAX_COMMAND_THREADS 16
+
+// All clients are served by a single thread, which waits on all file
+// descriptors at once (with epoll if available, poll otherwise). Commands are
+// run on worker threads, because they can block for a long time (e.g. while
+// the player opens a file). Each client has at most one command running, so
+// replies are sent in order, and a slow command only delays the client which
+// sent it.
 struct mp_ipc_ctx {
     struct mp_log *log;
     struct mp_client_api *client_api;
     const char *path;
+    const char *input_file;
 
     pthread_t thread;
-    int death_pipe[2];
+    // Written to by mp_uninit_ipc(), the client wakeup callbacks, and the
+    // command workers.
+    int wakeup_pipe[2];
+
+    pthread_mutex_t lock;
+    // -- protected by lock
+    bool terminate;
+    bool shutting_down;         // set by mp_shutdown_ipc()
+    struct client_arg **ready;  // clients which have new mpv events
+    int num_ready;
+
+    // -- IPC thread only
+    bool drop_blocked;          // copy of shutting_down
+    struct mp_thread_pool *workers;
+    int ipc_fd;                 // listening socket, or -1
+    struct client_arg **clients;
+    int num_clients;
+#if HAVE_EPOLL
+    int epoll_fd;
+#else
+    struct pollfd *poll_fds;    // registered file descriptors
+    void **poll_ptrs;           // poll_fds[n] belongs to poll_ptrs[n]
+    int num_poll_fds;
+#endif
 };
 
 struct client_arg {
     struct mp_log *log;
     struct mpv_handle *client;
+    struct mp_ipc_ctx *ipc;
 
     char *client_name;
     int client_fd;
     bool close_client_fd;
 
     bool writable;
+
+    // -- protected by ipc->lock
+    bool queued;            // in ipc->ready
+    struct ipc_request *done; // finished command, not yet replied to
+
+    // -- IPC thread only
+    bool busy;              // a command is running (see ipc_request)
+    bool events_pending;    // mpv events might be queued
+    bool dead;              // to be destroyed
+    bool always_readable;   // a regular file, which can't be polled
+    int poll_events;        // registered POLLIN/POLLOUT flags
+    bool msgpack;           // binary protocol (see set_protocol)
+    bstr input;             // unterminated command
+    bstr output;            // output.start[output_start..] is not yet written
+    size_t output_start;
+    struct json_arena *arena; // for parsing commands (used by the worker)
+};
+
+enum {
+    REQUEST_JSON,
+    REQUEST_MSGPACK,
+    REQUEST_TEXT,
+};
+
+// A command, run by a worker thread. Allocations for it must not use the
+// client_arg as talloc parent, because the IPC thread uses that concurrently.
+struct ipc_request {
+    struct client_arg *arg;
+    int type;               // REQUEST_*
+    bstr src;               // command (JSON/text is 0-terminated)
+    bstr reply;             // encoded reply
+    bool msgpack;           // protocol after the command (see set_protocol)
 };
 
 static mpv_node *mpv_node_map_get(mpv_node *src, const char *key)
@@ -86,6 +166,18 @@ static mpv_node *mpv_node_array_get(mpv_node *src, int index)
     return &src->u.list->values[index];
 }
 
+static bool mpv_node_get_number(mpv_node *src, double *out)
+{
+    if (src->format == MPV_FORMAT_INT64) {
+        *out = src->u.int64;
+    } else if (src->format == MPV_FORMAT_DOUBLE) {
+        *out = src->u.double_;
+    } else {
+        return false;
+    }
+    return true;
+}
+
 static void mpv_node_array_add(void *ta_parent, mpv_node *src,  mpv_node *val)
 {
     if (src->format != MPV_FORMAT_NODE_ARRAY)
@@ -102,12 +194,6 @@ static void mpv_node_array_add(void *ta_parent, mpv_node *src,  mpv_node *val)
     src->u.list->num++;
 }
 
-static void mpv_node_array_add_string(void *ta_parent, mpv_node *src, const char *val)
-{
-    mpv_node val_node = {.format = MPV_FORMAT_STRING, .u.string = (char *)val};
-    mpv_node_array_add(ta_parent, src, &val_node);
-}
-
 static void mpv_node_map_add(void *ta_parent, mpv_node *src, const char *key, mpv_node *val)
 {
     if (src->format != MPV_FORMAT_NODE_MAP)
@@ -133,127 +219,36 @@ static void mpv_node_map_add_null(void *ta_parent, mpv_node *src, const char *ke
     mpv_node_map_add(ta_parent, src, key, &val_node);
 }
 
-static void mpv_node_map_add_flag(void *ta_parent, mpv_node *src, const char *key, bool val)
-{
-    mpv_node val_node = {.format = MPV_FORMAT_FLAG, .u.flag = val};
-
-    mpv_node_map_add(ta_parent, src, key, &val_node);
-}
-
 static void mpv_node_map_add_int64(void *ta_parent, mpv_node *src, const char *key, int64_t val)
 {
     mpv_node val_node = {.format = MPV_FORMAT_INT64, .u.int64 = val};
     mpv_node_map_add(ta_parent, src, key, &val_node);
 }
 
-static void mpv_node_map_add_double(void *ta_parent, mpv_node *src, const char *key, double val)
-{
-    mpv_node val_node = {.format = MPV_FORMAT_DOUBLE, .u.double_ = val};
-    mpv_node_map_add(ta_parent, src, key, &val_node);
-}
-
 static void mpv_node_map_add_string(void *ta_parent, mpv_node *src, const char *key, const char *val)
 {
     mpv_node val_node = {.format = MPV_FORMAT_STRING, .u.string = (char*)val};
     mpv_node_map_add(ta_parent, src, key, &val_node);
 }
 
-static void mpv_event_to_node(void *ta_parent, mpv_event *event, mpv_node *dst)
-{
-    mpv_node_map_add_string(ta_parent, dst, "event", mpv_event_name(event->event_id));
-
-    if (event->reply_userdata)
-        mpv_node_map_add_int64(ta_parent, dst, "id", event->reply_userdata);
-
-    if (event->error < 0)
-        mpv_node_map_add_string(ta_parent, dst, "error", mpv_error_string(event->error));
-
-    switch (event->event_id) {
-    case MPV_EVENT_LOG_MESSAGE: {
-        mpv_event_log_message *msg = event->data;
-
-        mpv_node_map_add_string(ta_parent, dst, "prefix", msg->prefix);
-        mpv_node_map_add_string(ta_parent, dst, "level",  msg->level);
-        mpv_node_map_add_string(ta_parent, dst, "text",   msg->text);
-
-        break;
-    }
-
-    case MPV_EVENT_CLIENT_MESSAGE: {
-        mpv_event_client_message *msg = event->data;
-
-        mpv_node args_node = {.format = MPV_FORMAT_NODE_ARRAY, .u.list = NULL};
-        for (int n = 0; n < msg->num_args; n++)
-            mpv_node_array_add_string(ta_parent, &args_node, msg->args[n]);
-        mpv_node_map_add(ta_parent, dst, "args", &args_node);
-        break;
-    }
-
-    case MPV_EVENT_PROPERTY_CHANGE: {
-        mpv_event_property *prop = event->data;
-
-        mpv_node_map_add_string(ta_parent, dst, "name", prop->name);
-
-        switch (prop->format) {
-        case MPV_FORMAT_NODE:
-            mpv_node_map_add(ta_parent, dst, "data", prop->data);
-            break;
-        case MPV_FORMAT_DOUBLE:
-            mpv_node_map_add_double(ta_parent, dst, "data", *(double *)prop->data);
-            break;
-        case MPV_FORMAT_FLAG:
-            mpv_node_map_add_flag(ta_parent, dst, "data", *(int *)prop->data);
-            break;
-        case MPV_FORMAT_STRING:
-            mpv_node_map_add_string(ta_parent, dst, "data", *(char **)prop->data);
-            break;
-        default:
-            mpv_node_map_add_null(ta_parent, dst, "data");
-        }
-        break;
-    }
-    }
-}
-
-static char *json_encode_event(mpv_event *event)
-{
-    void *ta_parent = talloc_new(NULL);
-    mpv_node event_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
-
-    mpv_event_to_node(ta_parent, event, &event_node);
-
-    char *output = talloc_strdup(NULL, "");
-    json_write(&output, &event_node);
-    output = ta_talloc_strdup_append(output, "\n");
-
-    talloc_free(ta_parent);
-
-    return output;
-}
-
-// Function is allowed to modify src[n].
-static char *json_execute_command(struct client_arg *arg, void *ta_parent,
-                                  char *src)
+// Run the command in msg_node (the parsed message). The reply is written to
+// req->reply, using the client's protocol.
+static void execute_command(struct ipc_request *req, void *ta_parent,
+                            mpv_node *msg_node)
 {
+    struct client_arg *arg = req->arg;
     int rc;
     const char *cmd = NULL;
+    bool msgpack = arg->msgpack;
 
-    mpv_node msg_node;
     mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
 
-    rc = json_parse(ta_parent, &msg_node, &src, 3);
-    if (rc < 0) {
-        MP_ERR(arg, "malformed JSON received\n");
-        rc = MPV_ERROR_INVALID_PARAMETER;
-        goto error;
-    }
-
-    if (msg_node.format != MPV_FORMAT_NODE_MAP) {
+    if (msg_node->format != MPV_FORMAT_NODE_MAP) {
         rc = MPV_ERROR_INVALID_PARAMETER;
         goto error;
     }
 
-    mpv_node *cmd_node = mpv_node_map_get(&msg_node, "command");
+    mpv_node *cmd_node = mpv_node_map_get(msg_node, "command");
     if (!cmd_node ||
         (cmd_node->format != MPV_FORMAT_NODE_ARRAY) ||
         !cmd_node->u.list->num)
@@ -282,6 +277,24 @@ static char *json_execute_command(struct client_arg *arg, void *ta_parent,
         int64_t ver = mpv_client_api_version();
         mpv_node_map_add_int64(ta_parent, &reply_node, "data", ver);
         rc = MPV_ERROR_SUCCESS;
+    } else if (!strcmp("set_protocol", cmd)) {
+        if (cmd_node->u.list->num != 2 ||
+            cmd_node->u.list->values[1].format != MPV_FORMAT_STRING)
+        {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        const char *name = cmd_node->u.list->values[1].u.string;
+        if (!strcmp(name, "json")) {
+            msgpack = false;
+        } else if (!strcmp(name, "msgpack")) {
+            msgpack = true;
+        } else {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+        rc = MPV_ERROR_SUCCESS;
     } else if (!strcmp("get_property", cmd)) {
         mpv_node result_node;
 
@@ -301,6 +314,42 @@ static char *json_execute_command(struct client_arg *arg, void *ta_parent,
             mpv_node_map_add(ta_parent, &reply_node, "data", &result_node);
             mpv_free_node_contents(&result_node);
         }
+    } else if (!strcmp("get_properties", cmd)) {
+        int num = cmd_node->u.list->num - 1;
+        mpv_node *args = cmd_node->u.list->values + 1;
+        const char **names = talloc_array(ta_parent, const char *, num);
+        mpv_format *formats = talloc_array(ta_parent, mpv_format, num);
+        mpv_node *results = talloc_zero_array(ta_parent, mpv_node, num);
+        void **data = talloc_array(ta_parent, void *, num);
+        int *errors = talloc_array(ta_parent, int, num);
+
+        for (int n = 0; n < num; n++) {
+            if (args[n].format != MPV_FORMAT_STRING) {
+                rc = MPV_ERROR_INVALID_PARAMETER;
+                goto error;
+            }
+            names[n] = args[n].u.string;
+            formats[n] = MPV_FORMAT_NODE;
+            data[n] = &results[n];
+        }
+
+        rc = mpv_get_properties(arg->client, num, names, formats, data, errors);
+        if (rc >= 0) {
+            // Properties which can't be read are returned as null.
+            mpv_node null_node = {.format = MPV_FORMAT_NONE};
+            mpv_node list = {.format = MPV_FORMAT_NODE_ARRAY};
+            for (int n = 0; n < num; n++) {
+                if (errors[n] >= 0) {
+                    mpv_node_array_add(ta_parent, &list, &results[n]);
+                    mpv_free_node_contents(&results[n]);
+                } else {
+                    mpv_node_array_add(ta_parent, &list, &null_node);
+                }
+            }
+            if (!list.u.list)
+                list.u.list = talloc_zero(ta_parent, mpv_node_list);
+            mpv_node_map_add(ta_parent, &reply_node, "data", &list);
+        }
     } else if (!strcmp("get_property_string", cmd)) {
         if (cmd_node->u.list->num != 2) {
             rc = MPV_ERROR_INVALID_PARAMETER;
@@ -372,6 +421,40 @@ static char *json_execute_command(struct client_arg *arg, void *ta_parent,
                                   cmd_node->u.list->values[1].u.int64,
                                   cmd_node->u.list->values[2].u.string,
                                   MPV_FORMAT_NODE);
+    } else if (!strcmp("observe_property_throttled", cmd)) {
+        double interval = 0, delta = 0;
+
+        if (cmd_node->u.list->num != 4 && cmd_node->u.list->num != 5) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        if (cmd_node->u.list->values[1].format != MPV_FORMAT_INT64) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        if (cmd_node->u.list->values[2].format != MPV_FORMAT_STRING) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        if (!mpv_node_get_number(&cmd_node->u.list->values[3], &interval)) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        if (cmd_node->u.list->num == 5 &&
+            !mpv_node_get_number(&cmd_node->u.list->values[4], &delta))
+        {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        rc = mpv_observe_property_throttled(arg->client,
+                                            cmd_node->u.list->values[1].u.int64,
+                                            cmd_node->u.list->values[2].u.string,
+                                            MPV_FORMAT_NODE, interval, delta);
     } else if (!strcmp("observe_property_string", cmd)) {
         if (cmd_node->u.list->num != 3) {
             rc = MPV_ERROR_INVALID_PARAMETER;
@@ -468,189 +551,464 @@ static char *json_execute_command(struct client_arg *arg, void *ta_parent,
 error:
     mpv_node_map_add_string(ta_parent, &reply_node, "error", mpv_error_string(rc));
 
-    char *output = talloc_strdup(ta_parent, "");
-    json_write(&output, &reply_node);
-    output = ta_talloc_strdup_append(output, "\n");
+    if (arg->writable) {
+        if (arg->msgpack) {
+            size_t start = msgpack_frame_begin(&req->reply);
+            msgpack_append(&req->reply, &reply_node);
+            msgpack_frame_end(&req->reply, start);
+        } else {
+            json_append(&req->reply, &reply_node);
+            bstr_xappend(req, &req->reply, bstr0("\n"));
+        }
+    }
 
-    return output;
+    // Switched only after the reply, which uses the old protocol.
+    req->msgpack = msgpack;
 }
 
-static char *text_execute_command(struct client_arg *arg, void *tmp, char *src)
+// Function is allowed to modify src[n].
+static void json_execute_command(struct ipc_request *req, void *ta_parent,
+                                 char *src)
 {
-    mpv_command_string(arg->client, src);
+    struct client_arg *arg = req->arg;
+    mpv_node msg_node;
 
-    return NULL;
+    json_arena_reset(arg->arena);
+    if (json_parse_arena(arg->arena, &msg_node, &src, 3) < 0) {
+        MP_ERR(arg, "malformed JSON received\n");
+        msg_node = (mpv_node){.format = MPV_FORMAT_NONE};
+    }
+
+    execute_command(req, ta_parent, &msg_node);
 }
 
-static int ipc_write(int fd, const char *buf, size_t count)
+static void msgpack_execute_command(struct ipc_request *req, void *ta_parent,
+                                    bstr src)
 {
-    while (count > 0) {
-        ssize_t rc = write(fd, buf, count);
-        if (rc <= 0) {
-            if (rc == 0)
-                return -1;
+    struct client_arg *arg = req->arg;
+    mpv_node msg_node;
 
-            if (errno == EINTR)
-                continue;
+    json_arena_reset(arg->arena);
+    if (msgpack_parse_arena(arg->arena, &msg_node, &src, 3) < 0 || src.len) {
+        MP_ERR(arg, "malformed MessagePack received\n");
+        msg_node = (mpv_node){.format = MPV_FORMAT_NONE};
+    }
 
-            if (errno == EAGAIN)
-                return 0;
+    execute_command(req, ta_parent, &msg_node);
+}
 
-            return rc;
-        }
+static void text_execute_command(struct ipc_request *req, void *tmp, char *src)
+{
+    mpv_command_string(req->arg->client, src);
+}
 
-        count -= rc;
-        buf   += rc;
+// Runs on a worker thread. Hands the request back to the IPC thread when done.
+static void run_request(void *p)
+{
+    struct ipc_request *req = p;
+    struct client_arg *arg = req->arg;
+    struct mp_ipc_ctx *ctx = arg->ipc;
+
+    void *tmp = talloc_new(NULL);
+    switch (req->type) {
+    case REQUEST_JSON:
+        json_execute_command(req, tmp, req->src.start);
+        break;
+    case REQUEST_MSGPACK:
+        msgpack_execute_command(req, tmp, req->src);
+        break;
+    case REQUEST_TEXT:
+        text_execute_command(req, tmp, req->src.start);
+        break;
     }
+    talloc_free(tmp);
+
+    // arg can be destroyed as soon as the lock is released.
+    pthread_mutex_lock(&ctx->lock);
+    arg->done = req;
+    bool need_wakeup = false;
+    if (!arg->queued) {
+        arg->queued = true;
+        MP_TARRAY_APPEND(ctx, ctx->ready, ctx->num_ready, arg);
+        need_wakeup = ctx->num_ready == 1;
+    }
+    pthread_mutex_unlock(&ctx->lock);
 
-    return 0;
+    if (need_wakeup)
+        write(ctx->wakeup_pipe[1], &(char){0}, 1);
 }
 
-static void *client_thread(void *p)
+static size_t output_size(struct client_arg *arg)
 {
-    pthread_detach(pthread_self());
+    return arg->output.len - arg->output_start;
+}
 
-    int rc;
+// Register fd with the given POLLIN/POLLOUT flags. events==0 unregisters it.
+// ptr identifies the file descriptor in ipc_wait().
+static int ipc_poll_update(struct mp_ipc_ctx *ctx, int fd, void *ptr,
+                           int old_events, int events)
+{
+#if HAVE_EPOLL
+    struct epoll_event ev = {
+        .events = (events & POLLIN ? EPOLLIN : 0) |
+                  (events & POLLOUT ? EPOLLOUT : 0),
+        .data = {.ptr = ptr},
+    };
+    int op = !events ? EPOLL_CTL_DEL : old_events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    return epoll_ctl(ctx->epoll_fd, op, fd, &ev);
+#else
+    for (int n = 0; n < ctx->num_poll_fds; n++) {
+        if (ctx->poll_fds[n].fd == fd) {
+            if (events) {
+                ctx->poll_fds[n].events = events;
+            } else {
+                int num = ctx->num_poll_fds;
+                MP_TARRAY_REMOVE_AT(ctx->poll_ptrs, num, n);
+                MP_TARRAY_REMOVE_AT(ctx->poll_fds, ctx->num_poll_fds, n);
+            }
+            return 0;
+        }
+    }
+    if (events) {
+        MP_TARRAY_GROW(ctx, ctx->poll_fds, ctx->num_poll_fds);
+        MP_TARRAY_GROW(ctx, ctx->poll_ptrs, ctx->num_poll_fds);
+        ctx->poll_fds[ctx->num_poll_fds] = (struct pollfd){fd, events};
+        ctx->poll_ptrs[ctx->num_poll_fds] = ptr;
+        ctx->num_poll_fds++;
+    }
+    return 0;
+#endif
+}
 
-    struct client_arg *arg = p;
-    bstr client_msg = { talloc_strdup(NULL, ""), 0 };
+struct ipc_poll_result {
+    void *ptr;
+    int revents;            // POLLIN/POLLOUT/POLLERR/POLLHUP
+};
 
-    mpthread_set_name(arg->client_name);
+#define MAX_POLL_RESULTS 64
 
-    int pipe_fd = mpv_get_wakeup_pipe(arg->client);
-    if (pipe_fd < 0) {
-        MP_ERR(arg, "Could not get wakeup pipe\n");
-        goto done;
+// Wait until a registered file descriptor is ready. Returns the number of
+// entries written to res.
+static int ipc_wait(struct mp_ipc_ctx *ctx, int timeout_ms,
+                    struct ipc_poll_result res[MAX_POLL_RESULTS])
+{
+#if HAVE_EPOLL
+    struct epoll_event evs[MAX_POLL_RESULTS];
+    int num = epoll_wait(ctx->epoll_fd, evs, MAX_POLL_RESULTS, timeout_ms);
+    for (int n = 0; n < num; n++) {
+        uint32_t e = evs[n].events;
+        res[n] = (struct ipc_poll_result){
+            .ptr = evs[n].data.ptr,
+            .revents = (e & EPOLLIN ? POLLIN : 0) |
+                       (e & EPOLLOUT ? POLLOUT : 0) |
+                       (e & EPOLLERR ? POLLERR : 0) |
+                       (e & EPOLLHUP ? POLLHUP : 0),
+        };
     }
+    return num;
+#else
+    int rc = poll(ctx->poll_fds, ctx->num_poll_fds, timeout_ms);
+    if (rc <= 0)
+        return rc;
+    int num = 0;
+    for (int n = 0; n < ctx->num_poll_fds && num < MAX_POLL_RESULTS; n++) {
+        if (ctx->poll_fds[n].revents) {
+            res[num++] = (struct ipc_poll_result){
+                .ptr = ctx->poll_ptrs[n],
+                .revents = ctx->poll_fds[n].revents,
+            };
+        }
+    }
+    return num;
+#endif
+}
 
-    MP_INFO(arg, "Client connected\n");
-
-    struct pollfd fds[2] = {
-        {.events = POLLIN, .fd = pipe_fd},
-        {.events = POLLIN, .fd = arg->client_fd},
-    };
-
-    fcntl(arg->client_fd, F_SETFL, fcntl(arg->client_fd, F_GETFL, 0) | O_NONBLOCK);
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
 
-    while (1) {
-        rc = poll(fds, 2, -1);
-        if (rc < 0) {
-            MP_ERR(arg, "Poll error\n");
+// Write as much of the buffered output as possible without blocking.
+static void client_flush(struct client_arg *arg)
+{
+    while (output_size(arg)) {
+        // Only sockets are writable. Avoid SIGPIPE if the client is gone.
+        ssize_t rc = send(arg->client_fd, arg->output.start + arg->output_start,
+                          output_size(arg), MSG_NOSIGNAL);
+        if (rc < 0 && errno == EINTR)
             continue;
+        if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (rc <= 0) {
+            MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
+            arg->dead = true;
+            return;
         }
+        arg->output_start += rc;
+    }
+    if (arg->output_start == arg->output.len) {
+        arg->output_start = arg->output.len = 0;
+    } else if (arg->output_start > arg->output.len / 2) {
+        memmove(arg->output.start, arg->output.start + arg->output_start,
+                output_size(arg));
+        arg->output.len -= arg->output_start;
+        arg->output_start = 0;
+    }
+}
 
-        if (fds[0].revents & POLLIN) {
-            char discard[100];
-            read(pipe_fd, discard, sizeof(discard));
+static bool client_blocked(struct client_arg *arg)
+{
+    return output_size(arg) >= MAX_OUTPUT_BUFFER;
+}
 
-            while (1) {
-                mpv_event *event = mpv_wait_event(arg->client, 0);
+static void client_events(struct client_arg *arg)
+{
+    while (!arg->dead) {
+        if (client_blocked(arg)) {
+            client_flush(arg);
+            if (arg->dead)
+                return;
+            if (client_blocked(arg)) {
+                // The player waits until all clients have seen the shutdown
+                // event, so a client which doesn't read must not stop it.
+                if (!arg->ipc->drop_blocked)
+                    return; // events_pending stays set, resumed on POLLOUT
+                MP_WARN(arg, "Client not reading, dropping its output.\n");
+                arg->output_start = arg->output.len = 0;
+            }
+        }
+        mpv_event *event = mpv_wait_event(arg->client, 0);
 
-                if (event->event_id == MPV_EVENT_NONE)
-                    break;
+        if (event->event_id == MPV_EVENT_NONE)
+            break;
 
-                if (event->event_id == MPV_EVENT_SHUTDOWN)
-                    goto done;
+        if (event->event_id == MPV_EVENT_SHUTDOWN) {
+            arg->dead = true;
+            break;
+        }
 
-                if (!arg->writable)
-                    continue;
+        if (!arg->writable)
+            continue;
 
-                char *event_msg = json_encode_event(event);
-                if (!event_msg) {
-                    MP_ERR(arg, "Encoding error\n");
-                    goto done;
-                }
+        // Events are encoded directly into the output buffer, which is
+        // written when the loop is done (or the buffer is full).
+        int rc;
+        if (arg->msgpack) {
+            size_t start = msgpack_frame_begin(&arg->output);
+            rc = msgpack_append_event(&arg->output, event);
+            msgpack_frame_end(&arg->output, start);
+        } else {
+            rc = json_append_event(&arg->output, event);
+        }
+        if (rc < 0) {
+            MP_ERR(arg, "Encoding error\n");
+            arg->dead = true;
+            break;
+        }
+    }
+    arg->events_pending = false;
+    if (!arg->dead)
+        client_flush(arg);
+}
 
-                rc = ipc_write(arg->client_fd, event_msg, strlen(event_msg));
-                talloc_free(event_msg);
-                if (rc < 0) {
-                    MP_ERR(arg, "Write error\n");
-                    goto done;
+// Start the first command in the input buffer, if it's complete and no command
+// is running yet.
+static void client_start_command(struct client_arg *arg)
+{
+    while (!arg->dead && !arg->busy) {
+        struct ipc_request *req = talloc_zero(NULL, struct ipc_request);
+        req->arg = arg;
+        // Preallocate, so that the json_append functions don't create a new
+        // talloc root.
+        req->reply = (bstr){talloc_size(req, 1), 0};
+
+        bstr rest;
+        if (arg->msgpack) {
+            int64_t size = msgpack_frame_size(arg->input);
+            if (size < 0 || arg->input.len - MSGPACK_FRAME_HEADER < size) {
+                if (size > MAX_INPUT_FRAME) {
+                    MP_ERR(arg, "Message too large\n");
+                    arg->dead = true;
                 }
+                talloc_free(req);
+                return;
             }
+            req->type = REQUEST_MSGPACK;
+            size += MSGPACK_FRAME_HEADER;
+            req->src = bstrdup(req, bstr_splice(arg->input,
+                                                MSGPACK_FRAME_HEADER, size));
+            rest = bstr_cut(arg->input, size);
+        } else {
+            if (bstrchr(arg->input, '\n') == -1) {
+                talloc_free(req);
+                return;
+            }
+            bstr line = bstr_getline(arg->input, &rest);
+            char *line0 = bstrto0(req, line);
+            json_skip_whitespace(&line0);
+            req->type = line0[0] == '{' ? REQUEST_JSON : REQUEST_TEXT;
+            req->src = bstr0(line0);
         }
 
-        if (fds[1].revents & POLLIN) {
-            while (1) {
-                char buf[128];
-                bstr append = { buf, 0 };
+        char *old = arg->input.start;
+        arg->input = bstrdup(arg, rest);
+        talloc_free(old);
 
-                ssize_t bytes = read(arg->client_fd, buf, sizeof(buf));
-                if (bytes < 0) {
-                    if (errno == EAGAIN)
-                        break;
+        if (!arg->msgpack && (!req->src.len || req->src.start[0] == '#')) {
+            talloc_free(req);
+            continue;
+        }
 
-                    MP_ERR(arg, "Read error (%s)\n", mp_strerror(errno));
-                    goto done;
-                }
+        arg->busy = true;
+        if (!mp_thread_pool_queue(arg->ipc->workers, run_request, req))
+            run_request(req);
+    }
+}
 
-                if (bytes == 0) {
-                    MP_INFO(arg, "Client disconnected\n");
-                    goto done;
-                }
+// If the running command is done, send the reply, and start the next one.
+static void client_finish_command(struct client_arg *arg)
+{
+    pthread_mutex_lock(&arg->ipc->lock);
+    struct ipc_request *req = arg->done;
+    arg->done = NULL;
+    pthread_mutex_unlock(&arg->ipc->lock);
 
-                append.len = bytes;
-
-                bstr_xappend(NULL, &client_msg, append);
-
-                while (bstrchr(client_msg, '\n') != -1) {
-                    void *tmp = talloc_new(NULL);
-                    bstr rest;
-                    bstr line = bstr_getline(client_msg, &rest);
-                    char *line0 = bstrto0(tmp, line);
-                    talloc_steal(tmp, client_msg.start);
-                    client_msg = bstrdup(NULL, rest);
-
-                    json_skip_whitespace(&line0);
-
-                    char *reply_msg = NULL;
-                    if (line0[0] == '\0' || line0[0] == '#') {
-                        // skip
-                    } else if (line0[0] == '{') {
-                        reply_msg = json_execute_command(arg, tmp, line0);
-                    } else {
-                        reply_msg = text_execute_command(arg, tmp, line0);
-                    }
-
-                    if (reply_msg && arg->writable) {
-                        rc = ipc_write(arg->client_fd, reply_msg,
-                                       strlen(reply_msg));
-                        if (rc < 0) {
-                            MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
-                            talloc_free(tmp);
-                            goto done;
-                        }
-                    }
-
-                    talloc_free(tmp);
-                }
-            }
+    if (!req)
+        return;
+
+    arg->busy = false;
+    bstr_xappend(arg, &arg->output, req->reply);
+    arg->msgpack = req->msgpack;
+    talloc_free(req);
+
+    client_start_command(arg);
+    if (!arg->dead)
+        client_flush(arg);
+}
+
+static void client_read(struct client_arg *arg)
+{
+    // Read once per call, so that a client flooding us with commands can't
+    // starve the others.
+    char buf[4096];
+    ssize_t bytes = read(arg->client_fd, buf, sizeof(buf));
+    if (bytes < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return;
+
+        MP_ERR(arg, "Read error (%s)\n", mp_strerror(errno));
+        arg->dead = true;
+        return;
+    }
+
+    if (bytes == 0) {
+        MP_INFO(arg, "Client disconnected\n");
+        arg->dead = true;
+        return;
+    }
+
+    bstr_xappend(arg, &arg->input, (bstr){buf, bytes});
+
+    client_start_command(arg);
+    if (!arg->dead)
+        client_flush(arg);
+}
+
+// Called by the client API (with arbitrary locks held).
+static void client_wakeup(void *p)
+{
+    struct client_arg *arg = p;
+    struct mp_ipc_ctx *ctx = arg->ipc;
+
+    pthread_mutex_lock(&ctx->lock);
+    bool need_wakeup = false;
+    if (!arg->queued) {
+        arg->queued = true;
+        MP_TARRAY_APPEND(ctx, ctx->ready, ctx->num_ready, arg);
+        need_wakeup = ctx->num_ready == 1;
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (need_wakeup)
+        write(ctx->wakeup_pipe[1], &(char){0}, 1);
+}
+
+// Update the registered poll flags of the client.
+static void client_update_poll(struct mp_ipc_ctx *ctx, struct client_arg *arg)
+{
+    int events = 0;
+    // While a command runs, further commands are left in the socket buffer.
+    if (!client_blocked(arg) && !arg->always_readable && !arg->busy)
+        events |= POLLIN;
+    if (output_size(arg))
+        events |= POLLOUT;
+    if (events == arg->poll_events)
+        return;
+    if (ipc_poll_update(ctx, arg->client_fd, arg, arg->poll_events, events) < 0)
+    {
+        // epoll doesn't support regular files. They're always readable.
+        if (errno == EPERM && !arg->poll_events) {
+            arg->always_readable = true;
+            return;
         }
+        MP_ERR(arg, "Could not poll client (%s)\n", mp_strerror(errno));
+        arg->dead = true;
+        return;
     }
+    arg->poll_events = events;
+}
 
-done:
-    if (client_msg.len > 0)
+// Must not be called while a command is running (arg->busy).
+static void client_destroy(struct mp_ipc_ctx *ctx, struct client_arg *arg)
+{
+    // After this, client_wakeup() can't be called anymore.
+    mpv_set_wakeup_callback(arg->client, NULL, NULL);
+
+    pthread_mutex_lock(&ctx->lock);
+    for (int n = 0; n < ctx->num_ready; n++) {
+        if (ctx->ready[n] == arg) {
+            MP_TARRAY_REMOVE_AT(ctx->ready, ctx->num_ready, n);
+            break;
+        }
+    }
+    talloc_free(arg->done);
+    arg->done = NULL;
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (arg->poll_events)
+        ipc_poll_update(ctx, arg->client_fd, arg, arg->poll_events, 0);
+
+    if (arg->input.len > 0)
         MP_WARN(arg, "Ignoring unterminated command on disconnect.\n");
-    talloc_free(client_msg.start);
     if (arg->close_client_fd)
         close(arg->client_fd);
     mpv_detach_destroy(arg->client);
+
+    for (int n = 0; n < ctx->num_clients; n++) {
+        if (ctx->clients[n] == arg) {
+            MP_TARRAY_REMOVE_AT(ctx->clients, ctx->num_clients, n);
+            break;
+        }
+    }
     talloc_free(arg);
-    return NULL;
 }
 
 static void ipc_start_client(struct mp_ipc_ctx *ctx, struct client_arg *client)
 {
     client->client = mp_new_client(ctx->client_api, client->client_name),
     client->log    = mp_client_get_log(client->client);
+    client->ipc    = ctx;
+    client->arena  = json_arena_create(client);
+    // Preallocate, so that the json_append functions don't create a new
+    // talloc root.
+    client->output = (bstr){talloc_size(client, 1), 0};
 
-    pthread_t client_thr;
-    if (pthread_create(&client_thr, NULL, client_thread, client)) {
-        mpv_detach_destroy(client->client);
-        if (client->close_client_fd)
-            close(client->client_fd);
-        talloc_free(client);
-    }
+    fcntl(client->client_fd, F_SETFL,
+          fcntl(client->client_fd, F_GETFL, 0) | O_NONBLOCK);
+
+    MP_INFO(client, "Client connected\n");
+
+    MP_TARRAY_APPEND(ctx, ctx->clients, ctx->num_clients, client);
+    mpv_set_wakeup_callback(client->client, client_wakeup, client);
 }
 
 static void ipc_start_client_json(struct mp_ipc_ctx *ctx, int id, int fd)
@@ -700,29 +1058,25 @@ static void ipc_start_client_text(struct mp_ipc_ctx *ctx, const char *path)
     ipc_start_client(ctx, client);
 }
 
-static void *ipc_thread(void *p)
+static int ipc_listen(struct mp_ipc_ctx *arg)
 {
     int rc;
 
     int ipc_fd;
     struct sockaddr_un ipc_un;
 
-    struct mp_ipc_ctx *arg = p;
-
-    mpthread_set_name("ipc socket listener");
-
     MP_INFO(arg, "Starting IPC master\n");
 
     ipc_fd = socket(AF_UNIX, SOCK_STREAM, 0);
     if (ipc_fd < 0) {
         MP_ERR(arg, "Could not create IPC socket\n");
-        goto done;
+        goto error;
     }
 
     size_t path_len = strlen(arg->path);
     if (path_len >= sizeof(ipc_un.sun_path) - 1) {
         MP_ERR(arg, "Could not create IPC socket\n");
-        goto done;
+        goto error;
     }
 
     ipc_un.sun_family = AF_UNIX,
@@ -739,46 +1093,141 @@ static void *ipc_thread(void *p)
     rc = bind(ipc_fd, (struct sockaddr *) &ipc_un, addr_len);
     if (rc < 0) {
         MP_ERR(arg, "Could not bind IPC socket\n");
-        goto done;
+        goto error;
     }
 
     rc = listen(ipc_fd, 10);
     if (rc < 0) {
         MP_ERR(arg, "Could not listen on IPC socket\n");
-        goto done;
+        goto error;
+    }
+
+    return ipc_fd;
+
+error:
+    if (ipc_fd >= 0)
+        close(ipc_fd);
+    return -1;
+}
+
+// Handle a wakeup from mp_uninit_ipc() or client_wakeup(). Returns false if
+// the thread should exit.
+static bool ipc_handle_wakeup(struct mp_ipc_ctx *ctx)
+{
+    char discard[100];
+    while (read(ctx->wakeup_pipe[0], discard, sizeof(discard)) > 0) {}
+
+    pthread_mutex_lock(&ctx->lock);
+    for (int n = 0; n < ctx->num_ready; n++) {
+        ctx->ready[n]->queued = false;
+        ctx->ready[n]->events_pending = true;
     }
+    ctx->num_ready = 0;
+    ctx->drop_blocked = ctx->shutting_down;
+    bool terminate = ctx->terminate;
+    pthread_mutex_unlock(&ctx->lock);
+
+    return !terminate;
+}
+
+static void *ipc_thread(void *p)
+{
+    struct mp_ipc_ctx *arg = p;
+
+    mpthread_set_name("ipc");
 
     int client_num = 0;
 
-    struct pollfd fds[2] = {
-        {.events = POLLIN, .fd = arg->death_pipe[0]},
-        {.events = POLLIN, .fd = ipc_fd},
-    };
+    arg->workers = mp_thread_pool_create(NULL, MAX_COMMAND_THREADS);
 
-    while (1) {
-        rc = poll(fds, 2, -1);
-        if (rc < 0) {
+    if (ipc_poll_update(arg, arg->wakeup_pipe[0], arg, 0, POLLIN) < 0) {
+        MP_ERR(arg, "Poll error\n");
+        goto done;
+    }
+
+    if (arg->input_file)
+        ipc_start_client_text(arg, arg->input_file);
+
+    if (arg->path) {
+        arg->ipc_fd = ipc_listen(arg);
+        if (arg->ipc_fd >= 0 &&
+            ipc_poll_update(arg, arg->ipc_fd, &arg->ipc_fd, 0, POLLIN) < 0)
+        {
             MP_ERR(arg, "Poll error\n");
-            continue;
+            goto done;
         }
+    }
 
-        if (fds[0].revents & POLLIN)
+    while (1) {
+        bool poll_now = false;
+        for (int n = arg->num_clients - 1; n >= 0; n--) {
+            struct client_arg *client = arg->clients[n];
+            if (client->busy)
+                client_finish_command(client);
+            if (client->events_pending && !client->dead)
+                client_events(client);
+            if (!client->dead)
+                client_update_poll(arg, client);
+            if (client->dead) {
+                if (!client->busy)
+                    client_destroy(arg, client);
+                continue;
+            }
+            if (client->always_readable && !client_blocked(client) &&
+                !client->busy)
+                poll_now = true;
+        }
+
+        struct ipc_poll_result res[MAX_POLL_RESULTS];
+        int num = ipc_wait(arg, poll_now ? 0 : -1, res);
+        if (num < 0 && errno != EINTR) {
+            // Retrying would most likely fail the same way, forever.
+            MP_ERR(arg, "Poll error (%s)\n", mp_strerror(errno));
             goto done;
+        }
 
-        if (fds[1].revents & POLLIN) {
-            int client_fd = accept(ipc_fd, NULL, NULL);
-            if (client_fd < 0) {
-                MP_ERR(arg, "Could not accept IPC client\n");
-                goto done;
+        for (int n = 0; n < num; n++) {
+            if (res[n].ptr == arg) {
+                if (!ipc_handle_wakeup(arg))
+                    goto done;
+            } else if (res[n].ptr == &arg->ipc_fd) {
+                int client_fd = accept(arg->ipc_fd, NULL, NULL);
+                if (client_fd < 0) {
+                    MP_ERR(arg, "Could not accept IPC client\n");
+                    continue;
+                }
+
+                ipc_start_client_json(arg, client_num++, client_fd);
+            } else {
+                struct client_arg *client = res[n].ptr;
+                if (res[n].revents & POLLOUT)
+                    client_flush(client);
+                if (!client->dead && (res[n].revents & ~POLLOUT))
+                    client_read(client);
             }
+        }
 
-            ipc_start_client_json(arg, client_num++, client_fd);
+        for (int n = 0; n < arg->num_clients; n++) {
+            struct client_arg *client = arg->clients[n];
+            if (client->always_readable && !client->dead &&
+                !client_blocked(client) && !client->busy)
+                client_read(client);
         }
     }
 
 done:
-    if (ipc_fd >= 0)
-        close(ipc_fd);
+    // Waits until all running commands are done.
+    talloc_free(arg->workers);
+    arg->workers = NULL;
+
+    while (arg->num_clients) {
+        struct client_arg *client = arg->clients[0];
+        client->busy = false;
+        client_destroy(arg, client);
+    }
+
+    if (arg->ipc_fd >= 0)
+        close(arg->ipc_fd);
 
     return NULL;
 }
@@ -793,18 +1242,32 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
         .log        = mp_log_new(arg, global->log, "ipc"),
         .client_api = client_api,
         .path       = mp_get_user_path(arg, global, opts->ipc_path),
-        .death_pipe = {-1, -1},
+        .input_file = mp_get_user_path(arg, global, opts->input_file),
+        .wakeup_pipe = {-1, -1},
+        .ipc_fd     = -1,
+#if HAVE_EPOLL
+        .epoll_fd   = -1,
+#endif
     };
-    char *input_file = mp_get_user_path(arg, global, opts->input_file);
+    pthread_mutex_init(&arg->lock, NULL);
 
-    if (input_file && *input_file)
-        ipc_start_client_text(arg, input_file);
+    if (arg->input_file && !*arg->input_file)
+        arg->input_file = NULL;
 
-    if (!opts->ipc_path || !*opts->ipc_path)
+    if (arg->path && !*arg->path)
+        arg->path = NULL;
+
+    if (!arg->input_file && !arg->path)
+        goto out;
+
+    if (mp_make_wakeup_pipe(arg->wakeup_pipe) < 0)
         goto out;
 
-    if (mp_make_wakeup_pipe(arg->death_pipe) < 0)
+#if HAVE_EPOLL
+    arg->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (arg->epoll_fd < 0)
         goto out;
+#endif
 
     if (pthread_create(&arg->thread, NULL, ipc_thread, arg))
         goto out;
@@ -812,21 +1275,46 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
     return arg;
 
 out:
-    close(arg->death_pipe[0]);
-    close(arg->death_pipe[1]);
+#if HAVE_EPOLL
+    if (arg->epoll_fd >= 0)
+        close(arg->epoll_fd);
+#endif
+    close(arg->wakeup_pipe[0]);
+    close(arg->wakeup_pipe[1]);
+    pthread_mutex_destroy(&arg->lock);
     talloc_free(arg);
     return NULL;
 }
 
+// Called before the player waits for its clients to exit. Clients which don't
+// read their output anymore lose it, so that they get the shutdown event.
+void mp_shutdown_ipc(struct mp_ipc_ctx *arg)
+{
+    if (!arg)
+        return;
+
+    pthread_mutex_lock(&arg->lock);
+    arg->shutting_down = true;
+    pthread_mutex_unlock(&arg->lock);
+    write(arg->wakeup_pipe[1], &(char){0}, 1);
+}
+
 void mp_uninit_ipc(struct mp_ipc_ctx *arg)
 {
     if (!arg)
         return;
 
-    write(arg->death_pipe[1], &(char){0}, 1);
+    pthread_mutex_lock(&arg->lock);
+    arg->terminate = true;
+    pthread_mutex_unlock(&arg->lock);
+    write(arg->wakeup_pipe[1], &(char){0}, 1);
     pthread_join(arg->thread, NULL);
 
-    close(arg->death_pipe[0]);
-    close(arg->death_pipe[1]);
+#if HAVE_EPOLL
+    close(arg->epoll_fd);
+#endif
+    close(arg->wakeup_pipe[0]);
+    close(arg->wakeup_pipe[1]);
+    pthread_mutex_destroy(&arg->lock);
     talloc_free(arg);
 }
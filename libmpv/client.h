@@ -101,6 +101,26 @@ extern "C" {
  * the client API, since everything is serialized through a single lock in the
  * playback core.
  *
+ * Multiple instances
+ * ------------------
+ *
+ * Any number of mpv instances can be created with mpv_create(), and they can
+ * be created, used and destroyed concurrently from different threads. Each
+ * instance has its own options, properties, playback thread and decoders,
+ * and instances don't influence each other, except for the following:
+ *
+ * - Process-wide state which never changes after creation is shared by all
+ *   instances, such as the property lookup index and the libavcodec/
+ *   libavformat registration. It's created with the first instance, and freed
+ *   with the last one.
+ * - Background work which doesn't need a dedicated thread (currently, writing
+ *   screenshots and vo_image frames) runs on a thread pool shared by all
+ *   instances, with at most one thread per CPU. Options like
+ *   --screenshot-threads still limit the concurrency of each instance.
+ * - Only one instance uses the terminal, and log messages from FFmpeg are
+ *   sent to one instance only.
+ * - The basic environment requirements below apply to the whole process.
+ *
  * Basic environment requirements
  * ------------------------------
  *
@@ -167,7 +187,7 @@ extern "C" {
  * relational operators (<, >, <=, >=).
  */
 #define MPV_MAKE_VERSION(major, minor) (((major) << 16) | (minor) | 0UL)
-#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(1, 12)
+#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(1, 17)
 
 /**
  * Return the MPV_CLIENT_API_VERSION the mpv source has been compiled with.
@@ -884,6 +904,66 @@ char *mpv_get_property_osd_string(mpv_handle *ctx, const char *name);
 int mpv_get_property_async(mpv_handle *ctx, uint64_t reply_userdata,
                            const char *name, mpv_format format);
 
+/**
+ * Read several properties at once. All properties are read while the player
+ * is locked once, so the values are consistent with each other (e.g. the
+ * "time-pos" and "percent-pos" properties refer to the same playback
+ * position), and this is faster than calling mpv_get_property() for each
+ * property.
+ *
+ * @param num Number of properties.
+ * @param[in] names Array of num property names.
+ * @param[in] formats Array of num formats, see mpv_get_property().
+ * @param[out] data Array of num pointers, each pointing to a variable of the
+ *                  type given by the corresponding entry in formats, as in
+ *                  mpv_get_property(). The variable is only set if the
+ *                  corresponding entry in errors is >= 0.
+ * @param[out] errors Array of num error codes, one for each property.
+ * @return error code if the request as a whole failed (the contents of errors
+ *         are undefined then), otherwise 0
+ */
+int mpv_get_properties(mpv_handle *ctx, int num, const char **names,
+                       const mpv_format *formats, void **data, int *errors);
+
+/**
+ * Opaque handle to a property name, see mpv_resolve_property().
+ */
+typedef struct mpv_property_handle mpv_property_handle;
+
+/**
+ * Look up a property name once, so that the property can be accessed
+ * repeatedly with mpv_get_property_resolved() and mpv_set_property_resolved()
+ * without parsing and looking up the name every time. This is useful for
+ * clients which poll many properties at a high rate.
+ *
+ * The name can include a sub-property path (like "track-list/3/lang"). Only
+ * the top-level property is looked up, so the handle stays valid if the sub-
+ * property (the 4th track in the example) appears or disappears.
+ *
+ * The handle can be used with any mpv_handle of the same mpv instance, and
+ * must be freed with mpv_free().
+ *
+ * @param name The property name.
+ * @return Property handle, or NULL if there is no such property.
+ */
+mpv_property_handle *mpv_resolve_property(mpv_handle *ctx, const char *name);
+
+/**
+ * Like mpv_get_property(), but with a property handle.
+ *
+ * @param prop Property handle returned by mpv_resolve_property().
+ */
+int mpv_get_property_resolved(mpv_handle *ctx, mpv_property_handle *prop,
+                              mpv_format format, void *data);
+
+/**
+ * Like mpv_set_property(), but with a property handle.
+ *
+ * @param prop Property handle returned by mpv_resolve_property().
+ */
+int mpv_set_property_resolved(mpv_handle *ctx, mpv_property_handle *prop,
+                              mpv_format format, void *data);
+
 /**
  * Get a notification whenever the given property changes. You will receive
  * updates as MPV_EVENT_PROPERTY_CHANGE. Note that this is not very precise:
@@ -934,6 +1014,31 @@ int mpv_get_property_async(mpv_handle *ctx, uint64_t reply_userdata,
 int mpv_observe_property(mpv_handle *mpv, uint64_t reply_userdata,
                          const char *name, mpv_format format);
 
+/**
+ * Like mpv_observe_property(), but limit the rate of change events. This is
+ * meant for properties which change all the time during playback, like
+ * "time-pos" or "percent-pos", if you don't need every update.
+ *
+ * Changes are coalesced: after a new value was retrieved, the next one is
+ * retrieved at the earliest min_interval seconds later, and you get only the
+ * most recent value. If the property stops changing, you still get the last
+ * value once the interval has passed. A held back change doesn't wake up the
+ * client, and the player doesn't need to compute the property value for it.
+ *
+ * @param min_interval minimum time in seconds between retrieving two new
+ *                     values. 0 means no rate limit.
+ * @param min_delta If the property value is a number (MPV_FORMAT_INT64,
+ *                  MPV_FORMAT_DOUBLE, or MPV_FORMAT_NODE with one of these),
+ *                  changes smaller than this compared to the last reported
+ *                  value are not reported. 0 reports all changes. Ignored
+ *                  for other values.
+ * @return error code (MPV_ERROR_INVALID_PARAMETER if either parameter is
+ *         negative, otherwise same as mpv_observe_property())
+ */
+int mpv_observe_property_throttled(mpv_handle *mpv, uint64_t reply_userdata,
+                                   const char *name, mpv_format format,
+                                   double min_interval, double min_delta);
+
 /**
  * Undo mpv_observe_property(). This will remove all observed properties for
  * which the given number was passed as reply_userdata to mpv_observe_property.
@@ -1117,7 +1222,14 @@ typedef enum mpv_event_id {
      *             "chapter" property. The event is redundant, and might
      *             be removed in the far future.
      */
-    MPV_EVENT_CHAPTER_CHANGE = 23
+    MPV_EVENT_CHAPTER_CHANGE = 23,
+    /**
+     * A screenshot requested with the "screenshot" or "screenshot_to_file"
+     * commands was written (or failed to be written). Screenshots are encoded
+     * asynchronously, so this can happen a while after the command returned.
+     * See also mpv_event and mpv_event_screenshot.
+     */
+    MPV_EVENT_SCREENSHOT_DONE = 24
     // Internal note: adjust INTERNAL_EVENT_BASE when adding new events.
 } mpv_event_id;
 
@@ -1270,6 +1382,33 @@ typedef struct mpv_event_client_message {
     const char **args;
 } mpv_event_client_message;
 
+typedef enum mpv_screenshot_status {
+    /**
+     * The screenshot was written successfully.
+     */
+    MPV_SCREENSHOT_SAVED = 0,
+    /**
+     * Encoding or writing the image file failed.
+     */
+    MPV_SCREENSHOT_FAILED = 1,
+    /**
+     * The screenshot was discarded, because the queue of pending screenshots
+     * was full and the "screenshot-queue-full" option was set to "drop".
+     */
+    MPV_SCREENSHOT_DROPPED = 2,
+} mpv_screenshot_status;
+
+typedef struct mpv_event_screenshot {
+    /**
+     * Outcome of the request, one of mpv_screenshot_status.
+     */
+    int status;
+    /**
+     * Full path of the target file.
+     */
+    const char *filename;
+} mpv_event_screenshot;
+
 typedef struct mpv_event {
     /**
      * One of mpv_event. Keep in mind that later ABI compatible releases might
@@ -1305,6 +1444,7 @@ typedef struct mpv_event {
      *  MPV_EVENT_LOG_MESSAGE:            mpv_event_log_message*
      *  MPV_EVENT_CLIENT_MESSAGE:         mpv_event_client_message*
      *  MPV_EVENT_END_FILE:               mpv_event_end_file*
+     *  MPV_EVENT_SCREENSHOT_DONE:        mpv_event_screenshot*
      *  other: NULL
      *
      * Note: future enhancements might add new event structs for existing or new
@@ -0,0 +1,119 @@
+/* Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef MPV_CLIENT_API_STATS_SHM_H_
+#define MPV_CLIENT_API_STATS_SHM_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Layout of the shared memory region created with --stats-shm. It doesn't
+ * require linking to libmpv.
+ *
+ * The player updates the region on every iteration of its playback loop. A
+ * reader maps it read-only, and copies it with mpv_stats_shm_read(), which
+ * needs no system calls or locks:
+ *
+ *      int fd = shm_open("/name", O_RDONLY, 0);
+ *      struct mpv_stats_shm *shm =
+ *          mmap(NULL, sizeof(*shm), PROT_READ, MAP_SHARED, fd, 0);
+ *      close(fd);
+ *      if (shm->magic != MPV_STATS_SHM_MAGIC ||
+ *          shm->version != MPV_STATS_SHM_VERSION ||
+ *          shm->size < sizeof(*shm))
+ *          ... incompatible ...
+ *      struct mpv_stats_shm st;
+ *      if (mpv_stats_shm_read(shm, &st) == 0)
+ *          ... use st.time_pos etc. ...
+ *
+ * Fields may be appended in later versions (with a larger size field).
+ * Incompatible changes increase the version field.
+ *
+ * The player removes the name on exit, and sets active to 0. If the player is
+ * restarted with the same name, a new region is created, so readers which
+ * see active==0 should map the name again.
+ *
+ * Values which are unavailable (e.g. duration with no file loaded) are NAN for
+ * doubles, and -1 for counters.
+ */
+struct mpv_stats_shm {
+    uint32_t magic;             // MPV_STATS_SHM_MAGIC
+    uint32_t version;           // MPV_STATS_SHM_VERSION
+    uint32_t size;              // sizeof(struct mpv_stats_shm) of the player
+    uint32_t seq;               // odd while an update is in progress
+    int64_t pid;                // process ID of the player
+    int64_t update_count;       // number of updates so far
+    int64_t update_time_us;     // time of the last update in microseconds, on
+                                // the system's monotonic clock (on Linux:
+                                // CLOCK_MONOTONIC)
+    int32_t active;             // 0 after the player exited
+    int32_t idle;               // no file is loaded (the "idle" property)
+    int32_t pause;              // the "pause" property
+    int32_t paused_for_cache;   // the "paused-for-cache" property
+    int32_t seeking;            // the "seeking" property
+    int32_t eof_reached;        // the "eof-reached" property
+    double time_pos;            // the "time-pos" property
+    double playback_time;       // the "playback-time" property
+    double duration;            // the "length" property
+    double percent_pos;         // the "percent-pos" property
+    double speed;               // the "speed" property
+    double avsync;              // the "avsync" property
+    double cache_percent;       // the "cache" property
+    int64_t drop_frame_count;   // the "drop-frame-count" property
+    int64_t vo_drop_frame_count; // the "vo-drop-frame-count" property
+};
+
+#define MPV_STATS_SHM_MAGIC 0x7374706dU // "mpts" in little endian
+#define MPV_STATS_SHM_VERSION 1
+
+#if defined(__ATOMIC_ACQUIRE)
+#define MPV_STATS_SHM_LOAD_SEQ_(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define MPV_STATS_SHM_FENCE_() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#else
+#define MPV_STATS_SHM_LOAD_SEQ_(p) \
+    (__sync_synchronize(), *(volatile const uint32_t *)(p))
+#define MPV_STATS_SHM_FENCE_() __sync_synchronize()
+#endif
+
+/**
+ * Copy a consistent snapshot of shm to out. Retries while the player is
+ * writing; gives up after a few thousand attempts.
+ *
+ * @return 0 on success, -1 if no consistent copy could be made (out is
+ *         undefined then)
+ */
+static inline int mpv_stats_shm_read(const struct mpv_stats_shm *shm,
+                                     struct mpv_stats_shm *out)
+{
+    for (int n = 0; n < 5000; n++) {
+        uint32_t seq = MPV_STATS_SHM_LOAD_SEQ_(&shm->seq);
+        if (seq & 1)
+            continue;
+        memcpy(out, (const void *)shm, sizeof(*out));
+        MPV_STATS_SHM_FENCE_();
+        if (*(volatile const uint32_t *)&shm->seq == seq)
+            return 0;
+    }
+    return -1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -37,6 +37,10 @@
  *
  * Currently, will insert \u literals for characters 0-31, '"', '\', and write
  * everything else literally.
+ *
+ * The json_append_*() functions write directly into a caller provided
+ * buffer, so messages can be generated without building a mpv_node tree
+ * first, and without any allocations once the buffer is large enough.
  */
 
 #include <stdlib.h>
@@ -48,6 +52,7 @@
 
 #include "common/common.h"
 #include "misc/bstr.h"
+#include "player/client.h"
 
 #include "json.h"
 
@@ -75,6 +80,59 @@ void json_skip_whitespace(char **src)
     eat_ws(src);
 }
 
+#define ARENA_ALIGN 16
+#define ARENA_MIN_SIZE 4096
+
+struct json_arena {
+    void *ta;               // escaped strings, replaced blocks
+    char *block;
+    size_t size, used;
+    // Elements of the arrays/objects which are being parsed. They're copied
+    // to the arena once the number of elements is known.
+    struct mpv_node *values;
+    char **keys;
+    int num_values;
+};
+
+struct json_arena *json_arena_create(void *ta_parent)
+{
+    struct json_arena *arena = talloc_zero(ta_parent, struct json_arena);
+    arena->ta = talloc_new(arena);
+    return arena;
+}
+
+void json_arena_reset(struct json_arena *arena)
+{
+    talloc_free_children(arena->ta);
+    arena->used = 0;
+    arena->num_values = 0;
+}
+
+// Allocate memory, which is valid until the next json_arena_reset() call.
+void *json_arena_alloc(struct json_arena *arena, size_t size)
+{
+    size = MP_ALIGN_UP(size, ARENA_ALIGN);
+    if (size > arena->size - arena->used) {
+        // Keep the old block until the next reset; it's still referenced.
+        talloc_steal(arena->ta, arena->block);
+        arena->size = MPMAX(MPMAX(arena->size * 2, ARENA_MIN_SIZE), size);
+        arena->block = talloc_size(arena, arena->size);
+        arena->used = 0;
+    }
+    void *p = arena->block + arena->used;
+    arena->used += size;
+    return p;
+}
+
+// Allocations either come from the arena, or are talloc children of ta.
+struct parse_ctx {
+    void *ta;
+    struct json_arena *arena;
+};
+
+static int parse(struct parse_ctx *ctx, struct mpv_node *dst, char **src,
+                 int max_depth);
+
 static int read_str(void *ta_parent, struct mpv_node *dst, char **src)
 {
     if (!eat_c(src, '"'))
@@ -109,7 +167,7 @@ static int read_str(void *ta_parent, struct mpv_node *dst, char **src)
     return 0;
 }
 
-static int read_sub(void *ta_parent, struct mpv_node *dst, char **src,
+static int read_sub(struct parse_ctx *ctx, struct mpv_node *dst, char **src,
                     int max_depth)
 {
     bool is_arr = eat_c(src, '[');
@@ -117,7 +175,16 @@ static int read_sub(void *ta_parent, struct mpv_node *dst, char **src,
     if (!is_arr && !is_obj)
         return -1; // not an array or object
     char term = is_obj ? '}' : ']';
-    struct mpv_node_list *list = talloc_zero(ta_parent, struct mpv_node_list);
+    struct json_arena *arena = ctx->arena;
+    struct mpv_node_list *list;
+    if (arena) {
+        list = json_arena_alloc(arena, sizeof(*list));
+        *list = (struct mpv_node_list){0};
+    } else {
+        list = talloc_zero(ctx->ta, struct mpv_node_list);
+    }
+    // With an arena, the elements are first collected in the arena's stack.
+    int base = arena ? arena->num_values : 0;
     while (1) {
         eat_ws(src);
         if (eat_c(src, term))
@@ -125,22 +192,52 @@ static int read_sub(void *ta_parent, struct mpv_node *dst, char **src,
         if (list->num > 0 && !eat_c(src, ','))
             return -1; // missing ','
         eat_ws(src);
+        char *key = NULL;
         if (is_obj) {
             struct mpv_node keynode;
-            if (read_str(list, &keynode, src) < 0)
+            if (read_str(arena ? arena->ta : list, &keynode, src) < 0)
                 return -1; // key is not a string
             eat_ws(src);
             if (!eat_c(src, ':'))
                 return -1; // ':' missing
             eat_ws(src);
-            MP_TARRAY_GROW(list, list->keys, list->num);
-            list->keys[list->num] = keynode.u.string;
+            key = keynode.u.string;
         }
-        MP_TARRAY_GROW(list, list->values, list->num);
-        if (json_parse(ta_parent, &list->values[list->num], src, max_depth) < 0)
+        struct mpv_node val;
+        if (parse(ctx, &val, src, max_depth) < 0)
             return -1;
+        // (The key is added only now, because val might use the stack too.)
+        if (arena) {
+            if (is_obj) {
+                MP_TARRAY_GROW(arena, arena->keys, base + list->num);
+                arena->keys[base + list->num] = key;
+            }
+            MP_TARRAY_GROW(arena, arena->values, base + list->num);
+            arena->values[base + list->num] = val;
+            arena->num_values = base + list->num + 1;
+        } else {
+            if (is_obj) {
+                MP_TARRAY_GROW(list, list->keys, list->num);
+                list->keys[list->num] = key;
+            }
+            MP_TARRAY_GROW(list, list->values, list->num);
+            list->values[list->num] = val;
+        }
         list->num++;
     }
+    if (arena && list->num) {
+        list->values = json_arena_alloc(arena,
+                                        list->num * sizeof(list->values[0]));
+        memcpy(list->values, arena->values + base,
+               list->num * sizeof(list->values[0]));
+        arena->num_values = base;
+        if (is_obj) {
+            list->keys = json_arena_alloc(arena,
+                                          list->num * sizeof(list->keys[0]));
+            memcpy(list->keys, arena->keys + base,
+                   list->num * sizeof(list->keys[0]));
+        }
+    }
     dst->format = is_obj ? MPV_FORMAT_NODE_MAP : MPV_FORMAT_NODE_ARRAY;
     dst->u.list = list;
     return 0;
@@ -158,6 +255,25 @@ static int read_sub(void *ta_parent, struct mpv_node *dst, char **src,
  * elements, which point into the (mutated) input string.
  */
 int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
+{
+    struct parse_ctx ctx = {.ta = ta_parent};
+    return parse(&ctx, dst, src, max_depth);
+}
+
+/* Like json_parse(), but allocate the result from the arena. The result is
+ * valid until the next json_arena_reset() call (the caller should reset the
+ * arena before each parse, otherwise memory usage grows). This avoids most of
+ * the allocations done by json_parse().
+ */
+int json_parse_arena(struct json_arena *arena, struct mpv_node *dst,
+                     char **src, int max_depth)
+{
+    struct parse_ctx ctx = {.ta = arena->ta, .arena = arena};
+    return parse(&ctx, dst, src, max_depth);
+}
+
+static int parse(struct parse_ctx *ctx, struct mpv_node *dst, char **src,
+                 int max_depth)
 {
     max_depth -= 1;
     if (max_depth < 0)
@@ -183,9 +299,9 @@ int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
         dst->u.flag = 0;
         return 0;
     } else if (c == '"') {
-        return read_str(ta_parent, dst, src);
+        return read_str(ctx->ta, dst, src);
     } else if (c == '[' || c == '{') {
-        return read_sub(ta_parent, dst, src, max_depth);
+        return read_sub(ctx, dst, src, max_depth);
     } else if (c == '-' || (c >= '0' && c <= '9')) {
         // The number could be either a float or an int. JSON doesn't make a
         // difference, but the client API does.
@@ -218,24 +334,45 @@ int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
 
 #define APPEND(b, s) bstr_xappend(NULL, (b), bstr0(s))
 
-static void write_json_str(bstr *b, char *str)
+void json_append_string(bstr *b, const char *str)
 {
-    APPEND(b, "\"");
+    bstr_xappend(NULL, b, bstr0("\""));
     while (1) {
-        char *cur = str;
-        while (cur[0] && cur[0] >= 32 && cur[0] != '"' && cur[0] != '\\')
+        const char *cur = str;
+        // (unsigned, so that UTF-8 sequences are written literally)
+        while ((unsigned char)cur[0] >= 32 && cur[0] != '"' && cur[0] != '\\')
             cur++;
+        bstr_xappend(NULL, b, (bstr){(char *)str, cur - str});
         if (!cur[0])
             break;
-        bstr_xappend(NULL, b, (bstr){str, cur - str});
-        bstr_xappend_asprintf(NULL, b, "\\u%04x", (unsigned char)cur[0]);
+        static const char hex[] = "0123456789abcdef";
+        unsigned char c = cur[0];
+        char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+        bstr_xappend(NULL, b, (bstr){esc, sizeof(esc)});
         str = cur + 1;
     }
-    APPEND(b, str);
-    APPEND(b, "\"");
+    bstr_xappend(NULL, b, bstr0("\""));
 }
 
-static int json_append(bstr *b, const struct mpv_node *src)
+void json_append_int64(bstr *b, int64_t v)
+{
+    char buf[24];
+    int len = snprintf(buf, sizeof(buf), "%"PRId64, v);
+    bstr_xappend(NULL, b, (bstr){buf, len});
+}
+
+void json_append_double(bstr *b, double v)
+{
+    char buf[64];
+    int len = snprintf(buf, sizeof(buf), "%f", v);
+    if (len >= sizeof(buf)) {
+        bstr_xappend_asprintf(NULL, b, "%f", v); // huge numbers
+    } else {
+        bstr_xappend(NULL, b, (bstr){buf, len});
+    }
+}
+
+int json_append(bstr *b, const struct mpv_node *src)
 {
     switch (src->format) {
     case MPV_FORMAT_NONE:
@@ -245,13 +382,13 @@ static int json_append(bstr *b, const struct mpv_node *src)
         APPEND(b, src->u.flag ? "true" : "false");
         return 0;
     case MPV_FORMAT_INT64:
-        bstr_xappend_asprintf(NULL, b, "%"PRId64, src->u.int64);
+        json_append_int64(b, src->u.int64);
         return 0;
     case MPV_FORMAT_DOUBLE:
-        bstr_xappend_asprintf(NULL, b, "%f", src->u.double_);
+        json_append_double(b, src->u.double_);
         return 0;
     case MPV_FORMAT_STRING:
-        write_json_str(b, src->u.string);
+        json_append_string(b, src->u.string);
         return 0;
     case MPV_FORMAT_NODE_ARRAY:
     case MPV_FORMAT_NODE_MAP: {
@@ -262,7 +399,7 @@ static int json_append(bstr *b, const struct mpv_node *src)
             if (n)
                 APPEND(b, ",");
             if (is_obj) {
-                write_json_str(b, list->keys[n]);
+                json_append_string(b, list->keys[n]);
                 APPEND(b, ":");
             }
             json_append(b, &list->values[n]);
@@ -286,3 +423,100 @@ int json_write(char **dst, struct mpv_node *src)
     *dst = buffer.start;
     return r;
 }
+
+// Append ',"key":'. The key must not need escaping.
+static void append_key(bstr *b, const char *key)
+{
+    APPEND(b, ",\"");
+    APPEND(b, key);
+    APPEND(b, "\":");
+}
+
+/* Append the event as JSON object, as used by the IPC protocol, followed by
+ * a newline. This is equivalent to converting the event to a mpv_node map and
+ * calling json_append(), but much cheaper.
+ * Returns: 0 on success, <0 on failure (if the event data is invalid).
+ */
+int json_append_event(bstr *b, struct mpv_event *event)
+{
+    APPEND(b, "{\"event\":");
+    json_append_string(b, mpv_event_name(event->event_id));
+
+    if (event->reply_userdata) {
+        append_key(b, "id");
+        json_append_int64(b, event->reply_userdata);
+    }
+
+    if (event->error < 0) {
+        append_key(b, "error");
+        json_append_string(b, mpv_error_string(event->error));
+    }
+
+    switch (event->event_id) {
+    case MPV_EVENT_LOG_MESSAGE: {
+        struct mpv_event_log_message *msg = event->data;
+
+        append_key(b, "prefix");
+        json_append_string(b, msg->prefix);
+        append_key(b, "level");
+        json_append_string(b, msg->level);
+        append_key(b, "text");
+        json_append_string(b, msg->text);
+        break;
+    }
+
+    case MPV_EVENT_CLIENT_MESSAGE: {
+        struct mpv_event_client_message *msg = event->data;
+
+        append_key(b, "args");
+        APPEND(b, "[");
+        for (int n = 0; n < msg->num_args; n++) {
+            if (n)
+                APPEND(b, ",");
+            json_append_string(b, msg->args[n]);
+        }
+        APPEND(b, "]");
+        break;
+    }
+
+    case MPV_EVENT_SCREENSHOT_DONE: {
+        struct mpv_event_screenshot *msg = event->data;
+
+        append_key(b, "status");
+        json_append_string(b, mp_screenshot_status_name(msg->status));
+        append_key(b, "filename");
+        json_append_string(b, msg->filename);
+        break;
+    }
+
+    case MPV_EVENT_PROPERTY_CHANGE: {
+        struct mpv_event_property *prop = event->data;
+
+        append_key(b, "name");
+        json_append_string(b, prop->name);
+
+        append_key(b, "data");
+        switch (prop->format) {
+        case MPV_FORMAT_NODE:
+            if (json_append(b, prop->data) < 0)
+                return -1;
+            break;
+        case MPV_FORMAT_DOUBLE:
+            json_append_double(b, *(double *)prop->data);
+            break;
+        case MPV_FORMAT_FLAG:
+            APPEND(b, *(int *)prop->data ? "true" : "false");
+            break;
+        case MPV_FORMAT_STRING:
+            json_append_string(b, *(char **)prop->data);
+            break;
+        default:
+            APPEND(b, "null");
+        }
+        break;
+    }
+    }
+
+    APPEND(b, "}\n");
+    return 0;
+}
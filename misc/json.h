@@ -21,8 +21,26 @@
 // We reuse mpv_node.
 #include "libmpv/client.h"
 
+#include "misc/bstr.h"
+
+struct json_arena;
+
 int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth);
 void json_skip_whitespace(char **src);
 int json_write(char **s, struct mpv_node *src);
 
+struct json_arena *json_arena_create(void *ta_parent);
+void json_arena_reset(struct json_arena *arena);
+void *json_arena_alloc(struct json_arena *arena, size_t size);
+int json_parse_arena(struct json_arena *arena, struct mpv_node *dst,
+                     char **src, int max_depth);
+
+// Streaming writer. b->start must be a talloc allocation or NULL (like with
+// bstr_xappend()), and is extended as needed.
+int json_append(bstr *b, const struct mpv_node *src);
+void json_append_string(bstr *b, const char *str);
+void json_append_int64(bstr *b, int64_t v);
+void json_append_double(bstr *b, double v);
+int json_append_event(bstr *b, struct mpv_event *event);
+
 #endif
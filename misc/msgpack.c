@@ -0,0 +1,486 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* MessagePack encoder/decoder for mpv_node, used by the binary IPC protocol.
+ *
+ * This is a subset of http://msgpack.org/ (the "new" spec with str8 and bin
+ * types). Not supported: ext types (rejected by the parser), and uint64
+ * values larger than INT64_MAX (likewise). Map keys must be strings. float32
+ * values are read, but never written.
+ *
+ * The parser returns str and bin values as MPV_FORMAT_STRING (if they contain
+ * embedded 0 bytes, they're cut off there). The writer never writes bin.
+ *
+ * The binary IPC protocol prefixes each message with its length in bytes,
+ * as 32 bit big endian number. This is done by msgpack_frame_begin/end().
+ */
+
+#include <string.h>
+#include <assert.h>
+
+#include "common/common.h"
+#include "misc/bstr.h"
+
+#include "misc/json.h"
+#include "player/client.h"
+
+#include "msgpack.h"
+
+static void append_bytes(bstr *b, const void *data, size_t size)
+{
+    bstr_xappend(NULL, b, (bstr){(unsigned char *)data, size});
+}
+
+// Append tag byte followed by the lowest size bytes of v, big endian.
+static void append_tagged(bstr *b, uint8_t tag, uint64_t v, int size)
+{
+    uint8_t buf[9] = {tag};
+    for (int n = 0; n < size; n++)
+        buf[1 + n] = v >> (8 * (size - n - 1));
+    append_bytes(b, buf, 1 + size);
+}
+
+static void append_int64(bstr *b, int64_t v)
+{
+    if (v >= 0) {
+        if (v < 128) {
+            append_tagged(b, v, 0, 0);
+        } else if (v <= UINT8_MAX) {
+            append_tagged(b, 0xcc, v, 1);
+        } else if (v <= UINT16_MAX) {
+            append_tagged(b, 0xcd, v, 2);
+        } else if (v <= UINT32_MAX) {
+            append_tagged(b, 0xce, v, 4);
+        } else {
+            append_tagged(b, 0xcf, v, 8);
+        }
+    } else {
+        if (v >= -32) {
+            append_tagged(b, (uint8_t)v, 0, 0);
+        } else if (v >= INT8_MIN) {
+            append_tagged(b, 0xd0, v, 1);
+        } else if (v >= INT16_MIN) {
+            append_tagged(b, 0xd1, v, 2);
+        } else if (v >= INT32_MIN) {
+            append_tagged(b, 0xd2, v, 4);
+        } else {
+            append_tagged(b, 0xd3, v, 8);
+        }
+    }
+}
+
+static void append_double(bstr *b, double v)
+{
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    append_tagged(b, 0xcb, bits, 8);
+}
+
+// fix: tag of the fix* variant, which can encode sizes up to fix_max.
+// tag8: tag of the 8 bit variant (or 0 if none). tag16: tag of the 16 bit
+// variant, which is followed by the 32 bit one.
+static void append_size(bstr *b, size_t size, uint8_t fix, size_t fix_max,
+                        uint8_t tag8, uint8_t tag16)
+{
+    if (size <= fix_max) {
+        append_tagged(b, fix | size, 0, 0);
+    } else if (tag8 && size <= UINT8_MAX) {
+        append_tagged(b, tag8, size, 1);
+    } else if (size <= UINT16_MAX) {
+        append_tagged(b, tag16, size, 2);
+    } else {
+        append_tagged(b, tag16 + 1, size, 4);
+    }
+}
+
+static void append_str(bstr *b, const char *str)
+{
+    size_t len = strlen(str);
+    append_size(b, len, 0xa0, 31, 0xd9, 0xda);
+    append_bytes(b, str, len);
+}
+
+static void append_map_header(bstr *b, int num)
+{
+    append_size(b, num, 0x80, 15, 0, 0xde);
+}
+
+static void append_array_header(bstr *b, int num)
+{
+    append_size(b, num, 0x90, 15, 0, 0xdc);
+}
+
+/* Write the contents of *src as MessagePack, and append it to *b. This uses
+ * ta_get_size() and ta_realloc() to extend the memory allocation of b->start.
+ * Returns: 0 on success, <0 on failure.
+ */
+int msgpack_append(bstr *b, const struct mpv_node *src)
+{
+    switch (src->format) {
+    case MPV_FORMAT_NONE:
+        append_tagged(b, 0xc0, 0, 0);
+        return 0;
+    case MPV_FORMAT_FLAG:
+        append_tagged(b, src->u.flag ? 0xc3 : 0xc2, 0, 0);
+        return 0;
+    case MPV_FORMAT_INT64:
+        append_int64(b, src->u.int64);
+        return 0;
+    case MPV_FORMAT_DOUBLE:
+        append_double(b, src->u.double_);
+        return 0;
+    case MPV_FORMAT_STRING:
+        append_str(b, src->u.string);
+        return 0;
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP: {
+        struct mpv_node_list *list = src->u.list;
+        bool is_obj = src->format == MPV_FORMAT_NODE_MAP;
+        if (is_obj) {
+            append_map_header(b, list->num);
+        } else {
+            append_array_header(b, list->num);
+        }
+        for (int n = 0; n < list->num; n++) {
+            if (is_obj)
+                append_str(b, list->keys[n]);
+            if (msgpack_append(b, &list->values[n]) < 0)
+                return -1;
+        }
+        return 0;
+    }
+    }
+    return -1; // unknown format
+}
+
+/* Append the event as MessagePack map, with the same contents as the JSON
+ * object written by json_append_event().
+ * Returns: 0 on success, <0 on failure (if the event data is invalid).
+ */
+int msgpack_append_event(bstr *b, struct mpv_event *event)
+{
+    int num = 1 + !!event->reply_userdata + (event->error < 0);
+    switch (event->event_id) {
+    case MPV_EVENT_LOG_MESSAGE:     num += 3; break;
+    case MPV_EVENT_CLIENT_MESSAGE:  num += 1; break;
+    case MPV_EVENT_SCREENSHOT_DONE: num += 2; break;
+    case MPV_EVENT_PROPERTY_CHANGE: num += 2; break;
+    }
+    append_map_header(b, num);
+
+    append_str(b, "event");
+    append_str(b, mpv_event_name(event->event_id));
+
+    if (event->reply_userdata) {
+        append_str(b, "id");
+        append_int64(b, event->reply_userdata);
+    }
+
+    if (event->error < 0) {
+        append_str(b, "error");
+        append_str(b, mpv_error_string(event->error));
+    }
+
+    switch (event->event_id) {
+    case MPV_EVENT_LOG_MESSAGE: {
+        struct mpv_event_log_message *msg = event->data;
+
+        append_str(b, "prefix");
+        append_str(b, msg->prefix);
+        append_str(b, "level");
+        append_str(b, msg->level);
+        append_str(b, "text");
+        append_str(b, msg->text);
+        break;
+    }
+
+    case MPV_EVENT_CLIENT_MESSAGE: {
+        struct mpv_event_client_message *msg = event->data;
+
+        append_str(b, "args");
+        append_array_header(b, msg->num_args);
+        for (int n = 0; n < msg->num_args; n++)
+            append_str(b, msg->args[n]);
+        break;
+    }
+
+    case MPV_EVENT_SCREENSHOT_DONE: {
+        struct mpv_event_screenshot *msg = event->data;
+
+        append_str(b, "status");
+        append_str(b, mp_screenshot_status_name(msg->status));
+        append_str(b, "filename");
+        append_str(b, msg->filename);
+        break;
+    }
+
+    case MPV_EVENT_PROPERTY_CHANGE: {
+        struct mpv_event_property *prop = event->data;
+
+        append_str(b, "name");
+        append_str(b, prop->name);
+
+        append_str(b, "data");
+        switch (prop->format) {
+        case MPV_FORMAT_NODE:
+            if (msgpack_append(b, prop->data) < 0)
+                return -1;
+            break;
+        case MPV_FORMAT_DOUBLE:
+            append_double(b, *(double *)prop->data);
+            break;
+        case MPV_FORMAT_FLAG:
+            append_tagged(b, *(int *)prop->data ? 0xc3 : 0xc2, 0, 0);
+            break;
+        case MPV_FORMAT_STRING:
+            append_str(b, *(char **)prop->data);
+            break;
+        default:
+            append_tagged(b, 0xc0, 0, 0);
+        }
+        break;
+    }
+    }
+
+    return 0;
+}
+
+// Reserve space for the frame header. Returns the value to pass to
+// msgpack_frame_end() after the message was appended.
+size_t msgpack_frame_begin(bstr *b)
+{
+    size_t start = b->len;
+    append_bytes(b, (uint8_t[MSGPACK_FRAME_HEADER]){0}, MSGPACK_FRAME_HEADER);
+    return start;
+}
+
+void msgpack_frame_end(bstr *b, size_t start)
+{
+    size_t size = b->len - start - MSGPACK_FRAME_HEADER;
+    for (int n = 0; n < MSGPACK_FRAME_HEADER; n++)
+        b->start[start + n] = size >> (8 * (MSGPACK_FRAME_HEADER - n - 1));
+}
+
+// Return the size of the message (excluding the header) at the start of src,
+// or -1 if the header is incomplete.
+int64_t msgpack_frame_size(bstr src)
+{
+    if (src.len < MSGPACK_FRAME_HEADER)
+        return -1;
+    int64_t size = 0;
+    for (int n = 0; n < MSGPACK_FRAME_HEADER; n++)
+        size = (size << 8) | src.start[n];
+    return size;
+}
+
+// Read a size bytes big endian number.
+static bool read_uint(bstr *src, int size, uint64_t *out)
+{
+    if (src->len < size)
+        return false;
+    uint64_t v = 0;
+    for (int n = 0; n < size; n++)
+        v = (v << 8) | src->start[n];
+    *src = bstr_cut(*src, size);
+    *out = v;
+    return true;
+}
+
+static bool read_bytes(bstr *src, uint64_t size, bstr *out)
+{
+    if (src->len < size)
+        return false;
+    *out = bstr_splice(*src, 0, size);
+    *src = bstr_cut(*src, size);
+    return true;
+}
+
+// Allocations either come from the arena, or are talloc children of ta.
+struct parse_ctx {
+    void *ta;
+    struct json_arena *arena;
+};
+
+static void *parse_alloc(struct parse_ctx *ctx, size_t size)
+{
+    return ctx->arena ? json_arena_alloc(ctx->arena, size)
+                      : talloc_size(ctx->ta, size);
+}
+
+static int parse(struct parse_ctx *ctx, struct mpv_node *dst, bstr *src,
+                 int max_depth)
+{
+    max_depth -= 1;
+    if (max_depth < 0)
+        return -1;
+
+    uint64_t v;
+    if (!read_uint(src, 1, &v))
+        return -1;
+    uint8_t tag = v;
+
+    uint64_t size = 0;
+    enum { SCALAR, STR, BIN, ARRAY, MAP } type = SCALAR;
+    if (tag <= 0x7f) {
+        *dst = (struct mpv_node){.format = MPV_FORMAT_INT64, .u.int64 = tag};
+        return 0;
+    } else if (tag >= 0xe0) {
+        *dst = (struct mpv_node){.format = MPV_FORMAT_INT64,
+                                 .u.int64 = (int8_t)tag};
+        return 0;
+    } else if (tag <= 0x8f) {
+        type = MAP;
+        size = tag & 0x0f;
+    } else if (tag <= 0x9f) {
+        type = ARRAY;
+        size = tag & 0x0f;
+    } else if (tag <= 0xbf) {
+        type = STR;
+        size = tag & 0x1f;
+    }
+
+    switch (tag) {
+    case 0xc0:
+        *dst = (struct mpv_node){.format = MPV_FORMAT_NONE};
+        return 0;
+    case 0xc2:
+    case 0xc3:
+        *dst = (struct mpv_node){.format = MPV_FORMAT_FLAG,
+                                 .u.flag = tag == 0xc3};
+        return 0;
+    case 0xc4: case 0xc5: case 0xc6:
+        type = BIN;
+        if (!read_uint(src, 1 << (tag - 0xc4), &size))
+            return -1;
+        break;
+    case 0xca: {
+        uint32_t bits;
+        float f;
+        if (!read_uint(src, 4, &v))
+            return -1;
+        bits = v;
+        memcpy(&f, &bits, sizeof(f));
+        *dst = (struct mpv_node){.format = MPV_FORMAT_DOUBLE, .u.double_ = f};
+        return 0;
+    }
+    case 0xcb: {
+        double d;
+        if (!read_uint(src, 8, &v))
+            return -1;
+        memcpy(&d, &v, sizeof(d));
+        *dst = (struct mpv_node){.format = MPV_FORMAT_DOUBLE, .u.double_ = d};
+        return 0;
+    }
+    case 0xcc: case 0xcd: case 0xce: case 0xcf:
+        if (!read_uint(src, 1 << (tag - 0xcc), &v) || v > INT64_MAX)
+            return -1;
+        *dst = (struct mpv_node){.format = MPV_FORMAT_INT64, .u.int64 = v};
+        return 0;
+    case 0xd0: case 0xd1: case 0xd2: case 0xd3: {
+        int size_bytes = 1 << (tag - 0xd0);
+        if (!read_uint(src, size_bytes, &v))
+            return -1;
+        // sign extend
+        int shift = 64 - 8 * size_bytes;
+        int64_t i = shift ? (int64_t)(v << shift) >> shift : (int64_t)v;
+        *dst = (struct mpv_node){.format = MPV_FORMAT_INT64, .u.int64 = i};
+        return 0;
+    }
+    case 0xd9: case 0xda: case 0xdb:
+        type = STR;
+        if (!read_uint(src, 1 << (tag - 0xd9), &size))
+            return -1;
+        break;
+    case 0xdc: case 0xdd:
+        type = ARRAY;
+        if (!read_uint(src, tag == 0xdc ? 2 : 4, &size))
+            return -1;
+        break;
+    case 0xde: case 0xdf:
+        type = MAP;
+        if (!read_uint(src, tag == 0xde ? 2 : 4, &size))
+            return -1;
+        break;
+    }
+
+    switch (type) {
+    case STR:
+    case BIN: {
+        bstr data;
+        if (!read_bytes(src, size, &data))
+            return -1;
+        char *str = parse_alloc(ctx, data.len + 1);
+        memcpy(str, data.start, data.len);
+        str[data.len] = '\0';
+        *dst = (struct mpv_node){.format = MPV_FORMAT_STRING, .u.string = str};
+        return 0;
+    }
+    case ARRAY:
+    case MAP: {
+        bool is_obj = type == MAP;
+        // Each element takes at least 1 byte, so this avoids huge allocations
+        // for broken input.
+        if (size > src->len)
+            return -1;
+        struct mpv_node_list *list = parse_alloc(ctx, sizeof(*list));
+        *list = (struct mpv_node_list){
+            .values = parse_alloc(ctx, size * sizeof(list->values[0])),
+            .keys = is_obj ? parse_alloc(ctx, size * sizeof(list->keys[0]))
+                           : NULL,
+        };
+        for (int n = 0; n < size; n++) {
+            if (is_obj) {
+                struct mpv_node key;
+                if (parse(ctx, &key, src, 1) < 0 ||
+                    key.format != MPV_FORMAT_STRING)
+                    return -1; // key is not a string
+                list->keys[n] = key.u.string;
+            }
+            if (parse(ctx, &list->values[n], src, max_depth) < 0)
+                return -1;
+            list->num++;
+        }
+        dst->format = is_obj ? MPV_FORMAT_NODE_MAP : MPV_FORMAT_NODE_ARRAY;
+        dst->u.list = list;
+        return 0;
+    }
+    default:
+        return -1; // unused or ext tags
+    }
+}
+
+/* Parse the MessagePack value at the start of *src, and write the result to
+ * *dst. *src is advanced to the end of the value. Strings and other data are
+ * allocated with ta_parent. max_depth is the maximum nesting of arrays and
+ * maps (like with json_parse()).
+ * Returns: 0 on success, <0 on failure.
+ */
+int msgpack_parse(void *ta_parent, struct mpv_node *dst, bstr *src,
+                  int max_depth)
+{
+    struct parse_ctx ctx = {.ta = ta_parent};
+    return parse(&ctx, dst, src, max_depth);
+}
+
+// Like msgpack_parse(), but allocate the result from the arena (see
+// json_parse_arena()).
+int msgpack_parse_arena(struct json_arena *arena, struct mpv_node *dst,
+                        bstr *src, int max_depth)
+{
+    struct parse_ctx ctx = {.arena = arena};
+    return parse(&ctx, dst, src, max_depth);
+}
@@ -0,0 +1,45 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_MSGPACK_H
+#define MP_MSGPACK_H
+
+// We reuse mpv_node.
+#include "libmpv/client.h"
+
+#include "misc/bstr.h"
+
+// Size of the big endian length field before each message of the binary IPC
+// protocol.
+#define MSGPACK_FRAME_HEADER 4
+
+struct json_arena;
+
+int msgpack_parse(void *ta_parent, struct mpv_node *dst, bstr *src,
+                  int max_depth);
+int msgpack_parse_arena(struct json_arena *arena, struct mpv_node *dst,
+                        bstr *src, int max_depth);
+
+// Same buffer requirements as with json_append().
+int msgpack_append(bstr *b, const struct mpv_node *src);
+int msgpack_append_event(bstr *b, struct mpv_event *event);
+
+size_t msgpack_frame_begin(bstr *b);
+void msgpack_frame_end(bstr *b, size_t start);
+int64_t msgpack_frame_size(bstr src);
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef MP_SIMD_H_
+#define MP_SIMD_H_
+
+#include <stddef.h>
+#include <pthread.h>
+
+#include <libavutil/cpu.h>
+
+#include "config.h"
+
+// Kernel sets with several implementations are a struct mp_<name>_fns of
+// function pointers with a "name" field. The C file defines one const instance
+// per implementation, named <name>_fns_c, <name>_fns_sse2 and
+// <name>_fns_avx2. The C version serves as reference; the SIMD ones are only
+// defined if HAVE_X86_SIMD is set.
+
+// Declare the public functions of a kernel set:
+//
+//  mp_<name>_init_fns(fns, cpu_flags)
+//      Select the fastest implementation allowed by cpu_flags (AV_CPU_FLAG_*).
+//      cpu_flags==0 selects the C reference implementation.
+//  mp_<name>_get_fns()
+//      Implementation selected for the host CPU (initialized on first use).
+#define MP_SIMD_DECLARE(name)                                                 \
+    void mp_##name##_init_fns(struct mp_##name##_fns *fns, int cpu_flags);    \
+    const struct mp_##name##_fns *mp_##name##_get_fns(void);
+
+// Define the functions declared by MP_SIMD_DECLARE(name).
+#define MP_SIMD_DEFINE(name)                                                  \
+    void mp_##name##_init_fns(struct mp_##name##_fns *fns, int cpu_flags)     \
+    {                                                                         \
+        *fns = *(const struct mp_##name##_fns *)mp_simd_select(cpu_flags,     \
+                    &name##_fns_c, MP_SIMD_X86(&name##_fns_sse2),             \
+                    MP_SIMD_X86(&name##_fns_avx2));                           \
+    }                                                                         \
+                                                                              \
+    static pthread_once_t name##_init_once = PTHREAD_ONCE_INIT;               \
+    static struct mp_##name##_fns name##_host_fns;                            \
+                                                                              \
+    static void name##_init(void)                                             \
+    {                                                                         \
+        mp_##name##_init_fns(&name##_host_fns, av_get_cpu_flags());           \
+    }                                                                         \
+                                                                              \
+    const struct mp_##name##_fns *mp_##name##_get_fns(void)                   \
+    {                                                                         \
+        pthread_once(&name##_init_once, name##_init);                         \
+        return &name##_host_fns;                                              \
+    }
+
+#if HAVE_X86_SIMD
+#define MP_SIMD_X86(x) (x)
+// Compile a function for the given instruction set.
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2")))
+#else
+#define MP_SIMD_X86(x) NULL
+#endif
+
+// Return the fastest of the given implementations allowed by cpu_flags. NULL
+// entries are not available in this build.
+static inline const void *mp_simd_select(int cpu_flags, const void *c,
+                                         const void *sse2, const void *avx2)
+{
+    const void *fns = c;
+    if (sse2 && (cpu_flags & AV_CPU_FLAG_SSE2))
+        fns = sse2;
+#ifdef AV_CPU_FLAG_AVX2
+    if (avx2 && (cpu_flags & AV_CPU_FLAG_AVX2))
+        fns = avx2;
+#endif
+    return fns;
+}
+
+#endif
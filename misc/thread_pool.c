@@ -0,0 +1,183 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/common.h"
+#include "osdep/threads.h"
+#include "talloc.h"
+
+#include "thread_pool.h"
+
+struct work {
+    void (*fn)(void *ctx);
+    void *fn_ctx;
+};
+
+struct mp_thread_pool {
+    int max_threads;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+
+    // --- the following fields are protected by lock
+    pthread_t *threads;
+    int num_threads;
+    int num_idle;       // threads waiting for work
+    bool terminate;
+    struct work *work;  // FIFO
+    int num_work;
+};
+
+static void *worker_thread(void *arg)
+{
+    struct mp_thread_pool *pool = arg;
+    mpthread_set_name("worker");
+
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        if (!pool->num_work) {
+            if (pool->terminate)
+                break;
+            pool->num_idle++;
+            pthread_cond_wait(&pool->wakeup, &pool->lock);
+            pool->num_idle--;
+            continue;
+        }
+        struct work work = pool->work[0];
+        MP_TARRAY_REMOVE_AT(pool->work, pool->num_work, 0);
+        pthread_mutex_unlock(&pool->lock);
+
+        work.fn(work.fn_ctx);
+
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static void thread_pool_dtor(void *ctx)
+{
+    struct mp_thread_pool *pool = ctx;
+
+    // Workers exit only after all queued work is done.
+    pthread_mutex_lock(&pool->lock);
+    pool->terminate = true;
+    pthread_cond_broadcast(&pool->wakeup);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int n = 0; n < pool->num_threads; n++)
+        pthread_join(pool->threads[n], NULL);
+
+    assert(!pool->num_work);
+
+    pthread_cond_destroy(&pool->wakeup);
+    pthread_mutex_destroy(&pool->lock);
+}
+
+// Create a pool that runs queued work on up to max_threads threads. Threads
+// are started on demand, and stay around until the pool is freed with
+// talloc_free(). Freeing the pool waits until all queued work is done, so it
+// must not be done from within work running on the pool.
+struct mp_thread_pool *mp_thread_pool_create(void *ta_parent, int max_threads)
+{
+    assert(max_threads > 0);
+
+    struct mp_thread_pool *pool = talloc_zero(ta_parent, struct mp_thread_pool);
+    talloc_set_destructor(pool, thread_pool_dtor);
+    pool->max_threads = max_threads;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wakeup, NULL);
+    return pool;
+}
+
+// Run fn(fn_ctx) on a pool thread. Work is started in FIFO order, and runs
+// concurrently if there are enough threads. fn must not wait for other work
+// queued on the same pool, as it might not have been started yet.
+// Returns false if no thread exists and none could be created; fn is not
+// run in this case.
+bool mp_thread_pool_queue(struct mp_thread_pool *pool, void (*fn)(void *ctx),
+                          void *fn_ctx)
+{
+    bool ok = true;
+
+    pthread_mutex_lock(&pool->lock);
+    assert(!pool->terminate);
+    struct work work = {fn, fn_ctx};
+    MP_TARRAY_APPEND(pool, pool->work, pool->num_work, work);
+    if (pool->num_idle < pool->num_work && pool->num_threads < pool->max_threads)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, worker_thread, pool) == 0) {
+            MP_TARRAY_APPEND(pool, pool->threads, pool->num_threads, thread);
+        } else if (!pool->num_threads) {
+            pool->num_work--;
+            ok = false;
+        }
+    }
+    pthread_cond_signal(&pool->wakeup);
+    pthread_mutex_unlock(&pool->lock);
+
+    return ok;
+}
+
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct mp_thread_pool *shared_pool;
+static int shared_refs;
+
+static int cpu_count(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > 0)
+        return MPMIN(n, 64);
+#endif
+    return 4;
+}
+
+// Return the pool shared by all mpv instances in the process. It has one
+// thread per CPU at most. Every call must be paired with a call to
+// mp_thread_pool_release_shared(); the pool is destroyed (after finishing
+// all queued work) when the last user releases it.
+struct mp_thread_pool *mp_thread_pool_get_shared(void)
+{
+    pthread_mutex_lock(&shared_lock);
+    if (!shared_pool)
+        shared_pool = mp_thread_pool_create(NULL, cpu_count());
+    shared_refs++;
+    struct mp_thread_pool *pool = shared_pool;
+    pthread_mutex_unlock(&shared_lock);
+    return pool;
+}
+
+void mp_thread_pool_release_shared(struct mp_thread_pool *pool)
+{
+    if (!pool)
+        return;
+    struct mp_thread_pool *destroy = NULL;
+    pthread_mutex_lock(&shared_lock);
+    assert(pool == shared_pool && shared_refs > 0);
+    if (--shared_refs == 0) {
+        destroy = shared_pool;
+        shared_pool = NULL;
+    }
+    pthread_mutex_unlock(&shared_lock);
+    talloc_free(destroy);
+}
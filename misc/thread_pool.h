@@ -0,0 +1,15 @@
+#ifndef MP_THREAD_POOL_H_
+#define MP_THREAD_POOL_H_
+
+#include <stdbool.h>
+
+struct mp_thread_pool;
+
+struct mp_thread_pool *mp_thread_pool_create(void *ta_parent, int max_threads);
+bool mp_thread_pool_queue(struct mp_thread_pool *pool, void (*fn)(void *ctx),
+                          void *fn_ctx);
+
+struct mp_thread_pool *mp_thread_pool_get_shared(void);
+void mp_thread_pool_release_shared(struct mp_thread_pool *pool);
+
+#endif
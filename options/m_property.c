@@ -52,27 +52,31 @@ static const struct legacy_prop legacy_props[] = {
 static bool translate_legacy_property(struct mp_log *log, const char *name,
                                       char *buffer, size_t buffer_size)
 {
-    if (strlen(name) + 1 > buffer_size)
-        return false;
-
     const char *old_name = name;
+    bool changed = false;
 
     for (int n = 0; legacy_props[n].new; n++) {
         if (strcmp(name, legacy_props[n].old) == 0) {
             name = legacy_props[n].new;
+            changed = true;
             break;
         }
     }
 
-    snprintf(buffer, buffer_size, "%s", name);
+    size_t len = strlen(name);
+    if (len + 1 > buffer_size)
+        return false;
+    memcpy(buffer, name, len + 1);
 
     // Old names used "_" instead of "-"
     for (int n = 0; buffer[n]; n++) {
-        if (buffer[n] == '_')
+        if (buffer[n] == '_') {
             buffer[n] = '-';
+            changed = true;
+        }
     }
 
-    if (log && strcmp(old_name, buffer) != 0) {
+    if (log && changed) {
         mp_warn(log, "Warning: property '%s' is deprecated, replaced with '%s'."
                 " Fix your input.conf!\n", old_name, buffer);
     }
@@ -80,65 +84,127 @@ static bool translate_legacy_property(struct mp_log *log, const char *name,
     return true;
 }
 
-static struct m_property *m_property_list_find(const struct m_property *list,
-                                                     const char *name)
+// Open addressing hash table over the names in a property list.
+struct m_property_index {
+    const struct m_property *list;
+    struct m_property **table; // NULL for free slots
+    unsigned int mask;         // table size - 1, table size is a power of 2
+};
+
+static unsigned int hash_name(bstr name)
+{
+    // FNV-1a
+    unsigned int h = 2166136261u;
+    for (int n = 0; n < name.len; n++)
+        h = (h ^ name.start[n]) * 16777619u;
+    return h;
+}
+
+struct m_property_index *m_property_index_create(void *ta_parent,
+                                                 const struct m_property *list)
 {
-    for (int n = 0; list && list[n].name; n++) {
-        if (strcmp(list[n].name, name) == 0)
-            return (struct m_property *)&list[n];
+    struct m_property_index *index =
+        talloc_zero(ta_parent, struct m_property_index);
+    index->list = list;
+    int num = 0;
+    while (list[num].name)
+        num++;
+    // Keep the load factor below 1/2, so that lookups rarely probe more than
+    // one or two slots.
+    unsigned int size = 16;
+    while (size < num * 2)
+        size *= 2;
+    index->table = talloc_zero_array(index, struct m_property *, size);
+    index->mask = size - 1;
+    for (int n = 0; n < num; n++) {
+        bstr name = bstr0(list[n].name);
+        unsigned int i = hash_name(name) & index->mask;
+        while (index->table[i] && !bstr_equals0(name, index->table[i]->name))
+            i = (i + 1) & index->mask;
+        // On duplicate names, the first entry wins.
+        if (!index->table[i])
+            index->table[i] = (struct m_property *)&list[n];
+    }
+    return index;
+}
+
+static struct m_property *m_property_index_find(
+    const struct m_property_index *index, bstr name)
+{
+    unsigned int i = hash_name(name) & index->mask;
+    for (; index->table[i]; i = (i + 1) & index->mask) {
+        if (bstr_equals0(name, index->table[i]->name))
+            return index->table[i];
     }
     return NULL;
 }
 
-static int do_action(const struct m_property *prop_list, const char *name,
-                     int action, void *arg, void *ctx)
+bool m_property_resolve(struct mp_log *log, const struct m_property_index *index,
+                        const char *in_name, struct m_property_path *path)
+{
+    *path = (struct m_property_path){0};
+    if (!translate_legacy_property(log, in_name, path->name, sizeof(path->name)))
+        return false;
+    const char *name = path->name;
+    const char *sep = strchr(name, '/');
+    if (sep && sep[1]) {
+        bstr base = bstr_splice(bstr0(name), 0, sep - name);
+        path->prop = m_property_index_find(index, base);
+        path->key_offset = sep + 1 - name;
+    } else {
+        path->prop = m_property_index_find(index, bstr0(name));
+    }
+    return !!path->prop;
+}
+
+static int do_action(const struct m_property_path *path, int action, void *arg,
+                     void *ctx)
 {
-    const char *sep;
-    struct m_property *prop;
+    struct m_property *prop = path->prop;
     struct m_property_action_arg ka;
-    if ((sep = strchr(name, '/')) && sep[1]) {
-        int len = sep - name;
-        char base[len + 1];
-        memcpy(base, name, len);
-        base[len] = 0;
-        prop = m_property_list_find(prop_list, base);
+    if (!prop)
+        return M_PROPERTY_UNKNOWN;
+    if (path->key_offset) {
         ka = (struct m_property_action_arg) {
-            .key = sep + 1,
+            .key = path->name + path->key_offset,
             .action = action,
             .arg = arg,
         };
         action = M_PROPERTY_KEY_ACTION;
         arg = &ka;
-    } else
-        prop = m_property_list_find(prop_list, name);
-    if (!prop)
-        return M_PROPERTY_UNKNOWN;
+    }
     return prop->call(ctx, prop, action, arg);
 }
 
 // (as a hack, log can be NULL on read-only paths)
-int m_property_do(struct mp_log *log, const struct m_property *prop_list,
-                  const char *in_name, int action, void *arg, void *ctx)
+int m_property_do(struct mp_log *log, const struct m_property_index *index,
+                  const char *name, int action, void *arg, void *ctx)
+{
+    struct m_property_path path;
+    m_property_resolve(log, index, name, &path);
+    return m_property_do_path(log, &path, action, arg, ctx);
+}
+
+int m_property_do_path(struct mp_log *log, const struct m_property_path *path,
+                       int action, void *arg, void *ctx)
 {
     union m_option_value val = {0};
     int r;
 
-    char name[64];
-    if (!translate_legacy_property(log, in_name, name, sizeof(name)))
-        return M_PROPERTY_UNKNOWN;
+    const char *name = path->name;
 
     struct m_option opt = {0};
-    r = do_action(prop_list, name, M_PROPERTY_GET_TYPE, &opt, ctx);
+    r = do_action(path, M_PROPERTY_GET_TYPE, &opt, ctx);
     if (r <= 0)
         return r;
     assert(opt.type);
 
     switch (action) {
     case M_PROPERTY_PRINT: {
-        if ((r = do_action(prop_list, name, M_PROPERTY_PRINT, arg, ctx)) >= 0)
+        if ((r = do_action(path, M_PROPERTY_PRINT, arg, ctx)) >= 0)
             return r;
         // Fallback to m_option
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(path, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         char *str = m_option_pretty_print(&opt, &val);
         m_option_free(&opt, &val);
@@ -146,7 +212,7 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
         return str != NULL;
     }
     case M_PROPERTY_GET_STRING: {
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(path, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         char *str = m_option_print(&opt, &val);
         m_option_free(&opt, &val);
@@ -158,7 +224,7 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
             return M_PROPERTY_ERROR;
         if (m_option_parse(log, &opt, bstr0(name), bstr0(arg), &val) < 0)
             return M_PROPERTY_ERROR;
-        r = do_action(prop_list, name, M_PROPERTY_SET, &val, ctx);
+        r = do_action(path, M_PROPERTY_SET, &val, ctx);
         m_option_free(&opt, &val);
         return r;
     }
@@ -166,16 +232,16 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
         if (!log)
             return M_PROPERTY_ERROR;
         struct m_property_switch_arg *sarg = arg;
-        if ((r = do_action(prop_list, name, M_PROPERTY_SWITCH, arg, ctx)) !=
+        if ((r = do_action(path, M_PROPERTY_SWITCH, arg, ctx)) !=
             M_PROPERTY_NOT_IMPLEMENTED)
             return r;
         // Fallback to m_option
         if (!opt.type->add)
             return M_PROPERTY_NOT_IMPLEMENTED;
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(path, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         opt.type->add(&opt, &val, sarg->inc, sarg->wrap);
-        r = do_action(prop_list, name, M_PROPERTY_SET, &val, ctx);
+        r = do_action(path, M_PROPERTY_SET, &val, ctx);
         m_option_free(&opt, &val);
         return r;
     }
@@ -189,13 +255,13 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
             mp_err(log, "Property '%s': invalid value.\n", name);
             return M_PROPERTY_ERROR;
         }
-        return do_action(prop_list, name, M_PROPERTY_SET, arg, ctx);
+        return do_action(path, M_PROPERTY_SET, arg, ctx);
     }
     case M_PROPERTY_GET_NODE: {
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET_NODE, arg, ctx)) !=
+        if ((r = do_action(path, M_PROPERTY_GET_NODE, arg, ctx)) !=
             M_PROPERTY_NOT_IMPLEMENTED)
             return r;
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(path, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         struct mpv_node *node = arg;
         int err = m_option_get_node(&opt, NULL, node, &val);
@@ -210,7 +276,7 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
         return r;
     }
     case M_PROPERTY_SET_NODE: {
-        if ((r = do_action(prop_list, name, M_PROPERTY_SET_NODE, arg, ctx)) !=
+        if ((r = do_action(path, M_PROPERTY_SET_NODE, arg, ctx)) !=
             M_PROPERTY_NOT_IMPLEMENTED)
             return r;
         struct mpv_node *node = arg;
@@ -220,13 +286,13 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
         } else if (err < 0) {
             r = M_PROPERTY_INVALID_FORMAT;
         } else {
-            r = do_action(prop_list, name, M_PROPERTY_SET, &val, ctx);
+            r = do_action(path, M_PROPERTY_SET, &val, ctx);
         }
         m_option_free(&opt, &val);
         return r;
     }
     default:
-        return do_action(prop_list, name, action, arg, ctx);
+        return do_action(path, action, arg, ctx);
     }
 }
 
@@ -257,14 +323,14 @@ static void m_property_unkey(int *action, void **arg)
     }
 }
 
-static int m_property_do_bstr(const struct m_property *prop_list, bstr name,
+static int m_property_do_bstr(const struct m_property_index *index, bstr name,
                               int action, void *arg, void *ctx)
 {
     char name0[64];
     if (name.len >= sizeof(name0))
         return M_PROPERTY_UNKNOWN;
     snprintf(name0, sizeof(name0), "%.*s", BSTR_P(name));
-    return m_property_do(NULL, prop_list, name0, action, arg, ctx);
+    return m_property_do(NULL, index, name0, action, arg, ctx);
 }
 
 static void append_str(char **s, int *len, bstr append)
@@ -274,7 +340,7 @@ static void append_str(char **s, int *len, bstr append)
     *len = *len + append.len;
 }
 
-static int expand_property(const struct m_property *prop_list, char **ret,
+static int expand_property(const struct m_property_index *index, char **ret,
                            int *ret_len, bstr prop, bool silent_error, void *ctx)
 {
     bool cond_yes = bstr_eatstart0(&prop, "?");
@@ -288,7 +354,7 @@ static int expand_property(const struct m_property *prop_list, char **ret,
     int method = raw ? M_PROPERTY_GET_STRING : M_PROPERTY_PRINT;
 
     char *s = NULL;
-    int r = m_property_do_bstr(prop_list, prop, method, &s, ctx);
+    int r = m_property_do_bstr(index, prop, method, &s, ctx);
     bool skip;
     if (comp) {
         skip = ((s && bstr_equals0(comp_with, s)) != cond_yes);
@@ -305,7 +371,7 @@ static int expand_property(const struct m_property *prop_list, char **ret,
     return skip;
 }
 
-char *m_properties_expand_string(const struct m_property *prop_list,
+char *m_properties_expand_string(const struct m_property_index *index,
                                  const char *str0, void *ctx)
 {
     char *ret = NULL;
@@ -331,7 +397,7 @@ char *m_properties_expand_string(const struct m_property *prop_list,
             bool have_fallback = bstr_eatstart0(&str, ":");
 
             if (!skip) {
-                skip = expand_property(prop_list, &ret, &ret_len, name,
+                skip = expand_property(index, &ret, &ret_len, name,
                                        have_fallback, ctx);
                 if (skip)
                     skip_level = level;
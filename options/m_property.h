@@ -129,13 +129,39 @@ struct m_property {
     void *priv;
 };
 
+// Lookup table for the names in a property list (terminated by an entry with
+// name==NULL). The list must stay valid and unchanged while the index exists.
+struct m_property_index;
+struct m_property_index *m_property_index_create(void *ta_parent,
+                                                 const struct m_property *list);
+
+// A property name resolved with m_property_resolve().
+struct m_property_path {
+    // The property, or NULL if it doesn't exist.
+    struct m_property *prop;
+    // If not 0, name+key_offset is the sub-property path passed to prop with
+    // M_PROPERTY_KEY_ACTION.
+    int key_offset;
+    // Full property name, with legacy names translated.
+    char name[64];
+};
+
+// Look up a property name once, so that it can be accessed repeatedly with
+// m_property_do_path(). Returns false if the property is unknown.
+bool m_property_resolve(struct mp_log *log, const struct m_property_index *index,
+                        const char *name, struct m_property_path *path);
+
 // Access a property.
 // action: one of m_property_action
 // ctx: opaque value passed through to property implementation
 // returns: one of mp_property_return
-int m_property_do(struct mp_log *log, const struct m_property* prop_list,
+int m_property_do(struct mp_log *log, const struct m_property_index *index,
                   const char* property_name, int action, void* arg, void *ctx);
 
+// Like m_property_do(), with a name returned by m_property_resolve().
+int m_property_do_path(struct mp_log *log, const struct m_property_path *path,
+                       int action, void *arg, void *ctx);
+
 // Given a path of the form "a/b/c", this function will set *prefix to "a",
 // and rem to "b/c", and return true.
 // If there is no '/' in the path, set prefix to path, and rem to "", and
@@ -158,7 +184,7 @@ void m_properties_print_help_list(struct mp_log *log,
 // STR is recursively expanded using the same rules.
 // "$$" can be used to escape "$", and "$}" to escape "}".
 // "$>" disables parsing of "$" for the rest of the string.
-char* m_properties_expand_string(const struct m_property *prop_list,
+char* m_properties_expand_string(const struct m_property_index *index,
                                  const char *str, void *ctx);
 
 // Trivial helpers for implementing properties.
@@ -390,6 +390,7 @@ const m_option_t mp_opts[] = {
                 {"weak", -1})),
     OPT_DOUBLE("audio-buffer", audio_buffer, M_OPT_MIN | M_OPT_MAX,
                .min = 0, .max = 10),
+    OPT_FLAG("audio-decode-thread", audio_decode_thread, 0),
 
     OPT_GEOMETRY("geometry", vo.geometry, 0),
     OPT_SIZE_BOX("autofit", vo.autofit, 0),
@@ -556,9 +557,20 @@ const m_option_t mp_opts[] = {
 
     OPT_STRING("input-file", input_file, M_OPT_FILE | M_OPT_GLOBAL),
     OPT_STRING("input-unix-socket", ipc_path, M_OPT_FILE),
+    OPT_STRING("stats-shm", stats_shm, 0),
 
     OPT_SUBSTRUCT("screenshot", screenshot_image_opts, image_writer_conf, 0),
     OPT_STRING("screenshot-template", screenshot_template, 0),
+    OPT_INTRANGE("screenshot-threads", screenshot_threads, 0, 0, 64),
+    OPT_INTRANGE("screenshot-queue-size", screenshot_queue_size, 0, 1, 1000),
+    OPT_CHOICE("screenshot-queue-full", screenshot_queue_drop, 0,
+               ({"block", 0}, {"drop", 1})),
+
+    OPT_STRING("storyboard", storyboard_file, M_OPT_FILE),
+    OPT_DOUBLE("storyboard-interval", storyboard_interval, M_OPT_MIN, .min = 0),
+    OPT_INTRANGE("storyboard-width", storyboard_width, 0, 16, 4096),
+    OPT_INTRANGE("storyboard-columns", storyboard_columns, 0, 1, 1000),
+    OPT_INTRANGE("storyboard-tiles", storyboard_tiles, 0, 1, 100000),
 
     OPT_SUBSTRUCT("input", input_opts, input_config, 0),
 
@@ -779,6 +791,13 @@ const struct MPOpts mp_default_opts = {
 
     .index_mode = 1,
 
+    .screenshot_threads = 1,
+    .screenshot_queue_size = 4,
+
+    .storyboard_width = 160,
+    .storyboard_columns = 10,
+    .storyboard_tiles = 100,
+
     .dvd_angle = 1,
 
     .mf_fps = 1.0,
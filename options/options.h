@@ -79,6 +79,7 @@ typedef struct MPOpts {
     float softvol_max;
     int gapless_audio;
     double audio_buffer;
+    int audio_decode_thread;
 
     mp_vo_opts vo;
     int allow_win_drag;
@@ -209,6 +210,15 @@ typedef struct MPOpts {
 
     struct image_writer_opts *screenshot_image_opts;
     char *screenshot_template;
+    int screenshot_threads;
+    int screenshot_queue_size;
+    int screenshot_queue_drop;
+
+    char *storyboard_file;
+    double storyboard_interval;
+    int storyboard_width;
+    int storyboard_columns;
+    int storyboard_tiles;
 
     double force_fps;
     int index_mode;
@@ -302,6 +312,7 @@ typedef struct MPOpts {
 
     char *ipc_path;
     char *input_file;
+    char *stats_shm;
 } MPOpts;
 
 extern const m_option_t mp_opts[];
@@ -22,6 +22,7 @@
 #include <limits.h>
 #include <math.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "config.h"
 #include "talloc.h"
@@ -30,6 +31,9 @@
 #include "common/encode.h"
 #include "options/options.h"
 #include "common/common.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
+#include "input/input.h"
 
 #include "audio/mixer.h"
 #include "audio/audio.h"
@@ -43,6 +47,190 @@
 #include "core.h"
 #include "command.h"
 
+// Decodes and filters audio ahead of the playloop (--audio-decode-thread).
+// While the thread is running and not suspended, it owns d_audio; the
+// playloop only takes filtered audio from buf.
+struct audio_thread {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool terminate;
+    bool suspended;         // don't touch d_audio
+    bool busy;              // thread is decoding (d_audio in use)
+    bool player_waiting;    // wake up the playloop on new data
+    int target;             // samples to keep buffered in buf
+    int status;             // result of the last audio_decode()
+    double end_pts;         // filtered_audio_pts() at the end of buf
+    struct mp_audio_buffer *buf;    // filtered audio, ao format
+    struct mp_audio_buffer *tmp;    // decoder output (thread only)
+};
+
+static double filtered_audio_pts(struct MPContext *mpctx);
+
+static void *audio_thread(void *p)
+{
+    struct MPContext *mpctx = p;
+    struct audio_thread *at = mpctx->audio_thread;
+
+    mpthread_set_name("audio decoder");
+
+    pthread_mutex_lock(&at->lock);
+    while (!at->terminate) {
+        int buffered = mp_audio_buffer_samples(at->buf);
+        if (at->suspended || (at->status != AD_OK && at->status != AD_WAIT) ||
+            buffered >= at->target)
+        {
+            pthread_cond_wait(&at->wakeup, &at->lock);
+            continue;
+        }
+        if (at->status == AD_WAIT) {
+            // The demuxer had no packets; poll until it has.
+            struct timespec ts = mp_time_us_to_timespec(mp_time_us() + 10000);
+            pthread_cond_timedwait(&at->wakeup, &at->lock, &ts);
+            if (at->status == AD_WAIT)
+                at->status = AD_OK;
+            continue;
+        }
+
+        at->busy = true;
+        int chunk = MPMIN(at->target - buffered, 4096);
+        pthread_mutex_unlock(&at->lock);
+
+        int status = audio_decode(mpctx->d_audio, at->tmp, chunk);
+        double pts = filtered_audio_pts(mpctx);
+
+        pthread_mutex_lock(&at->lock);
+        struct mp_audio data;
+        mp_audio_buffer_peek(at->tmp, &data);
+        mp_audio_buffer_append(at->buf, &data);
+        mp_audio_buffer_clear(at->tmp);
+        at->end_pts = pts;
+        at->status = status;
+        at->busy = false;
+        pthread_cond_broadcast(&at->wakeup);
+        if (at->player_waiting) {
+            at->player_waiting = false;
+            mp_input_wakeup(mpctx->input);
+        }
+    }
+    pthread_mutex_unlock(&at->lock);
+    return NULL;
+}
+
+static void start_audio_thread(struct MPContext *mpctx)
+{
+    struct audio_thread *at = talloc_zero(NULL, struct audio_thread);
+    pthread_mutex_init(&at->lock, NULL);
+    pthread_cond_init(&at->wakeup, NULL);
+    at->suspended = true;
+    at->end_pts = MP_NOPTS_VALUE;
+    at->buf = mp_audio_buffer_create(at);
+    at->tmp = mp_audio_buffer_create(at);
+    struct mp_audio fmt;
+    mp_audio_buffer_get_format(mpctx->ao_buffer, &fmt);
+    mp_audio_buffer_reinit(at->buf, &fmt);
+    mp_audio_buffer_reinit(at->tmp, &fmt);
+
+    mpctx->audio_thread = at;
+    if (pthread_create(&at->thread, NULL, audio_thread, mpctx)) {
+        MP_ERR(mpctx, "Could not start the audio decoding thread.\n");
+        mpctx->audio_thread = NULL;
+        pthread_cond_destroy(&at->wakeup);
+        pthread_mutex_destroy(&at->lock);
+        talloc_free(at);
+    }
+}
+
+static void stop_audio_thread(struct MPContext *mpctx)
+{
+    struct audio_thread *at = mpctx->audio_thread;
+    if (!at)
+        return;
+    pthread_mutex_lock(&at->lock);
+    at->terminate = true;
+    pthread_cond_broadcast(&at->wakeup);
+    pthread_mutex_unlock(&at->lock);
+    pthread_join(at->thread, NULL);
+    pthread_cond_destroy(&at->wakeup);
+    pthread_mutex_destroy(&at->lock);
+    talloc_free(at);
+    mpctx->audio_thread = NULL;
+}
+
+// Make the audio thread release d_audio (and stop reading from the demuxer)
+// until fill_audio_out_buffers() resumes it. Must be called before anything
+// else on the playloop accesses d_audio or the audio filters, or seeks.
+void suspend_audio_thread(struct MPContext *mpctx)
+{
+    struct audio_thread *at = mpctx->audio_thread;
+    if (!at)
+        return;
+    pthread_mutex_lock(&at->lock);
+    at->suspended = true;
+    while (at->busy)
+        pthread_cond_wait(&at->wakeup, &at->lock);
+    pthread_mutex_unlock(&at->lock);
+}
+
+// Move filtered audio from the thread to mpctx->ao_buffer, until it contains
+// playsize samples. Returns an AD_* code like audio_decode().
+static int read_audio_thread(struct MPContext *mpctx, int playsize)
+{
+    struct audio_thread *at = mpctx->audio_thread;
+    struct mp_audio fmt;
+    mp_audio_buffer_get_format(mpctx->ao_buffer, &fmt);
+    int want = playsize - mp_audio_buffer_samples(mpctx->ao_buffer);
+    int r = AD_OK;
+
+    pthread_mutex_lock(&at->lock);
+    if (at->suspended) {
+        // The AO format might have changed in the meantime.
+        struct mp_audio cur;
+        mp_audio_buffer_get_format(at->buf, &cur);
+        if (!mp_audio_config_equals(&fmt, &cur)) {
+            mp_audio_buffer_reinit(at->buf, &fmt);
+            mp_audio_buffer_reinit(at->tmp, &fmt);
+            at->end_pts = MP_NOPTS_VALUE;
+        }
+        at->suspended = false;
+    }
+    // Keep about 100ms more than requested buffered.
+    at->target = want + fmt.rate / 10;
+
+    struct mp_audio data;
+    mp_audio_buffer_peek(at->buf, &data);
+    data.samples = MPMIN(data.samples, MPMAX(want, 0));
+    mp_audio_buffer_append(mpctx->ao_buffer, &data);
+    mp_audio_buffer_skip(at->buf, data.samples);
+
+    if (data.samples < want) {
+        r = at->status == AD_OK ? AD_WAIT : at->status;
+        if (r == AD_WAIT) {
+            at->player_waiting = true;
+        } else {
+            at->status = AD_OK; // try decoding again on the next call
+        }
+    }
+    pthread_cond_broadcast(&at->wakeup);
+    pthread_mutex_unlock(&at->lock);
+    return r;
+}
+
+// Return the pts at the end of the audio the thread has buffered, or
+// MP_NOPTS_VALUE.
+static double audio_thread_pts(struct MPContext *mpctx)
+{
+    struct audio_thread *at = mpctx->audio_thread;
+    pthread_mutex_lock(&at->lock);
+    double pts = at->end_pts;
+    if (pts != MP_NOPTS_VALUE) {
+        pts -= mp_audio_buffer_seconds(at->buf) *
+               mpctx->opts->playback_speed;
+    }
+    pthread_mutex_unlock(&at->lock);
+    return pts;
+}
+
 static int try_filter(struct MPContext *mpctx,
                       char *name, char *label, char **args)
 {
@@ -115,6 +303,8 @@ int reinit_audio_filters(struct MPContext *mpctx)
     if (!d_audio)
         return 0;
 
+    suspend_audio_thread(mpctx);
+
     af_uninit(mpctx->d_audio->afilter);
     if (af_init(mpctx->d_audio->afilter) < 0)
         return -1;
@@ -128,6 +318,8 @@ void set_playback_speed(struct MPContext *mpctx, double new_speed)
 {
     struct MPOpts *opts = mpctx->opts;
 
+    suspend_audio_thread(mpctx);
+
     // Adjust time until next frame flip for nosound mode
     mpctx->time_frame *= opts->playback_speed / new_speed;
 
@@ -141,6 +333,15 @@ void set_playback_speed(struct MPContext *mpctx, double new_speed)
 
 void reset_audio_state(struct MPContext *mpctx)
 {
+    struct audio_thread *at = mpctx->audio_thread;
+    if (at) {
+        suspend_audio_thread(mpctx);
+        pthread_mutex_lock(&at->lock);
+        mp_audio_buffer_clear(at->buf);
+        at->end_pts = MP_NOPTS_VALUE;
+        at->status = AD_OK;
+        pthread_mutex_unlock(&at->lock);
+    }
     if (mpctx->d_audio)
         audio_reset_decoding(mpctx->d_audio);
     if (mpctx->ao_buffer)
@@ -150,6 +351,7 @@ void reset_audio_state(struct MPContext *mpctx)
 
 void uninit_audio_out(struct MPContext *mpctx)
 {
+    suspend_audio_thread(mpctx); // the mixer accesses the filters
     if (mpctx->ao) {
         // Note: with gapless_audio, stop_play is not correctly set
         if (mpctx->opts->gapless_audio || mpctx->stop_play == AT_END_OF_FILE)
@@ -165,6 +367,7 @@ void uninit_audio_out(struct MPContext *mpctx)
 void uninit_audio_chain(struct MPContext *mpctx)
 {
     if (mpctx->d_audio) {
+        stop_audio_thread(mpctx);
         mixer_uninit_audio(mpctx->mixer);
         audio_uninit(mpctx->d_audio);
         mpctx->d_audio = NULL;
@@ -187,6 +390,8 @@ void reinit_audio_chain(struct MPContext *mpctx)
 
     mp_notify(mpctx, MPV_EVENT_AUDIO_RECONFIG, NULL);
 
+    suspend_audio_thread(mpctx);
+
     if (!mpctx->d_audio) {
         mpctx->d_audio = talloc_zero(NULL, struct dec_audio);
         mpctx->d_audio->log = mp_log_new(mpctx->d_audio, mpctx->log, "!ad");
@@ -296,13 +501,11 @@ no_audio:
         error_on_track(mpctx, track);
 }
 
-// Return pts value corresponding to the end point of audio written to the
-// ao so far.
-double written_audio_pts(struct MPContext *mpctx)
+// Return pts value corresponding to the end point of audio output by the
+// filter chain so far.
+static double filtered_audio_pts(struct MPContext *mpctx)
 {
     struct dec_audio *d_audio = mpctx->d_audio;
-    if (!d_audio)
-        return MP_NOPTS_VALUE;
 
     struct mp_audio in_format = d_audio->decode_format;
 
@@ -329,13 +532,27 @@ double written_audio_pts(struct MPContext *mpctx)
     // Data buffered in audio filters, measured in seconds of "missing" output
     double buffered_output = af_calc_delay(d_audio->afilter);
 
-    // Data that was ready for ao but was buffered because ao didn't fully
-    // accept everything to internal buffers yet
-    buffered_output += mp_audio_buffer_seconds(mpctx->ao_buffer);
-
     // Filters divide audio length by playback_speed, so multiply by it
     // to get the length in original units without speedup or slowdown
-    a_pts -= buffered_output * mpctx->opts->playback_speed;
+    return a_pts - buffered_output * mpctx->opts->playback_speed;
+}
+
+// Return pts value corresponding to the end point of audio written to the
+// ao so far.
+double written_audio_pts(struct MPContext *mpctx)
+{
+    if (!mpctx->d_audio)
+        return MP_NOPTS_VALUE;
+
+    double a_pts = mpctx->audio_thread ? audio_thread_pts(mpctx)
+                                       : filtered_audio_pts(mpctx);
+    if (a_pts == MP_NOPTS_VALUE)
+        return MP_NOPTS_VALUE;
+
+    // Data that was ready for ao but was buffered because ao didn't fully
+    // accept everything to internal buffers yet
+    a_pts -= mp_audio_buffer_seconds(mpctx->ao_buffer) *
+             mpctx->opts->playback_speed;
 
     return a_pts +
         get_track_video_offset(mpctx, mpctx->current_track[0][STREAM_AUDIO]);
@@ -451,6 +668,7 @@ static void do_fill_audio_out_buffers(struct MPContext *mpctx, double endpts)
         return;
 
     if (d_audio->afilter->initialized < 1 || !mpctx->ao) {
+        suspend_audio_thread(mpctx);
         // Probe the initial audio format. Returns AD_OK (and does nothing) if
         // the format is already known.
         int r = initial_audio_decode(mpctx->d_audio);
@@ -492,9 +710,20 @@ static void do_fill_audio_out_buffers(struct MPContext *mpctx, double endpts)
         playsize = MPMAX(1, playsize + skip); // silence will be prepended
     }
 
+    // Without demuxer thread, reading packets is not thread-safe, and the
+    // playloop reads packets for the other streams.
+    struct track *track = mpctx->current_track[0][STREAM_AUDIO];
+    if (opts->audio_decode_thread && !mpctx->audio_thread &&
+        track && track->demuxer && demux_is_threaded(track->demuxer))
+        start_audio_thread(mpctx);
+
     int status = AD_OK;
     if (playsize > mp_audio_buffer_samples(mpctx->ao_buffer)) {
-        status = audio_decode(d_audio, mpctx->ao_buffer, playsize);
+        if (mpctx->audio_thread) {
+            status = read_audio_thread(mpctx, playsize);
+        } else {
+            status = audio_decode(d_audio, mpctx->ao_buffer, playsize);
+        }
         if (status == AD_WAIT)
             return;
         if (status == AD_NEW_FMT) {
@@ -14,6 +14,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <math.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -54,6 +55,11 @@
  *
  */
 
+struct client_list {
+    struct mpv_handle **clients;
+    int num;
+};
+
 struct mp_client_api {
     struct MPContext *mpctx;
 
@@ -63,6 +69,11 @@ struct mp_client_api {
     struct mpv_handle **clients;
     int num_clients;
     uint64_t event_masks;   // combined events of all clients, or 0 if unknown
+    // Clients observing a property, indexed by property id + 1 (unknown
+    // properties have the id -1).
+    struct client_list *observers_by_id;
+    int num_observers_by_id;
+    int num_throttled;      // number of rate-limited observed properties
 };
 
 struct observe_property {
@@ -75,11 +86,20 @@ struct observe_property {
     bool need_new_value;    // a new value should be retrieved
     bool updating;          // a new value is being retrieved
     bool dead;              // property unobserved while retrieving value
+    int index;              // position in mpv_handle.properties
+    int64_t min_interval;   // rate limit (in microseconds), 0 if none
+    double min_delta;       // smallest change of numbers that is reported
+    int64_t next_update;    // no new value is retrieved before this time
     bool new_value_valid, user_value_valid;
     union m_option_value new_value, user_value;
     struct mpv_handle *client;
 };
 
+struct observer_list {
+    struct observe_property **props;
+    int num;
+};
+
 struct mpv_handle {
     // -- immmutable
     char name[MAX_CLIENT_NAME];
@@ -121,6 +141,12 @@ struct mpv_handle {
     int lowest_changed;     // attempt at making change processing incremental
     int properties_updating;
     uint64_t property_event_masks; // or-ed together event masks of all properties
+    int num_throttled;      // number of rate-limited properties
+    int64_t throttle_deadline; // when a held back property is due, or 0
+    // Reverse indexes of properties: by property id + 1, and by event bit.
+    struct observer_list *props_by_id;
+    int num_props_by_id;
+    struct observer_list props_by_event[64];
 
     bool fuzzy_initialized; // see scripting.c wait_loaded()
     struct mp_log_buffer *messages;
@@ -189,6 +215,16 @@ static struct mpv_handle *find_client(struct mp_client_api *clients,
     return NULL;
 }
 
+static void remove_client(struct client_list *list, struct mpv_handle *ctx)
+{
+    for (int n = 0; n < list->num; n++) {
+        if (list->clients[n] == ctx) {
+            MP_TARRAY_REMOVE_AT(list->clients, list->num, n);
+            return;
+        }
+    }
+}
+
 bool mp_client_exists(struct MPContext *mpctx, const char *client_name)
 {
     pthread_mutex_lock(&mpctx->clients->lock);
@@ -380,6 +416,11 @@ void mpv_detach_destroy(mpv_handle *ctx)
     for (int n = 0; n < clients->num_clients; n++) {
         if (clients->clients[n] == ctx) {
             MP_TARRAY_REMOVE_AT(clients->clients, clients->num_clients, n);
+            clients->num_throttled -= ctx->num_throttled;
+            for (int i = 0; i < ctx->num_props_by_id; i++) {
+                if (ctx->props_by_id[i].num)
+                    remove_client(&clients->observers_by_id[i], ctx);
+            }
             while (ctx->num_events) {
                 talloc_free(ctx->events[ctx->first_event].data);
                 ctx->first_event = (ctx->first_event + 1) % ctx->max_events;
@@ -526,6 +567,14 @@ static void dup_event_data(struct mpv_event *ev)
     case MPV_EVENT_END_FILE:
         ev->data = talloc_memdup(NULL, ev->data, sizeof(mpv_event_end_file));
         break;
+    case MPV_EVENT_SCREENSHOT_DONE: {
+        struct mpv_event_screenshot *src = ev->data;
+        struct mpv_event_screenshot *msg =
+            talloc_memdup(NULL, src, sizeof(*src));
+        msg->filename = talloc_strdup(msg, src->filename);
+        ev->data = msg;
+        break;
+    }
     default:
         // Doesn't use events with memory allocation.
         if (ev->data)
@@ -761,8 +810,12 @@ mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
                 break;
             }
         }
-        int r = wait_wakeup(ctx, deadline);
-        if (r == ETIMEDOUT)
+        // Wake up when a held back property change is due.
+        int64_t until = deadline;
+        if (ctx->throttle_deadline)
+            until = MPMIN(until, ctx->throttle_deadline);
+        int r = wait_wakeup(ctx, until);
+        if (r == ETIMEDOUT && until == deadline)
             break;
     }
     ctx->queued_wakeup = false;
@@ -868,6 +921,24 @@ static bool compare_value(void *a, void *b, mpv_format format)
     abort();
 }
 
+static bool get_number(void *v, mpv_format format, double *out)
+{
+    switch (format) {
+    case MPV_FORMAT_INT64:
+        *out = *(int64_t *)v;
+        return true;
+    case MPV_FORMAT_DOUBLE:
+        *out = *(double *)v;
+        return true;
+    case MPV_FORMAT_NODE: {
+        struct mpv_node *node = v;
+        return get_number(&node->u, node->format, out);
+    }
+    default:
+        return false;
+    }
+}
+
 void mpv_free_node_contents(mpv_node *node)
 {
     static const struct m_option type = { .type = CONF_TYPE_NODE };
@@ -1042,6 +1113,7 @@ static int translate_property_error(int errc)
 struct setproperty_request {
     struct MPContext *mpctx;
     const char *name;
+    const struct m_property_path *path; // if set, name is ignored
     int format;
     void *data;
     int status;
@@ -1053,6 +1125,12 @@ static void setproperty_fn(void *arg)
 {
     struct setproperty_request *req = arg;
     const struct m_option *type = get_mp_type(req->format);
+    struct m_property_path path_buf;
+    const struct m_property_path *path = req->path;
+    if (!path) {
+        mp_property_resolve(req->mpctx, req->name, &path_buf);
+        path = &path_buf;
+    }
 
     int err;
     switch (req->format) {
@@ -1061,8 +1139,9 @@ static void setproperty_fn(void *arg)
         // do this, because it tries to be somewhat type-strict. But the client
         // needs a way to set everything by string.
         char *s = *(char **)req->data;
-        MP_VERBOSE(req->mpctx, "Set property string: %s='%s'\n", req->name, s);
-        err = mp_property_do(req->name, M_PROPERTY_SET_STRING, s, req->mpctx);
+        MP_VERBOSE(req->mpctx, "Set property string: %s='%s'\n",
+                   path->name, s);
+        err = mp_property_do_path(path, M_PROPERTY_SET_STRING, s, req->mpctx);
         break;
     }
     case MPV_FORMAT_NODE:
@@ -1080,10 +1159,12 @@ static void setproperty_fn(void *arg)
         if (mp_msg_test(req->mpctx->log, MSGL_V)) {
             struct m_option ot = {.type = &m_option_type_node};
             char *t = m_option_print(&ot, &node);
-            MP_VERBOSE(req->mpctx, "Set property: %s=%s\n", req->name, t ? t : "?");
+            MP_VERBOSE(req->mpctx, "Set property: %s=%s\n", path->name,
+                        t ? t : "?");
             talloc_free(t);
         }
-        err = mp_property_do(req->name, M_PROPERTY_SET_NODE, &node, req->mpctx);
+        err = mp_property_do_path(path, M_PROPERTY_SET_NODE, &node,
+                                  req->mpctx);
         break;
     }
     default:
@@ -1156,6 +1237,7 @@ int mpv_set_property_async(mpv_handle *ctx, uint64_t ud, const char *name,
 struct getproperty_request {
     struct MPContext *mpctx;
     const char *name;
+    const struct m_property_path *path; // if set, name is ignored
     mpv_format format;
     void *data;
     int status;
@@ -1174,6 +1256,12 @@ static void getproperty_fn(void *arg)
 {
     struct getproperty_request *req = arg;
     const struct m_option *type = get_mp_type_get(req->format);
+    struct m_property_path path_buf;
+    const struct m_property_path *path = req->path;
+    if (!path) {
+        mp_property_resolve(req->mpctx, req->name, &path_buf);
+        path = &path_buf;
+    }
 
     union m_option_value xdata = {0};
     void *data = req->data ? req->data : &xdata;
@@ -1181,11 +1269,11 @@ static void getproperty_fn(void *arg)
     int err = -1;
     switch (req->format) {
     case MPV_FORMAT_OSD_STRING:
-        err = mp_property_do(req->name, M_PROPERTY_PRINT, data, req->mpctx);
+        err = mp_property_do_path(path, M_PROPERTY_PRINT, data, req->mpctx);
         break;
     case MPV_FORMAT_STRING: {
         char *s = NULL;
-        err = mp_property_do(req->name, M_PROPERTY_GET_STRING, &s, req->mpctx);
+        err = mp_property_do_path(path, M_PROPERTY_GET_STRING, &s, req->mpctx);
         if (err == M_PROPERTY_OK)
             *(char **)req->data = s;
         break;
@@ -1195,13 +1283,14 @@ static void getproperty_fn(void *arg)
     case MPV_FORMAT_INT64:
     case MPV_FORMAT_DOUBLE: {
         struct mpv_node node = {{0}};
-        err = mp_property_do(req->name, M_PROPERTY_GET_NODE, &node, req->mpctx);
+        err = mp_property_do_path(path, M_PROPERTY_GET_NODE, &node,
+                                  req->mpctx);
         if (err == M_PROPERTY_NOT_IMPLEMENTED) {
             // Go through explicit string conversion. Same reasoning as on the
             // GET code path.
             char *s = NULL;
-            err = mp_property_do(req->name, M_PROPERTY_GET_STRING, &s,
-                                 req->mpctx);
+            err = mp_property_do_path(path, M_PROPERTY_GET_STRING, &s,
+                                      req->mpctx);
             if (err != M_PROPERTY_OK)
                 break;
             node.format = MPV_FORMAT_STRING;
@@ -1296,6 +1385,117 @@ int mpv_get_property_async(mpv_handle *ctx, uint64_t ud, const char *name,
     return run_async(ctx, getproperty_fn, req);
 }
 
+struct getproperties_request {
+    struct MPContext *mpctx;
+    int num;
+    const char **names;
+    const mpv_format *formats;
+    void **data;
+    int *errors;
+};
+
+static void getproperties_fn(void *arg)
+{
+    struct getproperties_request *req = arg;
+    for (int n = 0; n < req->num; n++) {
+        if (req->errors[n] < 0)
+            continue;
+        struct getproperty_request preq = {
+            .mpctx = req->mpctx,
+            .name = req->names[n],
+            .format = req->formats[n],
+            .data = req->data[n],
+        };
+        getproperty_fn(&preq);
+        req->errors[n] = preq.status;
+    }
+}
+
+int mpv_get_properties(mpv_handle *ctx, int num, const char **names,
+                       const mpv_format *formats, void **data, int *errors)
+{
+    if (!ctx->mpctx->initialized)
+        return MPV_ERROR_UNINITIALIZED;
+    if (num < 0 || (num && (!names || !formats || !data || !errors)))
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    for (int n = 0; n < num; n++) {
+        errors[n] = 0;
+        if (!names[n] || !data[n]) {
+            errors[n] = MPV_ERROR_INVALID_PARAMETER;
+        } else if (!get_mp_type_get(formats[n])) {
+            errors[n] = MPV_ERROR_PROPERTY_FORMAT;
+        }
+    }
+
+    struct getproperties_request req = {
+        .mpctx = ctx->mpctx,
+        .num = num,
+        .names = names,
+        .formats = formats,
+        .data = data,
+        .errors = errors,
+    };
+    run_locked(ctx, getproperties_fn, &req);
+    return 0;
+}
+
+struct mpv_property_handle {
+    struct m_property_path path;
+};
+
+mpv_property_handle *mpv_resolve_property(mpv_handle *ctx, const char *name)
+{
+    struct m_property_path path;
+    if (!mp_property_resolve(ctx->mpctx, name, &path))
+        return NULL;
+    struct mpv_property_handle *prop = talloc_ptrtype(NULL, prop);
+    prop->path = path;
+    return prop;
+}
+
+int mpv_get_property_resolved(mpv_handle *ctx, mpv_property_handle *prop,
+                              mpv_format format, void *data)
+{
+    if (!ctx->mpctx->initialized)
+        return MPV_ERROR_UNINITIALIZED;
+    if (!prop || !data)
+        return MPV_ERROR_INVALID_PARAMETER;
+    if (!get_mp_type_get(format))
+        return MPV_ERROR_PROPERTY_FORMAT;
+
+    struct getproperty_request req = {
+        .mpctx = ctx->mpctx,
+        .name = prop->path.name,
+        .path = &prop->path,
+        .format = format,
+        .data = data,
+    };
+    run_locked(ctx, getproperty_fn, &req);
+    return req.status;
+}
+
+int mpv_set_property_resolved(mpv_handle *ctx, mpv_property_handle *prop,
+                              mpv_format format, void *data)
+{
+    if (!ctx->mpctx->initialized)
+        return MPV_ERROR_UNINITIALIZED;
+    if (!prop)
+        return MPV_ERROR_INVALID_PARAMETER;
+    if (!get_mp_type(format))
+        return MPV_ERROR_PROPERTY_FORMAT;
+
+    struct setproperty_request req = {
+        .mpctx = ctx->mpctx,
+        .name = prop->path.name,
+        .path = &prop->path,
+        .format = format,
+        .data = data,
+    };
+    run_locked(ctx, setproperty_fn, &req);
+    return req.status;
+}
+
 static void property_free(void *p)
 {
     struct observe_property *prop = p;
@@ -1306,15 +1506,89 @@ static void property_free(void *p)
     }
 }
 
+static void remove_observer(struct observer_list *list,
+                            struct observe_property *prop)
+{
+    for (int n = 0; n < list->num; n++) {
+        if (list->props[n] == prop) {
+            MP_TARRAY_REMOVE_AT(list->props, list->num, n);
+            return;
+        }
+    }
+}
+
+// Grow the array *p of *num zero-initialized elements of the given size, so
+// that index is valid.
+static void *grow_index(void *ta_parent, void *p, int *num, size_t size,
+                        int index)
+{
+    if (index < *num)
+        return p;
+    p = talloc_realloc_size(ta_parent, p, (index + 1) * size);
+    memset((char *)p + *num * size, 0, (index + 1 - *num) * size);
+    *num = index + 1;
+    return p;
+}
+
+// Add prop to the reverse indexes. Called with clients->lock and ctx->lock.
+static void index_property(struct mpv_handle *ctx,
+                           struct observe_property *prop)
+{
+    struct mp_client_api *clients = ctx->clients;
+    int i = prop->id + 1;
+    ctx->props_by_id = grow_index(ctx, ctx->props_by_id, &ctx->num_props_by_id,
+                                  sizeof(ctx->props_by_id[0]), i);
+    struct observer_list *list = &ctx->props_by_id[i];
+    MP_TARRAY_APPEND(ctx, list->props, list->num, prop);
+    if (list->num == 1) {
+        clients->observers_by_id =
+            grow_index(clients, clients->observers_by_id,
+                       &clients->num_observers_by_id,
+                       sizeof(clients->observers_by_id[0]), i);
+        struct client_list *cl = &clients->observers_by_id[i];
+        MP_TARRAY_APPEND(clients, cl->clients, cl->num, ctx);
+    }
+    for (int n = 0; n < 64; n++) {
+        if (prop->event_mask & (1ULL << n)) {
+            list = &ctx->props_by_event[n];
+            MP_TARRAY_APPEND(ctx, list->props, list->num, prop);
+        }
+    }
+}
+
+// Inverse of index_property(). Called with clients->lock and ctx->lock.
+static void unindex_property(struct mpv_handle *ctx,
+                             struct observe_property *prop)
+{
+    int i = prop->id + 1;
+    remove_observer(&ctx->props_by_id[i], prop);
+    if (!ctx->props_by_id[i].num)
+        remove_client(&ctx->clients->observers_by_id[i], ctx);
+    for (int n = 0; n < 64; n++) {
+        if (prop->event_mask & (1ULL << n))
+            remove_observer(&ctx->props_by_event[n], prop);
+    }
+}
+
 int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
                          const char *name, mpv_format format)
+{
+    return mpv_observe_property_throttled(ctx, userdata, name, format, 0, 0);
+}
+
+int mpv_observe_property_throttled(mpv_handle *ctx, uint64_t userdata,
+                                   const char *name, mpv_format format,
+                                   double min_interval, double min_delta)
 {
     if (format != MPV_FORMAT_NONE && !get_mp_type_get(format))
         return MPV_ERROR_PROPERTY_FORMAT;
     // Explicitly disallow this, because it would require a special code path.
     if (format == MPV_FORMAT_OSD_STRING)
         return MPV_ERROR_PROPERTY_FORMAT;
+    if (!(min_interval >= 0 && min_interval < 1e6) || !(min_delta >= 0))
+        return MPV_ERROR_INVALID_PARAMETER;
 
+    pthread_mutex_lock(&ctx->clients->lock);
     pthread_mutex_lock(&ctx->lock);
     struct observe_property *prop = talloc_ptrtype(ctx, prop);
     talloc_set_destructor(prop, property_free);
@@ -1327,17 +1601,27 @@ int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
         .format = format,
         .changed = true,
         .need_new_value = true,
+        .index = ctx->num_properties,
+        .min_interval = min_interval * 1e6,
+        .min_delta = min_delta,
     };
     MP_TARRAY_APPEND(ctx, ctx->properties, ctx->num_properties, prop);
+    index_property(ctx, prop);
     ctx->property_event_masks |= prop->event_mask;
     ctx->lowest_changed = 0;
+    if (prop->min_interval) {
+        ctx->num_throttled++;
+        ctx->clients->num_throttled++;
+    }
     pthread_mutex_unlock(&ctx->lock);
-    invalidate_global_event_mask(ctx);
+    ctx->clients->event_masks = 0;
+    pthread_mutex_unlock(&ctx->clients->lock);
     return 0;
 }
 
 int mpv_unobserve_property(mpv_handle *ctx, uint64_t userdata)
 {
+    pthread_mutex_lock(&ctx->clients->lock);
     pthread_mutex_lock(&ctx->lock);
     ctx->property_event_masks = 0;
     int count = 0;
@@ -1353,46 +1637,69 @@ int mpv_unobserve_property(mpv_handle *ctx, uint64_t userdata)
                 // with the value update mechanism.
                 talloc_steal(ctx->cur_event, prop);
             }
+            unindex_property(ctx, prop);
+            if (prop->min_interval) {
+                ctx->num_throttled--;
+                ctx->clients->num_throttled--;
+            }
             MP_TARRAY_REMOVE_AT(ctx->properties, ctx->num_properties, n);
             count++;
         }
         if (!prop->dead)
             ctx->property_event_masks |= prop->event_mask;
     }
+    for (int n = 0; n < ctx->num_properties; n++)
+        ctx->properties[n]->index = n;
     ctx->lowest_changed = 0;
     pthread_mutex_unlock(&ctx->lock);
-    invalidate_global_event_mask(ctx);
+    ctx->clients->event_masks = 0;
+    pthread_mutex_unlock(&ctx->clients->lock);
     return count;
 }
 
-static void mark_property_changed(struct mpv_handle *client, int index)
+// Returns false if the client doesn't need to be woken up, because the change
+// of a rate-limited property is held back.
+static bool mark_property_changed(struct mpv_handle *client,
+                                  struct observe_property *prop)
 {
-    struct observe_property *prop = client->properties[index];
     if (!prop->changed && !prop->need_new_value) {
         prop->changed = true;
         prop->need_new_value = prop->format != 0;
-        client->lowest_changed = MPMIN(client->lowest_changed, index);
+        client->lowest_changed = MPMIN(client->lowest_changed, prop->index);
     }
+    if (prop->min_interval && prop->next_update > mp_time_us()) {
+        // The core wakes up the client once it's due, see
+        // mp_client_wakeup_throttled().
+        if (!client->throttle_deadline ||
+            prop->next_update < client->throttle_deadline)
+            client->throttle_deadline = prop->next_update;
+        return false;
+    }
+    return true;
 }
 
 // Broadcast that a property has changed.
 void mp_client_property_change(struct MPContext *mpctx, const char *name)
 {
     struct mp_client_api *clients = mpctx->clients;
-    int id = mp_get_property_id(name);
+    int i = mp_get_property_id(name) + 1;
 
     pthread_mutex_lock(&clients->lock);
 
-    for (int n = 0; n < clients->num_clients; n++) {
-        struct mpv_handle *client = clients->clients[n];
-        pthread_mutex_lock(&client->lock);
-        for (int i = 0; i < client->num_properties; i++) {
-            if (client->properties[i]->id == id)
-                mark_property_changed(client, i);
+    // Only the clients which observe the property are touched.
+    if (i < clients->num_observers_by_id) {
+        struct client_list *cl = &clients->observers_by_id[i];
+        for (int n = 0; n < cl->num; n++) {
+            struct mpv_handle *client = cl->clients[n];
+            pthread_mutex_lock(&client->lock);
+            struct observer_list *list = &client->props_by_id[i];
+            bool wakeup = false;
+            for (int p = 0; p < list->num; p++)
+                wakeup |= mark_property_changed(client, list->props[p]);
+            if (wakeup)
+                wakeup_client(client);
+            pthread_mutex_unlock(&client->lock);
         }
-        if (client->lowest_changed < client->num_properties)
-            wakeup_client(client);
-        pthread_mutex_unlock(&client->lock);
     }
 
     pthread_mutex_unlock(&clients->lock);
@@ -1402,17 +1709,49 @@ void mp_client_property_change(struct MPContext *mpctx, const char *name)
 // Called with ctx->lock held.
 static void notify_property_events(struct mpv_handle *ctx, uint64_t event_mask)
 {
-    for (int i = 0; i < ctx->num_properties; i++) {
-        if (ctx->properties[i]->event_mask & event_mask)
-            mark_property_changed(ctx, i);
+    bool wakeup = false;
+    for (int n = 0; n < 64; n++) {
+        if (event_mask & (1ULL << n)) {
+            struct observer_list *list = &ctx->props_by_event[n];
+            for (int i = 0; i < list->num; i++)
+                wakeup |= mark_property_changed(ctx, list->props[i]);
+        }
     }
-    if (ctx->lowest_changed < ctx->num_properties)
+    if (wakeup)
         wakeup_client(ctx);
 }
 
-static void update_prop(void *p)
+// Wake up the clients for which rate-limited property changes are due. Returns
+// the time in seconds until the next one is due.
+double mp_client_wakeup_throttled(struct MPContext *mpctx)
+{
+    struct mp_client_api *clients = mpctx->clients;
+    double timeout = 1e20;
+
+    pthread_mutex_lock(&clients->lock);
+    if (clients->num_throttled) {
+        int64_t now = mp_time_us();
+        for (int n = 0; n < clients->num_clients; n++) {
+            struct mpv_handle *ctx = clients->clients[n];
+            pthread_mutex_lock(&ctx->lock);
+            if (ctx->throttle_deadline) {
+                if (ctx->throttle_deadline <= now) {
+                    ctx->throttle_deadline = 0;
+                    wakeup_client(ctx);
+                } else {
+                    timeout = MPMIN(timeout,
+                                    (ctx->throttle_deadline - now) / 1e6);
+                }
+            }
+            pthread_mutex_unlock(&ctx->lock);
+        }
+    }
+    pthread_mutex_unlock(&clients->lock);
+    return timeout;
+}
+
+static void update_prop(struct observe_property *prop)
 {
-    struct observe_property *prop = p;
     struct mpv_handle *ctx = prop->client;
 
     const struct m_option *type = get_mp_type_get(prop->format);
@@ -1437,8 +1776,20 @@ static void update_prop(void *p)
     if (prop->user_value_valid != prop->new_value_valid) {
         prop->changed = true;
     } else if (prop->user_value_valid && prop->new_value_valid) {
-        if (!compare_value(&prop->user_value, &prop->new_value, prop->format))
+        double a, b;
+        if (prop->min_delta &&
+            get_number(&prop->user_value, prop->format, &a) &&
+            get_number(&prop->new_value, prop->format, &b))
+        {
+            // Compare with the last value the user has seen, so that slow
+            // changes still add up.
+            if (fabs(a - b) >= prop->min_delta)
+                prop->changed = true;
+        } else if (!compare_value(&prop->user_value, &prop->new_value,
+                                  prop->format))
+        {
             prop->changed = true;
+        }
     }
     if (prop->dead)
         talloc_steal(ctx->cur_event, prop);
@@ -1446,18 +1797,58 @@ static void update_prop(void *p)
     pthread_mutex_unlock(&ctx->lock);
 }
 
+struct prop_updates {
+    struct observe_property **props;
+    int num;
+};
+
+// Retrieve the new values of a batch of properties, all within the same
+// dispatch callback.
+static void update_props(void *p)
+{
+    struct prop_updates *updates = p;
+    for (int n = 0; n < updates->num; n++)
+        update_prop(updates->props[n]);
+    talloc_free(updates);
+}
+
+static void flush_prop_updates(struct mpv_handle *ctx,
+                               struct prop_updates *updates)
+{
+    if (updates->num) {
+        mp_dispatch_enqueue(ctx->mpctx->dispatch, update_props, updates);
+    } else {
+        talloc_free(updates);
+    }
+}
+
 // Set ctx->cur_event to a generated property change event, if there is any
 // outstanding property.
 static bool gen_property_change_event(struct mpv_handle *ctx)
 {
     if (!ctx->mpctx->initialized)
         return false;
+    struct prop_updates *updates = talloc_zero(NULL, struct prop_updates);
+    int64_t now = ctx->num_throttled ? mp_time_us() : 0;
+    int64_t throttle_deadline = 0;
     int start = ctx->lowest_changed;
     ctx->lowest_changed = ctx->num_properties;
     for (int n = start; n < ctx->num_properties; n++) {
         struct observe_property *prop = ctx->properties[n];
         if ((prop->changed || prop->updating) && n < ctx->lowest_changed)
             ctx->lowest_changed = n;
+        // Rate-limited properties are held back before their value is
+        // retrieved. They stay marked as changed until they're due.
+        if (prop->changed && prop->min_interval &&
+            (prop->need_new_value || !prop->format))
+        {
+            if (prop->next_update > now) {
+                if (!throttle_deadline || prop->next_update < throttle_deadline)
+                    throttle_deadline = prop->next_update;
+                continue;
+            }
+            prop->next_update = now + prop->min_interval;
+        }
         if (prop->changed) {
             bool get_value = prop->need_new_value;
             prop->need_new_value = false;
@@ -1465,7 +1856,7 @@ static bool gen_property_change_event(struct mpv_handle *ctx)
             if (prop->format && get_value) {
                 ctx->properties_updating++;
                 prop->updating = true;
-                mp_dispatch_enqueue(ctx->mpctx->dispatch, update_prop, prop);
+                MP_TARRAY_APPEND(updates, updates->props, updates->num, prop);
             } else {
                 const struct m_option *type = get_mp_type_get(prop->format);
                 prop->user_value_valid = prop->new_value_valid;
@@ -1482,10 +1873,18 @@ static bool gen_property_change_event(struct mpv_handle *ctx)
                     .reply_userdata = prop->reply_id,
                     .data = &ctx->cur_property_event,
                 };
+                // Not all properties were looked at, so keep the old deadline
+                // if it's earlier.
+                int64_t old = ctx->throttle_deadline;
+                if (throttle_deadline && (!old || throttle_deadline < old))
+                    ctx->throttle_deadline = throttle_deadline;
+                flush_prop_updates(ctx, updates);
                 return true;
             }
         }
     }
+    ctx->throttle_deadline = throttle_deadline;
+    flush_prop_updates(ctx, updates);
     return false;
 }
 
@@ -1608,6 +2007,7 @@ static const char *const event_table[] = {
     [MPV_EVENT_PLAYBACK_RESTART] = "playback-restart",
     [MPV_EVENT_PROPERTY_CHANGE] = "property-change",
     [MPV_EVENT_CHAPTER_CHANGE] = "chapter-change",
+    [MPV_EVENT_SCREENSHOT_DONE] = "screenshot-done",
 };
 
 const char *mpv_event_name(mpv_event_id event)
@@ -1617,6 +2017,19 @@ const char *mpv_event_name(mpv_event_id event)
     return event_table[event];
 }
 
+static const char *const screenshot_status_table[] = {
+    [MPV_SCREENSHOT_SAVED] = "saved",
+    [MPV_SCREENSHOT_FAILED] = "failed",
+    [MPV_SCREENSHOT_DROPPED] = "dropped",
+};
+
+const char *mp_screenshot_status_name(int status)
+{
+    if ((unsigned)status >= MP_ARRAY_SIZE(screenshot_status_table))
+        return "unknown";
+    return screenshot_status_table[status];
+}
+
 void mpv_free(void *data)
 {
     talloc_free(data);
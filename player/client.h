@@ -27,6 +27,7 @@ int mp_client_send_event_dup(struct MPContext *mpctx, const char *client_name,
                              int event, void *data);
 bool mp_client_event_is_registered(struct MPContext *mpctx, int event);
 void mp_client_property_change(struct MPContext *mpctx, const char *name);
+double mp_client_wakeup_throttled(struct MPContext *mpctx);
 
 struct mpv_handle *mp_new_client(struct mp_client_api *clients, const char *name);
 struct mp_log *mp_client_get_log(struct mpv_handle *ctx);
@@ -34,6 +35,9 @@ struct MPContext *mp_client_get_core(struct mpv_handle *ctx);
 
 void mp_resume_all(struct mpv_handle *ctx);
 
+// Name of a mpv_screenshot_status value, or "unknown" if out of range.
+const char *mp_screenshot_status_name(int status);
+
 // m_option.c
 void *node_get_alloc(struct mpv_node *node);
 
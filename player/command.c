@@ -90,8 +90,16 @@ struct command_ctx {
     int64_t hook_seq; // for hook_handler.seq
 
     struct ao_device_list *cached_ao_devices;
+
+    struct m_property_index *properties; // index for mp_properties (shared)
 };
 
+// The property index depends on mp_properties[] only, so it's shared by all
+// mpv instances in the process. Freed with the last instance.
+static pthread_mutex_t property_index_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct m_property_index *property_index;
+static int property_index_refs;
+
 struct overlay {
     void *map_start;
     size_t map_size;
@@ -1431,6 +1439,7 @@ static int mp_property_volume(void *ctx, struct m_property *prop,
                               int action, void *arg)
 {
     MPContext *mpctx = ctx;
+    suspend_audio_thread(mpctx); // the mixer accesses the filters
     if (!mixer_audio_initialized(mpctx->mixer))
         return M_PROPERTY_UNAVAILABLE;
     switch (action) {
@@ -1471,6 +1480,7 @@ static int mp_property_mute(void *ctx, struct m_property *prop,
                             int action, void *arg)
 {
     MPContext *mpctx = ctx;
+    suspend_audio_thread(mpctx);
     if (!mixer_audio_initialized(mpctx->mixer))
         return M_PROPERTY_ERROR;
     switch (action) {
@@ -1491,6 +1501,7 @@ static int mp_property_volrestore(void *ctx, struct m_property *prop,
                                   int action, void *arg)
 {
     MPContext *mpctx = ctx;
+    suspend_audio_thread(mpctx);
     switch (action) {
     case M_PROPERTY_GET: {
         char *s = mixer_get_volume_restore_data(mpctx->mixer);
@@ -1549,6 +1560,17 @@ static int mp_property_audio_devices(void *ctx, struct m_property *prop,
                                 get_device_entry, cmd->cached_ao_devices);
 }
 
+/// Number of audio output buffer underruns (RO)
+static int mp_property_audio_xruns(void *ctx, struct m_property *prop,
+                                   int action, void *arg)
+{
+    struct MPContext *mpctx = ctx;
+    struct ao_stats stats;
+    if (!mpctx->ao || !ao_get_stats(mpctx->ao, &stats))
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_int64_ro(action, arg, stats.xruns);
+}
+
 /// Audio delay (RW)
 static int mp_property_audio_delay(void *ctx, struct m_property *prop,
                                    int action, void *arg)
@@ -1574,6 +1596,7 @@ static int mp_property_audio_format(void *ctx, struct m_property *prop,
                                     int action, void *arg)
 {
     MPContext *mpctx = ctx;
+    suspend_audio_thread(mpctx);
     const char *c = mpctx->d_audio ? mpctx->d_audio->header->codec : NULL;
     return m_property_strdup_ro(action, arg, c);
 }
@@ -1583,6 +1606,7 @@ static int mp_property_audio_codec(void *ctx, struct m_property *prop,
                                    int action, void *arg)
 {
     MPContext *mpctx = ctx;
+    suspend_audio_thread(mpctx);
     const char *c = mpctx->d_audio ? mpctx->d_audio->decoder_desc : NULL;
     return m_property_strdup_ro(action, arg, c);
 }
@@ -1592,6 +1616,7 @@ static int mp_property_audio_bitrate(void *ctx, struct m_property *prop,
                                      int action, void *arg)
 {
     MPContext *mpctx = ctx;
+    suspend_audio_thread(mpctx);
     if (!mpctx->d_audio)
         return M_PROPERTY_UNAVAILABLE;
     if (action == M_PROPERTY_PRINT) {
@@ -1606,6 +1631,7 @@ static int mp_property_samplerate(void *ctx, struct m_property *prop,
                                   int action, void *arg)
 {
     MPContext *mpctx = ctx;
+    suspend_audio_thread(mpctx);
     struct mp_audio fmt = {0};
     if (mpctx->d_audio)
         fmt = mpctx->d_audio->decode_format;
@@ -1623,6 +1649,7 @@ static int mp_property_channels(void *ctx, struct m_property *prop,
                                 int action, void *arg)
 {
     MPContext *mpctx = ctx;
+    suspend_audio_thread(mpctx);
     struct mp_audio fmt = {0};
     if (mpctx->d_audio)
         fmt = mpctx->d_audio->decode_format;
@@ -1647,6 +1674,7 @@ static int mp_property_balance(void *ctx, struct m_property *prop,
                                int action, void *arg)
 {
     MPContext *mpctx = ctx;
+    suspend_audio_thread(mpctx);
     float bal;
 
     switch (action) {
@@ -3298,6 +3326,7 @@ static const struct m_property mp_properties[] = {
     {"volume-restore-data", mp_property_volrestore},
     {"audio-device", mp_property_audio_device},
     {"audio-device-list", mp_property_audio_devices},
+    {"audio-xruns", mp_property_audio_xruns},
 
     // Video
     {"fullscreen", mp_property_fullscreen},
@@ -3502,18 +3531,39 @@ static bool is_property_set(int action, void *val)
     }
 }
 
-int mp_property_do(const char *name, int action, void *val,
-                   struct MPContext *ctx)
+// The result can be used with mp_property_do_path() as long as mpctx exists.
+// Can be called from any thread (the index is never changed after init).
+bool mp_property_resolve(struct MPContext *mpctx, const char *name,
+                         struct m_property_path *path)
 {
-    int r = m_property_do(ctx->log, mp_properties, name, action, val, ctx);
+    return m_property_resolve(mpctx->log, mpctx->command_ctx->properties,
+                              name, path);
+}
+
+int mp_property_do_path(const struct m_property_path *path, int action,
+                        void *val, struct MPContext *ctx)
+{
+    // Setting properties can change the audio filters (volume, speed, ...).
+    if (is_property_set(action, val))
+        suspend_audio_thread(ctx);
+    int r = m_property_do_path(ctx->log, path, action, val, ctx);
     if (r == M_PROPERTY_OK && is_property_set(action, val))
-        mp_notify_property(ctx, (char *)name);
+        mp_notify_property(ctx, path->name);
     return r;
 }
 
+int mp_property_do(const char *name, int action, void *val,
+                   struct MPContext *ctx)
+{
+    struct m_property_path path;
+    mp_property_resolve(ctx, name, &path);
+    return mp_property_do_path(&path, action, val, ctx);
+}
+
 char *mp_property_expand_string(struct MPContext *mpctx, const char *str)
 {
-    return m_properties_expand_string(mp_properties, str, mpctx);
+    return m_properties_expand_string(mpctx->command_ctx->properties, str,
+                                      mpctx);
 }
 
 // Before expanding properties, parse C-style escapes like "\n"
@@ -4592,6 +4642,15 @@ int run_command(MPContext *mpctx, mp_cmd_t *cmd)
         return edit_filters_osd(mpctx, STREAM_AUDIO, cmd->args[0].v.s,
                                 cmd->args[1].v.s, msg_osd);
 
+    case MP_CMD_AF_COMMAND:
+        if (!mpctx->d_audio)
+            return -1;
+        suspend_audio_thread(mpctx);
+        if (af_send_command(mpctx->d_audio->afilter, cmd->args[0].v.s,
+                            cmd->args[1].v.s, cmd->args[2].v.s) < 0)
+            return -1;
+        break;
+
     case MP_CMD_VF:
         return edit_filters_osd(mpctx, STREAM_VIDEO, cmd->args[0].v.s,
                                 cmd->args[1].v.s, msg_osd);
@@ -4697,11 +4756,34 @@ int run_command(MPContext *mpctx, mp_cmd_t *cmd)
     return 0;
 }
 
+static struct m_property_index *get_property_index(void)
+{
+    pthread_mutex_lock(&property_index_lock);
+    if (!property_index)
+        property_index = m_property_index_create(NULL, mp_properties);
+    property_index_refs++;
+    struct m_property_index *index = property_index;
+    pthread_mutex_unlock(&property_index_lock);
+    return index;
+}
+
+static void release_property_index(void)
+{
+    pthread_mutex_lock(&property_index_lock);
+    assert(property_index_refs > 0);
+    if (--property_index_refs == 0) {
+        talloc_free(property_index);
+        property_index = NULL;
+    }
+    pthread_mutex_unlock(&property_index_lock);
+}
+
 void command_uninit(struct MPContext *mpctx)
 {
     overlay_uninit(mpctx);
     talloc_free(mpctx->command_ctx);
     mpctx->command_ctx = NULL;
+    release_property_index();
 }
 
 void command_init(struct MPContext *mpctx)
@@ -4711,6 +4793,7 @@ void command_init(struct MPContext *mpctx)
         .last_seek_pts = MP_NOPTS_VALUE,
         .prev_pts = MP_NOPTS_VALUE,
     };
+    mpctx->command_ctx->properties = get_property_index();
 }
 
 static void command_event(struct MPContext *mpctx, int event, void *arg)
@@ -22,6 +22,7 @@
 struct MPContext;
 struct mp_cmd;
 struct mp_log;
+struct m_property_path;
 
 void command_init(struct MPContext *mpctx);
 void command_uninit(struct MPContext *mpctx);
@@ -32,6 +33,10 @@ char *mp_property_expand_escaped_string(struct MPContext *mpctx, const char *str
 void property_print_help(struct mp_log *log);
 int mp_property_do(const char* name, int action, void* val,
                    struct MPContext *mpctx);
+bool mp_property_resolve(struct MPContext *mpctx, const char *name,
+                         struct m_property_path *path);
+int mp_property_do_path(const struct m_property_path *path, int action,
+                        void *val, struct MPContext *mpctx);
 
 void mp_notify(struct MPContext *mpctx, int event, void *arg);
 void mp_notify_property(struct MPContext *mpctx, const char *property);
@@ -42,7 +47,7 @@ uint64_t mp_get_property_event_mask(const char *name);
 enum {
     // Must start with the first unused positive value in enum mpv_event_id
     // MPV_EVENT_* and MP_EVENT_* must not overlap.
-    INTERNAL_EVENT_BASE = 24,
+    INTERNAL_EVENT_BASE = 25,
     MP_EVENT_CACHE_UPDATE,
     MP_EVENT_WIN_RESIZE,
     MP_EVENT_WIN_STATE,
@@ -221,6 +221,8 @@ typedef struct MPContext {
     struct ao *ao;
     struct mp_audio *ao_decoder_fmt; // for weak gapless audio check
     struct mp_audio_buffer *ao_buffer;  // queued audio; passed to ao_play() later
+    // If set, owns d_audio while running (see suspend_audio_thread()).
+    struct audio_thread *audio_thread;
 
     struct vo *video_out;
     // next_frame[0] is the next frame, next_frame[1] the one after that.
@@ -340,11 +342,13 @@ typedef struct MPContext {
     struct mp_nav_state *nav_state;
 
     struct mp_ipc_ctx *ipc_ctx;
+    struct mp_stats_shm *stats_shm;
 
     struct mpv_opengl_cb_context *gl_cb_ctx;
 } MPContext;
 
 // audio.c
+void suspend_audio_thread(struct MPContext *mpctx);
 void reset_audio_state(struct MPContext *mpctx);
 void reinit_audio_chain(struct MPContext *mpctx);
 int reinit_audio_filters(struct MPContext *mpctx);
@@ -0,0 +1,364 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "talloc.h"
+
+#include "osdep/io.h"
+#include "osdep/threads.h"
+#include "common/msg.h"
+#include "common/common.h"
+#include "common/encode.h"
+#include "common/playlist.h"
+#include "options/options.h"
+#include "options/m_config.h"
+#include "options/m_option.h"
+#include "options/path.h"
+#include "input/input.h"
+#include "demux/demux.h"
+#include "libmpv/client.h"
+
+#include "core.h"
+#include "encode_chunks.h"
+
+// Options that must not be passed to the chunk encoders, because they are
+// set per chunk, or would make the chunk instance do something else.
+static const char *const excluded_opts[] = {
+    "o", "ochunks", "start", "end", "length", "chapter", "frames",
+    "playlist", "include", "profile", "shuffle", "loop", "pause",
+    "config", "config-dir", "idle", "terminal", "input-terminal",
+    "input-file", "input-unix-socket", "log-file", "script",
+    "stream-dump", "storyboard", "ab-loop-a", "ab-loop-b", "stats-shm",
+    NULL
+};
+
+struct chunk_state;
+
+struct chunk {
+    struct chunk_state *cs;
+    int index;
+    char *file;             // temporary output file
+    mpv_handle *handle;     // NULL once the instance is being destroyed
+    pthread_t thread;
+    bool running;
+    bool quit_sent;
+    bool done;
+    bool ok;
+};
+
+struct chunk_state {
+    struct MPContext *mpctx;
+    pthread_mutex_t lock;
+    struct chunk *chunks;
+    int num_chunks;
+};
+
+// Return the pts of the keyframe at or before pts, or MP_NOPTS_VALUE.
+static double find_keyframe(struct demuxer *demuxer, struct sh_stream *sh,
+                            double pts)
+{
+    demux_seek(demuxer, pts, SEEK_ABSOLUTE | SEEK_BACKWARD);
+    while (1) {
+        struct demux_packet *pkt = demux_read_packet(sh);
+        if (!pkt)
+            return MP_NOPTS_VALUE;
+        double kf = pkt->keyframe ? pkt->pts : MP_NOPTS_VALUE;
+        talloc_free(pkt);
+        if (kf != MP_NOPTS_VALUE)
+            return kf;
+    }
+}
+
+// Fill bounds[0..num] with the start times of the chunks, and the end time.
+// Returns the number of chunks, which is less than num if keyframes are
+// too sparse.
+static int find_bounds(struct MPContext *mpctx, double start, double end,
+                       int num, double *bounds)
+{
+    struct track *track = mpctx->current_track[0][STREAM_VIDEO];
+    if (!track)
+        track = mpctx->current_track[0][STREAM_AUDIO];
+
+    // Only this stream is read; don't let the demuxer queue the others.
+    for (int n = 0; n < mpctx->num_tracks; n++) {
+        struct track *t = mpctx->tracks[n];
+        if (t != track && t->stream && t->selected)
+            demuxer_select_track(t->demuxer, t->stream, false);
+    }
+
+    int count = 0;
+    bounds[count++] = start;
+    for (int n = 1; n < num; n++) {
+        double pts = find_keyframe(track->demuxer, track->stream,
+                                   start + (end - start) * n / num);
+        if (pts != MP_NOPTS_VALUE && pts > bounds[count - 1] && pts < end)
+            bounds[count++] = pts;
+    }
+    bounds[count] = end;
+    return count;
+}
+
+static bool is_excluded(const char *name)
+{
+    for (int n = 0; excluded_opts[n]; n++) {
+        if (strcmp(excluded_opts[n], name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Pass all options that differ from the defaults to the chunk instance.
+static void copy_options(struct MPContext *mpctx, mpv_handle *h)
+{
+    struct m_config *conf = mpctx->mconfig;
+    for (int n = 0; n < conf->num_opts; n++) {
+        struct m_config_option *co = &conf->opts[n];
+        if (co->is_generated || !co->data || !co->default_data ||
+            is_excluded(co->name))
+            continue;
+        char *val = m_option_print(co->opt, co->data);
+        char *def = m_option_print(co->opt, co->default_data);
+        if (val && !(def && strcmp(val, def) == 0)) {
+            if (mpv_set_option_string(h, co->name, val) < 0) {
+                MP_VERBOSE(mpctx, "Chunked encoding: can't pass --%s=%s.\n",
+                           co->name, val);
+            }
+        }
+        talloc_free(val);
+        talloc_free(def);
+    }
+}
+
+static void *chunk_thread(void *p)
+{
+    struct chunk *c = p;
+    struct chunk_state *cs = c->cs;
+    struct MPContext *mpctx = cs->mpctx;
+    mpv_handle *h = c->handle;
+    bool ok = false;
+
+    mpthread_set_name("encode-chunk");
+
+    mpv_request_log_messages(h, "warn");
+    if (mpv_initialize(h) < 0)
+        goto done;
+    const char *cmd[] = {"loadfile", mpctx->filename, NULL};
+    if (mpv_command(h, cmd) < 0)
+        goto done;
+
+    while (1) {
+        mpv_event *ev = mpv_wait_event(h, -1);
+        if (ev->event_id == MPV_EVENT_SHUTDOWN)
+            break;
+        if (ev->event_id == MPV_EVENT_LOG_MESSAGE) {
+            mpv_event_log_message *msg = ev->data;
+            if (strcmp(msg->level, "warn") == 0) {
+                MP_WARN(mpctx, "[chunk %d] %s", c->index, msg->text);
+            } else {
+                MP_ERR(mpctx, "[chunk %d] %s", c->index, msg->text);
+            }
+        }
+        if (ev->event_id == MPV_EVENT_END_FILE) {
+            mpv_event_end_file *ef = ev->data;
+            ok = ef->reason == MPV_END_FILE_REASON_EOF;
+            break;
+        }
+    }
+
+done:
+    pthread_mutex_lock(&cs->lock);
+    c->handle = NULL;
+    pthread_mutex_unlock(&cs->lock);
+
+    // This also finishes writing the chunk file.
+    mpv_terminate_destroy(h);
+
+    pthread_mutex_lock(&cs->lock);
+    c->ok = ok;
+    c->done = true;
+    pthread_mutex_unlock(&cs->lock);
+    mp_input_wakeup(mpctx->input);
+    return NULL;
+}
+
+static bool start_chunk(struct chunk_state *cs, struct chunk *c,
+                        double start, double end)
+{
+    struct MPContext *mpctx = cs->mpctx;
+    struct MPOpts *opts = mpctx->opts;
+
+    mpv_handle *h = mpv_create();
+    if (!h)
+        return false;
+    copy_options(mpctx, h);
+    mpv_set_option_string(h, "o", c->file);
+    // Keep the user's start/end for the first/last chunk only.
+    if (c->index > 0 || opts->play_start.type) {
+        char *s = talloc_asprintf(NULL, "%f", start);
+        mpv_set_option_string(h, "start", s);
+        talloc_free(s);
+    }
+    if (end != MP_NOPTS_VALUE) {
+        char *s = talloc_asprintf(NULL, "%f", end);
+        mpv_set_option_string(h, "end", s);
+        talloc_free(s);
+    }
+
+    c->handle = h;
+    if (pthread_create(&c->thread, NULL, chunk_thread, c)) {
+        c->handle = NULL;
+        mpv_terminate_destroy(h);
+        return false;
+    }
+    c->running = true;
+    return true;
+}
+
+int encode_chunks_run(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+    struct encode_opts *eopts = opts->encode_opts;
+    int num = eopts->chunks;
+
+    if (!mpctx->encode_lavc_ctx || num < 2)
+        return 0;
+
+    if (mpctx->playlist->first != mpctx->playlist->last) {
+        MP_WARN(mpctx, "Chunked encoding works with a single input file "
+                "only; encoding normally.\n");
+        return 0;
+    }
+    if (mpctx->timeline || !mpctx->demuxer->seekable ||
+        (!mpctx->current_track[0][STREAM_VIDEO] &&
+         !mpctx->current_track[0][STREAM_AUDIO]))
+    {
+        MP_WARN(mpctx, "File can't be split into chunks; encoding normally.\n");
+        return 0;
+    }
+    if (!strcmp(eopts->file, "-") ||
+        bstr_startswith0(bstr0(eopts->file), "pipe:"))
+    {
+        MP_WARN(mpctx, "Chunked encoding needs a regular output file; "
+                "encoding normally.\n");
+        return 0;
+    }
+
+    double start = get_start_time(mpctx);
+    if (opts->play_start.type) {
+        double s = rel_time_to_abs(mpctx, opts->play_start);
+        if (s != MP_NOPTS_VALUE)
+            start = s;
+    }
+    double len = get_time_length(mpctx);
+    double end = get_play_end_pts(mpctx);
+    double split_end = end != MP_NOPTS_VALUE ? end : start + len;
+    if (len <= 0 || split_end <= start) {
+        MP_WARN(mpctx, "Unknown duration; encoding normally.\n");
+        return 0;
+    }
+
+    double *bounds = talloc_array(NULL, double, num + 1);
+    num = find_bounds(mpctx, start, split_end, num, bounds);
+    bounds[num] = end;
+
+    struct chunk_state *cs = talloc_zero(bounds, struct chunk_state);
+    cs->mpctx = mpctx;
+    pthread_mutex_init(&cs->lock, NULL);
+    cs->chunks = talloc_zero_array(cs, struct chunk, num);
+    cs->num_chunks = num;
+
+    MP_INFO(mpctx, "Encoding in %d chunks.\n", num);
+
+    bstr root = bstr0(eopts->file);
+    char *ext = mp_splitext(eopts->file, &root);
+
+    bool ok = true;
+    for (int n = 0; n < num; n++) {
+        struct chunk *c = &cs->chunks[n];
+        c->cs = cs;
+        c->index = n;
+        c->file = talloc_asprintf(cs, "%.*s.chunk%03d%s%s", BSTR_P(root), n,
+                                  ext ? "." : "", ext ? ext : "");
+        if (!start_chunk(cs, c, bounds[n], bounds[n + 1])) {
+            MP_ERR(mpctx, "Could not start encoding chunk %d.\n", n);
+            ok = false;
+            break;
+        }
+    }
+
+    bool aborted = !ok;
+    int last_done = 0;
+    while (1) {
+        int num_done = 0;
+        pthread_mutex_lock(&cs->lock);
+        for (int n = 0; n < num; n++) {
+            struct chunk *c = &cs->chunks[n];
+            if (!c->running || c->done)
+                num_done++;
+            if (c->done && !c->ok)
+                ok = false;
+            if ((aborted || mpctx->stop_play || !ok) && c->handle &&
+                !c->quit_sent)
+            {
+                const char *cmd[] = {"quit", NULL};
+                mpv_command_async(c->handle, 0, cmd);
+                c->quit_sent = true;
+            }
+        }
+        pthread_mutex_unlock(&cs->lock);
+        aborted |= mpctx->stop_play || !ok;
+
+        if (num_done > last_done && ok) {
+            MP_INFO(mpctx, "Encoded %d of %d chunks.\n", num_done, num);
+            last_done = num_done;
+        }
+        if (num_done == num)
+            break;
+
+        mp_wait_events(mpctx, 1.0);
+        mp_process_input(mpctx);
+    }
+
+    for (int n = 0; n < num; n++) {
+        if (cs->chunks[n].running)
+            pthread_join(cs->chunks[n].thread, NULL);
+    }
+
+    if (ok && !aborted) {
+        char **files = talloc_array(cs, char *, num);
+        for (int n = 0; n < num; n++)
+            files[n] = cs->chunks[n].file;
+        encode_lavc_set_metadata(mpctx->encode_lavc_ctx,
+                                 mpctx->demuxer->metadata);
+        ok = encode_lavc_concat(mpctx->encode_lavc_ctx, files, num);
+    } else if (!aborted) {
+        MP_ERR(mpctx, "Encoding a chunk failed.\n");
+    }
+
+    for (int n = 0; n < num; n++)
+        unlink(cs->chunks[n].file);
+
+    pthread_mutex_destroy(&cs->lock);
+    talloc_free(bounds);
+    return ok && !aborted ? 1 : -1;
+}
@@ -0,0 +1,30 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPLAYER_ENCODE_CHUNKS_H
+#define MPLAYER_ENCODE_CHUNKS_H
+
+struct MPContext;
+
+// Encode the loaded file in --ochunks segments, each with its own internal
+// player instance, and concatenate the results into the --o file. Called
+// instead of playback once the file is loaded.
+// Returns 1 on success, -1 on error, and 0 if the file can't be split (the
+// caller should encode it normally then).
+int encode_chunks_run(struct MPContext *mpctx);
+
+#endif /* MPLAYER_ENCODE_CHUNKS_H */
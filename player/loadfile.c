@@ -57,6 +57,8 @@
 
 #include "core.h"
 #include "command.h"
+#include "storyboard.h"
+#include "encode_chunks.h"
 #include "libmpv/client.h"
 
 static void uninit_demuxer(struct MPContext *mpctx)
@@ -212,6 +214,7 @@ static bool need_init_seek(struct demuxer *demux)
 // Also initializes position for external streams.
 void reselect_demux_streams(struct MPContext *mpctx)
 {
+    suspend_audio_thread(mpctx);
     // Note: we assume that all demuxer streams are covered by the track list.
     for (int t = 0; t < mpctx->num_tracks; t++) {
         struct track *track = mpctx->tracks[t];
@@ -1117,7 +1120,22 @@ goto_reopen_demuxer: ;
             "Displaying attached picture. Use --no-audio-display to prevent this.\n");
     }
 
+    if (opts->storyboard_file) {
+        if (storyboard_generate(mpctx))
+            mpctx->error_playing = 1; // no playback, but not an error either
+        goto terminate_playback;
+    }
+
 #if HAVE_ENCODING
+    if (mpctx->encode_lavc_ctx && opts->encode_opts->chunks > 1) {
+        int r = encode_chunks_run(mpctx);
+        if (r > 0)
+            mpctx->error_playing = 1; // no playback, but not an error either
+        if (r < 0 && !mpctx->stop_play)
+            mpctx->stop_play = PT_QUIT; // like other encoding failures
+        if (r)
+            goto terminate_playback;
+    }
     if (mpctx->encode_lavc_ctx && mpctx->current_track[0][STREAM_VIDEO])
         encode_lavc_expect_stream(mpctx->encode_lavc_ctx, AVMEDIA_TYPE_VIDEO);
     if (mpctx->encode_lavc_ctx && mpctx->current_track[0][STREAM_AUDIO])
@@ -80,6 +80,9 @@ struct script_ctx {
     struct mp_log *log;
     struct mpv_handle *client;
     struct MPContext *mpctx;
+    // For mp.get_api_stats().
+    int64_t api_calls;
+    int64_t api_time_us;
 };
 
 #if LUA_VERSION_NUM <= 501
@@ -157,6 +160,19 @@ static struct MPContext *get_mpctx(lua_State *L)
     return get_ctx(L)->mpctx;
 }
 
+// Account a client API call made by the script; api_end() must be called with
+// the returned value when it's done.
+static int64_t api_begin(struct script_ctx *ctx)
+{
+    ctx->api_calls++;
+    return mp_time_us();
+}
+
+static void api_end(struct script_ctx *ctx, int64_t start)
+{
+    ctx->api_time_us += mp_time_us() - start;
+}
+
 static int error_handler(lua_State *L)
 {
     struct script_ctx *ctx = get_ctx(L);
@@ -513,6 +529,14 @@ static int script_wait_event(lua_State *L)
         lua_setfield(L, -2, "args"); // event
         break;
     }
+    case MPV_EVENT_SCREENSHOT_DONE: {
+        mpv_event_screenshot *msg = event->data;
+        lua_pushstring(L, mp_screenshot_status_name(msg->status)); // event s
+        lua_setfield(L, -2, "status"); // event
+        lua_pushstring(L, msg->filename); // event s
+        lua_setfield(L, -2, "filename"); // event
+        break;
+    }
     case MPV_EVENT_PROPERTY_CHANGE: {
         mpv_event_property *prop = event->data;
         lua_pushstring(L, prop->name);
@@ -574,7 +598,10 @@ static int script_command(lua_State *L)
     struct script_ctx *ctx = get_ctx(L);
     const char *s = luaL_checkstring(L, 1);
 
-    return check_error(L, mpv_command_string(ctx->client, s));
+    int64_t t = api_begin(ctx);
+    int err = mpv_command_string(ctx->client, s);
+    api_end(ctx, t);
+    return check_error(L, err);
 }
 
 static int script_commandv(lua_State *L)
@@ -591,25 +618,95 @@ static int script_commandv(lua_State *L)
         args[n - 1] = s;
     }
     args[num] = NULL;
-    return check_error(L, mpv_command(ctx->client, args));
+    int64_t t = api_begin(ctx);
+    int err = mpv_command(ctx->client, args);
+    api_end(ctx, t);
+    return check_error(L, err);
 }
 
-static int script_set_property(lua_State *L)
+// Userdata returned by mp.resolve_property().
+struct prop_handle {
+    mpv_property_handle *handle;
+};
+
+static int destroy_prop_handle(lua_State *L)
+{
+    struct prop_handle *h = luaL_checkudata(L, 1, "mp.property_handle");
+    mpv_free(h->handle);
+    h->handle = NULL;
+    return 0;
+}
+
+static int script_resolve_property(lua_State *L)
 {
     struct script_ctx *ctx = get_ctx(L);
-    const char *p = luaL_checkstring(L, 1);
+    const char *name = luaL_checkstring(L, 1);
+    struct prop_handle *h = lua_newuserdata(L, sizeof(*h)); // u
+    h->handle = NULL;
+    if (luaL_newmetatable(L, "mp.property_handle")) { // u metatable
+        lua_pushcfunction(L, destroy_prop_handle); // u metatable gc
+        lua_setfield(L, -2, "__gc"); // u metatable
+    }
+    lua_setmetatable(L, -2); // u
+    h->handle = mpv_resolve_property(ctx->client, name);
+    if (!h->handle) {
+        lua_pushnil(L);
+        lua_pushstring(L, mpv_error_string(MPV_ERROR_PROPERTY_NOT_FOUND));
+        return 2;
+    }
+    return 1;
+}
+
+// Return the handle if the given argument is a property handle, or NULL.
+static mpv_property_handle *to_prop_handle(lua_State *L, int arg)
+{
+    struct prop_handle *h = lua_touserdata(L, arg);
+    if (!h || !lua_getmetatable(L, arg)) // mt
+        return NULL;
+    luaL_getmetatable(L, "mp.property_handle"); // mt mt2
+    bool ok = lua_rawequal(L, -1, -2);
+    lua_pop(L, 2); // -
+    return ok ? h->handle : NULL;
+}
+
+// The property functions take either a property name or a property handle as
+// argument arg.
+static int get_property(lua_State *L, int arg, mpv_format format, void *data)
+{
+    struct script_ctx *ctx = get_ctx(L);
+    mpv_property_handle *h = to_prop_handle(L, arg);
+    const char *name = h ? NULL : luaL_checkstring(L, arg);
+    int64_t t = api_begin(ctx);
+    int err = h ? mpv_get_property_resolved(ctx->client, h, format, data)
+                : mpv_get_property(ctx->client, name, format, data);
+    api_end(ctx, t);
+    return err;
+}
+
+static int set_property(lua_State *L, int arg, mpv_format format, void *data)
+{
+    struct script_ctx *ctx = get_ctx(L);
+    mpv_property_handle *h = to_prop_handle(L, arg);
+    const char *name = h ? NULL : luaL_checkstring(L, arg);
+    int64_t t = api_begin(ctx);
+    int err = h ? mpv_set_property_resolved(ctx->client, h, format, data)
+                : mpv_set_property(ctx->client, name, format, data);
+    api_end(ctx, t);
+    return err;
+}
+
+static int script_set_property(lua_State *L)
+{
     const char *v = luaL_checkstring(L, 2);
 
-    return check_error(L, mpv_set_property_string(ctx->client, p, v));
+    return check_error(L, set_property(L, 1, MPV_FORMAT_STRING, &v));
 }
 
 static int script_set_property_bool(lua_State *L)
 {
-    struct script_ctx *ctx = get_ctx(L);
-    const char *p = luaL_checkstring(L, 1);
     int v = lua_toboolean(L, 2);
 
-    return check_error(L, mpv_set_property(ctx->client, p, MPV_FORMAT_FLAG, &v));
+    return check_error(L, set_property(L, 1, MPV_FORMAT_FLAG, &v));
 }
 
 static bool is_int(double d)
@@ -620,17 +717,15 @@ static bool is_int(double d)
 
 static int script_set_property_number(lua_State *L)
 {
-    struct script_ctx *ctx = get_ctx(L);
-    const char *p = luaL_checkstring(L, 1);
     double d = luaL_checknumber(L, 2);
     // If the number might be an integer, then set it as integer. The mpv core
     // will (probably) convert INT64 to DOUBLE when setting, but not the other
     // way around.
     int res;
     if (is_int(d)) {
-        res = mpv_set_property(ctx->client, p, MPV_FORMAT_INT64, &(int64_t){d});
+        res = set_property(L, 1, MPV_FORMAT_INT64, &(int64_t){d});
     } else {
-        res = mpv_set_property(ctx->client, p, MPV_FORMAT_DOUBLE, &d);
+        res = set_property(L, 1, MPV_FORMAT_DOUBLE, &d);
     }
     return check_error(L, res);
 }
@@ -746,12 +841,10 @@ static void makenode(void *tmp, mpv_node *dst, lua_State *L, int t)
 
 static int script_set_property_native(lua_State *L)
 {
-    struct script_ctx *ctx = get_ctx(L);
-    const char *p = luaL_checkstring(L, 1);
     struct mpv_node node;
     void *tmp = mp_lua_PITA(L);
     makenode(tmp, &node, L, 2);
-    int res = mpv_set_property(ctx->client, p, MPV_FORMAT_NODE, &node);
+    int res = set_property(L, 1, MPV_FORMAT_NODE, &node);
     talloc_free_children(tmp);
     return check_error(L, res);
 
@@ -759,13 +852,11 @@ static int script_set_property_native(lua_State *L)
 
 static int script_get_property(lua_State *L)
 {
-    struct script_ctx *ctx = get_ctx(L);
-    const char *name = luaL_checkstring(L, 1);
     int type = lua_tointeger(L, lua_upvalueindex(1))
                ? MPV_FORMAT_OSD_STRING : MPV_FORMAT_STRING;
 
     char *result = NULL;
-    int err = mpv_get_property(ctx->client, name, type, &result);
+    int err = get_property(L, 1, type, &result);
     if (err >= 0) {
         lua_pushstring(L, result);
         talloc_free(result);
@@ -783,11 +874,8 @@ static int script_get_property(lua_State *L)
 
 static int script_get_property_bool(lua_State *L)
 {
-    struct script_ctx *ctx = get_ctx(L);
-    const char *name = luaL_checkstring(L, 1);
-
     int result = 0;
-    int err = mpv_get_property(ctx->client, name, MPV_FORMAT_FLAG, &result);
+    int err = get_property(L, 1, MPV_FORMAT_FLAG, &result);
     if (err >= 0) {
         lua_pushboolean(L, !!result);
         return 1;
@@ -800,12 +888,9 @@ static int script_get_property_bool(lua_State *L)
 
 static int script_get_property_number(lua_State *L)
 {
-    struct script_ctx *ctx = get_ctx(L);
-    const char *name = luaL_checkstring(L, 1);
-
     // Note: the mpv core will (hopefully) convert INT64 to DOUBLE
     double result = 0;
-    int err = mpv_get_property(ctx->client, name, MPV_FORMAT_DOUBLE, &result);
+    int err = get_property(L, 1, MPV_FORMAT_DOUBLE, &result);
     if (err >= 0) {
         lua_pushnumber(L, result);
         return 1;
@@ -867,13 +952,11 @@ static void pushnode(lua_State *L, mpv_node *node)
 
 static int script_get_property_native(lua_State *L)
 {
-    struct script_ctx *ctx = get_ctx(L);
-    const char *name = luaL_checkstring(L, 1);
     mp_lua_optarg(L, 2);
     void *tmp = mp_lua_PITA(L);
 
     mpv_node node;
-    int err = mpv_get_property(ctx->client, name, MPV_FORMAT_NODE, &node);
+    int err = get_property(L, 1, MPV_FORMAT_NODE, &node);
     if (err >= 0) {
         auto_free_node(tmp, &node);
         pushnode(L, &node);
@@ -885,6 +968,67 @@ static int script_get_property_native(lua_State *L)
     return 2;
 }
 
+// If names is an array, return an array with the values in the same order. If
+// it's a map (e.g. {pos = "time-pos"}), return a map with the same keys.
+static int script_get_properties_native(lua_State *L)
+{
+    struct script_ctx *ctx = get_ctx(L);
+    luaL_checktype(L, 1, LUA_TTABLE);
+    mp_lua_optarg(L, 2);
+    void *tmp = mp_lua_PITA(L);
+
+    // Collect the names in the order lua_next() returns them; the result is
+    // built in the same order again.
+    int num = 0;
+    const char **names = NULL;
+    lua_pushnil(L); // nil
+    while (lua_next(L, 1) != 0) { // key name
+        if (lua_type(L, -1) != LUA_TSTRING)
+            luaL_error(L, "property names must be strings");
+        MP_TARRAY_GROW(tmp, names, num);
+        // The string stays referenced by the table.
+        names[num++] = lua_tostring(L, -1);
+        lua_pop(L, 1); // key
+    }
+    mpv_format *formats = talloc_array(tmp, mpv_format, num);
+    mpv_node *nodes = talloc_array(tmp, mpv_node, num);
+    void **data = talloc_array(tmp, void *, num);
+    int *errors = talloc_array(tmp, int, num);
+    for (int n = 0; n < num; n++) {
+        formats[n] = MPV_FORMAT_NODE;
+        data[n] = &nodes[n];
+    }
+
+    int64_t t = api_begin(ctx);
+    int err = mpv_get_properties(ctx->client, num, names, formats, data, errors);
+    api_end(ctx, t);
+    if (err < 0) {
+        lua_pushnil(L);
+        lua_pushstring(L, mpv_error_string(err));
+        return 2;
+    }
+    for (int n = 0; n < num; n++) {
+        if (errors[n] >= 0)
+            auto_free_node(tmp, &nodes[n]);
+    }
+    lua_newtable(L); // res
+    int n = 0;
+    lua_pushnil(L); // res nil
+    while (lua_next(L, 1) != 0) { // res key name
+        lua_pop(L, 1); // res key
+        lua_pushvalue(L, -1); // res key key
+        if (errors[n] >= 0) {
+            pushnode(L, &nodes[n]); // res key key value
+        } else {
+            lua_pushvalue(L, 2); // res key key def
+        }
+        lua_rawset(L, -4); // res key
+        n++;
+    }
+    talloc_free_children(tmp);
+    return 1;
+}
+
 static mpv_format check_property_format(lua_State *L, int arg)
 {
     if (lua_isnil(L, arg))
@@ -926,7 +1070,9 @@ static int script_command_native(lua_State *L)
     struct mpv_node result;
     void *tmp = mp_lua_PITA(L);
     makenode(tmp, &node, L, 1);
+    int64_t t = api_begin(ctx);
     int err = mpv_command_node(ctx->client, &node, &result);
+    api_end(ctx, t);
     if (err >= 0) {
         auto_free_node(tmp, &result);
         pushnode(L, &result);
@@ -983,6 +1129,17 @@ static int script_get_mouse_pos(lua_State *L)
     return 2;
 }
 
+static int script_get_api_stats(lua_State *L)
+{
+    struct script_ctx *ctx = get_ctx(L);
+    lua_newtable(L); // t
+    lua_pushnumber(L, ctx->api_calls); // t calls
+    lua_setfield(L, -2, "calls"); // t
+    lua_pushnumber(L, ctx->api_time_us / 1e6); // t time
+    lua_setfield(L, -2, "time"); // t
+    return 1;
+}
+
 static int script_get_time(lua_State *L)
 {
     struct script_ctx *ctx = get_ctx(L);
@@ -1271,6 +1428,8 @@ static const struct fn_entry main_fns[] = {
     FN_ENTRY(get_property_bool),
     FN_ENTRY(get_property_number),
     FN_ENTRY(get_property_native),
+    FN_ENTRY(get_properties_native),
+    FN_ENTRY(resolve_property),
     FN_ENTRY(set_property),
     FN_ENTRY(set_property_bool),
     FN_ENTRY(set_property_number),
@@ -1282,6 +1441,7 @@ static const struct fn_entry main_fns[] = {
     FN_ENTRY(get_screen_size),
     FN_ENTRY(get_mouse_pos),
     FN_ENTRY(get_time),
+    FN_ENTRY(get_api_stats),
     FN_ENTRY(input_define_section),
     FN_ENTRY(input_enable_section),
     FN_ENTRY(input_disable_section),
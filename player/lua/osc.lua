@@ -78,6 +78,15 @@ local state = {
     idle = false,
 }
 
+-- properties read on every render, looked up only once
+local props = {}
+for _, name in ipairs({"percent-pos", "playback-time", "playback-time/full",
+                       "playtime-remaining", "playtime-remaining/full",
+                       "length", "length/full", "demuxer-cache-duration",
+                       "cache-used"}) do
+    props[name] = mp.resolve_property(name) or name
+end
+
 
 
 
@@ -1470,9 +1479,9 @@ function osc_init()
         end
     end
     ne.slider.posF =
-        function () return mp.get_property_number("percent-pos", nil) end
+        function () return mp.get_property_number(props["percent-pos"], nil) end
     ne.slider.tooltipF = function (pos)
-        local duration = mp.get_property_number("length", nil)
+        local duration = mp.get_property_number(props["length"], nil)
         if not ((duration == nil) or (pos == nil)) then
             possec = duration * (pos / 100)
             return mp.format_time(possec)
@@ -1506,9 +1515,9 @@ function osc_init()
 
     ne.content = function ()
         if (state.tc_ms) then
-            return (mp.get_property_osd("playback-time/full"))
+            return (mp.get_property_osd(props["playback-time/full"]))
         else
-            return (mp.get_property_osd("playback-time"))
+            return (mp.get_property_osd(props["playback-time"]))
         end
     end
     ne.eventresponder["mouse_btn0_up"] =
@@ -1522,15 +1531,15 @@ function osc_init()
     ne.content = function ()
         if (state.rightTC_trem) then
             if state.tc_ms then
-                return ("-"..mp.get_property_osd("playtime-remaining/full"))
+                return ("-"..mp.get_property_osd(props["playtime-remaining/full"]))
             else
-                return ("-"..mp.get_property_osd("playtime-remaining"))
+                return ("-"..mp.get_property_osd(props["playtime-remaining"]))
             end
         else
             if state.tc_ms then
-                return (mp.get_property_osd("length/full"))
+                return (mp.get_property_osd(props["length/full"]))
             else
-                return (mp.get_property_osd("length"))
+                return (mp.get_property_osd(props["length"]))
             end
         end
     end
@@ -1541,13 +1550,13 @@ function osc_init()
     ne = new_element("cache", "button")
 
     ne.content = function ()
-        local dmx_cache = mp.get_property_number("demuxer-cache-duration")
+        local dmx_cache = mp.get_property_number(props["demuxer-cache-duration"])
         if not (dmx_cache == nil) then
             dmx_cache = math.floor(dmx_cache + 0.5) .. "s + "
         else
             dmx_cache = ""
         end
-        local cache_used = mp.get_property_number("cache-used")
+        local cache_used = mp.get_property_number(props["cache-used"])
         if not (cache_used == nil) then
             if (cache_used < 1024) then
                 cache_used = cache_used .. " KB"
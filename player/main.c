@@ -62,6 +62,7 @@
 #include "client.h"
 #include "command.h"
 #include "screenshot.h"
+#include "stats_shm.h"
 
 #if defined(__MINGW32__) || defined(__CYGWIN__)
 #include <windows.h>
@@ -141,12 +142,22 @@ static void shutdown_clients(struct MPContext *mpctx)
 
 void mp_destroy(struct MPContext *mpctx)
 {
+#if !defined(__MINGW32__)
+    mp_shutdown_ipc(mpctx->ipc_ctx);
+#endif
+    shutdown_clients(mpctx);
+
+    // The IPC clients are gone now. They need the playback thread to process
+    // their requests until they are destroyed.
 #if !defined(__MINGW32__)
     mp_uninit_ipc(mpctx->ipc_ctx);
     mpctx->ipc_ctx = NULL;
 #endif
 
-    shutdown_clients(mpctx);
+    // Clients can take screenshots until they are gone.
+    screenshot_uninit(mpctx);
+
+    mp_stats_shm_uninit(mpctx);
 
     uninit_audio_out(mpctx);
     uninit_video_out(mpctx);
@@ -483,6 +494,8 @@ int mp_initialize(struct MPContext *mpctx)
     mpctx->ipc_ctx = mp_init_ipc(mpctx->clients, mpctx->global);
 #endif
 
+    mp_stats_shm_init(mpctx);
+
     prepare_playlist(mpctx, mpctx->playlist);
 
     MP_STATS(mpctx, "end init");
@@ -51,11 +51,14 @@
 #include "core.h"
 #include "client.h"
 #include "command.h"
+#include "screenshot.h"
+#include "stats_shm.h"
 
 // Wait until mp_input_wakeup(mpctx->input) is called, since the last time
 // mp_wait_events() was called. (But see mp_process_input().)
 void mp_wait_events(struct MPContext *mpctx, double sleeptime)
 {
+    sleeptime = MPMIN(sleeptime, mp_client_wakeup_throttled(mpctx));
     mp_input_wait(mpctx->input, sleeptime);
 }
 
@@ -178,6 +181,9 @@ static int mp_seek(MPContext *mpctx, struct seek_params seek,
         return -1;
     }
 
+    // Don't let the audio thread read packets from before the seek.
+    suspend_audio_thread(mpctx);
+
     if (mpctx->stop_play == AT_END_OF_FILE)
         mpctx->stop_play = KEEP_PLAYING;
 
@@ -911,6 +917,7 @@ void run_playloop(struct MPContext *mpctx)
 
     handle_cursor_autohide(mpctx);
     handle_vo_events(mpctx);
+    screenshot_update(mpctx);
     handle_heartbeat_cmd(mpctx);
 
     fill_audio_out_buffers(mpctx, endpts);
@@ -995,6 +1002,8 @@ void run_playloop(struct MPContext *mpctx)
 
     handle_sstep(mpctx);
 
+    mp_stats_shm_update(mpctx);
+
     if (mpctx->stop_play)
         return;
 
@@ -1019,11 +1028,13 @@ void run_playloop(struct MPContext *mpctx)
 void mp_idle(struct MPContext *mpctx)
 {
     handle_dummy_ticks(mpctx);
+    mp_stats_shm_update(mpctx);
     mp_wait_events(mpctx, mpctx->sleeptime);
     mpctx->sleeptime = 100.0;
     mp_process_input(mpctx);
     handle_cursor_autohide(mpctx);
     handle_vo_events(mpctx);
+    screenshot_update(mpctx);
     update_osd_msg(mpctx);
     handle_osd_redraw(mpctx);
 }
@@ -19,6 +19,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <assert.h>
+#include <pthread.h>
 
 #include "config.h"
 
@@ -29,6 +31,7 @@
 #include "core.h"
 #include "command.h"
 #include "misc/bstr.h"
+#include "misc/thread_pool.h"
 #include "common/msg.h"
 #include "options/path.h"
 #include "video/mp_image.h"
@@ -37,12 +40,24 @@
 #include "video/out/vo.h"
 #include "video/image_writer.h"
 #include "sub/osd.h"
+#include "input/input.h"
+#include "libmpv/client.h"
 
 #include "video/csputils.h"
 
 #define MODE_FULL_WINDOW 1
 #define MODE_SUBTITLES 2
 
+// A screenshot waiting to be written, or just written.
+struct job {
+    struct mp_image *image;
+    struct image_writer_opts opts;
+    char *filename;
+    bool osd;
+    bool writing;       // a writer is working on it
+    int status;         // MPV_SCREENSHOT_*
+};
+
 typedef struct screenshot_ctx {
     struct MPContext *mpctx;
 
@@ -51,6 +66,19 @@ typedef struct screenshot_ctx {
     bool osd;
 
     int frameno;
+
+    struct mp_thread_pool *pool;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;      // job finished, or writer exited
+    int num_writers;            // write_job() calls queued or running
+    int max_writers;            // --screenshot-threads
+    // Queued or currently written jobs. Their filenames are reserved.
+    struct job **jobs;
+    int num_jobs;
+    // Finished jobs, to be reported by the player thread.
+    struct job **done;
+    int num_done;
 } screenshot_ctx;
 
 void screenshot_init(struct MPContext *mpctx)
@@ -59,7 +87,10 @@ void screenshot_init(struct MPContext *mpctx)
     *mpctx->screenshot_ctx = (screenshot_ctx) {
         .mpctx = mpctx,
         .frameno = 1,
+        .pool = mp_thread_pool_get_shared(),
     };
+    pthread_mutex_init(&mpctx->screenshot_ctx->lock, NULL);
+    pthread_cond_init(&mpctx->screenshot_ctx->wakeup, NULL);
 }
 
 #define SMSG_OK 0
@@ -85,6 +116,204 @@ static void screenshot_msg(screenshot_ctx *ctx, int status, const char *msg,
     talloc_free(s);
 }
 
+// Write one queued job, if there is any. Returns false if there was none.
+static bool write_one(screenshot_ctx *ctx)
+{
+    pthread_mutex_lock(&ctx->lock);
+    struct job *job = NULL;
+    for (int n = 0; n < ctx->num_jobs; n++) {
+        if (!ctx->jobs[n]->writing) {
+            job = ctx->jobs[n];
+            break;
+        }
+    }
+    if (job)
+        job->writing = true;
+    pthread_mutex_unlock(&ctx->lock);
+    if (!job)
+        return false;
+
+    bool ok = write_image(job->image, &job->opts, job->filename,
+                          ctx->mpctx->log);
+    job->status = ok ? MPV_SCREENSHOT_SAVED : MPV_SCREENSHOT_FAILED;
+    // Release the frame memory right away; the job itself lives until the
+    // player thread has reported it.
+    talloc_free(job->image);
+    job->image = NULL;
+
+    pthread_mutex_lock(&ctx->lock);
+    for (int n = 0; n < ctx->num_jobs; n++) {
+        if (ctx->jobs[n] == job) {
+            MP_TARRAY_REMOVE_AT(ctx->jobs, ctx->num_jobs, n);
+            break;
+        }
+    }
+    MP_TARRAY_APPEND(ctx, ctx->done, ctx->num_done, job);
+    pthread_cond_broadcast(&ctx->wakeup);
+    pthread_mutex_unlock(&ctx->lock);
+    mp_input_wakeup(ctx->mpctx->input);
+    return true;
+}
+
+static void start_writers(screenshot_ctx *ctx);
+
+// Runs on the thread pool. Writes a single job, and queues a new call for the
+// next one, so that the shared pool alternates between all of its users.
+static void write_job(void *p)
+{
+    screenshot_ctx *ctx = p;
+
+    write_one(ctx);
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->num_writers--;
+    start_writers(ctx);
+    pthread_cond_broadcast(&ctx->wakeup);
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+// Queue write_job() calls until there is one for each job waiting to be
+// written, but not more than max_writers in total. Called with ctx->lock held.
+static void start_writers(screenshot_ctx *ctx)
+{
+    int pending = 0, writing = 0;
+    for (int n = 0; n < ctx->num_jobs; n++) {
+        if (ctx->jobs[n]->writing) {
+            writing++;
+        } else {
+            pending++;
+        }
+    }
+    while (ctx->num_writers < ctx->max_writers &&
+           ctx->num_writers - writing < pending)
+    {
+        if (!mp_thread_pool_queue(ctx->pool, write_job, ctx))
+            break;
+        ctx->num_writers++;
+    }
+}
+
+static void report_job(screenshot_ctx *ctx, struct job *job)
+{
+    bool old_osd = ctx->osd;
+    ctx->osd = job->osd;
+    if (job->status == MPV_SCREENSHOT_FAILED)
+        screenshot_msg(ctx, SMSG_ERR, "Error writing screenshot '%s'!",
+                       job->filename);
+    if (job->status == MPV_SCREENSHOT_DROPPED)
+        screenshot_msg(ctx, SMSG_ERR, "Screenshot queue full, dropping '%s'.",
+                       job->filename);
+    ctx->osd = old_osd;
+
+    struct mpv_event_screenshot ev = {
+        .status = job->status,
+        .filename = job->filename,
+    };
+    mp_notify(ctx->mpctx, MPV_EVENT_SCREENSHOT_DONE, &ev);
+    talloc_free(job);
+}
+
+// Takes ownership of image and filename. opts is copied.
+static void queue_screenshot(screenshot_ctx *ctx, struct mp_image *image,
+                             const struct image_writer_opts *opts,
+                             char *filename)
+{
+    struct MPOpts *mopts = ctx->mpctx->opts;
+
+    struct job *job = talloc_ptrtype(NULL, job);
+    *job = (struct job){
+        .image = talloc_steal(job, image),
+        .opts = *opts,
+        .filename = talloc_steal(job, filename),
+        .osd = ctx->osd,
+    };
+    job->opts.format = talloc_strdup(job, opts->format);
+
+    screenshot_msg(ctx, SMSG_OK, "Screenshot: '%s'", filename);
+
+    if (!mopts->screenshot_threads) {
+        bool ok = write_image(image, &job->opts, filename, ctx->mpctx->log);
+        job->status = ok ? MPV_SCREENSHOT_SAVED : MPV_SCREENSHOT_FAILED;
+        report_job(ctx, job);
+        return;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    while (ctx->num_jobs >= mopts->screenshot_queue_size) {
+        if (mopts->screenshot_queue_drop) {
+            pthread_mutex_unlock(&ctx->lock);
+            job->status = MPV_SCREENSHOT_DROPPED;
+            report_job(ctx, job);
+            return;
+        }
+        pthread_cond_wait(&ctx->wakeup, &ctx->lock);
+    }
+    MP_TARRAY_APPEND(ctx, ctx->jobs, ctx->num_jobs, job);
+    ctx->max_writers = mopts->screenshot_threads;
+    start_writers(ctx);
+    bool write_now = !ctx->num_writers;
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (write_now) {
+        MP_ERR(ctx->mpctx, "Could not start screenshot writer.\n");
+        while (write_one(ctx)) {}
+    }
+}
+
+// Whether a queued screenshot is going to be written to this filename.
+static bool is_pending(screenshot_ctx *ctx, const char *filename)
+{
+    bool res = false;
+    pthread_mutex_lock(&ctx->lock);
+    for (int n = 0; n < ctx->num_jobs; n++)
+        res |= strcmp(ctx->jobs[n]->filename, filename) == 0;
+    pthread_mutex_unlock(&ctx->lock);
+    return res;
+}
+
+static bool file_taken(screenshot_ctx *ctx, const char *filename)
+{
+    return mp_path_exists(filename) || is_pending(ctx, filename);
+}
+
+void screenshot_update(struct MPContext *mpctx)
+{
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
+
+    pthread_mutex_lock(&ctx->lock);
+    struct job **done = talloc_steal(NULL, ctx->done);
+    int num_done = ctx->num_done;
+    ctx->done = NULL;
+    ctx->num_done = 0;
+    pthread_mutex_unlock(&ctx->lock);
+
+    for (int n = 0; n < num_done; n++)
+        report_job(ctx, done[n]);
+    talloc_free(done);
+}
+
+void screenshot_uninit(struct MPContext *mpctx)
+{
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
+    if (!ctx)
+        return;
+
+    // The writers requeue themselves until the queue is empty.
+    pthread_mutex_lock(&ctx->lock);
+    while (ctx->num_writers)
+        pthread_cond_wait(&ctx->wakeup, &ctx->lock);
+    pthread_mutex_unlock(&ctx->lock);
+    mp_thread_pool_release_shared(ctx->pool);
+    while (write_one(ctx)) {} // in case requeuing failed
+
+    screenshot_update(mpctx);
+
+    pthread_cond_destroy(&ctx->wakeup);
+    pthread_mutex_destroy(&ctx->lock);
+    talloc_free(ctx);
+    mpctx->screenshot_ctx = NULL;
+}
+
 static char *stripext(void *talloc_ctx, const char *s)
 {
     const char *end = strrchr(s, '.');
@@ -280,7 +509,7 @@ static char *gen_fname(screenshot_ctx *ctx, const char *file_ext)
             return NULL;
         }
 
-        if (!mp_path_exists(fname))
+        if (!file_taken(ctx, fname))
             return fname;
 
         if (sequence == prev_sequence) {
@@ -316,10 +545,9 @@ static void screenshot_save(struct MPContext *mpctx, struct mp_image *image)
 
     char *filename = gen_fname(ctx, image_writer_file_ext(opts));
     if (filename) {
-        screenshot_msg(ctx, SMSG_OK, "Screenshot: '%s'", filename);
-        if (!write_image(image, opts, filename, mpctx->log))
-            screenshot_msg(ctx, SMSG_ERR, "Error writing screenshot!");
-        talloc_free(filename);
+        queue_screenshot(ctx, image, opts, filename);
+    } else {
+        talloc_free(image);
     }
 }
 
@@ -358,7 +586,7 @@ void screenshot_to_file(struct MPContext *mpctx, const char *filename, int mode,
     bool old_osd = ctx->osd;
     ctx->osd = osd;
 
-    if (mp_path_exists(filename)) {
+    if (file_taken(ctx, filename)) {
         screenshot_msg(ctx, SMSG_ERR, "Screenshot: file '%s' already exists.",
                        filename);
         goto end;
@@ -371,10 +599,7 @@ void screenshot_to_file(struct MPContext *mpctx, const char *filename, int mode,
         screenshot_msg(ctx, SMSG_ERR, "Taking screenshot failed.");
         goto end;
     }
-    screenshot_msg(ctx, SMSG_OK, "Screenshot: '%s'", filename);
-    if (!write_image(image, &opts, filename, mpctx->log))
-        screenshot_msg(ctx, SMSG_ERR, "Error writing screenshot!");
-    talloc_free(image);
+    queue_screenshot(ctx, image, &opts, talloc_strdup(NULL, filename));
 
 end:
     ctx->osd = old_osd;
@@ -406,8 +631,6 @@ void screenshot_request(struct MPContext *mpctx, int mode, bool each_frame,
     } else {
         screenshot_msg(ctx, SMSG_ERR, "Taking screenshot failed.");
     }
-
-    talloc_free(image);
 }
 
 void screenshot_flip(struct MPContext *mpctx)
@@ -43,4 +43,10 @@ void screenshot_to_file(struct MPContext *mpctx, const char *filename, int mode,
 // Called by the playback core code when a new frame is displayed.
 void screenshot_flip(struct MPContext *mpctx);
 
+// Report screenshots finished by the background writers (player thread only).
+void screenshot_update(struct MPContext *mpctx);
+
+// Wait until all queued screenshots are written, and free everything.
+void screenshot_uninit(struct MPContext *mpctx);
+
 #endif /* MPLAYER_SCREENSHOT_H */
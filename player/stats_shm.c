@@ -0,0 +1,234 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+
+#include "config.h"
+
+#if HAVE_POSIX_SHM
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "talloc.h"
+
+#include "common/msg.h"
+#include "common/common.h"
+#include "options/options.h"
+#include "osdep/timer.h"
+#include "video/out/vo.h"
+#include "libmpv/stats_shm.h"
+
+#include "core.h"
+#include "stats_shm.h"
+
+struct mp_stats_shm {
+    struct mp_log *log;
+    char *name;
+    struct mpv_stats_shm *p;
+    int64_t update_count;
+};
+
+// Everything after the fields set once in mp_stats_shm_create().
+#define DATA_OFFSET offsetof(struct mpv_stats_shm, update_count)
+
+// Seqlock writer side; see mpv_stats_shm_read() for the reader side.
+#if defined(__ATOMIC_RELEASE)
+static void begin_write(struct mpv_stats_shm *p)
+{
+    __atomic_store_n(&p->seq, p->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void end_write(struct mpv_stats_shm *p)
+{
+    __atomic_store_n(&p->seq, p->seq + 1, __ATOMIC_RELEASE);
+}
+#else
+static void begin_write(struct mpv_stats_shm *p)
+{
+    *(volatile uint32_t *)&p->seq = p->seq + 1;
+    __sync_synchronize();
+}
+
+static void end_write(struct mpv_stats_shm *p)
+{
+    __sync_synchronize();
+    *(volatile uint32_t *)&p->seq = p->seq + 1;
+}
+#endif
+
+void mp_stats_shm_write(struct mp_stats_shm *shm, struct mpv_stats_shm *st)
+{
+    st->update_count = ++shm->update_count;
+    st->update_time_us = mp_raw_time_us();
+    begin_write(shm->p);
+    memcpy((char *)shm->p + DATA_OFFSET, (char *)st + DATA_OFFSET,
+           sizeof(*st) - DATA_OFFSET);
+    end_write(shm->p);
+}
+
+#if HAVE_POSIX_SHM
+
+struct mp_stats_shm *mp_stats_shm_create(struct mp_log *log, const char *name)
+{
+    struct mp_stats_shm *shm = talloc_zero(NULL, struct mp_stats_shm);
+    shm->log = log;
+    shm->name = name[0] == '/' ? talloc_strdup(shm, name)
+                               : talloc_asprintf(shm, "/%s", name);
+
+    // Never attach to an existing region: it might be left over from a player
+    // that crashed, and its readers would see our header changes.
+    int fd = shm_open(shm->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 && errno == EEXIST) {
+        mp_warn(log, "Replacing existing shared memory '%s'.\n", shm->name);
+        shm_unlink(shm->name);
+        fd = shm_open(shm->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    }
+    if (fd < 0) {
+        mp_err(log, "Could not create shared memory '%s': %s\n",
+               shm->name, mp_strerror(errno));
+        goto error;
+    }
+
+    size_t size = sizeof(struct mpv_stats_shm);
+    void *p = MAP_FAILED;
+    if (ftruncate(fd, size) == 0)
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        mp_err(log, "Could not map shared memory '%s': %s\n",
+               shm->name, mp_strerror(errno));
+        shm_unlink(shm->name);
+        goto error;
+    }
+    shm->p = p;
+
+    // The region is zero-filled (and with it seq), so readers ignore it
+    // until the magic field is set.
+    shm->p->version = MPV_STATS_SHM_VERSION;
+    shm->p->size = size;
+    shm->p->pid = getpid();
+    __sync_synchronize();
+    shm->p->magic = MPV_STATS_SHM_MAGIC;
+
+    mp_verbose(log, "Writing playback state to shared memory '%s'.\n",
+               shm->name);
+    return shm;
+
+error:
+    talloc_free(shm);
+    return NULL;
+}
+
+void mp_stats_shm_destroy(struct mp_stats_shm *shm)
+{
+    if (!shm)
+        return;
+    struct mpv_stats_shm st = {
+        .time_pos = NAN, .playback_time = NAN, .duration = NAN,
+        .percent_pos = NAN, .speed = NAN, .avsync = NAN, .cache_percent = NAN,
+        .drop_frame_count = -1, .vo_drop_frame_count = -1,
+    };
+    mp_stats_shm_write(shm, &st);
+    shm_unlink(shm->name);
+    munmap(shm->p, sizeof(*shm->p));
+    talloc_free(shm);
+}
+
+#else
+
+struct mp_stats_shm *mp_stats_shm_create(struct mp_log *log, const char *name)
+{
+    mp_err(log, "Shared memory is not supported on this system.\n");
+    return NULL;
+}
+
+void mp_stats_shm_destroy(struct mp_stats_shm *shm)
+{
+}
+
+#endif
+
+void mp_stats_shm_init(struct MPContext *mpctx)
+{
+    char *name = mpctx->opts->stats_shm;
+    if (name && name[0])
+        mpctx->stats_shm = mp_stats_shm_create(mpctx->log, name);
+}
+
+void mp_stats_shm_uninit(struct MPContext *mpctx)
+{
+    mp_stats_shm_destroy(mpctx->stats_shm);
+    mpctx->stats_shm = NULL;
+}
+
+void mp_stats_shm_update(struct MPContext *mpctx)
+{
+    if (!mpctx->stats_shm)
+        return;
+
+    struct MPOpts *opts = mpctx->opts;
+    struct mpv_stats_shm st = {
+        .active = 1,
+        .idle = !mpctx->playing,
+        .pause = opts->pause,
+        .time_pos = NAN,
+        .playback_time = NAN,
+        .duration = NAN,
+        .percent_pos = NAN,
+        .speed = opts->playback_speed,
+        .avsync = NAN,
+        .cache_percent = NAN,
+        .drop_frame_count = -1,
+        .vo_drop_frame_count = -1,
+    };
+
+    if (mpctx->num_sources) {
+        st.paused_for_cache = mpctx->paused_for_cache;
+        st.seeking = !mpctx->restart_complete;
+        st.eof_reached = mpctx->video_status == STATUS_EOF &&
+                         mpctx->audio_status == STATUS_EOF;
+        st.time_pos = get_current_time(mpctx);
+        st.playback_time = get_playback_time(mpctx);
+        double len = get_time_length(mpctx);
+        if (len >= 0)
+            st.duration = len;
+        double pos = get_current_pos_ratio(mpctx, false);
+        if (pos >= 0)
+            st.percent_pos = pos * 100.0;
+    }
+
+    float cache = mp_get_cache_percent(mpctx);
+    if (cache >= 0)
+        st.cache_percent = cache;
+
+    if (mpctx->d_video) {
+        st.drop_frame_count = mpctx->dropped_frames_total;
+        st.vo_drop_frame_count = vo_get_drop_count(mpctx->video_out);
+        if (mpctx->d_audio && mpctx->last_av_difference != MP_NOPTS_VALUE)
+            st.avsync = mpctx->last_av_difference;
+    }
+
+    mp_stats_shm_write(mpctx->stats_shm, &st);
+}
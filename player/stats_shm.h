@@ -0,0 +1,43 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPLAYER_STATS_SHM_H
+#define MPLAYER_STATS_SHM_H
+
+struct MPContext;
+struct mp_log;
+struct mpv_stats_shm;
+struct mp_stats_shm;
+
+// Create the shared memory region with the given name (a leading '/' is added
+// if missing). Returns NULL on failure, or if not supported.
+struct mp_stats_shm *mp_stats_shm_create(struct mp_log *log, const char *name);
+
+// Mark the region as inactive, remove the name, and unmap it.
+void mp_stats_shm_destroy(struct mp_stats_shm *shm);
+
+// Copy st (except the header fields) to the region under the seqlock.
+void mp_stats_shm_write(struct mp_stats_shm *shm, struct mpv_stats_shm *st);
+
+// Create/destroy mpctx->stats_shm according to --stats-shm.
+void mp_stats_shm_init(struct MPContext *mpctx);
+void mp_stats_shm_uninit(struct MPContext *mpctx);
+
+// Write the current playback state. Called on every playloop iteration.
+void mp_stats_shm_update(struct MPContext *mpctx);
+
+#endif /* MPLAYER_STATS_SHM_H */
@@ -0,0 +1,223 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "config.h"
+#include "talloc.h"
+
+#include "common/msg.h"
+#include "common/common.h"
+#include "options/options.h"
+#include "options/path.h"
+#include "demux/demux.h"
+#include "video/mp_image.h"
+#include "video/sws_utils.h"
+#include "video/image_writer.h"
+#include "video/decode/dec_video.h"
+#include "video/decode/vd.h"
+
+#include "core.h"
+#include "storyboard.h"
+
+struct storyboard {
+    struct MPContext *mpctx;
+    struct dec_video *d_video;
+    struct demuxer *demuxer;
+    struct sh_stream *sh;
+    struct mp_image **tiles;
+    int num_tiles;
+    int tile_w, tile_h;
+};
+
+// Return the next decoded frame. Since the decoder skips non-keyframes, this
+// is the first keyframe at or after the current demuxer position.
+static struct mp_image *decode_keyframe(struct storyboard *sb)
+{
+    while (1) {
+        struct demux_packet *pkt = demux_read_packet(sb->sh);
+        // Non-keyframes produce no output; don't bother the decoder with them
+        // unless it still has to output delayed frames.
+        if (pkt && !pkt->keyframe) {
+            int delay = 0;
+            video_vd_control(sb->d_video, VDCTRL_QUERY_UNSEEN_FRAMES, &delay);
+            if (!delay) {
+                talloc_free(pkt);
+                continue;
+            }
+        }
+        struct mp_image *img = video_decode(sb->d_video, pkt, 0);
+        bool eof = !pkt;
+        talloc_free(pkt);
+        if (img || eof)
+            return img;
+    }
+}
+
+static void add_tile(struct storyboard *sb, struct mp_image *img)
+{
+    if (!sb->tile_w) {
+        struct MPOpts *opts = sb->mpctx->opts;
+        double aspect = (double)img->params.d_w / img->params.d_h;
+        sb->tile_w = opts->storyboard_width;
+        sb->tile_h = MPMAX(lrint(sb->tile_w / aspect / 2) * 2, 2);
+    }
+
+    struct mp_image *tile = mp_image_alloc(IMGFMT_RGB24, sb->tile_w, sb->tile_h);
+    if (!tile)
+        return;
+    mp_image_copy_attributes(tile, img);
+    mp_image_swscale(tile, img, mp_sws_fast_flags);
+    MP_TARRAY_APPEND(sb, sb->tiles, sb->num_tiles, tile);
+}
+
+static void collect_tiles(struct storyboard *sb)
+{
+    struct MPContext *mpctx = sb->mpctx;
+    struct MPOpts *opts = mpctx->opts;
+
+    double start = get_start_time(mpctx);
+    double len = get_time_length(mpctx);
+    double interval = opts->storyboard_interval;
+    if (interval <= 0 && len > 0)
+        interval = len / opts->storyboard_tiles;
+
+    double last_pts = MP_NOPTS_VALUE;
+    for (int n = 0; sb->num_tiles < opts->storyboard_tiles; n++) {
+        // Without a known duration, decode all keyframes in order.
+        if (interval > 0) {
+            double pts = start + n * interval;
+            if (len > 0 && n * interval >= len)
+                break;
+            demux_seek(sb->demuxer, pts, SEEK_ABSOLUTE | SEEK_BACKWARD);
+            video_reset_decoding(sb->d_video);
+        }
+
+        struct mp_image *img = decode_keyframe(sb);
+        if (!img)
+            break;
+        // With an interval shorter than the keyframe distance, seeking
+        // backwards can land on the same keyframe again.
+        if (last_pts == MP_NOPTS_VALUE || img->pts == MP_NOPTS_VALUE ||
+            img->pts > last_pts)
+        {
+            add_tile(sb, img);
+            MP_VERBOSE(mpctx, "Storyboard: tile %d at %f\n", sb->num_tiles,
+                       img->pts);
+        }
+        last_pts = img->pts;
+        talloc_free(img);
+
+        mp_process_input(mpctx);
+        if (mpctx->stop_play)
+            break;
+    }
+}
+
+static struct mp_image *render_sheet(struct storyboard *sb)
+{
+    int cols = MPMIN(sb->mpctx->opts->storyboard_columns, sb->num_tiles);
+    int rows = (sb->num_tiles + cols - 1) / cols;
+
+    struct mp_image *sheet =
+        mp_image_alloc(IMGFMT_RGB24, cols * sb->tile_w, rows * sb->tile_h);
+    if (!sheet)
+        return NULL;
+    mp_image_copy_attributes(sheet, sb->tiles[0]);
+    mp_image_clear(sheet, 0, 0, sheet->w, sheet->h);
+
+    for (int n = 0; n < sb->num_tiles; n++) {
+        int x = (n % cols) * sb->tile_w;
+        int y = (n / cols) * sb->tile_h;
+        struct mp_image dst = *sheet;
+        mp_image_crop(&dst, x, y, x + sb->tile_w, y + sb->tile_h);
+        mp_image_copy(&dst, sb->tiles[n]);
+    }
+    return sheet;
+}
+
+bool storyboard_generate(struct MPContext *mpctx)
+{
+    struct MPOpts *opts = mpctx->opts;
+    struct track *track = mpctx->current_track[0][STREAM_VIDEO];
+    bool ok = false;
+
+    if (!track || !track->stream || track->attached_picture) {
+        MP_ERR(mpctx, "Storyboard: no video track.\n");
+        return false;
+    }
+    if (mpctx->timeline) {
+        MP_ERR(mpctx, "Storyboard: not supported with timelines.\n");
+        return false;
+    }
+
+    // Only the video stream is read; don't let the demuxer queue the others.
+    for (int n = 0; n < mpctx->num_tracks; n++) {
+        struct track *t = mpctx->tracks[n];
+        if (t != track && t->stream && t->selected)
+            demuxer_select_track(t->demuxer, t->stream, false);
+    }
+
+    struct storyboard *sb = talloc_zero(NULL, struct storyboard);
+    sb->mpctx = mpctx;
+    sb->demuxer = track->demuxer;
+    sb->sh = track->stream;
+
+    struct dec_video *d_video = talloc_zero(NULL, struct dec_video);
+    sb->d_video = d_video;
+    d_video->global = mpctx->global;
+    d_video->log = mp_log_new(d_video, mpctx->log, "!vd");
+    d_video->opts = opts;
+    d_video->header = sb->sh;
+    d_video->fps = sb->sh->video->fps;
+    if (!video_init_best_codec(d_video, opts->video_decoders))
+        goto done;
+    if (video_vd_control(d_video, VDCTRL_SET_KEYFRAMES_ONLY,
+                         &(int){1}) != CONTROL_TRUE)
+        MP_WARN(mpctx, "Storyboard: decoder can't skip non-keyframes.\n");
+
+    collect_tiles(sb);
+    if (!sb->num_tiles) {
+        MP_ERR(mpctx, "Storyboard: no frames decoded.\n");
+        goto done;
+    }
+
+    struct mp_image *sheet = render_sheet(sb);
+    if (!sheet)
+        goto done;
+
+    char *filename = mp_get_user_path(sb, mpctx->global, opts->storyboard_file);
+    struct image_writer_opts wopts = *opts->screenshot_image_opts;
+    char *ext = mp_splitext(filename, NULL);
+    if (ext)
+        wopts.format = ext;
+    ok = write_image(sheet, &wopts, filename, mpctx->log);
+    if (ok) {
+        MP_INFO(mpctx, "Storyboard: %d tiles written to '%s'.\n",
+                sb->num_tiles, filename);
+    }
+    talloc_free(sheet);
+
+done:
+    video_uninit(d_video);
+    for (int n = 0; n < sb->num_tiles; n++)
+        talloc_free(sb->tiles[n]);
+    talloc_free(sb);
+    return ok;
+}
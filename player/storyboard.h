@@ -0,0 +1,30 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MPLAYER_STORYBOARD_H
+#define MPLAYER_STORYBOARD_H
+
+#include <stdbool.h>
+
+struct MPContext;
+
+// Decode keyframes of the selected video track, and write them as a grid of
+// thumbnails to the file set with --storyboard. Called instead of playback
+// once the file is loaded. Returns success.
+bool storyboard_generate(struct MPContext *mpctx);
+
+#endif /* MPLAYER_STORYBOARD_H */
@@ -27,11 +27,13 @@
 
 #include "common/common.h"
 #include "draw_bmp.h"
+#include "draw_bmp_blend.h"
 #include "img_convert.h"
 #include "video/mp_image.h"
 #include "video/sws_utils.h"
 #include "video/img_format.h"
 #include "video/csputils.h"
+#include "video/memcpy_pic.h"
 
 const bool mp_draw_sub_formats[SUBBITMAP_COUNT] = {
     [SUBBITMAP_LIBASS] = true,
@@ -51,9 +53,28 @@ struct part {
     struct sub_cache *imgs;
 };
 
+// Final result of rendering a sub_bitmaps, which can be blended onto further
+// frames as long as the sub_bitmaps does not change.
+struct overlay {
+    int bitmap_pos_id;
+    int imgfmt, w, h;
+    enum mp_csp colorspace;
+    enum mp_csp_levels levels;
+    int num_rc;
+    struct mp_rect rc[MP_SUB_BB_LIST_MAX];
+    // Premultiplied color and alpha for each rc[] entry, in the format of the
+    // target image. All planes of the alpha images use the range 0-255.
+    struct mp_image *color[MP_SUB_BB_LIST_MAX];
+    struct mp_image *alpha[MP_SUB_BB_LIST_MAX];
+};
+
 struct mp_draw_sub_cache
 {
     struct part *parts[MAX_OSD_PARTS];
+    struct overlay *overlays[MAX_OSD_PARTS];
+    // bitmap_pos_id of the last sub_bitmaps drawn without overlay
+    bool have_direct_id[MAX_OSD_PARTS];
+    int direct_id[MAX_OSD_PARTS];
     struct mp_image *upsample_img;
     struct mp_image upsample_temp;
 };
@@ -65,108 +86,15 @@ static bool get_sub_area(struct mp_rect bb, struct mp_image *temp,
                          struct sub_bitmap *sb, struct mp_image *out_area,
                          int *out_src_x, int *out_src_y);
 
-#define ACCURATE
-#define CONDITIONAL
-
-static void blend_const16_alpha(void *dst, int dst_stride, uint16_t srcp,
-                                uint8_t *srca, int srca_stride, uint8_t srcamul,
-                                int w, int h)
-{
-    if (!srcamul)
-        return;
-    for (int y = 0; y < h; y++) {
-        uint16_t *dst_r = (uint16_t *)((uint8_t *)dst + dst_stride * y);
-        uint8_t *srca_r = srca + srca_stride * y;
-        for (int x = 0; x < w; x++) {
-            uint32_t srcap = srca_r[x];
-#ifdef CONDITIONAL
-            if (!srcap)
-                continue;
-#endif
-            srcap *= srcamul; // now 0..65025
-            dst_r[x] = (srcp * srcap + dst_r[x] * (65025 - srcap) + 32512) / 65025;
-        }
-    }
-}
-
-static void blend_const8_alpha(void *dst, int dst_stride, uint16_t srcp,
-                               uint8_t *srca, int srca_stride, uint8_t srcamul,
-                               int w, int h)
-{
-    if (!srcamul)
-        return;
-    for (int y = 0; y < h; y++) {
-        uint8_t *dst_r = (uint8_t *)dst + dst_stride * y;
-        uint8_t *srca_r = srca + srca_stride * y;
-        for (int x = 0; x < w; x++) {
-            uint32_t srcap = srca_r[x];
-#ifdef CONDITIONAL
-            if (!srcap)
-                continue;
-#endif
-#ifdef ACCURATE
-            srcap *= srcamul; // now 0..65025
-            dst_r[x] = (srcp * srcap + dst_r[x] * (65025 - srcap) + 32512) / 65025;
-#else
-            srcap = (srcap * srcamul + 255) >> 8;
-            dst_r[x] = (srcp * srcap + dst_r[x] * (255 - srcap) + 255) >> 8;
-#endif
-        }
-    }
-}
-
 static void blend_const_alpha(void *dst, int dst_stride, int srcp,
                               uint8_t *srca, int srca_stride, uint8_t srcamul,
                               int w, int h, int bytes)
 {
+    const struct mp_blend_fns *fns = mp_blend_get_fns();
     if (bytes == 2) {
-        blend_const16_alpha(dst, dst_stride, srcp, srca, srca_stride, srcamul,
-                            w, h);
+        fns->const16(dst, dst_stride, srcp, srca, srca_stride, srcamul, w, h);
     } else if (bytes == 1) {
-        blend_const8_alpha(dst, dst_stride, srcp, srca, srca_stride, srcamul,
-                           w, h);
-    }
-}
-
-static void blend_src16_alpha(void *dst, int dst_stride, void *src,
-                              int src_stride, uint8_t *srca, int srca_stride,
-                              int w, int h)
-{
-    for (int y = 0; y < h; y++) {
-        uint16_t *dst_r = (uint16_t *)((uint8_t *)dst + dst_stride * y);
-        uint16_t *src_r = (uint16_t *)((uint8_t *)src + src_stride * y);
-        uint8_t *srca_r = srca + srca_stride * y;
-        for (int x = 0; x < w; x++) {
-            uint32_t srcap = srca_r[x];
-#ifdef CONDITIONAL
-            if (!srcap)
-                continue;
-#endif
-            dst_r[x] = (src_r[x] * srcap + dst_r[x] * (255 - srcap) + 127) / 255;
-        }
-    }
-}
-
-static void blend_src8_alpha(void *dst, int dst_stride, void *src,
-                             int src_stride, uint8_t *srca, int srca_stride,
-                             int w, int h)
-{
-    for (int y = 0; y < h; y++) {
-        uint8_t *dst_r = (uint8_t *)dst + dst_stride * y;
-        uint8_t *src_r = (uint8_t *)src + src_stride * y;
-        uint8_t *srca_r = srca + srca_stride * y;
-        for (int x = 0; x < w; x++) {
-            uint16_t srcap = srca_r[x];
-#ifdef CONDITIONAL
-            if (!srcap)
-                continue;
-#endif
-#ifdef ACCURATE
-            dst_r[x] = (src_r[x] * srcap + dst_r[x] * (255 - srcap) + 127) / 255;
-#else
-            dst_r[x] = (src_r[x] * srcap + dst_r[x] * (255 - srcap) + 255) >> 8;
-#endif
-        }
+        fns->const8(dst, dst_stride, srcp, srca, srca_stride, srcamul, w, h);
     }
 }
 
@@ -174,43 +102,20 @@ static void blend_src_alpha(void *dst, int dst_stride, void *src,
                             int src_stride, uint8_t *srca, int srca_stride,
                             int w, int h, int bytes)
 {
+    const struct mp_blend_fns *fns = mp_blend_get_fns();
     if (bytes == 2) {
-        blend_src16_alpha(dst, dst_stride, src, src_stride, srca, srca_stride,
-                          w, h);
+        fns->src16(dst, dst_stride, src, src_stride, srca, srca_stride, w, h);
     } else if (bytes == 1) {
-        blend_src8_alpha(dst, dst_stride, src, src_stride, srca, srca_stride,
-                         w, h);
+        fns->src8(dst, dst_stride, src, src_stride, srca, srca_stride, w, h);
     }
 }
 
 static void unpremultiply_and_split_BGR32(struct mp_image *img,
                                           struct mp_image *alpha)
 {
-    for (int y = 0; y < img->h; ++y) {
-        uint32_t *irow = (uint32_t *) &img->planes[0][img->stride[0] * y];
-        uint8_t *arow = &alpha->planes[0][alpha->stride[0] * y];
-        for (int x = 0; x < img->w; ++x) {
-            uint32_t pval = irow[x];
-            uint8_t aval = (pval >> 24);
-            uint8_t rval = (pval >> 16) & 0xFF;
-            uint8_t gval = (pval >> 8) & 0xFF;
-            uint8_t bval = pval & 0xFF;
-            // multiplied = separate * alpha / 255
-            // separate = rint(multiplied * 255 / alpha)
-            //          = floor(multiplied * 255 / alpha + 0.5)
-            //          = floor((multiplied * 255 + 0.5 * alpha) / alpha)
-            //          = floor((multiplied * 255 + floor(0.5 * alpha)) / alpha)
-            int div = (int) aval;
-            int add = div / 2;
-            if (aval) {
-                rval = FFMIN(255, (rval * 255 + add) / div);
-                gval = FFMIN(255, (gval * 255 + add) / div);
-                bval = FFMIN(255, (bval * 255 + add) / div);
-                irow[x] = bval + (gval << 8) + (rval << 16) + (aval << 24);
-            }
-            arow[x] = aval;
-        }
-    }
+    mp_blend_get_fns()->unpremultiply_bgr32(img->planes[0], img->stride[0],
+                                            alpha->planes[0], alpha->stride[0],
+                                            img->w, img->h);
 }
 
 // dst_format merely contains the target colorspace/format information
@@ -245,8 +150,9 @@ static void scale_sb_rgba(struct sub_bitmap *sb, struct mp_image *dst_format,
     *out_sba = sba;
 }
 
+// If alpha is not NULL, the coverage is accumulated in its first plane.
 static void draw_rgba(struct mp_draw_sub_cache *cache, struct mp_rect bb,
-                      struct mp_image *temp, int bits,
+                      struct mp_image *temp, struct mp_image *alpha, int bits,
                       struct sub_bitmaps *sbs)
 {
     struct part *part = get_cache(cache, sbs, temp);
@@ -279,14 +185,21 @@ static void draw_rgba(struct mp_draw_sub_cache *cache, struct mp_rect bb,
             blend_src_alpha(dst.planes[p], dst.stride[p], src, sbi->stride[p],
                             alpha_p, sba->stride[0], dst.w, dst.h, bytes);
         }
+        if (alpha) {
+            get_sub_area(bb, alpha, sb, &dst, &src_x, &src_y);
+            blend_const_alpha(dst.planes[0], dst.stride[0], 255, alpha_p,
+                              sba->stride[0], 255, dst.w, dst.h, bytes);
+        }
 
         part->imgs[i].i = talloc_steal(part, sbi);
         part->imgs[i].a = talloc_steal(part, sba);
     }
 }
 
+// If alpha is not NULL, the coverage is accumulated in its first plane.
 static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
-                     struct mp_image *temp, int bits, struct sub_bitmaps *sbs)
+                     struct mp_image *temp, struct mp_image *alpha, int bits,
+                     struct sub_bitmaps *sbs)
 {
     struct mp_csp_params cspar = MP_CSP_PARAMS_DEFAULTS;
     cspar.colorspace.format = temp->params.colorspace;
@@ -329,6 +242,11 @@ static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
             blend_const_alpha(dst.planes[p], dst.stride[p], color_yuv[p],
                               alpha_p, sb->stride, a, dst.w, dst.h, bytes);
         }
+        if (alpha) {
+            get_sub_area(bb, alpha, sb, &dst, &src_x, &src_y);
+            blend_const_alpha(dst.planes[0], dst.stride[0], 255, alpha_p,
+                              sb->stride, a, dst.w, dst.h, bytes);
+        }
     }
 }
 
@@ -529,23 +447,196 @@ static void chroma_down(struct mp_image *old_src, struct mp_image *temp)
     }
 }
 
-// cache: if not NULL, the function will set *cache to a talloc-allocated cache
-//        containing scaled versions of sbs contents - free the cache with
-//        talloc_free()
-void mp_draw_sub_bitmaps(struct mp_draw_sub_cache **cache, struct mp_image *dst,
-                         struct sub_bitmaps *sbs)
+// Whether the overlay cache can be used with the target format. The final
+// blending is done plane by plane, so the planes must have the same layout as
+// in the 444 format used for rendering, apart from subsampling.
+static bool overlay_supported(struct mp_image *dst, int format, int bits)
 {
-    assert(mp_draw_sub_formats[sbs->format]);
-    if (!mp_sws_supported_format(dst->imgfmt))
-        return;
+    struct mp_imgfmt_desc desc = mp_imgfmt_get_desc(dst->imgfmt);
+    if (dst->imgfmt == format)
+        return true;
+    return (desc.flags & MP_IMGFLAG_YUV_P) && desc.num_planes == 3 &&
+           desc.plane_bits == bits;
+}
 
-    struct mp_draw_sub_cache *cache_ = cache ? *cache : NULL;
-    if (!cache_)
-        cache_ = talloc_zero(NULL, struct mp_draw_sub_cache);
+static struct mp_image *alloc_cleared(int imgfmt, struct mp_image *dst,
+                                      int w, int h)
+{
+    struct mp_image *img = mp_image_alloc(imgfmt, w, h);
+    if (!img)
+        return NULL;
+    img->params.colorspace = dst->params.colorspace;
+    img->params.colorlevels = dst->params.colorlevels;
+    for (int p = 0; p < img->num_planes; p++) {
+        int bytes = (img->plane_w[p] * img->fmt.bpp[p] + 7) / 8;
+        memset_pic(img->planes[p], 0, bytes, img->plane_h[p], img->stride[p]);
+    }
+    return img;
+}
 
-    int format, bits;
-    get_closest_y444_format(dst->imgfmt, &format, &bits);
+// Convert the overlay image from the 444 render format to the target format.
+// Both color and alpha are linear, so averaging during chroma subsampling
+// yields the same result as blending onto upsampled chroma would.
+static struct mp_image *convert_overlay(struct mp_image *img,
+                                        struct mp_image *dst)
+{
+    if (img->imgfmt == dst->imgfmt)
+        return img;
+    struct mp_image *res = mp_image_alloc(dst->imgfmt, img->w, img->h);
+    if (res) {
+        res->params.colorspace = img->params.colorspace;
+        res->params.colorlevels = img->params.colorlevels;
+        mp_image_swscale(res, img, SWS_AREA);
+    }
+    talloc_free(img);
+    return res;
+}
+
+// Make sure color never exceeds alpha, which the premul blend functions rely
+// on. Rounding during subsampling could violate this.
+static void clamp_overlay(struct mp_image *color, struct mp_image *alpha,
+                          int bits)
+{
+    int max = (1 << bits) - 1;
+    for (int p = 0; p < color->num_planes; p++) {
+        for (int y = 0; y < color->plane_h[p]; y++) {
+            uint8_t *c_r = color->planes[p] + color->stride[p] * y;
+            uint8_t *a_r = alpha->planes[p] + alpha->stride[p] * y;
+            for (int x = 0; x < color->plane_w[p]; x++) {
+                if (bits > 8) {
+                    uint16_t *c = &((uint16_t *)c_r)[x];
+                    *c = FFMIN(*c, ((uint16_t *)a_r)[x] * max / 255);
+                } else {
+                    c_r[x] = FFMIN(c_r[x], a_r[x]);
+                }
+            }
+        }
+    }
+}
 
+static bool render_overlay(struct mp_draw_sub_cache *cache, struct overlay *ov,
+                           struct mp_image *dst, struct sub_bitmaps *sbs,
+                           int format, int bits)
+{
+    struct mp_rect rc_list[MP_SUB_BB_LIST_MAX];
+    int num_rc = mp_get_sub_bb_list(sbs, rc_list, MP_SUB_BB_LIST_MAX);
+
+    for (int r = 0; r < num_rc; r++) {
+        struct mp_rect bb = rc_list[r];
+
+        if (!align_bbox_for_swscale(dst, &bb))
+            break;
+
+        int w = bb.x1 - bb.x0, h = bb.y1 - bb.y0;
+        struct mp_image *color = alloc_cleared(format, dst, w, h);
+        struct mp_image *alpha = alloc_cleared(format, dst, w, h);
+        if (!color || !alpha) {
+            talloc_free(color);
+            talloc_free(alpha);
+            return false;
+        }
+
+        if (sbs->format == SUBBITMAP_RGBA) {
+            draw_rgba(cache, bb, color, alpha, bits, sbs);
+        } else if (sbs->format == SUBBITMAP_LIBASS) {
+            draw_ass(cache, bb, color, alpha, bits, sbs);
+        }
+
+        for (int p = 1; p < alpha->num_planes; p++) {
+            int bytes = (alpha->plane_w[p] * alpha->fmt.bpp[p] + 7) / 8;
+            memcpy_pic(alpha->planes[p], alpha->planes[0], bytes,
+                       alpha->plane_h[p], alpha->stride[p], alpha->stride[0]);
+        }
+
+        color = talloc_steal(ov, convert_overlay(color, dst));
+        alpha = talloc_steal(ov, convert_overlay(alpha, dst));
+        if (!color || !alpha)
+            return false;
+        clamp_overlay(color, alpha, bits);
+
+        ov->rc[ov->num_rc] = bb;
+        ov->color[ov->num_rc] = color;
+        ov->alpha[ov->num_rc] = alpha;
+        ov->num_rc++;
+    }
+
+    return true;
+}
+
+// Return the overlay for sbs. Rendering the overlay costs more than drawing
+// sbs directly once, so a new overlay is rendered only when sbs is drawn for
+// the second time. Returns NULL if sbs should be drawn directly, or on OOM.
+static struct overlay *get_overlay(struct mp_draw_sub_cache *cache,
+                                   struct mp_image *dst,
+                                   struct sub_bitmaps *sbs,
+                                   int format, int bits)
+{
+    int index = sbs->render_index;
+    struct overlay *ov = cache->overlays[index];
+    if (ov) {
+        if (ov->bitmap_pos_id == sbs->bitmap_pos_id
+            && ov->imgfmt == dst->imgfmt
+            && ov->w == dst->w && ov->h == dst->h
+            && ov->colorspace == dst->params.colorspace
+            && ov->levels == dst->params.colorlevels)
+            return ov;
+        talloc_free(ov);
+        cache->overlays[index] = NULL;
+    }
+
+    if (!cache->have_direct_id[index] ||
+        cache->direct_id[index] != sbs->bitmap_pos_id)
+    {
+        cache->have_direct_id[index] = true;
+        cache->direct_id[index] = sbs->bitmap_pos_id;
+        return NULL;
+    }
+    cache->have_direct_id[index] = false;
+
+    ov = talloc(cache, struct overlay);
+    *ov = (struct overlay) {
+        .bitmap_pos_id = sbs->bitmap_pos_id,
+        .imgfmt = dst->imgfmt,
+        .w = dst->w,
+        .h = dst->h,
+        .colorspace = dst->params.colorspace,
+        .levels = dst->params.colorlevels,
+    };
+    if (!render_overlay(cache, ov, dst, sbs, format, bits)) {
+        talloc_free(ov);
+        ov = NULL;
+    }
+    cache->overlays[index] = ov;
+    return ov;
+}
+
+static void blend_overlay(struct mp_image *dst, struct overlay *ov, int bits)
+{
+    const struct mp_blend_fns *fns = mp_blend_get_fns();
+    for (int r = 0; r < ov->num_rc; r++) {
+        struct mp_image region = *dst;
+        mp_image_crop_rc(&region, ov->rc[r]);
+        struct mp_image *color = ov->color[r];
+        struct mp_image *alpha = ov->alpha[r];
+        for (int p = 0; p < region.num_planes; p++) {
+            if (bits > 8) {
+                fns->premul16(region.planes[p], region.stride[p],
+                              color->planes[p], color->stride[p],
+                              alpha->planes[p], alpha->stride[p],
+                              region.plane_w[p], region.plane_h[p]);
+            } else {
+                fns->premul8(region.planes[p], region.stride[p],
+                             color->planes[p], color->stride[p],
+                             alpha->planes[p], alpha->stride[p],
+                             region.plane_w[p], region.plane_h[p]);
+            }
+        }
+    }
+}
+
+static void draw_direct(struct mp_draw_sub_cache *cache, struct mp_image *dst,
+                        struct sub_bitmaps *sbs, int format, int bits)
+{
     struct mp_rect rc_list[MP_SUB_BB_LIST_MAX];
     int num_rc = mp_get_sub_bb_list(sbs, rc_list, MP_SUB_BB_LIST_MAX);
 
@@ -557,18 +648,48 @@ void mp_draw_sub_bitmaps(struct mp_draw_sub_cache **cache, struct mp_image *dst,
 
         struct mp_image dst_region = *dst;
         mp_image_crop_rc(&dst_region, bb);
-        struct mp_image *temp = chroma_up(cache_, format, &dst_region);
+        struct mp_image *temp = chroma_up(cache, format, &dst_region);
         if (!temp)
             continue; // on OOM, skip region
 
         if (sbs->format == SUBBITMAP_RGBA) {
-            draw_rgba(cache_, bb, temp, bits, sbs);
+            draw_rgba(cache, bb, temp, NULL, bits, sbs);
         } else if (sbs->format == SUBBITMAP_LIBASS) {
-            draw_ass(cache_, bb, temp, bits, sbs);
+            draw_ass(cache, bb, temp, NULL, bits, sbs);
         }
 
         chroma_down(&dst_region, temp);
     }
+}
+
+// cache: if not NULL, the function will set *cache to a talloc-allocated cache
+//        containing scaled versions of sbs contents - free the cache with
+//        talloc_free(). It also keeps the final, format-converted overlay, so
+//        that unchanged subtitles are merely blended onto following frames.
+void mp_draw_sub_bitmaps(struct mp_draw_sub_cache **cache, struct mp_image *dst,
+                         struct sub_bitmaps *sbs)
+{
+    assert(mp_draw_sub_formats[sbs->format]);
+    if (!mp_sws_supported_format(dst->imgfmt))
+        return;
+
+    struct mp_draw_sub_cache *cache_ = cache ? *cache : NULL;
+    if (!cache_)
+        cache_ = talloc_zero(NULL, struct mp_draw_sub_cache);
+
+    int format, bits;
+    get_closest_y444_format(dst->imgfmt, &format, &bits);
+
+    // Rendering the overlay is only worth it if it can be reused.
+    struct overlay *ov = NULL;
+    if (cache && overlay_supported(dst, format, bits))
+        ov = get_overlay(cache_, dst, sbs, format, bits);
+
+    if (ov) {
+        blend_overlay(dst, ov, bits);
+    } else {
+        draw_direct(cache_, dst, sbs, format, bits);
+    }
 
     if (cache) {
         *cache = cache_;
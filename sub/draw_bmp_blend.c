@@ -0,0 +1,774 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <libavutil/common.h>
+
+#include "config.h"
+#include "draw_bmp_blend.h"
+
+#if HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#define ACCURATE
+#define CONDITIONAL
+
+static void blend_const16_alpha(void *dst, int dst_stride, uint16_t srcp,
+                                uint8_t *srca, int srca_stride, uint8_t srcamul,
+                                int w, int h)
+{
+    if (!srcamul)
+        return;
+    for (int y = 0; y < h; y++) {
+        uint16_t *dst_r = (uint16_t *)((uint8_t *)dst + dst_stride * y);
+        uint8_t *srca_r = srca + srca_stride * y;
+        for (int x = 0; x < w; x++) {
+            uint32_t srcap = srca_r[x];
+#ifdef CONDITIONAL
+            if (!srcap)
+                continue;
+#endif
+            srcap *= srcamul; // now 0..65025
+            dst_r[x] = (srcp * srcap + dst_r[x] * (65025 - srcap) + 32512) / 65025;
+        }
+    }
+}
+
+static void blend_const8_alpha(void *dst, int dst_stride, uint16_t srcp,
+                               uint8_t *srca, int srca_stride, uint8_t srcamul,
+                               int w, int h)
+{
+    if (!srcamul)
+        return;
+    for (int y = 0; y < h; y++) {
+        uint8_t *dst_r = (uint8_t *)dst + dst_stride * y;
+        uint8_t *srca_r = srca + srca_stride * y;
+        for (int x = 0; x < w; x++) {
+            uint32_t srcap = srca_r[x];
+#ifdef CONDITIONAL
+            if (!srcap)
+                continue;
+#endif
+#ifdef ACCURATE
+            srcap *= srcamul; // now 0..65025
+            dst_r[x] = (srcp * srcap + dst_r[x] * (65025 - srcap) + 32512) / 65025;
+#else
+            srcap = (srcap * srcamul + 255) >> 8;
+            dst_r[x] = (srcp * srcap + dst_r[x] * (255 - srcap) + 255) >> 8;
+#endif
+        }
+    }
+}
+
+static void blend_src16_alpha(void *dst, int dst_stride, void *src,
+                              int src_stride, uint8_t *srca, int srca_stride,
+                              int w, int h)
+{
+    for (int y = 0; y < h; y++) {
+        uint16_t *dst_r = (uint16_t *)((uint8_t *)dst + dst_stride * y);
+        uint16_t *src_r = (uint16_t *)((uint8_t *)src + src_stride * y);
+        uint8_t *srca_r = srca + srca_stride * y;
+        for (int x = 0; x < w; x++) {
+            uint32_t srcap = srca_r[x];
+#ifdef CONDITIONAL
+            if (!srcap)
+                continue;
+#endif
+            dst_r[x] = (src_r[x] * srcap + dst_r[x] * (255 - srcap) + 127) / 255;
+        }
+    }
+}
+
+static void blend_src8_alpha(void *dst, int dst_stride, void *src,
+                             int src_stride, uint8_t *srca, int srca_stride,
+                             int w, int h)
+{
+    for (int y = 0; y < h; y++) {
+        uint8_t *dst_r = (uint8_t *)dst + dst_stride * y;
+        uint8_t *src_r = (uint8_t *)src + src_stride * y;
+        uint8_t *srca_r = srca + srca_stride * y;
+        for (int x = 0; x < w; x++) {
+            uint16_t srcap = srca_r[x];
+#ifdef CONDITIONAL
+            if (!srcap)
+                continue;
+#endif
+#ifdef ACCURATE
+            dst_r[x] = (src_r[x] * srcap + dst_r[x] * (255 - srcap) + 127) / 255;
+#else
+            dst_r[x] = (src_r[x] * srcap + dst_r[x] * (255 - srcap) + 255) >> 8;
+#endif
+        }
+    }
+}
+
+static void blend_premul16(void *dst, int dst_stride, void *src,
+                           int src_stride, void *srca, int srca_stride,
+                           int w, int h)
+{
+    for (int y = 0; y < h; y++) {
+        uint16_t *dst_r = (uint16_t *)((uint8_t *)dst + dst_stride * y);
+        uint16_t *src_r = (uint16_t *)((uint8_t *)src + src_stride * y);
+        uint16_t *srca_r = (uint16_t *)((uint8_t *)srca + srca_stride * y);
+        for (int x = 0; x < w; x++) {
+            uint32_t srcap = srca_r[x];
+            if (!srcap)
+                continue;
+            dst_r[x] = (src_r[x] * 255 + dst_r[x] * (255 - srcap) + 127) / 255;
+        }
+    }
+}
+
+static void blend_premul8(void *dst, int dst_stride, void *src,
+                          int src_stride, void *srca, int srca_stride,
+                          int w, int h)
+{
+    for (int y = 0; y < h; y++) {
+        uint8_t *dst_r = (uint8_t *)dst + dst_stride * y;
+        uint8_t *src_r = (uint8_t *)src + src_stride * y;
+        uint8_t *srca_r = (uint8_t *)srca + srca_stride * y;
+        for (int x = 0; x < w; x++) {
+            uint16_t srcap = srca_r[x];
+            if (!srcap)
+                continue;
+            dst_r[x] = (src_r[x] * 255 + dst_r[x] * (255 - srcap) + 127) / 255;
+        }
+    }
+}
+
+static void unpremultiply_and_split_BGR32(uint8_t *img, int img_stride,
+                                          uint8_t *alpha, int alpha_stride,
+                                          int w, int h)
+{
+    for (int y = 0; y < h; ++y) {
+        uint32_t *irow = (uint32_t *) &img[img_stride * y];
+        uint8_t *arow = &alpha[alpha_stride * y];
+        for (int x = 0; x < w; ++x) {
+            uint32_t pval = irow[x];
+            uint8_t aval = (pval >> 24);
+            uint8_t rval = (pval >> 16) & 0xFF;
+            uint8_t gval = (pval >> 8) & 0xFF;
+            uint8_t bval = pval & 0xFF;
+            // multiplied = separate * alpha / 255
+            // separate = rint(multiplied * 255 / alpha)
+            //          = floor(multiplied * 255 / alpha + 0.5)
+            //          = floor((multiplied * 255 + 0.5 * alpha) / alpha)
+            //          = floor((multiplied * 255 + floor(0.5 * alpha)) / alpha)
+            int div = (int) aval;
+            int add = div / 2;
+            if (aval) {
+                rval = FFMIN(255, (rval * 255 + add) / div);
+                gval = FFMIN(255, (gval * 255 + add) / div);
+                bval = FFMIN(255, (bval * 255 + add) / div);
+                irow[x] = bval + (gval << 8) + (rval << 16) + (aval << 24);
+            }
+            arow[x] = aval;
+        }
+    }
+}
+
+static const struct mp_blend_fns blend_fns_c = {
+    .name = "C",
+    .const16 = blend_const16_alpha,
+    .const8 = blend_const8_alpha,
+    .src16 = blend_src16_alpha,
+    .src8 = blend_src8_alpha,
+    .premul16 = blend_premul16,
+    .premul8 = blend_premul8,
+    .unpremultiply_bgr32 = unpremultiply_and_split_BGR32,
+};
+
+#if HAVE_X86_SIMD
+
+// Each row is blended 16 (SSE2) or 32 (AVX2) bytes at a time, 4 or 8 pixels
+// for unpremultiply_bgr32; the C functions above handle the last columns. The
+// divisions by 255 are exact (multiply by the magic number, not >> 8), so the
+// results match the C versions.
+
+// floor(x / 255) for all uint32 lanes (same magic number compilers use)
+static inline SSE2 __m128i div255_epu32_sse2(__m128i x)
+{
+    const __m128i m = _mm_set1_epi32((int)0x80808081);
+    __m128i even = _mm_srli_epi64(_mm_mul_epu32(x, m), 39);
+    __m128i odd = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(x, 32), m), 39);
+    return _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+}
+
+// Pack uint32 lanes with values <= 65535 to uint16 (SSE2 has no packus_epi32)
+static inline SSE2 __m128i packus_epi32_sse2(__m128i lo, __m128i hi)
+{
+    const __m128i bias = _mm_set1_epi32(0x8000);
+    __m128i r = _mm_packs_epi32(_mm_sub_epi32(lo, bias), _mm_sub_epi32(hi, bias));
+    return _mm_add_epi16(r, _mm_set1_epi16(-0x8000));
+}
+
+// (s * ws + d * wd + max / 2) / max for uint16 lanes, with max being either
+// 255 or 65025 (= 255 * 255), and the result fitting into uint16.
+static inline SSE2 __m128i mix_epu16_sse2(__m128i d, __m128i s, __m128i ws,
+                                          __m128i wd, int max)
+{
+    __m128i sl = _mm_mullo_epi16(s, ws), sh = _mm_mulhi_epu16(s, ws);
+    __m128i dl = _mm_mullo_epi16(d, wd), dh = _mm_mulhi_epu16(d, wd);
+    __m128i round = _mm_set1_epi32(max / 2);
+    __m128i lo = _mm_add_epi32(_mm_unpacklo_epi16(sl, sh),
+                               _mm_unpacklo_epi16(dl, dh));
+    __m128i hi = _mm_add_epi32(_mm_unpackhi_epi16(sl, sh),
+                               _mm_unpackhi_epi16(dl, dh));
+    lo = div255_epu32_sse2(_mm_add_epi32(lo, round));
+    hi = div255_epu32_sse2(_mm_add_epi32(hi, round));
+    if (max == 65025) {
+        lo = div255_epu32_sse2(lo);
+        hi = div255_epu32_sse2(hi);
+    }
+    return packus_epi32_sse2(lo, hi);
+}
+
+static inline SSE2 __m128i blend_epu16_sse2(__m128i d, __m128i s, __m128i a,
+                                            int max)
+{
+    return mix_epu16_sse2(d, s, a, _mm_sub_epi16(_mm_set1_epi16(max), a), max);
+}
+
+// (s * ws + d * wd + 127) / 255 for uint16 lanes, where the sum must not
+// exceed 255 * 255 + 127.
+static inline SSE2 __m128i mix_epu8_sse2(__m128i d, __m128i s, __m128i ws,
+                                         __m128i wd)
+{
+    __m128i x = _mm_add_epi16(_mm_mullo_epi16(s, ws), _mm_mullo_epi16(d, wd));
+    x = _mm_add_epi16(x, _mm_set1_epi16(127));
+    // x <= 65152, for which floor(x / 255) == (x + 1 + (x >> 8)) >> 8
+    x = _mm_add_epi16(x, _mm_add_epi16(_mm_srli_epi16(x, 8), _mm_set1_epi16(1)));
+    return _mm_srli_epi16(x, 8);
+}
+
+static inline SSE2 __m128i blend_epu8_sse2(__m128i d, __m128i s, __m128i a)
+{
+    return mix_epu8_sse2(d, s, a, _mm_sub_epi16(_mm_set1_epi16(255), a));
+}
+
+static SSE2 void blend_const16_alpha_sse2(void *dst, int dst_stride,
+                                          uint16_t srcp, uint8_t *srca,
+                                          int srca_stride, uint8_t srcamul,
+                                          int w, int h)
+{
+    if (!srcamul)
+        return;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mul = _mm_set1_epi16(srcamul);
+    const __m128i s = _mm_set1_epi16(srcp);
+    for (int y = 0; y < h; y++) {
+        uint16_t *dst_r = (uint16_t *)((uint8_t *)dst + dst_stride * y);
+        uint8_t *srca_r = srca + srca_stride * y;
+        int x = 0;
+        for (; x + 8 <= w; x += 8) {
+            __m128i a = _mm_loadl_epi64((__m128i *)(srca_r + x));
+            if ((_mm_movemask_epi8(_mm_cmpeq_epi8(a, zero)) & 0xFF) == 0xFF)
+                continue;
+            a = _mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), mul);
+            __m128i d = _mm_loadu_si128((__m128i *)(dst_r + x));
+            d = blend_epu16_sse2(d, s, a, 65025);
+            _mm_storeu_si128((__m128i *)(dst_r + x), d);
+        }
+        blend_const16_alpha(dst_r + x, dst_stride, srcp, srca_r + x,
+                            srca_stride, srcamul, w - x, 1);
+    }
+}
+
+static SSE2 void blend_const8_alpha_sse2(void *dst, int dst_stride,
+                                         uint16_t srcp, uint8_t *srca,
+                                         int srca_stride, uint8_t srcamul,
+                                         int w, int h)
+{
+    if (!srcamul)
+        return;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mul = _mm_set1_epi16(srcamul);
+    const __m128i s = _mm_set1_epi16(srcp);
+    for (int y = 0; y < h; y++) {
+        uint8_t *dst_r = (uint8_t *)dst + dst_stride * y;
+        uint8_t *srca_r = srca + srca_stride * y;
+        int x = 0;
+        for (; x + 16 <= w; x += 16) {
+            __m128i a = _mm_loadu_si128((__m128i *)(srca_r + x));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, zero)) == 0xFFFF)
+                continue;
+            __m128i d = _mm_loadu_si128((__m128i *)(dst_r + x));
+            __m128i alo = _mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), mul);
+            __m128i ahi = _mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), mul);
+            __m128i lo = blend_epu16_sse2(_mm_unpacklo_epi8(d, zero), s, alo,
+                                          65025);
+            __m128i hi = blend_epu16_sse2(_mm_unpackhi_epi8(d, zero), s, ahi,
+                                          65025);
+            _mm_storeu_si128((__m128i *)(dst_r + x), _mm_packus_epi16(lo, hi));
+        }
+        blend_const8_alpha(dst_r + x, dst_stride, srcp, srca_r + x,
+                           srca_stride, srcamul, w - x, 1);
+    }
+}
+
+static SSE2 void blend_src16_alpha_sse2(void *dst, int dst_stride, void *src,
+                                        int src_stride, uint8_t *srca,
+                                        int srca_stride, int w, int h)
+{
+    const __m128i zero = _mm_setzero_si128();
+    for (int y = 0; y < h; y++) {
+        uint16_t *dst_r = (uint16_t *)((uint8_t *)dst + dst_stride * y);
+        uint16_t *src_r = (uint16_t *)((uint8_t *)src + src_stride * y);
+        uint8_t *srca_r = srca + srca_stride * y;
+        int x = 0;
+        for (; x + 8 <= w; x += 8) {
+            __m128i a = _mm_loadl_epi64((__m128i *)(srca_r + x));
+            if ((_mm_movemask_epi8(_mm_cmpeq_epi8(a, zero)) & 0xFF) == 0xFF)
+                continue;
+            a = _mm_unpacklo_epi8(a, zero);
+            __m128i s = _mm_loadu_si128((__m128i *)(src_r + x));
+            __m128i d = _mm_loadu_si128((__m128i *)(dst_r + x));
+            d = blend_epu16_sse2(d, s, a, 255);
+            _mm_storeu_si128((__m128i *)(dst_r + x), d);
+        }
+        blend_src16_alpha(dst_r + x, dst_stride, src_r + x, src_stride,
+                          srca_r + x, srca_stride, w - x, 1);
+    }
+}
+
+static SSE2 void blend_src8_alpha_sse2(void *dst, int dst_stride, void *src,
+                                       int src_stride, uint8_t *srca,
+                                       int srca_stride, int w, int h)
+{
+    const __m128i zero = _mm_setzero_si128();
+    for (int y = 0; y < h; y++) {
+        uint8_t *dst_r = (uint8_t *)dst + dst_stride * y;
+        uint8_t *src_r = (uint8_t *)src + src_stride * y;
+        uint8_t *srca_r = srca + srca_stride * y;
+        int x = 0;
+        for (; x + 16 <= w; x += 16) {
+            __m128i a = _mm_loadu_si128((__m128i *)(srca_r + x));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, zero)) == 0xFFFF)
+                continue;
+            __m128i s = _mm_loadu_si128((__m128i *)(src_r + x));
+            __m128i d = _mm_loadu_si128((__m128i *)(dst_r + x));
+            __m128i lo = blend_epu8_sse2(_mm_unpacklo_epi8(d, zero),
+                                         _mm_unpacklo_epi8(s, zero),
+                                         _mm_unpacklo_epi8(a, zero));
+            __m128i hi = blend_epu8_sse2(_mm_unpackhi_epi8(d, zero),
+                                         _mm_unpackhi_epi8(s, zero),
+                                         _mm_unpackhi_epi8(a, zero));
+            _mm_storeu_si128((__m128i *)(dst_r + x), _mm_packus_epi16(lo, hi));
+        }
+        blend_src8_alpha(dst_r + x, dst_stride, src_r + x, src_stride,
+                         srca_r + x, srca_stride, w - x, 1);
+    }
+}
+
+static SSE2 void blend_premul16_sse2(void *dst, int dst_stride, void *src,
+                                     int src_stride, void *srca,
+                                     int srca_stride, int w, int h)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i c255 = _mm_set1_epi16(255);
+    for (int y = 0; y < h; y++) {
+        uint16_t *dst_r = (uint16_t *)((uint8_t *)dst + dst_stride * y);
+        uint16_t *src_r = (uint16_t *)((uint8_t *)src + src_stride * y);
+        uint16_t *srca_r = (uint16_t *)((uint8_t *)srca + srca_stride * y);
+        int x = 0;
+        for (; x + 8 <= w; x += 8) {
+            __m128i a = _mm_loadu_si128((__m128i *)(srca_r + x));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(a, zero)) == 0xFFFF)
+                continue;
+            __m128i s = _mm_loadu_si128((__m128i *)(src_r + x));
+            __m128i d = _mm_loadu_si128((__m128i *)(dst_r + x));
+            d = mix_epu16_sse2(d, s, c255, _mm_sub_epi16(c255, a), 255);
+            _mm_storeu_si128((__m128i *)(dst_r + x), d);
+        }
+        blend_premul16(dst_r + x, dst_stride, src_r + x, src_stride,
+                       srca_r + x, srca_stride, w - x, 1);
+    }
+}
+
+static SSE2 void blend_premul8_sse2(void *dst, int dst_stride, void *src,
+                                    int src_stride, void *srca,
+                                    int srca_stride, int w, int h)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i c255 = _mm_set1_epi16(255);
+    for (int y = 0; y < h; y++) {
+        uint8_t *dst_r = (uint8_t *)dst + dst_stride * y;
+        uint8_t *src_r = (uint8_t *)src + src_stride * y;
+        uint8_t *srca_r = (uint8_t *)srca + srca_stride * y;
+        int x = 0;
+        for (; x + 16 <= w; x += 16) {
+            __m128i a = _mm_loadu_si128((__m128i *)(srca_r + x));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, zero)) == 0xFFFF)
+                continue;
+            __m128i s = _mm_loadu_si128((__m128i *)(src_r + x));
+            __m128i d = _mm_loadu_si128((__m128i *)(dst_r + x));
+            __m128i ainv = _mm_sub_epi8(_mm_set1_epi8(-1), a);
+            __m128i lo = mix_epu8_sse2(_mm_unpacklo_epi8(d, zero),
+                                       _mm_unpacklo_epi8(s, zero), c255,
+                                       _mm_unpacklo_epi8(ainv, zero));
+            __m128i hi = mix_epu8_sse2(_mm_unpackhi_epi8(d, zero),
+                                       _mm_unpackhi_epi8(s, zero), c255,
+                                       _mm_unpackhi_epi8(ainv, zero));
+            _mm_storeu_si128((__m128i *)(dst_r + x), _mm_packus_epi16(lo, hi));
+        }
+        blend_premul8(dst_r + x, dst_stride, src_r + x, src_stride,
+                      srca_r + x, srca_stride, w - x, 1);
+    }
+}
+
+// Unpremultiplying with float division is exact: the dividend is at most
+// 255 * 255 + 127, and results < 256 are at least 1/255 away from the next
+// integer, which is far more than the float rounding error.
+static SSE2 void unpremultiply_and_split_BGR32_sse2(uint8_t *img,
+                                                    int img_stride,
+                                                    uint8_t *alpha,
+                                                    int alpha_stride,
+                                                    int w, int h)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    const __m128 f255 = _mm_set1_ps(255.0f);
+    for (int y = 0; y < h; y++) {
+        uint32_t *irow = (uint32_t *) &img[img_stride * y];
+        uint8_t *arow = &alpha[alpha_stride * y];
+        int x = 0;
+        for (; x + 4 <= w; x += 4) {
+            __m128i p = _mm_loadu_si128((__m128i *)(irow + x));
+            __m128i a = _mm_srli_epi32(p, 24);
+            __m128 af = _mm_cvtepi32_ps(a);
+            __m128 add = _mm_cvtepi32_ps(_mm_srli_epi32(a, 1));
+            __m128i res = _mm_slli_epi32(a, 24);
+            for (int c = 0; c < 3; c++) {
+                __m128i v = _mm_and_si128(_mm_srli_epi32(p, c * 8), mask);
+                __m128 vf = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(v), f255), add);
+                // alpha==0 yields inf/nan, which is masked out below
+                vf = _mm_min_ps(_mm_div_ps(vf, af), f255);
+                v = _mm_cvttps_epi32(vf);
+                res = _mm_or_si128(res, _mm_slli_epi32(v, c * 8));
+            }
+            __m128i transparent = _mm_cmpeq_epi32(a, zero);
+            res = _mm_or_si128(_mm_and_si128(transparent, p),
+                               _mm_andnot_si128(transparent, res));
+            _mm_storeu_si128((__m128i *)(irow + x), res);
+            a = _mm_packus_epi16(_mm_packs_epi32(a, a), zero);
+            uint32_t a4 = _mm_cvtsi128_si32(a);
+            memcpy(arow + x, &a4, 4);
+        }
+        unpremultiply_and_split_BGR32((uint8_t *)(irow + x), img_stride,
+                                      arow + x, alpha_stride, w - x, 1);
+    }
+}
+
+static const struct mp_blend_fns blend_fns_sse2 = {
+    .name = "SSE2",
+    .const16 = blend_const16_alpha_sse2,
+    .const8 = blend_const8_alpha_sse2,
+    .src16 = blend_src16_alpha_sse2,
+    .src8 = blend_src8_alpha_sse2,
+    .premul16 = blend_premul16_sse2,
+    .premul8 = blend_premul8_sse2,
+    .unpremultiply_bgr32 = unpremultiply_and_split_BGR32_sse2,
+};
+
+// AVX2 versions of the above. Note that unpack and pack instructions operate
+// on each 128 bit lane separately; since every unpack is undone by a pack of
+// the same layout, the pixel order is preserved.
+
+static inline AVX2 __m256i div255_epu32_avx2(__m256i x)
+{
+    const __m256i m = _mm256_set1_epi32((int)0x80808081);
+    __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(x, m), 39);
+    __m256i odd = _mm256_srli_epi64(
+                    _mm256_mul_epu32(_mm256_srli_epi64(x, 32), m), 39);
+    return _mm256_or_si256(even, _mm256_slli_epi64(odd, 32));
+}
+
+static inline AVX2 __m256i mix_epu16_avx2(__m256i d, __m256i s, __m256i ws,
+                                          __m256i wd, int max)
+{
+    __m256i sl = _mm256_mullo_epi16(s, ws), sh = _mm256_mulhi_epu16(s, ws);
+    __m256i dl = _mm256_mullo_epi16(d, wd), dh = _mm256_mulhi_epu16(d, wd);
+    __m256i round = _mm256_set1_epi32(max / 2);
+    __m256i lo = _mm256_add_epi32(_mm256_unpacklo_epi16(sl, sh),
+                                  _mm256_unpacklo_epi16(dl, dh));
+    __m256i hi = _mm256_add_epi32(_mm256_unpackhi_epi16(sl, sh),
+                                  _mm256_unpackhi_epi16(dl, dh));
+    lo = div255_epu32_avx2(_mm256_add_epi32(lo, round));
+    hi = div255_epu32_avx2(_mm256_add_epi32(hi, round));
+    if (max == 65025) {
+        lo = div255_epu32_avx2(lo);
+        hi = div255_epu32_avx2(hi);
+    }
+    return _mm256_packus_epi32(lo, hi);
+}
+
+static inline AVX2 __m256i blend_epu16_avx2(__m256i d, __m256i s, __m256i a,
+                                            int max)
+{
+    return mix_epu16_avx2(d, s, a, _mm256_sub_epi16(_mm256_set1_epi16(max), a),
+                          max);
+}
+
+static inline AVX2 __m256i mix_epu8_avx2(__m256i d, __m256i s, __m256i ws,
+                                         __m256i wd)
+{
+    __m256i x = _mm256_add_epi16(_mm256_mullo_epi16(s, ws),
+                                 _mm256_mullo_epi16(d, wd));
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(127));
+    x = _mm256_add_epi16(x, _mm256_add_epi16(_mm256_srli_epi16(x, 8),
+                                             _mm256_set1_epi16(1)));
+    return _mm256_srli_epi16(x, 8);
+}
+
+static inline AVX2 __m256i blend_epu8_avx2(__m256i d, __m256i s, __m256i a)
+{
+    return mix_epu8_avx2(d, s, a, _mm256_sub_epi16(_mm256_set1_epi16(255), a));
+}
+
+static AVX2 void blend_const16_alpha_avx2(void *dst, int dst_stride,
+                                          uint16_t srcp, uint8_t *srca,
+                                          int srca_stride, uint8_t srcamul,
+                                          int w, int h)
+{
+    if (!srcamul)
+        return;
+    const __m256i mul = _mm256_set1_epi16(srcamul);
+    const __m256i s = _mm256_set1_epi16(srcp);
+    for (int y = 0; y < h; y++) {
+        uint16_t *dst_r = (uint16_t *)((uint8_t *)dst + dst_stride * y);
+        uint8_t *srca_r = srca + srca_stride * y;
+        int x = 0;
+        for (; x + 16 <= w; x += 16) {
+            __m128i a8 = _mm_loadu_si128((__m128i *)(srca_r + x));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(a8, _mm_setzero_si128())) == 0xFFFF)
+                continue;
+            __m256i a = _mm256_mullo_epi16(_mm256_cvtepu8_epi16(a8), mul);
+            __m256i d = _mm256_loadu_si256((__m256i *)(dst_r + x));
+            d = blend_epu16_avx2(d, s, a, 65025);
+            _mm256_storeu_si256((__m256i *)(dst_r + x), d);
+        }
+        blend_const16_alpha(dst_r + x, dst_stride, srcp, srca_r + x,
+                            srca_stride, srcamul, w - x, 1);
+    }
+}
+
+static AVX2 void blend_const8_alpha_avx2(void *dst, int dst_stride,
+                                         uint16_t srcp, uint8_t *srca,
+                                         int srca_stride, uint8_t srcamul,
+                                         int w, int h)
+{
+    if (!srcamul)
+        return;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i mul = _mm256_set1_epi16(srcamul);
+    const __m256i s = _mm256_set1_epi16(srcp);
+    for (int y = 0; y < h; y++) {
+        uint8_t *dst_r = (uint8_t *)dst + dst_stride * y;
+        uint8_t *srca_r = srca + srca_stride * y;
+        int x = 0;
+        for (; x + 32 <= w; x += 32) {
+            __m256i a = _mm256_loadu_si256((__m256i *)(srca_r + x));
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, zero)) == -1)
+                continue;
+            __m256i d = _mm256_loadu_si256((__m256i *)(dst_r + x));
+            __m256i alo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(a, zero), mul);
+            __m256i ahi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(a, zero), mul);
+            __m256i lo = blend_epu16_avx2(_mm256_unpacklo_epi8(d, zero), s, alo,
+                                          65025);
+            __m256i hi = blend_epu16_avx2(_mm256_unpackhi_epi8(d, zero), s, ahi,
+                                          65025);
+            _mm256_storeu_si256((__m256i *)(dst_r + x),
+                                _mm256_packus_epi16(lo, hi));
+        }
+        blend_const8_alpha(dst_r + x, dst_stride, srcp, srca_r + x,
+                           srca_stride, srcamul, w - x, 1);
+    }
+}
+
+static AVX2 void blend_src16_alpha_avx2(void *dst, int dst_stride, void *src,
+                                        int src_stride, uint8_t *srca,
+                                        int srca_stride, int w, int h)
+{
+    for (int y = 0; y < h; y++) {
+        uint16_t *dst_r = (uint16_t *)((uint8_t *)dst + dst_stride * y);
+        uint16_t *src_r = (uint16_t *)((uint8_t *)src + src_stride * y);
+        uint8_t *srca_r = srca + srca_stride * y;
+        int x = 0;
+        for (; x + 16 <= w; x += 16) {
+            __m128i a8 = _mm_loadu_si128((__m128i *)(srca_r + x));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(a8, _mm_setzero_si128())) == 0xFFFF)
+                continue;
+            __m256i a = _mm256_cvtepu8_epi16(a8);
+            __m256i s = _mm256_loadu_si256((__m256i *)(src_r + x));
+            __m256i d = _mm256_loadu_si256((__m256i *)(dst_r + x));
+            d = blend_epu16_avx2(d, s, a, 255);
+            _mm256_storeu_si256((__m256i *)(dst_r + x), d);
+        }
+        blend_src16_alpha(dst_r + x, dst_stride, src_r + x, src_stride,
+                          srca_r + x, srca_stride, w - x, 1);
+    }
+}
+
+static AVX2 void blend_src8_alpha_avx2(void *dst, int dst_stride, void *src,
+                                       int src_stride, uint8_t *srca,
+                                       int srca_stride, int w, int h)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    for (int y = 0; y < h; y++) {
+        uint8_t *dst_r = (uint8_t *)dst + dst_stride * y;
+        uint8_t *src_r = (uint8_t *)src + src_stride * y;
+        uint8_t *srca_r = srca + srca_stride * y;
+        int x = 0;
+        for (; x + 32 <= w; x += 32) {
+            __m256i a = _mm256_loadu_si256((__m256i *)(srca_r + x));
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, zero)) == -1)
+                continue;
+            __m256i s = _mm256_loadu_si256((__m256i *)(src_r + x));
+            __m256i d = _mm256_loadu_si256((__m256i *)(dst_r + x));
+            __m256i lo = blend_epu8_avx2(_mm256_unpacklo_epi8(d, zero),
+                                         _mm256_unpacklo_epi8(s, zero),
+                                         _mm256_unpacklo_epi8(a, zero));
+            __m256i hi = blend_epu8_avx2(_mm256_unpackhi_epi8(d, zero),
+                                         _mm256_unpackhi_epi8(s, zero),
+                                         _mm256_unpackhi_epi8(a, zero));
+            _mm256_storeu_si256((__m256i *)(dst_r + x),
+                                _mm256_packus_epi16(lo, hi));
+        }
+        blend_src8_alpha(dst_r + x, dst_stride, src_r + x, src_stride,
+                         srca_r + x, srca_stride, w - x, 1);
+    }
+}
+
+static AVX2 void blend_premul16_avx2(void *dst, int dst_stride, void *src,
+                                     int src_stride, void *srca,
+                                     int srca_stride, int w, int h)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i c255 = _mm256_set1_epi16(255);
+    for (int y = 0; y < h; y++) {
+        uint16_t *dst_r = (uint16_t *)((uint8_t *)dst + dst_stride * y);
+        uint16_t *src_r = (uint16_t *)((uint8_t *)src + src_stride * y);
+        uint16_t *srca_r = (uint16_t *)((uint8_t *)srca + srca_stride * y);
+        int x = 0;
+        for (; x + 16 <= w; x += 16) {
+            __m256i a = _mm256_loadu_si256((__m256i *)(srca_r + x));
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi16(a, zero)) == -1)
+                continue;
+            __m256i s = _mm256_loadu_si256((__m256i *)(src_r + x));
+            __m256i d = _mm256_loadu_si256((__m256i *)(dst_r + x));
+            d = mix_epu16_avx2(d, s, c255, _mm256_sub_epi16(c255, a), 255);
+            _mm256_storeu_si256((__m256i *)(dst_r + x), d);
+        }
+        blend_premul16(dst_r + x, dst_stride, src_r + x, src_stride,
+                       srca_r + x, srca_stride, w - x, 1);
+    }
+}
+
+static AVX2 void blend_premul8_avx2(void *dst, int dst_stride, void *src,
+                                    int src_stride, void *srca,
+                                    int srca_stride, int w, int h)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i c255 = _mm256_set1_epi16(255);
+    for (int y = 0; y < h; y++) {
+        uint8_t *dst_r = (uint8_t *)dst + dst_stride * y;
+        uint8_t *src_r = (uint8_t *)src + src_stride * y;
+        uint8_t *srca_r = (uint8_t *)srca + srca_stride * y;
+        int x = 0;
+        for (; x + 32 <= w; x += 32) {
+            __m256i a = _mm256_loadu_si256((__m256i *)(srca_r + x));
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, zero)) == -1)
+                continue;
+            __m256i s = _mm256_loadu_si256((__m256i *)(src_r + x));
+            __m256i d = _mm256_loadu_si256((__m256i *)(dst_r + x));
+            __m256i ainv = _mm256_sub_epi8(_mm256_set1_epi8(-1), a);
+            __m256i lo = mix_epu8_avx2(_mm256_unpacklo_epi8(d, zero),
+                                       _mm256_unpacklo_epi8(s, zero), c255,
+                                       _mm256_unpacklo_epi8(ainv, zero));
+            __m256i hi = mix_epu8_avx2(_mm256_unpackhi_epi8(d, zero),
+                                       _mm256_unpackhi_epi8(s, zero), c255,
+                                       _mm256_unpackhi_epi8(ainv, zero));
+            _mm256_storeu_si256((__m256i *)(dst_r + x),
+                                _mm256_packus_epi16(lo, hi));
+        }
+        blend_premul8(dst_r + x, dst_stride, src_r + x, src_stride,
+                      srca_r + x, srca_stride, w - x, 1);
+    }
+}
+
+static AVX2 void unpremultiply_and_split_BGR32_avx2(uint8_t *img,
+                                                    int img_stride,
+                                                    uint8_t *alpha,
+                                                    int alpha_stride,
+                                                    int w, int h)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    const __m256 f255 = _mm256_set1_ps(255.0f);
+    for (int y = 0; y < h; y++) {
+        uint32_t *irow = (uint32_t *) &img[img_stride * y];
+        uint8_t *arow = &alpha[alpha_stride * y];
+        int x = 0;
+        for (; x + 8 <= w; x += 8) {
+            __m256i p = _mm256_loadu_si256((__m256i *)(irow + x));
+            __m256i a = _mm256_srli_epi32(p, 24);
+            __m256 af = _mm256_cvtepi32_ps(a);
+            __m256 add = _mm256_cvtepi32_ps(_mm256_srli_epi32(a, 1));
+            __m256i res = _mm256_slli_epi32(a, 24);
+            for (int c = 0; c < 3; c++) {
+                __m256i v = _mm256_and_si256(_mm256_srli_epi32(p, c * 8), mask);
+                __m256 vf = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(v),
+                                                        f255), add);
+                vf = _mm256_min_ps(_mm256_div_ps(vf, af), f255);
+                v = _mm256_cvttps_epi32(vf);
+                res = _mm256_or_si256(res, _mm256_slli_epi32(v, c * 8));
+            }
+            __m256i transparent = _mm256_cmpeq_epi32(a, zero);
+            res = _mm256_blendv_epi8(res, p, transparent);
+            _mm256_storeu_si256((__m256i *)(irow + x), res);
+            // each 128 bit lane now contains its 4 alpha bytes at the start
+            a = _mm256_packus_epi16(_mm256_packs_epi32(a, a), zero);
+            uint32_t a4[2] = {
+                _mm_cvtsi128_si32(_mm256_castsi256_si128(a)),
+                _mm_cvtsi128_si32(_mm256_extracti128_si256(a, 1)),
+            };
+            memcpy(arow + x, a4, 8);
+        }
+        unpremultiply_and_split_BGR32((uint8_t *)(irow + x), img_stride,
+                                      arow + x, alpha_stride, w - x, 1);
+    }
+}
+
+static const struct mp_blend_fns blend_fns_avx2 = {
+    .name = "AVX2",
+    .const16 = blend_const16_alpha_avx2,
+    .const8 = blend_const8_alpha_avx2,
+    .src16 = blend_src16_alpha_avx2,
+    .src8 = blend_src8_alpha_avx2,
+    .premul16 = blend_premul16_avx2,
+    .premul8 = blend_premul8_avx2,
+    .unpremultiply_bgr32 = unpremultiply_and_split_BGR32_avx2,
+};
+
+#endif /* HAVE_X86_SIMD */
+
+MP_SIMD_DEFINE(blend)
@@ -0,0 +1,41 @@
+#ifndef MPLAYER_DRAW_BMP_BLEND_H
+#define MPLAYER_DRAW_BMP_BLEND_H
+
+#include <stdint.h>
+
+#include "misc/simd.h"
+
+// Inner loops used by draw_bmp.c. All implementations produce bit-identical
+// results; the plain C versions serve as reference.
+struct mp_blend_fns {
+    const char *name;
+    // Blend the constant color srcp using the alpha map srca, whose values are
+    // additionally multiplied with srcamul (0-255).
+    void (*const16)(void *dst, int dst_stride, uint16_t srcp,
+                    uint8_t *srca, int srca_stride, uint8_t srcamul,
+                    int w, int h);
+    void (*const8)(void *dst, int dst_stride, uint16_t srcp,
+                   uint8_t *srca, int srca_stride, uint8_t srcamul,
+                   int w, int h);
+    // Blend src using the alpha map srca.
+    void (*src16)(void *dst, int dst_stride, void *src, int src_stride,
+                  uint8_t *srca, int srca_stride, int w, int h);
+    void (*src8)(void *dst, int dst_stride, void *src, int src_stride,
+                 uint8_t *srca, int srca_stride, int w, int h);
+    // Blend the premultiplied src using the alpha map srca, which has the same
+    // size and sample type as src (but its values are still 0-255). src must
+    // not exceed srca scaled to the sample range.
+    void (*premul16)(void *dst, int dst_stride, void *src, int src_stride,
+                     void *srca, int srca_stride, int w, int h);
+    void (*premul8)(void *dst, int dst_stride, void *src, int src_stride,
+                    void *srca, int srca_stride, int w, int h);
+    // Convert premultiplied BGR32 to non-premultiplied BGR32 in place, and
+    // write the alpha channel to the 8 bit plane alpha.
+    void (*unpremultiply_bgr32)(uint8_t *img, int img_stride,
+                                uint8_t *alpha, int alpha_stride,
+                                int w, int h);
+};
+
+MP_SIMD_DECLARE(blend)
+
+#endif /* MPLAYER_DRAW_BMP_BLEND_H */
@@ -0,0 +1,80 @@
+#include "test_helpers.h"
+#include "talloc.h"
+#include "audio/audio.h"
+#include "audio/audio_buffer.h"
+#include "audio/chmap.h"
+#include "audio/format.h"
+
+// Append count samples with the values start, start + 1, ...
+static void append(struct mp_audio_buffer *ab, int start, int count)
+{
+    int16_t data[256];
+    struct mp_audio mpa = {0};
+    mp_audio_buffer_get_format(ab, &mpa);
+    for (int n = 0; n < count; n++)
+        data[n] = start + n;
+    mpa.planes[0] = data;
+    mpa.samples = count;
+    mp_audio_buffer_append(ab, &mpa);
+}
+
+static void check(struct mp_audio_buffer *ab, int start, int count)
+{
+    struct mp_audio mpa;
+    mp_audio_buffer_peek(ab, &mpa);
+    assert_int_equal(mpa.samples, count);
+    assert_int_equal(mp_audio_buffer_samples(ab), count);
+    int16_t *data = mpa.planes[0];
+    for (int n = 0; n < count; n++)
+        assert_int_equal(data[n], start + n);
+}
+
+static void test_buffer_skip_append(void **state) {
+    struct mp_audio_buffer *ab = mp_audio_buffer_create(NULL);
+    struct mp_chmap mono = MP_CHMAP_INIT_MONO;
+    mp_audio_buffer_reinit_fmt(ab, AF_FORMAT_S16, &mono, 48000);
+    mp_audio_buffer_preallocate_min(ab, 32);
+    int avail = mp_audio_buffer_get_write_available(ab);
+
+    append(ab, 0, 20);
+    mp_audio_buffer_skip(ab, 15);
+    check(ab, 15, 5);
+    // Skipped samples count as free space again.
+    assert_int_equal(mp_audio_buffer_get_write_available(ab), avail - 5);
+    // Doesn't fit after the data, so the data is moved to the front.
+    append(ab, 20, avail - 5);
+    check(ab, 15, avail);
+    assert_int_equal(mp_audio_buffer_get_write_available(ab), 0);
+
+    mp_audio_buffer_skip(ab, avail - 2);
+    check(ab, 13 + avail, 2);
+    mp_audio_buffer_prepend_silence(ab, 3);
+    struct mp_audio mpa;
+    mp_audio_buffer_peek(ab, &mpa);
+    assert_int_equal(mpa.samples, 5);
+    int16_t *data = mpa.planes[0];
+    assert_int_equal(data[0], 0);
+    assert_int_equal(data[2], 0);
+    assert_int_equal(data[3], 13 + avail);
+
+    // Prepending more than was skipped before.
+    mp_audio_buffer_skip(ab, 5);
+    append(ab, 100, 4);
+    mp_audio_buffer_skip(ab, 1);
+    mp_audio_buffer_prepend_silence(ab, 10);
+    mp_audio_buffer_peek(ab, &mpa);
+    assert_int_equal(mpa.samples, 13);
+    data = mpa.planes[0];
+    assert_int_equal(data[9], 0);
+    assert_int_equal(data[10], 101);
+    assert_int_equal(data[12], 103);
+
+    talloc_free(ab);
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_buffer_skip_append),
+    };
+    return run_tests(tests);
+}
@@ -0,0 +1,83 @@
+#include <pthread.h>
+#include <string.h>
+
+#include "test_helpers.h"
+#include "talloc.h"
+#include "common/common.h"
+#include "audio/audio_ring.h"
+
+static void test_ring_wrap(void **state) {
+    struct mp_audio_ring *ring = mp_audio_ring_new(NULL, 2, 10);
+    uint8_t a[16], b[16], out_a[16], out_b[16];
+    for (int n = 0; n < 16; n++) {
+        a[n] = n;
+        b[n] = 100 + n;
+    }
+
+    for (int round = 0; round < 5; round++) {
+        assert_int_equal(mp_audio_ring_write(ring, (void *[]){a, b}, 7), 7);
+        assert_int_equal(mp_audio_ring_buffered(ring), 7);
+        // only 3 bytes left
+        assert_int_equal(mp_audio_ring_write(ring, (void *[]){a + 7, b + 7}, 5), 3);
+        assert_int_equal(mp_audio_ring_available(ring), 0);
+        assert_int_equal(mp_audio_ring_read(ring, (void *[]){out_a, out_b}, 16), 10);
+        assert_memory_equal(out_a, a, 10);
+        assert_memory_equal(out_b, b, 10);
+        assert_int_equal(mp_audio_ring_buffered(ring), 0);
+        // move the positions, so the next round wraps around differently
+        mp_audio_ring_write(ring, (void *[]){a, b}, 3);
+        assert_int_equal(mp_audio_ring_read(ring, NULL, 3), 3);
+    }
+
+    talloc_free(ring);
+}
+
+#define TOTAL (1 << 20)
+
+static void *writer(void *p)
+{
+    struct mp_audio_ring *ring = p;
+    uint8_t a[37], b[37];
+    int pos = 0;
+    while (pos < TOTAL) {
+        int len = MPMIN(37, TOTAL - pos);
+        for (int n = 0; n < len; n++) {
+            a[n] = pos + n;
+            b[n] = ~(pos + n);
+        }
+        int r = 0;
+        while (r < len)
+            r += mp_audio_ring_write(ring, (void *[]){a + r, b + r}, len - r);
+        pos += len;
+    }
+    return NULL;
+}
+
+static void test_ring_threads(void **state) {
+    struct mp_audio_ring *ring = mp_audio_ring_new(NULL, 2, 100);
+    pthread_t thread;
+    assert_int_equal(pthread_create(&thread, NULL, writer, ring), 0);
+
+    uint8_t a[23], b[23];
+    int pos = 0;
+    while (pos < TOTAL) {
+        int r = mp_audio_ring_read(ring, (void *[]){a, b}, 23);
+        for (int n = 0; n < r; n++) {
+            assert_int_equal(a[n], (uint8_t)(pos + n));
+            assert_int_equal(b[n], (uint8_t)~(pos + n));
+        }
+        pos += r;
+    }
+
+    pthread_join(thread, NULL);
+    assert_int_equal(mp_audio_ring_buffered(ring), 0);
+    talloc_free(ring);
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_ring_wrap),
+        unit_test(test_ring_threads),
+    };
+    return run_tests(tests);
+}
@@ -0,0 +1,686 @@
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <math.h>
+
+#include "test_helpers.h"
+#include "talloc.h"
+#include "common/common.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "osdep/timer.h"
+#include "options/options.h"
+#include "audio/audio.h"
+#include "audio/audio_buffer.h"
+#include "audio/filter/af.h"
+#include "sub/draw_bmp_blend.h"
+#include "audio/filter/gain.h"
+#include "audio/filter/dotprod.h"
+#include "audio/filter/convolve.h"
+#include "audio/filter/biquad.h"
+#include "options/m_option.h"
+#include "options/m_property.h"
+#include "misc/json.h"
+#include "misc/msgpack.h"
+
+// Throughput of the inner loops which have several implementations, and of
+// other hot paths. These are not tests, and check nothing; the unit tests
+// compare the implementations against each other. Usage:
+//
+//   test/bench [name...]
+//
+// where the names select the benchmarks to run (default: all). The audio
+// filter benchmark can also run a single custom chain:
+//
+//   test/bench af <format> <channels> <rate>[:<outrate>] [filter...]
+//
+// where each filter uses the --af syntax, e.g. "scaletempo=scale=1.25".
+
+static void *random_bytes(void *ta, size_t size)
+{
+    uint8_t *p = talloc_size(ta, size);
+    for (size_t n = 0; n < size; n++)
+        p[n] = rand();
+    return p;
+}
+
+// Uniformly distributed in [-0.5, 0.5].
+static float *random_floats(void *ta, int num)
+{
+    float *p = talloc_array(ta, float, num);
+    for (int n = 0; n < num; n++)
+        p[n] = rand() / (double)RAND_MAX - 0.5;
+    return p;
+}
+
+MP_TEST_IMPLS(blend_impls, mp_blend_fns, mp_blend_init_fns)
+
+// Bitmap sizes typical for ASS subtitles.
+static void bench_blend(void *ta)
+{
+    struct mp_blend_fns fns[3];
+    int num = blend_impls(fns);
+    int sizes[][2] = {{800, 60}, {1600, 120}, {400, 400}};
+    for (int s = 0; s < MP_ARRAY_SIZE(sizes); s++) {
+        int w = sizes[s][0], h = sizes[s][1];
+        // Typical libass output: mostly transparent or opaque, some
+        // antialiasing
+        uint8_t *alpha = random_bytes(ta, w * h);
+        for (int n = 0; n < w * h; n++) {
+            int r = alpha[n] & 7;
+            alpha[n] = r < 4 ? 0 : r < 6 ? 255 : rand();
+        }
+        uint8_t *src = random_bytes(ta, w * h * 4);
+        uint8_t *dst = random_bytes(ta, w * h * 4);
+        uint8_t *tmp = talloc_size(ta, w * h * 4);
+        uint8_t *a_out = talloc_size(ta, w * h);
+        int reps = 50;
+        for (int n = 0; n < num; n++) {
+            struct mp_blend_fns *f = &fns[n];
+            int64_t t[6] = {0};
+            for (int r = 0; r < reps; r++) {
+                int64_t t0 = mp_time_us();
+                f->const8(dst, w, 200, alpha, w, 255, w, h);
+                int64_t t1 = mp_time_us();
+                f->const16(dst, w * 2, 50000, alpha, w, 255, w, h);
+                int64_t t2 = mp_time_us();
+                f->src8(dst, w, src, w, alpha, w, w, h);
+                int64_t t3 = mp_time_us();
+                f->src16(dst, w * 2, src, w * 2, alpha, w, w, h);
+                int64_t t4 = mp_time_us();
+                memcpy(tmp, src, w * h * 4);
+                int64_t t5 = mp_time_us();
+                f->unpremultiply_bgr32(tmp, w * 4, a_out, w, w, h);
+                int64_t t6 = mp_time_us();
+                f->premul8(dst, w, alpha, w, alpha, w, w, h);
+                int64_t t7 = mp_time_us();
+                t[0] += t1 - t0; t[1] += t2 - t1; t[2] += t3 - t2;
+                t[3] += t4 - t3; t[4] += t6 - t5; t[5] += t7 - t6;
+            }
+            double px = (double)w * h * reps / 1000.0; // ns per pixel
+            printf("%4dx%-4d %-5s const8 %.3f const16 %.3f src8 %.3f "
+                   "src16 %.3f unpremultiply %.3f premul8 %.3f ns/pixel\n",
+                   w, h, f->name, t[0] / px, t[1] / px, t[2] / px,
+                   t[3] / px, t[4] / px, t[5] / px);
+        }
+    }
+}
+
+MP_TEST_IMPLS(gain_impls, mp_gain_fns, mp_gain_init_fns)
+
+// One second of 7.1 audio at 192 kHz.
+static void bench_gain(void *ta)
+{
+    struct mp_gain_fns fns[3];
+    int num = gain_impls(fns);
+    int size = 192000 * 8;
+    int16_t *s16 = random_bytes(ta, size * sizeof(int16_t));
+    float *f = talloc_array(ta, float, size);
+    for (int n = 0; n < size; n++)
+        f[n] = rand() / (double)RAND_MAX * 4 - 2;
+    int reps = 20;
+    for (int n = 0; n < num; n++) {
+        struct mp_gain_fns *g = &fns[n];
+        int64_t t[3] = {0};
+        for (int r = 0; r < reps; r++) {
+            // alternate the gain to keep the values in range
+            float vol = r & 1 ? 0.5 : 2.0;
+            int64_t t0 = mp_time_us();
+            g->s16(s16, size, vol * 256);
+            int64_t t1 = mp_time_us();
+            g->clip_float(f, size, vol);
+            int64_t t2 = mp_time_us();
+            g->softclip_float(f, size, vol);
+            int64_t t3 = mp_time_us();
+            t[0] += t1 - t0; t[1] += t2 - t1; t[2] += t3 - t2;
+        }
+        double ns = (double)size * reps / 1000.0; // ns per sample
+        printf("%-5s s16 %.3f clip %.3f softclip %.3f ns/sample\n",
+               g->name, t[0] / ns, t[1] / ns, t[2] / ns);
+    }
+}
+
+MP_TEST_IMPLS(dotprod_impls, mp_dotprod_fns, mp_dotprod_init_fns)
+
+// The default scaletempo overlap size for 48 kHz stereo.
+static void bench_dotprod(void *ta)
+{
+    struct mp_dotprod_fns fns[3];
+    int num = dotprod_impls(fns);
+    int size = 576 * 2;
+    float *fa = random_floats(ta, size);
+    float *fb = random_floats(ta, size);
+    int32_t *ia = talloc_array(ta, int32_t, size);
+    int16_t *ib = random_bytes(ta, size * sizeof(int16_t));
+    // same range as the scaletempo pre-correlation buffer
+    for (int n = 0; n < size; n++)
+        ia[n] = rand() % 131072 - 65536;
+    int reps = 20000;
+    for (int n = 0; n < num; n++) {
+        struct mp_dotprod_fns *f = &fns[n];
+        // accumulate the results so the calls can't be optimized out
+        volatile double sink = 0;
+        int64_t t0 = mp_time_us();
+        for (int r = 0; r < reps; r++)
+            sink += f->dot_float(fa, fb, size);
+        int64_t t1 = mp_time_us();
+        for (int r = 0; r < reps; r++)
+            sink += f->dot_s16(ia, ib, size);
+        int64_t t2 = mp_time_us();
+        double ns = (double)size * reps / 1000.0; // ns per element
+        printf("%-5s float %.3f s16 %.3f ns/element\n", f->name,
+               (t1 - t0) / ns, (t2 - t1) / ns);
+    }
+}
+
+// The time per sample of the direct form (as used by af_hrtf before) and of
+// the partitioned convolution, for a long (room correction sized) impulse
+// response.
+static void bench_convolve(void *ta)
+{
+    int block = 256, len = 8192, num = block * 64;
+    float *x = random_floats(ta, num), *h = random_floats(ta, len);
+    float *y = talloc_zero_array(ta, float, num);
+
+    int64_t t0 = mp_time_us();
+    for (int n = 0; n < num; n++) {
+        double sum = 0;
+        for (int i = 0; i < len && i <= n; i++)
+            sum += x[n - i] * h[i];
+        y[n] += sum;
+    }
+    int64_t t1 = mp_time_us();
+
+    struct mp_convolver *c = mp_convolver_create(ta, block);
+    struct mp_conv_ir *ir = mp_conv_ir_create(c, h, len);
+    struct mp_conv_input *in = mp_conv_input_create(c, len);
+    struct mp_conv_output *out = mp_conv_output_create(c);
+    int64_t t2 = mp_time_us();
+    for (int pos = 0; pos < num; pos += block) {
+        mp_conv_input_push(in, x + pos);
+        mp_conv_output_add(out, in, ir);
+        mp_conv_output_finish(out, y + pos);
+    }
+    int64_t t3 = mp_time_us();
+
+    printf("%d taps: direct %.1f ns/sample, partitioned %.1f ns/sample\n",
+           len, (t1 - t0) * 1000.0 / num, (t3 - t2) * 1000.0 / num);
+}
+
+MP_TEST_IMPLS(biquad_impls, mp_biquad_fns, mp_biquad_init_fns)
+
+// A 10 band EQ on 2, 6 and 8 channels.
+static void bench_biquad(void *ta)
+{
+    struct mp_biquad_fns fns[3];
+    int num = biquad_impls(fns);
+    int frames = 4096, reps = 100;
+    struct mp_biquad bq[10];
+    for (int n = 0; n < 10; n++) {
+        mp_biquad_design(&bq[n], MP_BIQUAD_PEAK, 31.25 * (1 << n) / 48000.0,
+                         n % 2 ? 3 : -3, 1.4);
+    }
+    for (int n = 0; n < num; n++) {
+        int chs[] = {2, 6, 8};
+        printf("%-5s", fns[n].name);
+        for (int c = 0; c < 3; c++) {
+            float *a = random_floats(ta, frames * chs[c]);
+            for (int b = 0; b < 10; b++)
+                mp_biquad_reset(&bq[b]);
+            int64_t t0 = mp_time_us();
+            for (int r = 0; r < reps; r++)
+                fns[n].process(bq, 10, a, chs[c], frames);
+            int64_t t1 = mp_time_us();
+            printf(" %dch %.3f", chs[c],
+                   (t1 - t0) * 1000.0 / (frames * reps * 10));
+        }
+        printf(" ns/frame/band\n");
+    }
+}
+
+static int bench_prop_call(void *ctx, struct m_property *prop, int action,
+                           void *arg)
+{
+    switch (action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_INT};
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET:
+        *(int *)arg = prop - (struct m_property *)ctx;
+        return M_PROPERTY_OK;
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
+// The cost of a property access by name and with a resolved path, with about
+// as many properties as the player has.
+static void bench_property_index(void *ta)
+{
+    int num = 200;
+    struct m_property *list = talloc_zero_array(ta, struct m_property,
+                                                num + 1);
+    for (int n = 0; n < num; n++) {
+        list[n] = (struct m_property){
+            .name = talloc_asprintf(ta, "property-%d", n),
+            .call = bench_prop_call,
+        };
+    }
+    struct m_property_index *index = m_property_index_create(ta, list);
+    int reps = 1000000;
+    int v;
+
+    int64_t t0 = mp_time_us();
+    for (int r = 0; r < reps; r++)
+        m_property_do(NULL, index, list[r % num].name, M_PROPERTY_GET,
+                      &v, list);
+    int64_t t1 = mp_time_us();
+    struct m_property_path path;
+    m_property_resolve(NULL, index, "property-150", &path);
+    for (int r = 0; r < reps; r++)
+        m_property_do_path(NULL, &path, M_PROPERTY_GET, &v, list);
+    int64_t t2 = mp_time_us();
+    printf("by name %.1f ns, resolved %.1f ns\n",
+           (t1 - t0) * 1000.0 / reps, (t2 - t1) * 1000.0 / reps);
+}
+
+static void map_add(void *ta, struct mpv_node *map, const char *key,
+                    struct mpv_node val)
+{
+    struct mpv_node_list *list = map->u.list;
+    MP_TARRAY_GROW(list, list->values, list->num);
+    MP_TARRAY_GROW(list, list->keys, list->num);
+    list->keys[list->num] = talloc_strdup(ta, key);
+    list->values[list->num] = val;
+    list->num++;
+}
+
+// The rate of property-change messages generated by building a mpv_node tree
+// and writing it (what input/ipc.c used to do), and by writing the event
+// directly. Likewise for parsing a command with and without arena.
+static void bench_json(void *ta)
+{
+    int reps = 1000000;
+    double pos = 12.5;
+    struct mpv_event_property prop = {"time-pos", MPV_FORMAT_DOUBLE, &pos};
+    struct mpv_event ev = {.event_id = MPV_EVENT_PROPERTY_CHANGE, .data = &prop};
+
+    int64_t t0 = mp_time_us();
+    for (int r = 0; r < reps; r++) {
+        void *tmp = talloc_new(NULL);
+        struct mpv_node map = {.format = MPV_FORMAT_NODE_MAP,
+                               .u.list = talloc_zero(tmp, struct mpv_node_list)};
+        map_add(tmp, &map, "event", (struct mpv_node){.format = MPV_FORMAT_STRING,
+            .u.string = talloc_strdup(tmp, mpv_event_name(ev.event_id))});
+        map_add(tmp, &map, "name", (struct mpv_node){.format = MPV_FORMAT_STRING,
+            .u.string = talloc_strdup(tmp, prop.name)});
+        map_add(tmp, &map, "data", (struct mpv_node){.format = MPV_FORMAT_DOUBLE,
+            .u.double_ = pos});
+        char *s = talloc_strdup(tmp, "");
+        json_write(&s, &map);
+        s = talloc_strdup_append(s, "\n");
+        talloc_free(tmp);
+    }
+    int64_t t1 = mp_time_us();
+    bstr b = {0};
+    for (int r = 0; r < reps; r++) {
+        b.len = 0;
+        json_append_event(&b, &ev);
+    }
+    int64_t t2 = mp_time_us();
+    talloc_free(b.start);
+    printf("events: node tree %.0f/s, direct %.0f/s\n",
+           reps * 1e6 / (t1 - t0), reps * 1e6 / (t2 - t1));
+
+    const char *cmd =
+        "{\"command\": [\"get_property\", \"time-pos\"], \"request_id\": 12}";
+    char *buf = talloc_size(ta, strlen(cmd) + 1);
+    t0 = mp_time_us();
+    for (int r = 0; r < reps; r++) {
+        strcpy(buf, cmd);
+        char *src = buf;
+        void *tmp = talloc_new(NULL);
+        struct mpv_node node;
+        json_parse(tmp, &node, &src, 3);
+        talloc_free(tmp);
+    }
+    t1 = mp_time_us();
+    struct json_arena *arena = json_arena_create(buf);
+    for (int r = 0; r < reps; r++) {
+        strcpy(buf, cmd);
+        char *src = buf;
+        json_arena_reset(arena);
+        struct mpv_node node;
+        json_parse_arena(arena, &node, &src, 3);
+    }
+    t2 = mp_time_us();
+    printf("commands: talloc %.0f/s, arena %.0f/s\n",
+           reps * 1e6 / (t1 - t0), reps * 1e6 / (t2 - t1));
+}
+
+// The rate at which property-change events are written, and commands are
+// parsed, with JSON and MessagePack.
+static void bench_msgpack(void *ta)
+{
+    int reps = 1000000;
+    double pos = 1234.5678;
+    struct mpv_event_property prop = {"time-pos", MPV_FORMAT_DOUBLE, &pos};
+    struct mpv_event ev = {.event_id = MPV_EVENT_PROPERTY_CHANGE, .data = &prop};
+
+    bstr b = {talloc_size(ta, 1), 0};
+    int64_t t0 = mp_time_us();
+    for (int r = 0; r < reps; r++) {
+        b.len = 0;
+        json_append_event(&b, &ev);
+    }
+    int64_t t1 = mp_time_us();
+    for (int r = 0; r < reps; r++) {
+        b.len = 0;
+        size_t start = msgpack_frame_begin(&b);
+        msgpack_append_event(&b, &ev);
+        msgpack_frame_end(&b, start);
+    }
+    int64_t t2 = mp_time_us();
+    printf("events: json %.0f/s, msgpack %.0f/s\n",
+           reps * 1e6 / (t1 - t0), reps * 1e6 / (t2 - t1));
+
+    const char *cmd = "{\"command\":[\"set_property\",\"speed\",1.0625]}";
+    char *src = talloc_strdup(ta, cmd);
+    struct mpv_node node;
+    json_parse(ta, &node, &src, 3);
+    bstr packed = {talloc_size(ta, 1), 0};
+    msgpack_append(&packed, &node);
+
+    char *buf = talloc_size(ta, strlen(cmd) + 1);
+    struct json_arena *arena = json_arena_create(ta);
+    t0 = mp_time_us();
+    for (int r = 0; r < reps; r++) {
+        strcpy(buf, cmd);
+        char *s = buf;
+        json_arena_reset(arena);
+        json_parse_arena(arena, &node, &s, 3);
+    }
+    t1 = mp_time_us();
+    for (int r = 0; r < reps; r++) {
+        bstr s = packed;
+        json_arena_reset(arena);
+        msgpack_parse_arena(arena, &node, &s, 3);
+    }
+    t2 = mp_time_us();
+    printf("commands: json %.0f/s, msgpack %.0f/s\n",
+           reps * 1e6 / (t1 - t0), reps * 1e6 / (t2 - t1));
+}
+
+// Throughput of the audio filter chain, fed with synthetic audio. No decoder
+// or audio output is involved. Samples are counted per channel, at the input
+// rate of the chain or filter.
+
+#define MAX_CHAIN 8
+#define FRAME_SAMPLES 1024
+#define BENCH_SECONDS 10 // of audio per chain
+
+struct chain {
+    const char *format, *channels;
+    int rate, out_rate; // out_rate 0 means no resampling
+    const char *filters[MAX_CHAIN];
+};
+
+static const struct chain chains[] = {
+    {"s16", "stereo", 48000, 0, {"volume=volumedb=-3"}},
+    {"float", "stereo", 48000, 0, {"volume=volumedb=-3"}},
+    {"floatp", "5.1", 48000, 0, {"volume=volumedb=-3"}},
+    {"s16", "stereo", 44100, 48000},
+    {"floatp", "5.1", 44100, 48000},
+    {"s16", "stereo", 48000, 0, {"scaletempo=scale=1.25"}},
+    {"float", "stereo", 48000, 0, {"scaletempo=scale=1.25"}},
+    {"float", "stereo", 48000, 0, {"pan=channels=2:matrix=0.7,0.3,0.3,0.7"}},
+    {"float", "stereo", 48000, 0, {"drc=method=1"}},
+    {"float", "stereo", 48000, 0, {"drc=method=2"}},
+    {"s16", "5.1", 48000, 0, {"hrtf"}},
+    {"float", "stereo", 48000, 0, {"equalizer=e0=3:e3=-2:e6=1:e9=4"}},
+    {"float", "5.1", 48000, 0,
+     {"parameq=bands=[lowshelf/100/4,peak/1000/-3/1.4,highshelf/8000/2]"}},
+    {"floatp", "stereo", 44100, 48000,
+     {"scaletempo=scale=1.1", "volume=volumedb=-3", "drc"}},
+};
+
+// Per filter timing, recorded by a wrapper around af_instance.filter.
+struct filter_stat {
+    struct af_instance *af;
+    int (*filter)(struct af_instance *af, struct mp_audio *data, int flags);
+    int64_t time;
+    int64_t samples;
+};
+
+static struct filter_stat stats[MAX_CHAIN * 4];
+static int num_stats;
+
+static int timed_filter(struct af_instance *af, struct mp_audio *data,
+                        int flags)
+{
+    for (int n = 0; n < num_stats; n++) {
+        struct filter_stat *st = &stats[n];
+        if (st->af == af) {
+            st->samples += data->samples;
+            int64_t t0 = mp_time_us();
+            int r = st->filter(af, data, flags);
+            st->time += mp_time_us() - t0;
+            return r;
+        }
+    }
+    abort();
+}
+
+// Split "name=key=val:key=val" into the name and a key/value list, as used
+// by af_add().
+static char *parse_filter(void *ta, const char *spec, char ***args)
+{
+    char *name = talloc_strdup(ta, spec);
+    char **list = NULL;
+    int num = 0;
+    char *opts = strchr(name, '=');
+    if (opts) {
+        *opts++ = '\0';
+        // Brackets quote ':', like in the option parser.
+        while (*opts) {
+            char *end = opts;
+            while (*end && *end != ':')
+                end = *end == '[' && strchr(end, ']') ? strchr(end, ']') + 1
+                                                      : end + 1;
+            if (*end)
+                *end++ = '\0';
+            char *val = strchr(opts, '=');
+            if (val)
+                *val++ = '\0';
+            if (val && val[0] == '[' && val[strlen(val) - 1] == ']') {
+                val[strlen(val) - 1] = '\0';
+                val++;
+            }
+            MP_TARRAY_APPEND(ta, list, num, opts);
+            MP_TARRAY_APPEND(ta, list, num, val ? val : "yes");
+            opts = end;
+        }
+    }
+    MP_TARRAY_APPEND(ta, list, num, NULL);
+    *args = list;
+    return name;
+}
+
+// A sine per channel, each with a different frequency, plus some noise, so
+// that the filters which adapt to the signal have something to work on.
+static void fill_frame(struct mp_audio *a, int64_t pos)
+{
+    int fmt = af_fmt_from_planar(a->format);
+    for (int p = 0; p < a->num_planes; p++) {
+        char *ptr = a->planes[p];
+        for (int i = 0; i < a->samples; i++) {
+            for (int k = 0; k < a->spf; k++) {
+                int c = a->num_planes > 1 ? p : k;
+                double t = (pos + i) / (double)a->rate;
+                double v = 0.5 * sin(2 * M_PI * 110 * (c + 1) * t) +
+                           0.05 * (rand() / (double)RAND_MAX - 0.5);
+                switch (fmt) {
+                case AF_FORMAT_S16: *(int16_t *)ptr = v * INT16_MAX; break;
+                case AF_FORMAT_S32: *(int32_t *)ptr = v * INT32_MAX; break;
+                case AF_FORMAT_FLOAT: *(float *)ptr = v; break;
+                case AF_FORMAT_DOUBLE: *(double *)ptr = v; break;
+                default: abort();
+                }
+                ptr += a->bps;
+            }
+        }
+    }
+}
+
+// Returns false if the chain could not be created, or filtering failed.
+static bool run_chain(const struct chain *ch)
+{
+    void *ta = talloc_new(NULL);
+    struct MPOpts *opts = talloc_zero(ta, struct MPOpts);
+    struct mpv_global global = {.opts = opts, .log = mp_null_log};
+    struct af_stream *s = af_new(&global);
+    bool ok = false;
+
+    struct mp_chmap chmap;
+    int format = af_str2fmt_short(bstr0(ch->format));
+    if (!format || !mp_chmap_from_str(&chmap, bstr0(ch->channels))) {
+        printf("invalid format or channel layout\n");
+        goto done;
+    }
+    mp_audio_set_format(&s->input, format);
+    mp_audio_set_channels(&s->input, &chmap);
+    s->input.rate = ch->rate;
+    s->output.rate = ch->out_rate ? ch->out_rate : ch->rate;
+    if (af_init(s) < 0) {
+        printf("could not initialize the filter chain\n");
+        goto done;
+    }
+    // af_add() inserts at the start of the chain, so add them in reverse.
+    int num_filters = 0;
+    while (num_filters < MAX_CHAIN && ch->filters[num_filters])
+        num_filters++;
+    for (int n = num_filters - 1; n >= 0; n--) {
+        char **args;
+        char *name = parse_filter(ta, ch->filters[n], &args);
+        if (!af_add(s, name, args)) {
+            printf("could not add filter '%s'\n", ch->filters[n]);
+            goto done;
+        }
+    }
+
+    // Includes the conversion filters inserted by af.c.
+    num_stats = 0;
+    for (struct af_instance *af = s->first->next; af != s->last; af = af->next)
+    {
+        if (num_stats == MP_ARRAY_SIZE(stats))
+            break;
+        stats[num_stats++] = (struct filter_stat){af, af->filter};
+        af->filter = timed_filter;
+    }
+
+    char buf[80];
+    printf("%s ->", mp_audio_config_to_str_buf(buf, sizeof(buf), &s->input));
+    for (int n = 0; n < num_filters; n++)
+        printf(" %s", ch->filters[n]);
+    printf("\n");
+
+    struct mp_audio_pool *pool = mp_audio_pool_create(ta);
+    struct mp_audio_buffer *outbuf = mp_audio_buffer_create(ta);
+    mp_audio_buffer_reinit(outbuf, &s->output);
+    int num_frames = BENCH_SECONDS * ch->rate / FRAME_SAMPLES;
+    struct mp_audio *src = mp_audio_pool_get(pool, &s->input, FRAME_SAMPLES);
+    talloc_steal(ta, src);
+    int64_t total = 0, out_samples = 0;
+    for (int f = 0; f < num_frames; f++) {
+        // The input is generated outside of the timed section.
+        fill_frame(src, (int64_t)f * FRAME_SAMPLES);
+        struct mp_audio *frame =
+            mp_audio_pool_get(pool, &s->input, FRAME_SAMPLES);
+        mp_audio_copy(frame, 0, src, 0, FRAME_SAMPLES);
+        int64_t t0 = mp_time_us();
+        if (af_filter(s, frame, outbuf) < 0) {
+            printf("filtering failed\n");
+            goto done;
+        }
+        total += mp_time_us() - t0;
+        out_samples += mp_audio_buffer_samples(outbuf);
+        mp_audio_buffer_clear(outbuf);
+    }
+
+    int64_t in_samples = (int64_t)num_frames * FRAME_SAMPLES;
+    for (int n = 0; n < num_stats; n++) {
+        struct filter_stat *st = &stats[n];
+        printf("    %-14s %8.2f ns/sample%s\n", st->af->info->name,
+               st->samples ? st->time * 1000.0 / st->samples : 0,
+               st->af->auto_inserted ? " (auto)" : "");
+    }
+    printf("    %-14s %8.2f ns/sample %8.1f Msamples/s, %.0fx realtime"
+           ", %"PRId64" -> %"PRId64" samples\n", "total",
+           total * 1000.0 / in_samples,
+           total ? in_samples / (double)total : 0,
+           total ? BENCH_SECONDS * 1e6 / total : 0,
+           in_samples, out_samples);
+    ok = true;
+
+done:
+    af_destroy(s);
+    talloc_free(ta);
+    return ok;
+}
+
+static void bench_af(void *ta)
+{
+    for (int n = 0; n < MP_ARRAY_SIZE(chains); n++) {
+        if (!run_chain(&chains[n]))
+            printf("    failed\n");
+    }
+}
+
+static const struct bench {
+    const char *name;
+    void (*run)(void *ta);
+} benches[] = {
+    {"blend", bench_blend},
+    {"gain", bench_gain},
+    {"dotprod", bench_dotprod},
+    {"convolve", bench_convolve},
+    {"biquad", bench_biquad},
+    {"property", bench_property_index},
+    {"json", bench_json},
+    {"msgpack", bench_msgpack},
+    {"af", bench_af},
+};
+
+int main(int argc, char **argv) {
+    mp_time_init();
+    if (argc >= 5 && strcmp(argv[1], "af") == 0) {
+        struct chain ch = {argv[2], argv[3]};
+        if (sscanf(argv[4], "%d:%d", &ch.rate, &ch.out_rate) < 1 ||
+            ch.rate <= 0 || argc - 5 > MAX_CHAIN)
+            return 1;
+        for (int n = 5; n < argc; n++)
+            ch.filters[n - 5] = argv[n];
+        return run_chain(&ch) ? 0 : 1;
+    }
+    int ran = 0;
+    for (int n = 0; n < MP_ARRAY_SIZE(benches); n++) {
+        const struct bench *b = &benches[n];
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; i++)
+            selected |= strcmp(argv[i], b->name) == 0;
+        if (!selected)
+            continue;
+        printf("%s:\n", b->name);
+        void *ta = talloc_new(NULL);
+        b->run(ta);
+        talloc_free(ta);
+        ran++;
+    }
+    if (!ran) {
+        printf("benchmarks:");
+        for (int n = 0; n < MP_ARRAY_SIZE(benches); n++)
+            printf(" %s", benches[n].name);
+        printf("\n");
+        return 1;
+    }
+    return 0;
+}
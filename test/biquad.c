@@ -0,0 +1,79 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "test_helpers.h"
+#include "talloc.h"
+#include "common/common.h"
+#include "audio/filter/biquad.h"
+
+MP_TEST_IMPLS(num_impls, mp_biquad_fns, mp_biquad_init_fns)
+
+#define NUM_BQ 4
+
+static void init_bqs(struct mp_biquad bq[NUM_BQ])
+{
+    mp_biquad_design(&bq[0], MP_BIQUAD_LOWSHELF, 100 / 48000.0, 6, M_SQRT1_2);
+    mp_biquad_design(&bq[1], MP_BIQUAD_PEAK, 1000 / 48000.0, -3, 1.4);
+    mp_biquad_design(&bq[2], MP_BIQUAD_NOTCH, 50 / 48000.0, 0, 30);
+    mp_biquad_design(&bq[3], MP_BIQUAD_HIGHSHELF, 8000 / 48000.0, 2, 0.7);
+    for (int n = 0; n < NUM_BQ; n++)
+        mp_biquad_reset(&bq[n]);
+}
+
+static float *random_audio(void *ta, int num)
+{
+    float *a = talloc_array(ta, float, num);
+    for (int n = 0; n < num; n++)
+        a[n] = rand() / (double)RAND_MAX - 0.5;
+    return a;
+}
+
+static void test_biquad_matches_reference(void **state) {
+    void *ta = talloc_new(NULL);
+    struct mp_biquad_fns fns[3];
+    int num = num_impls(fns);
+    int frames = 1000;
+
+    // all channel counts, to exercise the padding of the SIMD versions
+    for (int nch = 1; nch <= MP_BIQUAD_LANES; nch++) {
+        float *src = random_audio(ta, frames * nch);
+        float *ref = talloc_memdup(ta, src, frames * nch * sizeof(float));
+        struct mp_biquad bq_ref[NUM_BQ];
+        init_bqs(bq_ref);
+        fns[0].process(bq_ref, NUM_BQ, ref, nch, frames);
+        for (int n = 1; n < num; n++) {
+            float *a = talloc_memdup(ta, src, frames * nch * sizeof(float));
+            struct mp_biquad bq[NUM_BQ];
+            init_bqs(bq);
+            // uneven split, so that the state is carried between calls
+            fns[n].process(bq, NUM_BQ, a, nch, 333);
+            fns[n].process(bq, NUM_BQ, a + 333 * nch, nch, frames - 333);
+            for (int i = 0; i < frames * nch; i++)
+                assert_true(fabs(a[i] - ref[i]) < 1e-6);
+        }
+    }
+    talloc_free(ta);
+}
+
+static void test_biquad_design(void **state) {
+    // a peak filter has the given gain at its center frequency
+    struct mp_biquad bq[1];
+    mp_biquad_design(&bq[0], MP_BIQUAD_PEAK, 0.25, 6, 1);
+    double w = 2 * M_PI * 0.25;
+    // |H(e^jw)| with H = (b0 + b1 z^-1 + b2 z^-2) / (1 + a1 z^-1 + a2 z^-2)
+    double nr = bq->b0[0] + bq->b1[0] * cos(w) + bq->b2[0] * cos(2 * w);
+    double ni = -bq->b1[0] * sin(w) - bq->b2[0] * sin(2 * w);
+    double dr = 1 + bq->a1[0] * cos(w) + bq->a2[0] * cos(2 * w);
+    double di = -bq->a1[0] * sin(w) - bq->a2[0] * sin(2 * w);
+    double gain = 20 * log10(sqrt((nr * nr + ni * ni) / (dr * dr + di * di)));
+    assert_true(fabs(gain - 6) < 1e-3);
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_biquad_matches_reference),
+        unit_test(test_biquad_design),
+    };
+    return run_tests(tests);
+}
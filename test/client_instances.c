@@ -0,0 +1,80 @@
+#include <pthread.h>
+
+#include "test_helpers.h"
+#include "libmpv/client.h"
+
+#define NUM_INSTANCES 8
+
+struct instance {
+    int id;
+    const char *failed;     // first failed check, or NULL
+};
+
+// cmocka's assertions must be used on the main thread only, so the instance
+// threads record the first failure and the test checks it after joining.
+#define CHECK(ctx, cond) do {                   \
+        if (!(cond)) {                          \
+            (ctx)->failed = #cond;              \
+            return NULL;                        \
+        }                                       \
+    } while (0)
+
+// Create, use and destroy players concurrently. Each instance must see only
+// its own state, while they share process-wide state (such as the property
+// index and the thread pool) behind the scenes.
+static void *instance_thread(void *p)
+{
+    struct instance *ctx = p;
+    double speed = 1.0 + ctx->id / 4.0;
+    for (int round = 0; round < 3; round++) {
+        mpv_handle *h = mpv_create();
+        CHECK(ctx, h);
+        CHECK(ctx, mpv_set_option_string(h, "vo", "null") == 0);
+        CHECK(ctx, mpv_set_option_string(h, "ao", "null") == 0);
+        CHECK(ctx, mpv_set_option_string(h, "load-scripts", "no") == 0);
+        CHECK(ctx, mpv_initialize(h) == 0);
+
+        for (int n = 0; n < 100; n++) {
+            double v = speed + n / 100.0;
+            CHECK(ctx, mpv_set_property(h, "speed", MPV_FORMAT_DOUBLE,
+                                        &v) == 0);
+            double r = 0;
+            CHECK(ctx, mpv_get_property(h, "speed", MPV_FORMAT_DOUBLE,
+                                        &r) == 0);
+            CHECK(ctx, r == v);
+        }
+        // resolved handles point into the shared index
+        mpv_property_handle *prop = mpv_resolve_property(h, "speed");
+        CHECK(ctx, prop);
+        double r = 0;
+        int err = mpv_get_property_resolved(h, prop, MPV_FORMAT_DOUBLE, &r);
+        mpv_free(prop);
+        CHECK(ctx, err == 0);
+        CHECK(ctx, r == speed + 99 / 100.0);
+
+        mpv_terminate_destroy(h);
+    }
+    return NULL;
+}
+
+static void test_concurrent_instances(void **state) {
+    pthread_t threads[NUM_INSTANCES];
+    struct instance ctx[NUM_INSTANCES];
+    for (int n = 0; n < NUM_INSTANCES; n++) {
+        ctx[n] = (struct instance){.id = n};
+        assert_int_equal(pthread_create(&threads[n], NULL, instance_thread,
+                                        &ctx[n]), 0);
+    }
+    for (int n = 0; n < NUM_INSTANCES; n++) {
+        pthread_join(threads[n], NULL);
+        if (ctx[n].failed)
+            fail_msg("instance %d: %s", n, ctx[n].failed);
+    }
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_concurrent_instances),
+    };
+    return run_tests(tests);
+}
@@ -0,0 +1,73 @@
+#include <stdlib.h>
+#include <math.h>
+
+#include "test_helpers.h"
+#include "talloc.h"
+#include "common/common.h"
+#include "audio/filter/convolve.h"
+
+static float *random_signal(void *ta, int num)
+{
+    float *s = talloc_array(ta, float, num);
+    for (int n = 0; n < num; n++)
+        s[n] = rand() / (double)RAND_MAX - 0.5;
+    return s;
+}
+
+// y[n] += sum(x[n - i] * h[i])
+static void direct_conv(float *y, const float *x, int num, const float *h,
+                        int len)
+{
+    for (int n = 0; n < num; n++) {
+        double sum = 0;
+        for (int i = 0; i < len && i <= n; i++)
+            sum += x[n - i] * h[i];
+        y[n] += sum;
+    }
+}
+
+static void test_convolve_matches_direct(void **state) {
+    void *ta = talloc_new(NULL);
+    int block = 32;
+    struct mp_convolver *c = mp_convolver_create(ta, block);
+    assert_true(c != NULL);
+
+    // shorter than, equal to, and not a multiple of the block size
+    int lens[] = {1, 31, 32, 113};
+    int num = block * 8;
+    for (int l = 0; l < MP_ARRAY_SIZE(lens); l++) {
+        int len = lens[l];
+        // two inputs mixed into one output, like af_hrtf does
+        float *x1 = random_signal(ta, num), *x2 = random_signal(ta, num);
+        float *h1 = random_signal(ta, len), *h2 = random_signal(ta, len / 2 + 1);
+        float *ref = talloc_zero_array(ta, float, num);
+        direct_conv(ref, x1, num, h1, len);
+        direct_conv(ref, x2, num, h2, len / 2 + 1);
+
+        struct mp_conv_ir *ir1 = mp_conv_ir_create(c, h1, len);
+        struct mp_conv_ir *ir2 = mp_conv_ir_create(c, h2, len / 2 + 1);
+        struct mp_conv_input *in1 = mp_conv_input_create(c, len);
+        struct mp_conv_input *in2 = mp_conv_input_create(c, len);
+        struct mp_conv_output *out = mp_conv_output_create(c);
+        float *y = talloc_array(ta, float, num);
+        for (int pos = 0; pos < num; pos += block) {
+            mp_conv_input_push(in1, x1 + pos);
+            mp_conv_input_push(in2, x2 + pos);
+            mp_conv_output_add(out, in1, ir1);
+            mp_conv_output_add(out, in2, ir2);
+            mp_conv_output_finish(out, y + pos);
+        }
+        for (int n = 0; n < num; n++)
+            assert_true(fabs(y[n] - ref[n]) < 1e-4);
+    }
+
+    assert_true(mp_convolver_create(ta, 100) == NULL);
+    talloc_free(ta);
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_convolve_matches_direct),
+    };
+    return run_tests(tests);
+}
@@ -0,0 +1,61 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "test_helpers.h"
+#include "talloc.h"
+#include "common/common.h"
+#include "audio/filter/dotprod.h"
+
+MP_TEST_IMPLS(num_impls, mp_dotprod_fns, mp_dotprod_init_fns)
+
+struct bufs {
+    float *fa, *fb;
+    int32_t *ia;
+    int16_t *ib;
+};
+
+static void init_bufs(struct bufs *b, void *ta, int num)
+{
+    b->fa = talloc_array(ta, float, num);
+    b->fb = talloc_array(ta, float, num);
+    b->ia = talloc_array(ta, int32_t, num);
+    b->ib = talloc_array(ta, int16_t, num);
+    for (int n = 0; n < num; n++) {
+        b->fa[n] = rand() / (double)RAND_MAX - 0.5;
+        b->fb[n] = rand() / (double)RAND_MAX - 0.5;
+        // same range as the scaletempo pre-correlation buffer
+        b->ia[n] = rand() % 131072 - 65536;
+        b->ib[n] = rand();
+    }
+}
+
+static void test_dotprod_matches_reference(void **state) {
+    void *ta = talloc_new(NULL);
+    struct mp_dotprod_fns fns[3];
+    int num = num_impls(fns);
+    struct mp_dotprod_fns *c = &fns[0];
+
+    // odd sizes to exercise the scalar tails of the SIMD versions
+    int sizes[] = {0, 1, 15, 17, 1001};
+    for (int s = 0; s < MP_ARRAY_SIZE(sizes); s++) {
+        int size = sizes[s];
+        struct bufs b;
+        init_bufs(&b, ta, size);
+        for (int n = 1; n < num; n++) {
+            assert_true(fns[n].dot_s16(b.ia, b.ib, size) ==
+                        c->dot_s16(b.ia, b.ib, size));
+            float ref = c->dot_float(b.fa, b.fb, size);
+            float r = fns[n].dot_float(b.fa, b.fb, size);
+            assert_true(fabs(r - ref) < 1e-4);
+        }
+    }
+    talloc_free(ta);
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_dotprod_matches_reference),
+    };
+    return run_tests(tests);
+}
@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_helpers.h"
+#include "talloc.h"
+#include "common/common.h"
+#include "sub/draw_bmp_blend.h"
+
+struct bufs {
+    int w, h;
+    uint8_t *alpha, *src, *dst, *ref;
+};
+
+static void init_bufs(struct bufs *b, void *ta, int w, int h)
+{
+    *b = (struct bufs){ .w = w, .h = h };
+    b->alpha = talloc_size(ta, w * h);
+    b->src = talloc_size(ta, w * h * 4);
+    b->dst = talloc_size(ta, w * h * 4);
+    b->ref = talloc_size(ta, w * h * 4);
+    // Typical libass output: mostly transparent or opaque, some antialiasing
+    for (int n = 0; n < w * h; n++) {
+        int r = rand() & 7;
+        b->alpha[n] = r < 4 ? 0 : r < 6 ? 255 : rand();
+    }
+    for (int n = 0; n < w * h * 4; n++) {
+        b->src[n] = rand();
+        b->dst[n] = b->ref[n] = rand();
+    }
+}
+
+MP_TEST_IMPLS(num_impls, mp_blend_fns, mp_blend_init_fns)
+
+static void test_blend_matches_reference(void **state) {
+    void *ta = talloc_new(NULL);
+    struct mp_blend_fns fns[3];
+    int num = num_impls(fns);
+    struct mp_blend_fns *c = &fns[0];
+
+    // odd sizes to exercise the scalar tails of the SIMD versions
+    int sizes[][2] = {{1, 1}, {15, 3}, {67, 5}, {333, 9}};
+    for (int s = 0; s < MP_ARRAY_SIZE(sizes); s++) {
+        int w = sizes[s][0], h = sizes[s][1];
+        for (int n = 1; n < num; n++) {
+            struct bufs b;
+            init_bufs(&b, ta, w, h);
+            int size = w * h * 4;
+            int amul = rand() & 255, srcp = rand();
+
+            c->const16(b.ref, w * 2, srcp, b.alpha, w, amul, w, h);
+            fns[n].const16(b.dst, w * 2, srcp, b.alpha, w, amul, w, h);
+            assert_memory_equal(b.dst, b.ref, size);
+
+            c->const8(b.ref, w, srcp & 255, b.alpha, w, amul, w, h);
+            fns[n].const8(b.dst, w, srcp & 255, b.alpha, w, amul, w, h);
+            assert_memory_equal(b.dst, b.ref, size);
+
+            c->src16(b.ref, w * 2, b.src, w * 2, b.alpha, w, w, h);
+            fns[n].src16(b.dst, w * 2, b.src, w * 2, b.alpha, w, w, h);
+            assert_memory_equal(b.dst, b.ref, size);
+
+            c->src8(b.ref, w, b.src, w, b.alpha, w, w, h);
+            fns[n].src8(b.dst, w, b.src, w, b.alpha, w, w, h);
+            assert_memory_equal(b.dst, b.ref, size);
+
+            // premultiplied overlay: color must not exceed alpha
+            uint16_t *a16 = talloc_array(ta, uint16_t, w * h);
+            uint16_t *s16 = talloc_array(ta, uint16_t, w * h);
+            uint8_t *s8 = talloc_size(ta, w * h);
+            for (int i = 0; i < w * h; i++) {
+                a16[i] = b.alpha[i];
+                s16[i] = rand() % (b.alpha[i] * 65535 / 255 + 1);
+                s8[i] = rand() % (b.alpha[i] + 1);
+            }
+
+            c->premul16(b.ref, w * 2, s16, w * 2, a16, w * 2, w, h);
+            fns[n].premul16(b.dst, w * 2, s16, w * 2, a16, w * 2, w, h);
+            assert_memory_equal(b.dst, b.ref, size);
+
+            c->premul8(b.ref, w, s8, w, b.alpha, w, w, h);
+            fns[n].premul8(b.dst, w, s8, w, b.alpha, w, w, h);
+            assert_memory_equal(b.dst, b.ref, size);
+
+            uint8_t *a_ref = talloc_size(ta, w * h), *a_dst = talloc_size(ta, w * h);
+            c->unpremultiply_bgr32(b.ref, w * 4, a_ref, w, w, h);
+            fns[n].unpremultiply_bgr32(b.dst, w * 4, a_dst, w, w, h);
+            assert_memory_equal(b.dst, b.ref, size);
+            assert_memory_equal(a_dst, a_ref, w * h);
+        }
+    }
+    talloc_free(ta);
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_blend_matches_reference),
+    };
+    return run_tests(tests);
+}
@@ -0,0 +1,70 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "test_helpers.h"
+#include "talloc.h"
+#include "common/common.h"
+#include "audio/filter/gain.h"
+
+MP_TEST_IMPLS(num_impls, mp_gain_fns, mp_gain_init_fns)
+
+static void fill(int16_t *s16, float *f, int num)
+{
+    for (int n = 0; n < num; n++) {
+        s16[n] = rand();
+        f[n] = rand() / (double)RAND_MAX * 4 - 2;
+    }
+}
+
+static void test_gain_matches_reference(void **state) {
+    void *ta = talloc_new(NULL);
+    struct mp_gain_fns fns[3];
+    int num = num_impls(fns);
+    struct mp_gain_fns *c = &fns[0];
+
+    // odd sizes to exercise the scalar tails of the SIMD versions
+    int sizes[] = {1, 7, 33, 1001};
+    // includes the s16 fallback for large volumes
+    int vols[] = {0, 100, 300, 5000, 40000};
+    for (int s = 0; s < MP_ARRAY_SIZE(sizes); s++) {
+        int size = sizes[s];
+        int16_t *s16 = talloc_array(ta, int16_t, size);
+        int16_t *s16_ref = talloc_array(ta, int16_t, size);
+        float *f = talloc_array(ta, float, size);
+        float *f_ref = talloc_array(ta, float, size);
+        for (int n = 1; n < num; n++) {
+            for (int v = 0; v < MP_ARRAY_SIZE(vols); v++) {
+                fill(s16, f, size);
+                memcpy(s16_ref, s16, size * sizeof(s16[0]));
+                memcpy(f_ref, f, size * sizeof(f[0]));
+
+                c->s16(s16_ref, size, vols[v]);
+                fns[n].s16(s16, size, vols[v]);
+                assert_memory_equal(s16, s16_ref, size * sizeof(s16[0]));
+
+                float vol = vols[v] / 256.0;
+                c->clip_float(f_ref, size, vol);
+                fns[n].clip_float(f, size, vol);
+                assert_memory_equal(f, f_ref, size * sizeof(f[0]));
+
+                fill(s16, f, size);
+                memcpy(f_ref, f, size * sizeof(f[0]));
+                c->softclip_float(f_ref, size, vol);
+                fns[n].softclip_float(f, size, vol);
+                for (int i = 0; i < size; i++) {
+                    assert_true(fabs(f[i] - f_ref[i]) < 1e-6);
+                    assert_true(f[i] >= -1.0 && f[i] <= 1.0);
+                }
+            }
+        }
+    }
+    talloc_free(ta);
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_gain_matches_reference),
+    };
+    return run_tests(tests);
+}
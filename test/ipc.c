@@ -0,0 +1,162 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "test_helpers.h"
+#include "libmpv/client.h"
+
+static int connect_ipc(const char *path)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    assert_true(fd >= 0);
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    // The socket is created asynchronously by the IPC thread.
+    for (int n = 0; n < 500; n++) {
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+            return fd;
+        usleep(10 * 1000);
+    }
+    fail_msg("could not connect to %s", path);
+    return -1;
+}
+
+static void send_line(int fd, const char *s)
+{
+    assert_int_equal(write(fd, s, strlen(s)), strlen(s));
+}
+
+// Read the next line which is not an event, waiting at most timeout_ms.
+// Returns false on timeout.
+static bool read_reply(int fd, char *buf, size_t size, int timeout_ms)
+{
+    size_t len = 0;
+    while (len < size - 1) {
+        struct pollfd p = {.fd = fd, .events = POLLIN};
+        if (poll(&p, 1, timeout_ms) <= 0)
+            return false;
+        if (read(fd, buf + len, 1) != 1)
+            return false;
+        if (buf[len] == '\n') {
+            buf[len] = '\0';
+            if (!strstr(buf, "\"event\""))
+                return true;
+            len = 0;
+            continue;
+        }
+        len++;
+    }
+    return false;
+}
+
+// A client running a command which blocks the player (here: loadlist on a FIFO
+// without writer) must not delay the replies to other clients.
+static void test_ipc_slow_command(void **state) {
+    char sock[64], fifo[64], buf[4096];
+    snprintf(sock, sizeof(sock), "/tmp/mpv-test-ipc-%d", (int)getpid());
+    snprintf(fifo, sizeof(fifo), "/tmp/mpv-test-fifo-%d", (int)getpid());
+    unlink(fifo);
+    assert_int_equal(mkfifo(fifo, 0600), 0);
+
+    mpv_handle *h = mpv_create();
+    assert_true(h);
+    assert_int_equal(mpv_set_option_string(h, "vo", "null"), 0);
+    assert_int_equal(mpv_set_option_string(h, "ao", "null"), 0);
+    assert_int_equal(mpv_set_option_string(h, "load-scripts", "no"), 0);
+    assert_int_equal(mpv_set_option_string(h, "input-unix-socket", sock), 0);
+    assert_int_equal(mpv_initialize(h), 0);
+
+    int slow = connect_ipc(sock);
+    int fast = connect_ipc(sock);
+
+    snprintf(buf, sizeof(buf), "{\"command\": [\"loadlist\", \"%s\"]}\n", fifo);
+    send_line(slow, buf);
+    usleep(100 * 1000); // let it block in open()
+
+    send_line(fast, "{\"command\": [\"client_name\"]}\n");
+    assert_true(read_reply(fast, buf, sizeof(buf), 5000));
+    assert_true(strstr(buf, "\"success\""));
+
+    // The slow command's reply arrives once it's unblocked.
+    int wfd = open(fifo, O_WRONLY | O_NONBLOCK);
+    assert_true(wfd >= 0);
+    close(wfd);
+    assert_true(read_reply(slow, buf, sizeof(buf), 5000));
+    assert_true(strstr(buf, "\"error\""));
+
+    close(slow);
+    close(fast);
+    mpv_terminate_destroy(h);
+    unlink(fifo);
+}
+
+struct destroy_ctx {
+    mpv_handle *h;
+    pthread_mutex_t lock;
+    bool done;
+};
+
+static void *destroy_thread(void *p)
+{
+    struct destroy_ctx *ctx = p;
+    mpv_terminate_destroy(ctx->h);
+    pthread_mutex_lock(&ctx->lock);
+    ctx->done = true;
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
+// Quitting must not wait for a client which stopped reading its output.
+static void test_ipc_quit_blocked_client(void **state) {
+    char sock[64];
+    snprintf(sock, sizeof(sock), "/tmp/mpv-test-ipc2-%d", (int)getpid());
+
+    mpv_handle *h = mpv_create();
+    assert_true(h);
+    assert_int_equal(mpv_set_option_string(h, "vo", "null"), 0);
+    assert_int_equal(mpv_set_option_string(h, "ao", "null"), 0);
+    assert_int_equal(mpv_set_option_string(h, "load-scripts", "no"), 0);
+    assert_int_equal(mpv_set_option_string(h, "input-unix-socket", sock), 0);
+    assert_int_equal(mpv_initialize(h), 0);
+
+    // Fill the socket and the IPC output buffer with replies, without ever
+    // reading them.
+    int fd = connect_ipc(sock);
+    const char *cmd = "{\"command\": [\"get_property\", \"property-list\"]}\n";
+    for (int n = 0; n < 2000; n++) {
+        if (send(fd, cmd, strlen(cmd), MSG_DONTWAIT) < 0)
+            break;
+    }
+    usleep(500 * 1000);
+
+    struct destroy_ctx ctx = {h, PTHREAD_MUTEX_INITIALIZER};
+    pthread_t thread;
+    assert_int_equal(pthread_create(&thread, NULL, destroy_thread, &ctx), 0);
+    bool done = false;
+    for (int n = 0; n < 1000 && !done; n++) {
+        usleep(10 * 1000);
+        pthread_mutex_lock(&ctx.lock);
+        done = ctx.done;
+        pthread_mutex_unlock(&ctx.lock);
+    }
+    if (!done)
+        fail_msg("player did not quit");
+    pthread_join(thread, NULL);
+    close(fd);
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_ipc_slow_command),
+        unit_test(test_ipc_quit_blocked_client),
+    };
+    return run_tests(tests);
+}
@@ -0,0 +1,110 @@
+#include <string.h>
+
+#include "test_helpers.h"
+#include "talloc.h"
+#include "common/common.h"
+#include "misc/json.h"
+
+static const char *const docs[] = {
+    "null",
+    "[1, -2.5, true, false, null, \"a\\\"b\\u0041\"]",
+    "{\"command\": [\"get_property\", \"time-pos\"], \"request_id\": 12}",
+    // nested objects in objects, and arrays in between
+    "{\"a\": {\"b\": {\"c\": 1, \"d\": [{\"e\": 2}, {}]}, \"f\": []}, \"g\": 3}",
+    "[[[[]]], {\"x\": [1, [2, {\"y\": \"z\"}]]}]",
+};
+
+static char *write_node(void *ta, struct mpv_node *node)
+{
+    char *s = talloc_strdup(ta, "");
+    assert_int_equal(json_write(&s, node), 0);
+    return s;
+}
+
+static void test_json_parse_arena(void **state) {
+    void *ta = talloc_new(NULL);
+    struct json_arena *arena = json_arena_create(ta);
+    // repeat, so that the arena is reused after a reset
+    for (int r = 0; r < 3; r++) {
+        for (int n = 0; n < MP_ARRAY_SIZE(docs); n++) {
+            char *src = talloc_strdup(ta, docs[n]);
+            struct mpv_node ref;
+            assert_int_equal(json_parse(ta, &ref, &src, 10), 0);
+
+            json_arena_reset(arena);
+            src = talloc_strdup(ta, docs[n]);
+            struct mpv_node node;
+            assert_int_equal(json_parse_arena(arena, &node, &src, 10), 0);
+
+            assert_string_equal(write_node(ta, &node), write_node(ta, &ref));
+        }
+    }
+
+    json_arena_reset(arena);
+    const char *bad[] = {"[1,", "{\"a\" 1}", "{1: 2}", "[[[[[[1]]]]]]"};
+    for (int n = 0; n < MP_ARRAY_SIZE(bad); n++) {
+        char *src = talloc_strdup(ta, bad[n]);
+        struct mpv_node node;
+        assert_true(json_parse_arena(arena, &node, &src, 5) < 0);
+    }
+    talloc_free(ta);
+}
+
+static void test_json_append(void **state) {
+    bstr b = {0};
+    json_append_string(&b, "a\"b\\c\n\x01 \xc3\xa4");
+    json_append_int64(&b, INT64_MIN);
+    json_append_double(&b, 0.5);
+    json_append_double(&b, 1e300);
+    assert_true(bstr_startswith0(b,
+        "\"a\\u0022b\\u005cc\\u000a\\u0001 \xc3\xa4\"-9223372036854775808"
+        "0.500000100000"));
+    assert_true(bstr_endswith0(b, ".000000"));
+    talloc_free(b.start);
+
+    // round trip
+    void *ta = talloc_new(NULL);
+    char *src = talloc_strdup(ta, docs[3]);
+    struct mpv_node node;
+    assert_int_equal(json_parse(ta, &node, &src, 10), 0);
+    bstr out = {0};
+    assert_int_equal(json_append(&out, &node), 0);
+    assert_true(bstr_equals0(out, "{\"a\":{\"b\":{\"c\":1,\"d\":[{\"e\":2},"
+                                  "{}]},\"f\":[]},\"g\":3}"));
+    talloc_free(out.start);
+    talloc_free(ta);
+}
+
+static void test_json_append_event(void **state) {
+    double pos = 12.5;
+    struct mpv_event_property prop = {"time-pos", MPV_FORMAT_DOUBLE, &pos};
+    struct mpv_event ev = {
+        .event_id = MPV_EVENT_PROPERTY_CHANGE,
+        .reply_userdata = 3,
+        .data = &prop,
+    };
+    bstr b = {0};
+    assert_int_equal(json_append_event(&b, &ev), 0);
+    char *args[] = {"a", "b\""};
+    struct mpv_event_client_message msg = {2, (const char **)args};
+    ev = (struct mpv_event){.event_id = MPV_EVENT_CLIENT_MESSAGE, .data = &msg};
+    assert_int_equal(json_append_event(&b, &ev), 0);
+    ev = (struct mpv_event){.event_id = MPV_EVENT_PAUSE,
+                            .error = MPV_ERROR_NOMEM};
+    assert_int_equal(json_append_event(&b, &ev), 0);
+    assert_true(bstr_equals0(b,
+        "{\"event\":\"property-change\",\"id\":3,\"name\":\"time-pos\","
+        "\"data\":12.500000}\n"
+        "{\"event\":\"client-message\",\"args\":[\"a\",\"b\\u0022\"]}\n"
+        "{\"event\":\"pause\",\"error\":\"memory allocation failed\"}\n"));
+    talloc_free(b.start);
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_json_parse_arena),
+        unit_test(test_json_append),
+        unit_test(test_json_append_event),
+    };
+    return run_tests(tests);
+}
@@ -0,0 +1,193 @@
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "test_helpers.h"
+#include "talloc.h"
+#include "common/common.h"
+#include "misc/json.h"
+#include "misc/msgpack.h"
+
+// The client library is not part of mpv; build it into the test to check
+// that both sides agree.
+#include "TOOLS/ipc-client/mpv_ipc.c"
+
+static const char *const docs[] = {
+    "null",
+    "[true, false, 0, 127, 128, 255, 256, 65535, 65536, 4294967295,"
+    " 4294967296, -1, -32, -33, -128, -129, -32768, -32769, -2147483648,"
+    " -2147483649, -9223372036854775807, 9223372036854775807, 1.5, -0.25]",
+    "{\"command\": [\"set_property\", \"pause\", true], \"x\": {}}",
+    "[[], [1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17], "
+    "{\"a\": [{\"b\": null}]}]",
+};
+
+static char *write_json(void *ta, struct mpv_node *node)
+{
+    char *s = talloc_strdup(ta, "");
+    assert_int_equal(json_write(&s, node), 0);
+    return s;
+}
+
+// Check that node survives a msgpack round trip.
+static void check_roundtrip(void *ta, struct mpv_node *node)
+{
+    bstr b = {talloc_size(ta, 1), 0};
+    assert_int_equal(msgpack_append(&b, node), 0);
+    bstr src = b;
+    struct mpv_node res;
+    assert_int_equal(msgpack_parse(ta, &res, &src, 10), 0);
+    assert_int_equal(src.len, 0);
+    assert_string_equal(write_json(ta, &res), write_json(ta, node));
+
+    struct json_arena *arena = json_arena_create(ta);
+    src = b;
+    assert_int_equal(msgpack_parse_arena(arena, &res, &src, 10), 0);
+    assert_string_equal(write_json(ta, &res), write_json(ta, node));
+}
+
+static void test_msgpack_roundtrip(void **state) {
+    void *ta = talloc_new(NULL);
+    for (int n = 0; n < MP_ARRAY_SIZE(docs); n++) {
+        char *src = talloc_strdup(ta, docs[n]);
+        struct mpv_node node;
+        assert_int_equal(json_parse(ta, &node, &src, 10), 0);
+        check_roundtrip(ta, &node);
+    }
+    // strings needing str8/str16/str32 sizes
+    int sizes[] = {0, 31, 32, 255, 256, 65535, 65536};
+    for (int n = 0; n < MP_ARRAY_SIZE(sizes); n++) {
+        char *s = talloc_zero_size(ta, sizes[n] + 1);
+        memset(s, 'x', sizes[n]);
+        check_roundtrip(ta, &(struct mpv_node){.format = MPV_FORMAT_STRING,
+                                               .u.string = s});
+    }
+    talloc_free(ta);
+}
+
+static void test_msgpack_encoding(void **state) {
+    void *ta = talloc_new(NULL);
+    char *src = talloc_strdup(ta, "[5, -1, 200, -200, \"a\", 1.5, {}, false]");
+    struct mpv_node node;
+    assert_int_equal(json_parse(ta, &node, &src, 10), 0);
+    bstr b = {talloc_size(ta, 1), 0};
+    assert_int_equal(msgpack_append(&b, &node), 0);
+    static const uint8_t ref[] = {
+        0x98, 0x05, 0xff, 0xcc, 0xc8, 0xd1, 0xff, 0x38, 0xa1, 'a',
+        0xcb, 0x3f, 0xf8, 0, 0, 0, 0, 0, 0, 0x80, 0xc2,
+    };
+    assert_int_equal(b.len, sizeof(ref));
+    assert_memory_equal(b.start, ref, sizeof(ref));
+
+    // float32, uint16 and bin8 are accepted, even if never written
+    static const uint8_t in[] = {
+        0x93, 0xca, 0x3f, 0xc0, 0, 0, 0xcd, 0x01, 0x00, 0xc4, 2, 'h', 'i',
+    };
+    bstr s = {(unsigned char *)in, sizeof(in)};
+    assert_int_equal(msgpack_parse(ta, &node, &s, 10), 0);
+    assert_string_equal(write_json(ta, &node), "[1.500000,256,\"hi\"]");
+
+    const uint8_t *const bad[] = {
+        (const uint8_t[]){2, 0x92, 0x01},       // truncated array
+        (const uint8_t[]){2, 0xa2, 'a'},        // truncated string
+        (const uint8_t[]){3, 0x81, 0x01, 0x01}, // key is not a string
+        (const uint8_t[]){2, 0xd4, 0x00},       // ext type
+        (const uint8_t[]){9, 0xcf, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+                          0xff},                // uint64 > INT64_MAX
+        (const uint8_t[]){3, 0x91, 0x91, 0x90}, // too deep
+        (const uint8_t[]){5, 0xdd, 0xff, 0xff, 0xff, 0xff}, // huge array
+    };
+    for (int n = 0; n < MP_ARRAY_SIZE(bad); n++) {
+        bstr bs = {(unsigned char *)bad[n] + 1, bad[n][0]};
+        assert_true(msgpack_parse(ta, &node, &bs, 2) < 0);
+    }
+    talloc_free(ta);
+}
+
+static void test_msgpack_frame(void **state) {
+    bstr b = {0};
+    size_t start = msgpack_frame_begin(&b);
+    msgpack_append(&b, &(struct mpv_node){.format = MPV_FORMAT_INT64,
+                                          .u.int64 = 1000});
+    msgpack_frame_end(&b, start);
+    assert_int_equal(b.len, 7);
+    assert_memory_equal(b.start, ((uint8_t[]){0, 0, 0, 3, 0xcd, 0x03, 0xe8}), 7);
+    assert_int_equal(msgpack_frame_size(b), 3);
+    assert_int_equal(msgpack_frame_size((bstr){b.start, 3}), -1);
+    talloc_free(b.start);
+}
+
+// Drive the client library against the server side code, over a socketpair.
+static void test_msgpack_client(void **state) {
+    void *ta = talloc_new(NULL);
+    int fds[2];
+    assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    // What mpv would send: a JSON event before the set_protocol reply, then
+    // an event and the reply to the next command.
+    bstr out = {talloc_size(ta, 1), 0};
+    bstr_xappend(ta, &out, bstr0("{\"event\":\"idle\"}\n"
+                                 "{\"error\":\"success\"}\n"));
+    double pos = 2.5;
+    struct mpv_event_property prop = {"time-pos", MPV_FORMAT_DOUBLE, &pos};
+    struct mpv_event ev = {.event_id = MPV_EVENT_PROPERTY_CHANGE,
+                           .reply_userdata = 7, .data = &prop};
+    size_t start = msgpack_frame_begin(&out);
+    assert_int_equal(msgpack_append_event(&out, &ev), 0);
+    msgpack_frame_end(&out, start);
+    char *reply_json = talloc_strdup(ta, "{\"data\":\"ipc-0\",\"error\":\"success\"}");
+    struct mpv_node reply;
+    assert_int_equal(json_parse(ta, &reply, &reply_json, 3), 0);
+    start = msgpack_frame_begin(&out);
+    assert_int_equal(msgpack_append(&out, &reply), 0);
+    msgpack_frame_end(&out, start);
+    assert_int_equal(write(fds[0], out.start, out.len), out.len);
+
+    mpv_ipc *ipc = mpv_ipc_open_fd(fds[1]);
+    assert_true(ipc);
+    mpv_ipc_value args[] = {mpv_ipc_string("client_name"), mpv_ipc_int(-300)};
+    mpv_ipc_value *res = mpv_ipc_command(ipc, 2, args);
+    assert_true(res);
+    const mpv_ipc_value *data = mpv_ipc_map_get(res, "data");
+    assert_true(data && data->type == MPV_IPC_STRING);
+    assert_string_equal(data->u.string, "ipc-0");
+    mpv_ipc_free(res);
+
+    // the event was queued by mpv_ipc_command()
+    mpv_ipc_value *event = mpv_ipc_receive(ipc, 0);
+    assert_true(event);
+    assert_string_equal(mpv_ipc_map_get(event, "event")->u.string,
+                        "property-change");
+    assert_int_equal(mpv_ipc_map_get(event, "id")->u.int64, 7);
+    assert_true(mpv_ipc_map_get(event, "data")->u.double_ == 2.5);
+    mpv_ipc_free(event);
+    assert_false(mpv_ipc_receive(ipc, 0));
+
+    // what the client sent
+    char buf[4096];
+    ssize_t len = read(fds[0], buf, sizeof(buf));
+    const char *req = "{\"command\":[\"set_protocol\",\"msgpack\"]}\n";
+    assert_true(len > strlen(req));
+    assert_memory_equal(buf, req, strlen(req));
+    bstr frame = {(unsigned char *)buf + strlen(req), len - strlen(req)};
+    assert_int_equal(msgpack_frame_size(frame), frame.len - MSGPACK_FRAME_HEADER);
+    frame = bstr_cut(frame, MSGPACK_FRAME_HEADER);
+    struct mpv_node cmd;
+    assert_int_equal(msgpack_parse(ta, &cmd, &frame, 3), 0);
+    assert_string_equal(write_json(ta, &cmd),
+                        "{\"command\":[\"client_name\",-300]}");
+
+    mpv_ipc_close(ipc);
+    close(fds[0]);
+    talloc_free(ta);
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_msgpack_roundtrip),
+        unit_test(test_msgpack_encoding),
+        unit_test(test_msgpack_frame),
+        unit_test(test_msgpack_client),
+    };
+    return run_tests(tests);
+}
@@ -0,0 +1,101 @@
+#include <string.h>
+
+#include "test_helpers.h"
+#include "talloc.h"
+#include "common/common.h"
+#include "options/m_option.h"
+#include "options/m_property.h"
+
+// Returns the index of the property in the list, or for sub-properties the
+// key passed with M_PROPERTY_KEY_ACTION.
+static int prop_call(void *ctx, struct m_property *prop, int action, void *arg)
+{
+    const struct m_property *list = ctx;
+    switch (action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_INT};
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET:
+        *(int *)arg = prop - list;
+        return M_PROPERTY_OK;
+    case M_PROPERTY_KEY_ACTION: {
+        struct m_property_action_arg *ka = arg;
+        if (ka->action == M_PROPERTY_GET_TYPE) {
+            *(struct m_option *)ka->arg =
+                (struct m_option){.type = CONF_TYPE_STRING};
+        } else if (ka->action == M_PROPERTY_GET) {
+            *(const char **)ka->arg = ka->key;
+        }
+        return M_PROPERTY_OK;
+    }
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
+#define NUM_PROPS 200
+
+static struct m_property *create_list(void *ta)
+{
+    struct m_property *list = talloc_zero_array(ta, struct m_property,
+                                                NUM_PROPS + 2);
+    for (int n = 0; n < NUM_PROPS; n++) {
+        list[n] = (struct m_property){
+            .name = talloc_asprintf(ta, "property-%d", n),
+            .call = prop_call,
+        };
+    }
+    // duplicate name, must never be found
+    list[NUM_PROPS] = (struct m_property){"property-7", prop_call};
+    return list;
+}
+
+static void test_property_index(void **state) {
+    void *ta = talloc_new(NULL);
+    struct m_property *list = create_list(ta);
+    struct m_property_index *index = m_property_index_create(ta, list);
+
+    for (int n = 0; n < NUM_PROPS; n++) {
+        struct m_property_path path;
+        assert_true(m_property_resolve(NULL, index, list[n].name, &path));
+        assert_true(path.prop == &list[n]);
+        assert_int_equal(path.key_offset, 0);
+        int v = -1;
+        assert_int_equal(m_property_do(NULL, index, list[n].name,
+                                       M_PROPERTY_GET, &v, list),
+                         M_PROPERTY_OK);
+        assert_int_equal(v, n);
+    }
+
+    struct m_property_path path;
+    assert_false(m_property_resolve(NULL, index, "property", &path));
+    assert_false(m_property_resolve(NULL, index, "property-200", &path));
+    assert_false(m_property_resolve(NULL, index, "", &path));
+    assert_true(path.prop == NULL);
+    int v;
+    assert_int_equal(m_property_do(NULL, index, "foo", M_PROPERTY_GET, &v,
+                                   list), M_PROPERTY_UNKNOWN);
+    // a trailing '/' is not a sub-property access
+    assert_false(m_property_resolve(NULL, index, "property-3/", &path));
+
+    // old names used '_'
+    assert_true(m_property_resolve(NULL, index, "property_12", &path));
+    assert_true(path.prop == &list[12]);
+    assert_string_equal(path.name, "property-12");
+
+    assert_true(m_property_resolve(NULL, index, "property-5/3/lang", &path));
+    assert_true(path.prop == &list[5]);
+    assert_string_equal(path.name + path.key_offset, "3/lang");
+    const char *key = NULL;
+    assert_int_equal(m_property_do_path(NULL, &path, M_PROPERTY_GET, &key,
+                                        list), M_PROPERTY_OK);
+    assert_string_equal(key, "3/lang");
+
+    talloc_free(ta);
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_property_index),
+    };
+    return run_tests(tests);
+}
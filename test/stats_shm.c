@@ -0,0 +1,106 @@
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "test_helpers.h"
+#include "config.h"
+#include "common/msg.h"
+#include "libmpv/stats_shm.h"
+#include "player/stats_shm.h"
+
+#if HAVE_POSIX_SHM
+
+struct writer {
+    struct mp_stats_shm *shm;
+    int count;
+};
+
+// Writes updates where all fields have the same value, so torn reads show.
+static void *writer_thread(void *p)
+{
+    struct writer *w = p;
+    for (int n = 1; n <= w->count; n++) {
+        struct mpv_stats_shm st = {
+            .active = 1, .pause = n, .time_pos = n, .duration = n,
+            .cache_percent = n, .drop_frame_count = n,
+            .vo_drop_frame_count = n,
+        };
+        mp_stats_shm_write(w->shm, &st);
+    }
+    return NULL;
+}
+
+static void test_stats_shm(void **state) {
+    char name[64];
+    snprintf(name, sizeof(name), "mpv-test-%d", (int)getpid());
+    struct mp_stats_shm *shm = mp_stats_shm_create(mp_null_log, name);
+    assert_true(shm);
+
+    char path[64];
+    snprintf(path, sizeof(path), "/%s", name);
+    int fd = shm_open(path, O_RDONLY, 0);
+    assert_true(fd >= 0);
+    const struct mpv_stats_shm *p =
+        mmap(NULL, sizeof(*p), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    assert_true(p != MAP_FAILED);
+    assert_int_equal(p->magic, MPV_STATS_SHM_MAGIC);
+    assert_int_equal(p->version, MPV_STATS_SHM_VERSION);
+    assert_int_equal(p->size, sizeof(*p));
+    assert_int_equal(p->pid, getpid());
+
+    struct writer w = {shm, 200000};
+    pthread_t thread;
+    assert_int_equal(pthread_create(&thread, NULL, writer_thread, &w), 0);
+    int64_t last = 0, reads = 0;
+    while (last < w.count) {
+        struct mpv_stats_shm st;
+        if (mpv_stats_shm_read(p, &st) < 0)
+            continue;
+        reads++;
+        assert_false(st.seq & 1);
+        assert_true(st.update_count >= last);
+        last = st.update_count;
+        if (!last)
+            continue;
+        assert_int_equal(st.pause, last);
+        assert_true(st.time_pos == last && st.duration == last &&
+                    st.cache_percent == last);
+        assert_int_equal(st.drop_frame_count, last);
+        assert_int_equal(st.vo_drop_frame_count, last);
+    }
+    pthread_join(thread, NULL);
+    assert_true(reads > 0);
+
+    // the header is not touched by updates
+    assert_int_equal(p->magic, MPV_STATS_SHM_MAGIC);
+    assert_int_equal(p->seq, 2 * w.count);
+
+    mp_stats_shm_destroy(shm);
+    // the name is gone, existing mappings see that the player exited
+    assert_int_equal(shm_open(path, O_RDONLY, 0), -1);
+    assert_int_equal(errno, ENOENT);
+    struct mpv_stats_shm st;
+    assert_int_equal(mpv_stats_shm_read(p, &st), 0);
+    assert_int_equal(st.active, 0);
+    assert_true(isnan(st.time_pos));
+    munmap((void *)p, sizeof(*p));
+}
+
+#endif
+
+int main(void) {
+#if HAVE_POSIX_SHM
+    const UnitTest tests[] = {
+        unit_test(test_stats_shm),
+    };
+    return run_tests(tests);
+#else
+    return 0;
+#endif
+}
@@ -7,5 +7,25 @@
 #include <cmocka.h>
 
 #include <stdio.h>
+#include <string.h>
+#include <libavutil/cpu.h>
+
+// Define "static int func(struct fns_type fns[3])", which fills fns with the
+// distinct implementations of a kernel set selectable with init_fn (e.g.
+// mp_gain_init_fns): the C reference, SSE2, and the best one for the host
+// CPU. Returns the number of entries set.
+#define MP_TEST_IMPLS(func, fns_type, init_fn)                                \
+    static int func(struct fns_type fns[3])                                   \
+    {                                                                         \
+        int flags = av_get_cpu_flags();                                       \
+        int cpu_sets[] = {0, AV_CPU_FLAG_SSE2, flags};                        \
+        int num = 0;                                                          \
+        for (int n = 0; n < 3; n++) {                                         \
+            init_fn(&fns[num], cpu_sets[n] & flags);                          \
+            if (!num || strcmp(fns[num].name, fns[num - 1].name) != 0)        \
+                num++;                                                        \
+        }                                                                     \
+        return num;                                                           \
+    }
 
 #endif
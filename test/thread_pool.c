@@ -0,0 +1,95 @@
+#include <pthread.h>
+#include <unistd.h>
+
+#include "test_helpers.h"
+#include "talloc.h"
+#include "misc/thread_pool.h"
+
+struct counter {
+    pthread_mutex_t lock;
+    int done;
+    int running;
+    int max_running;
+    int queued;         // set by user_thread(), checked after joining
+};
+
+static void work(void *p)
+{
+    struct counter *c = p;
+    pthread_mutex_lock(&c->lock);
+    c->running++;
+    if (c->running > c->max_running)
+        c->max_running = c->running;
+    pthread_mutex_unlock(&c->lock);
+
+    usleep(1000);
+
+    pthread_mutex_lock(&c->lock);
+    c->running--;
+    c->done++;
+    pthread_mutex_unlock(&c->lock);
+}
+
+static void test_thread_pool_limit(void **state) {
+    struct counter c = {.lock = PTHREAD_MUTEX_INITIALIZER};
+    struct mp_thread_pool *pool = mp_thread_pool_create(NULL, 3);
+    for (int n = 0; n < 100; n++)
+        assert_true(mp_thread_pool_queue(pool, work, &c));
+    // freeing waits for all queued work
+    talloc_free(pool);
+    assert_int_equal(c.done, 100);
+    assert_int_equal(c.running, 0);
+    assert_true(c.max_running >= 1 && c.max_running <= 3);
+}
+
+// Several users queueing work on the shared pool at the same time, the way
+// concurrent mpv instances do. cmocka's assertions must be used on the main
+// thread only, so the results are checked after joining.
+static void *user_thread(void *p)
+{
+    struct counter *c = p;
+    struct mp_thread_pool *pool = mp_thread_pool_get_shared();
+    for (int n = 0; n < 50; n++) {
+        if (mp_thread_pool_queue(pool, work, c))
+            c->queued++;
+    }
+    // wait for our own work, then drop the reference
+    while (1) {
+        pthread_mutex_lock(&c->lock);
+        bool done = c->done == c->queued;
+        pthread_mutex_unlock(&c->lock);
+        if (done)
+            break;
+        usleep(1000);
+    }
+    mp_thread_pool_release_shared(pool);
+    return NULL;
+}
+
+static void test_thread_pool_shared(void **state) {
+    struct mp_thread_pool *a = mp_thread_pool_get_shared();
+    struct mp_thread_pool *b = mp_thread_pool_get_shared();
+    assert_true(a == b);
+    mp_thread_pool_release_shared(b);
+    mp_thread_pool_release_shared(a);
+
+    struct counter c[8];
+    pthread_t threads[8];
+    for (int n = 0; n < 8; n++) {
+        c[n] = (struct counter){.lock = PTHREAD_MUTEX_INITIALIZER};
+        assert_int_equal(pthread_create(&threads[n], NULL, user_thread, &c[n]), 0);
+    }
+    for (int n = 0; n < 8; n++) {
+        pthread_join(threads[n], NULL);
+        assert_int_equal(c[n].queued, 50);
+        assert_int_equal(c[n].done, 50);
+    }
+}
+
+int main(void) {
+    const UnitTest tests[] = {
+        unit_test(test_thread_pool_limit),
+        unit_test(test_thread_pool_shared),
+    };
+    return run_tests(tests);
+}
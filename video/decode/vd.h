@@ -46,6 +46,7 @@ enum vd_ctrl {
     VDCTRL_QUERY_UNSEEN_FRAMES, // current decoder lag
     VDCTRL_FORCE_HWDEC_FALLBACK, // force software decoding fallback
     VDCTRL_GET_HWDEC,
+    VDCTRL_SET_KEYFRAMES_ONLY, // int*: if 1, skip decoding non-keyframes
 };
 
 #endif /* MPLAYER_VD_H */
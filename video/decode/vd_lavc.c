@@ -709,6 +709,10 @@ static int control(struct dec_video *vd, int cmd, void *arg)
     }
     case VDCTRL_FORCE_HWDEC_FALLBACK:
         return force_fallback(vd);
+    case VDCTRL_SET_KEYFRAMES_ONLY:
+        ctx->skip_frame = *(int *)arg ? AVDISCARD_NONKEY
+                                      : ctx->opts->vd_lavc_params->skip_frame;
+        return CONTROL_TRUE;
     }
     return CONTROL_UNKNOWN;
 }
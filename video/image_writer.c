@@ -147,6 +147,48 @@ error_exit:
     return success;
 }
 
+// Write the image planes as they are, without any header.
+static int write_planes(mp_image_t *image, FILE *fp)
+{
+    for (int p = 0; p < image->num_planes; p++) {
+        int line_bytes = (image->plane_w[p] * image->fmt.bpp[p] + 7) / 8;
+        for (int y = 0; y < image->plane_h[p]; y++) {
+            uint8_t *line = image->planes[p] + y * image->stride[p];
+            if (fwrite(line, line_bytes, 1, fp) != 1)
+                return 0;
+        }
+    }
+    return 1;
+}
+
+// Uncompressed formats are written directly; going through libavcodec would
+// only add an extra copy of the image.
+static int write_pnm(struct image_writer_ctx *ctx, mp_image_t *image, FILE *fp)
+{
+    bool gray = image->imgfmt == IMGFMT_Y8;
+    fprintf(fp, "P%c\n%d %d\n255\n", gray ? '5' : '6', image->w, image->h);
+    return write_planes(image, fp);
+}
+
+static int write_y4m(struct image_writer_ctx *ctx, mp_image_t *image, FILE *fp)
+{
+    const char *csp;
+    switch (image->imgfmt) {
+    case IMGFMT_420P:
+        // Video is usually mpeg2 sited (chroma between the left samples).
+        csp = image->params.chroma_location == MP_CHROMA_CENTER ? "420jpeg"
+                                                                : "420mpeg2";
+        break;
+    case IMGFMT_422P: csp = "422"; break;
+    case IMGFMT_444P: csp = "444"; break;
+    default:          csp = "mono";
+    }
+    bool full = image->params.colorlevels == MP_CSP_LEVELS_PC;
+    fprintf(fp, "YUV4MPEG2 W%d H%d F1:1 Ip A1:1 C%s%s\nFRAME\n",
+            image->w, image->h, csp, full ? " XCOLORRANGE=FULL" : "");
+    return write_planes(image, fp);
+}
+
 #if HAVE_JPEG
 
 static void write_jpeg_error_exit(j_common_ptr cinfo)
@@ -217,11 +259,16 @@ static int write_jpeg(struct image_writer_ctx *ctx, mp_image_t *image, FILE *fp)
 
 static const struct img_writer img_writers[] = {
     { "png", write_lavc, .lavc_codec = AV_CODEC_ID_PNG },
-    { "ppm", write_lavc, .lavc_codec = AV_CODEC_ID_PPM },
-    { "pgm", write_lavc,
-      .lavc_codec = AV_CODEC_ID_PGM,
+    { "ppm", write_pnm,
+      .pixfmts = (const int[]) { IMGFMT_RGB24, 0 },
+    },
+    { "pgm", write_pnm,
       .pixfmts = (const int[]) { IMGFMT_Y8, 0 },
     },
+    { "y4m", write_y4m,
+      .pixfmts = (const int[]) { IMGFMT_420P, IMGFMT_422P, IMGFMT_444P,
+                                 IMGFMT_Y8, 0 },
+    },
     { "pgmyuv", write_lavc,
       .lavc_codec = AV_CODEC_ID_PGMYUV,
       .pixfmts = (const int[]) { IMGFMT_420P, 0 },
@@ -20,12 +20,15 @@
 #include <string.h>
 #include <math.h>
 #include <stdbool.h>
+#include <assert.h>
+#include <pthread.h>
 #include <sys/stat.h>
 
 #include <libswscale/swscale.h>
 
 #include "config.h"
 #include "misc/bstr.h"
+#include "misc/thread_pool.h"
 #include "osdep/io.h"
 #include "options/path.h"
 #include "talloc.h"
@@ -41,14 +44,116 @@
 #include "sub/osd.h"
 #include "options/m_option.h"
 
+struct job {
+    struct mp_image *image;
+    char *filename;
+};
+
 struct priv {
     struct image_writer_opts *opts;
     char *outdir;
+    int threads;
+    int queue;
 
     struct mp_image *current;
     int frame;
+
+    struct mp_thread_pool *pool;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    int num_writers;            // write_job() calls queued or running
+    struct job **jobs;          // FIFO of frames not picked up yet
+    int num_jobs;
+    int num_writing;            // frames currently encoded by writers
 };
 
+// Write the oldest queued frame, if there is any. Returns false if there was
+// none.
+static bool write_one(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+
+    pthread_mutex_lock(&p->lock);
+    struct job *job = NULL;
+    if (p->num_jobs) {
+        job = p->jobs[0];
+        MP_TARRAY_REMOVE_AT(p->jobs, p->num_jobs, 0);
+        p->num_writing++;
+    }
+    pthread_mutex_unlock(&p->lock);
+    if (!job)
+        return false;
+
+    write_image(job->image, p->opts, job->filename, vo->log);
+    talloc_free(job);
+
+    pthread_mutex_lock(&p->lock);
+    p->num_writing--;
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+    return true;
+}
+
+static void start_writers(struct vo *vo);
+
+// Runs on the thread pool. Writes a single frame, and queues a new call for
+// the next one, so that the shared pool alternates between all of its users.
+static void write_job(void *arg)
+{
+    struct vo *vo = arg;
+    struct priv *p = vo->priv;
+
+    write_one(vo);
+
+    pthread_mutex_lock(&p->lock);
+    p->num_writers--;
+    start_writers(vo);
+    pthread_cond_broadcast(&p->wakeup);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// Queue write_job() calls until there is one for each frame waiting to be
+// written, but not more than p->threads. Called with p->lock held.
+static void start_writers(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+
+    while (p->num_writers < p->threads &&
+           p->num_writers - p->num_writing < p->num_jobs)
+    {
+        if (!mp_thread_pool_queue(p->pool, write_job, vo))
+            break;
+        p->num_writers++;
+    }
+}
+
+// Hand the image to the writer threads, blocking while too many frames are
+// pending. Takes ownership of image and filename.
+static void queue_image(struct vo *vo, struct mp_image *image, char *filename)
+{
+    struct priv *p = vo->priv;
+
+    struct job *job = talloc_ptrtype(NULL, job);
+    *job = (struct job){
+        .image = talloc_steal(job, image),
+        .filename = talloc_steal(job, filename),
+    };
+
+    pthread_mutex_lock(&p->lock);
+    while (p->num_jobs + p->num_writing >= p->queue)
+        pthread_cond_wait(&p->wakeup, &p->lock);
+    MP_TARRAY_APPEND(p, p->jobs, p->num_jobs, job);
+    start_writers(vo);
+    bool write_now = !p->num_writers;
+    pthread_mutex_unlock(&p->lock);
+
+    if (write_now) {
+        MP_ERR(vo, "Could not start writer thread.\n");
+        while (write_one(vo)) {}
+    }
+}
+
 static bool checked_mkdir(struct vo *vo, const char *buf)
 {
     MP_INFO(vo, "Creating output directory '%s'...\n", buf);
@@ -99,7 +204,12 @@ static void flip_page(struct vo *vo)
         filename = mp_path_join(t, bstr0(p->outdir), bstr0(filename));
 
     MP_INFO(vo, "Saving %s\n", filename);
-    write_image(p->current, p->opts, filename, vo->log);
+    if (p->threads) {
+        queue_image(vo, p->current, talloc_steal(NULL, filename));
+        p->current = NULL;
+    } else {
+        write_image(p->current, p->opts, filename, vo->log);
+    }
 
     talloc_free(t);
     mp_image_unrefp(&p->current);
@@ -116,14 +226,31 @@ static void uninit(struct vo *vo)
 {
     struct priv *p = vo->priv;
 
+    // Writers requeue themselves until all queued frames are written.
+    pthread_mutex_lock(&p->lock);
+    while (p->num_writers)
+        pthread_cond_wait(&p->wakeup, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+    mp_thread_pool_release_shared(p->pool);
+    while (write_one(vo)) {} // in case requeuing failed
+
+    pthread_cond_destroy(&p->wakeup);
+    pthread_mutex_destroy(&p->lock);
+
     mp_image_unrefp(&p->current);
 }
 
 static int preinit(struct vo *vo)
 {
     struct priv *p = vo->priv;
-    if (p->outdir && !checked_mkdir(vo, p->outdir))
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wakeup, NULL);
+    if (p->outdir && !checked_mkdir(vo, p->outdir)) {
+        uninit(vo);
         return -1;
+    }
+    if (p->threads)
+        p->pool = mp_thread_pool_get_shared();
     return 0;
 }
 
@@ -143,8 +270,13 @@ const struct vo_driver video_out_image =
     .options = (const struct m_option[]) {
         OPT_SUBSTRUCT("", opts, image_writer_conf, 0),
         OPT_STRING("outdir", outdir, 0),
+        OPT_INTRANGE("threads", threads, 0, 0, 64),
+        OPT_INTRANGE("queue", queue, 0, 1, 1000),
         {0},
     },
+    .priv_defaults = &(const struct priv){
+        .queue = 16,
+    },
     .preinit = preinit,
     .query_format = query_format,
     .reconfig = reconfig,
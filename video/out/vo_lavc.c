@@ -35,10 +35,14 @@
 #include "sub/osd.h"
 
 struct priv {
+    // Accessed by the encoder thread only (once it has been created).
     uint8_t *buffer;
     size_t buffer_size;
-    AVStream *stream;
     int have_first_packet;
+    int64_t last_frame_pts; // in codec time base
+
+    AVStream *stream;
+    struct encode_lavc_worker *worker;
 
     int harddup;
 
@@ -60,6 +64,12 @@ struct priv {
     bool shutdown;
 };
 
+// A frame to encode; a NULL job flushes the encoder.
+struct vo_job {
+    struct mp_image *image;
+    int64_t pts;        // in codec time base
+};
+
 static int preinit(struct vo *vo)
 {
     struct priv *vc;
@@ -74,6 +84,7 @@ static int preinit(struct vo *vo)
 }
 
 static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi);
+static void encode_job(void *priv, void *p);
 static void uninit(struct vo *vo)
 {
     struct priv *vc = vo->priv;
@@ -89,6 +100,9 @@ static void uninit(struct vo *vo)
 
     pthread_mutex_unlock(&vo->encode_lavc_ctx->lock);
 
+    encode_lavc_worker_destroy(vc->worker);
+    vc->worker = NULL;
+
     vc->shutdown = true;
 }
 
@@ -181,6 +195,9 @@ static int reconfig(struct vo *vo, struct mp_image_params *params, int flags)
 
     vc->buffer = talloc_size(vc, vc->buffer_size);
 
+    vc->worker = encode_lavc_worker_create(vo->encode_lavc_ctx, encode_job,
+                                           vo, 8);
+
 done:
     pthread_mutex_unlock(&vo->encode_lavc_ctx->lock);
     return 0;
@@ -223,7 +240,8 @@ static void write_packet(struct vo *vo, int size, AVPacket *packet)
                                        vc->stream->time_base);
         } else {
             MP_VERBOSE(vo, "codec did not provide pts\n");
-            packet->pts = av_rescale_q(vc->lastipts, vc->worst_time_base,
+            packet->pts = av_rescale_q(vc->last_frame_pts,
+                                       vc->stream->codec->time_base,
                                        vc->stream->time_base);
         }
         if (packet->dts != AV_NOPTS_VALUE) {
@@ -287,11 +305,55 @@ static int encode_video(struct vo *vo, AVFrame *frame, AVPacket *packet)
     }
 }
 
+// Called on the encoder thread, without the encode_lavc_context lock.
+static void encode_job(void *priv, void *p)
+{
+    struct vo *vo = priv;
+    struct priv *vc = vo->priv;
+    struct vo_job *job = p;
+    AVPacket packet;
+    int size;
+
+    if (!job) {
+        // finish encoding
+        do {
+            av_init_packet(&packet);
+            packet.data = vc->buffer;
+            packet.size = vc->buffer_size;
+            size = encode_video(vo, NULL, &packet);
+            write_packet(vo, size, &packet);
+        } while (size > 0);
+        return;
+    }
+
+    AVFrame *frame = av_frame_alloc();
+    if (!frame)
+        return;
+
+    frame->pts = job->pts;
+
+    enum AVPictureType savetype = frame->pict_type;
+    mp_image_copy_fields_to_av_frame(frame, job->image);
+    frame->pict_type = savetype;
+        // keep this at avcodec_get_frame_defaults default
+
+    frame->quality = vc->stream->codec->global_quality;
+
+    vc->last_frame_pts = job->pts;
+
+    av_init_packet(&packet);
+    packet.data = vc->buffer;
+    packet.size = vc->buffer_size;
+    size = encode_video(vo, frame, &packet);
+    write_packet(vo, size, &packet);
+
+    av_frame_free(&frame);
+}
+
 static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi)
 {
     struct priv *vc = vo->priv;
     struct encode_lavc_context *ectx = vo->encode_lavc_ctx;
-    int size;
     AVCodecContext *avc;
     int64_t frameipts;
     double nextpts;
@@ -420,7 +482,6 @@ static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi)
         // we have a valid image in lastimg
         while (vc->lastimg && vc->lastipts < frameipts) {
             int64_t thisduration = vc->harddup ? 1 : (frameipts - vc->lastipts);
-            AVPacket packet;
 
             // we will ONLY encode this frame if it can be encoded at at least
             // vc->mindeltapts after the last encoded frame!
@@ -432,28 +493,16 @@ static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi)
                 skipframes = 0;
 
             if (thisduration > skipframes) {
-                AVFrame *frame = av_frame_alloc();
-
+                struct vo_job *job = talloc_ptrtype(NULL, job);
                 // this is a nop, unless the worst time base is the STREAM time base
-                frame->pts = av_rescale_q(vc->lastipts + skipframes,
-                                          vc->worst_time_base, avc->time_base);
-
-                enum AVPictureType savetype = frame->pict_type;
-                mp_image_copy_fields_to_av_frame(frame, vc->lastimg);
-                frame->pict_type = savetype;
-                    // keep this at avcodec_get_frame_defaults default
-
-                frame->quality = avc->global_quality;
-
-                av_init_packet(&packet);
-                packet.data = vc->buffer;
-                packet.size = vc->buffer_size;
-                size = encode_video(vo, frame, &packet);
-                write_packet(vo, size, &packet);
+                job->pts = av_rescale_q(vc->lastipts + skipframes,
+                                        vc->worst_time_base, avc->time_base);
+                // The encoder thread gets its own reference, so lastimg can be
+                // replaced while the frame is still being encoded.
+                job->image = talloc_steal(job, mp_image_new_ref(vc->lastimg));
+                encode_lavc_worker_queue(vc->worker, job);
                 ++vc->lastdisplaycount;
                 vc->lastencodedipts = vc->lastipts + skipframes;
-
-                av_frame_free(&frame);
             }
 
             vc->lastipts += thisduration;
@@ -461,15 +510,7 @@ static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi)
     }
 
     if (!mpi) {
-        // finish encoding
-        do {
-            AVPacket packet;
-            av_init_packet(&packet);
-            packet.data = vc->buffer;
-            packet.size = vc->buffer_size;
-            size = encode_video(vo, NULL, &packet);
-            write_packet(vo, size, &packet);
-        } while (size > 0);
+        encode_lavc_worker_queue(vc->worker, NULL);
     } else {
         if (frameipts >= vc->lastframeipts) {
             if (vc->lastframeipts != AV_NOPTS_VALUE && vc->lastdisplaycount != 1)
@@ -0,0 +1,14 @@
+#include <immintrin.h>
+__attribute__((target("sse2")))
+static int sse2(void) {
+    __m128i a = _mm_set1_epi32(1);
+    return _mm_cvtsi128_si32(_mm_mul_epu32(a, a));
+}
+__attribute__((target("avx2")))
+static int avx2(void) {
+    __m256i a = _mm256_set1_epi16(1);
+    return _mm_cvtsi128_si32(_mm256_castsi256_si128(_mm256_packus_epi32(a, a)));
+}
+int main(void) {
+    return sse2() + avx2();
+}
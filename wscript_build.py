@@ -88,6 +88,7 @@ def build(ctx):
         ## Audio
         ( "audio/audio.c" ),
         ( "audio/audio_buffer.c" ),
+        ( "audio/audio_ring.c" ),
         ( "audio/chmap.c" ),
         ( "audio/chmap_sel.c" ),
         ( "audio/fmt-conversion.c" ),
@@ -103,6 +104,7 @@ def build(ctx):
         ( "audio/filter/af_channels.c" ),
         ( "audio/filter/af_convert24.c" ),
         ( "audio/filter/af_convertsignendian.c" ),
+        ( "audio/filter/af_convolve.c" ),
         ( "audio/filter/af_delay.c" ),
         ( "audio/filter/af_drc.c" ),
         ( "audio/filter/af_dummy.c" ),
@@ -118,13 +120,18 @@ def build(ctx):
         ( "audio/filter/af_lavfi.c",             "libavfilter" ),
         ( "audio/filter/af_lavrresample.c" ),
         ( "audio/filter/af_pan.c" ),
+        ( "audio/filter/af_parameq.c" ),
         ( "audio/filter/af_scaletempo.c" ),
         ( "audio/filter/af_sinesuppress.c" ),
         ( "audio/filter/af_sub.c" ),
         ( "audio/filter/af_surround.c" ),
         ( "audio/filter/af_sweep.c" ),
         ( "audio/filter/af_volume.c" ),
+        ( "audio/filter/biquad.c" ),
+        ( "audio/filter/convolve.c" ),
+        ( "audio/filter/dotprod.c" ),
         ( "audio/filter/filter.c" ),
+        ( "audio/filter/gain.c" ),
         ( "audio/filter/tools.c" ),
         ( "audio/filter/window.c" ),
         ( "audio/out/ao.c" ),
@@ -195,8 +202,10 @@ def build(ctx):
         ( "misc/charset_conv.c" ),
         ( "misc/dispatch.c" ),
         ( "misc/json.c" ),
+        ( "misc/msgpack.c" ),
         ( "misc/ring.c" ),
         ( "misc/rendezvous.c" ),
+        ( "misc/thread_pool.c" ),
 
         ## Options
         ( "options/m_config.c" ),
@@ -213,6 +222,7 @@ def build(ctx):
         ( "player/command.c" ),
         ( "player/configfiles.c" ),
         ( "player/discnav.c" ),
+        ( "player/encode_chunks.c",              "encoding" ),
         ( "player/loadfile.c" ),
         ( "player/main.c" ),
         ( "player/misc.c" ),
@@ -221,6 +231,8 @@ def build(ctx):
         ( "player/playloop.c" ),
         ( "player/screenshot.c" ),
         ( "player/scripting.c" ),
+        ( "player/stats_shm.c" ),
+        ( "player/storyboard.c" ),
         ( "player/sub.c" ),
         ( "player/timeline/tl_cue.c" ),
         ( "player/timeline/tl_mpv_edl.c" ),
@@ -264,6 +276,7 @@ def build(ctx):
         ( "sub/ass_mp.c",                        "libass"),
         ( "sub/dec_sub.c" ),
         ( "sub/draw_bmp.c" ),
+        ( "sub/draw_bmp_blend.c" ),
         ( "sub/find_subfiles.c" ),
         ( "sub/img_convert.c" ),
         ( "sub/osd.c" ),
@@ -514,7 +527,7 @@ def build(ctx):
             PRIV_LIBS    = get_deps(),
         )
 
-        headers = ["client.h", "qthelper.hpp", "opengl_cb.h"]
+        headers = ["client.h", "qthelper.hpp", "opengl_cb.h", "stats_shm.h"]
         for f in headers:
             ctx.install_as(ctx.env.INCDIR + '/mpv/' + f, 'libmpv/' + f)
 